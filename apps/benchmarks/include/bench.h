@@ -0,0 +1,56 @@
+/**
+ * Helpers for timing microbenchmarks. Each benchmark runs for at least
+ * BENCH_MIN_SECONDS & reports its throughput.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_MIN_SECONDS 0.5
+
+/**
+ * @returns The current monotonic time in seconds.
+ */
+static inline double bench_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Runs a statement repeatedly & prints the throughput in MB/s.
+ * @param name The name of the benchmark.
+ * @param bytes The number of input bytes the statement processes.
+ * @param statement The statement to time.
+ */
+#define bench_throughput(name, bytes, statement)                               \
+  ({                                                                           \
+    long long iterations = 0;                                                  \
+    double start = bench_now();                                                \
+    double elapsed = 0;                                                        \
+    do {                                                                       \
+      for (int bench_i = 0; bench_i < 1024; bench_i++)                         \
+        statement;                                                             \
+      iterations += 1024;                                                      \
+      elapsed = bench_now() - start;                                           \
+    } while (elapsed < BENCH_MIN_SECONDS);                                     \
+    printf("%-40s %10.1f MB/s\n", name,                                        \
+           (double)(bytes) * iterations / elapsed / 1e6);                      \
+  })
+
+/**
+ * Runs a statement repeatedly & prints the average time it takes.
+ * @param name The name of the benchmark.
+ * @param statement The statement to time.
+ */
+#define bench_latency(name, statement)                                         \
+  ({                                                                           \
+    long long iterations = 0;                                                  \
+    double start = bench_now();                                                \
+    double elapsed = 0;                                                        \
+    do {                                                                       \
+      statement;                                                               \
+      iterations++;                                                            \
+      elapsed = bench_now() - start;                                           \
+    } while (elapsed < BENCH_MIN_SECONDS);                                     \
+    printf("%-40s %10.1f us\n", name, elapsed / iterations * 1e6);             \
+  })
\ No newline at end of file
@@ -0,0 +1 @@
+extern void bench_select_serialization();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void bench_json_string();
\ No newline at end of file
@@ -0,0 +1,9 @@
+#include "postgres/bench_select_serialization.h"
+#include "utils/bench_json_string.h"
+
+int main() {
+  bench_json_string();
+  bench_select_serialization();
+
+  return 0;
+}
\ No newline at end of file
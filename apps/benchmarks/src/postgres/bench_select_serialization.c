@@ -0,0 +1,160 @@
+#include "bench.h"
+#include "libpq-fe.h"
+#include "postgres/select.h"
+#include "postgres/select_arrow.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_ROWS 10000
+#define BENCH_BUFFER_SIZE (16 * 1024 * 1024)
+
+// type OIDs (pg_type.dat)
+#define INT4OID 23
+#define TEXTOID 25
+#define FLOAT8OID 701
+#define TIMESTAMPOID 1114
+
+/**
+ * Writes a big-endian (network order) integer, as Postgres sends binary
+ * values.
+ */
+static void write_network_uint(char *cur, uint64_t value, int size) {
+  for (int i = size - 1; i >= 0; i--) {
+    cur[i] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+/**
+ * Builds a binary format result shaped like a time-series table: an id, a
+ * timestamp, a geodetic coordinate & a short comment.
+ * @returns The result, which must be cleared.
+ */
+static PGresult *create_time_series_result() {
+  PGresult *res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+  PGresAttDesc columns[] = {
+      {"id", 0, 0, 1, INT4OID, 4, -1},
+      {"time", 0, 0, 1, TIMESTAMPOID, 8, -1},
+      {"latitude", 0, 0, 1, FLOAT8OID, 8, -1},
+      {"longitude", 0, 0, 1, FLOAT8OID, 8, -1},
+      {"comments", 0, 0, 1, TEXTOID, -1, -1},
+  };
+  PQsetResultAttrs(res, sizeof(columns) / sizeof(columns[0]), columns);
+
+  for (int row_num = 0; row_num < BENCH_ROWS; row_num++) {
+    char id[4], time[8], latitude[8], longitude[8];
+    union {
+      double f;
+      uint64_t u;
+    } coordinate;
+
+    write_network_uint(id, row_num + 1, 4);
+    // one row a minute from 2025-01-01
+    write_network_uint(time, (788918400LL + row_num * 60LL) * 1000000LL, 8);
+    coordinate.f = 43.6532 + row_num * 1e-5;
+    write_network_uint(latitude, coordinate.u, 8);
+    coordinate.f = -79.3832 - row_num * 1e-5;
+    write_network_uint(longitude, coordinate.u, 8);
+
+    PQsetvalue(res, row_num, 0, id, 4);
+    PQsetvalue(res, row_num, 1, time, 8);
+    PQsetvalue(res, row_num, 2, latitude, 8);
+    PQsetvalue(res, row_num, 3, longitude, 8);
+    PQsetvalue(res, row_num, 4, "walked the dog", strlen("walked the dog"));
+  }
+
+  return res;
+}
+
+/**
+ * Serializes a result as MessagePack the way the GET path does.
+ * @returns The number of bytes written or -1.
+ */
+static int serialize_msgpack(const PGresult *res, char *buffer,
+                             size_t buffer_size) {
+  struct select_plan *plan = create_select_plan(res, SERIALIZE_MSGPACK);
+  int length = serialize_select_msgpack_start(res, 0, buffer, buffer_size);
+
+  for (int row_num = 0; length >= 0 && row_num < PQntuples(res); row_num++) {
+    int n = serialize_select_row(res, plan, row_num, buffer + length,
+                                 buffer_size - length);
+    length = n < 0 ? -1 : length + n;
+  }
+
+  free_select_plan(plan);
+  return length;
+}
+
+struct bench_sink {
+  char *buffer;
+  size_t length;
+  size_t buffer_size;
+};
+
+/**
+ * Collects an Arrow stream into a buffer (an arrow_sink).
+ */
+static int write_to_buffer(const char *data, size_t length, void *arg) {
+  struct bench_sink *sink = arg;
+  if (sink->length + length > sink->buffer_size)
+    return 0;
+  memcpy(sink->buffer + sink->length, data, length);
+  sink->length += length;
+  return 1;
+}
+
+/**
+ * Serializes a result as an Arrow IPC stream the way the GET path does.
+ * @returns The number of bytes written or -1.
+ */
+static int serialize_arrow(const PGresult *res, char *buffer,
+                           size_t buffer_size) {
+  // the schema create_time_series_result's columns come from
+  static const struct data_column schema[] = {
+      {"id", "int", false, ""},
+      {"time", "timestamp", false, ""},
+      {"latitude", "float", false, ""},
+      {"longitude", "float", false, ""},
+      {"comments", "string", false, ""},
+  };
+  struct select_options options = {0};
+  options.schema = schema;
+  options.schema_count = sizeof(schema) / sizeof(schema[0]);
+  struct bench_sink sink = {buffer, 0, buffer_size};
+
+  struct arrow_writer *writer =
+      create_arrow_writer(&options, write_to_buffer, &sink);
+  int success = writer && arrow_write_rows(writer, res) && arrow_finish(writer);
+  free_arrow_writer(writer);
+  return success ? sink.length : -1;
+}
+
+void bench_select_serialization() {
+  PGresult *res = create_time_series_result();
+  char *buffer = malloc(BENCH_BUFFER_SIZE);
+  char name[64];
+  volatile int sink = 0;
+
+  printf("%d rows: JSON %d bytes, MessagePack %d bytes, Arrow %d bytes\n",
+         BENCH_ROWS, serialize_select_result(res, 0, buffer, BENCH_BUFFER_SIZE),
+         serialize_msgpack(res, buffer, BENCH_BUFFER_SIZE),
+         serialize_arrow(res, buffer, BENCH_BUFFER_SIZE));
+
+  snprintf(name, sizeof(name), "JSON encode %d rows", BENCH_ROWS);
+  bench_latency(name, sink += serialize_select_result(res, 0, buffer,
+                                                      BENCH_BUFFER_SIZE));
+  snprintf(name, sizeof(name), "JSON (epoch) encode %d rows", BENCH_ROWS);
+  bench_latency(name, sink += serialize_select_result(
+                          res, SERIALIZE_EPOCH_TIMESTAMPS, buffer,
+                          BENCH_BUFFER_SIZE));
+  snprintf(name, sizeof(name), "MessagePack encode %d rows", BENCH_ROWS);
+  bench_latency(name,
+                sink += serialize_msgpack(res, buffer, BENCH_BUFFER_SIZE));
+  snprintf(name, sizeof(name), "Arrow encode %d rows", BENCH_ROWS);
+  bench_latency(name, sink += serialize_arrow(res, buffer, BENCH_BUFFER_SIZE));
+
+  free(buffer);
+  PQclear(res);
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "bench.h"
+#include "utils/json/json_string.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LONG_TEXT_LENGTH 4096
+
+/**
+ * Fills a buffer with free text, e.g. the contents of a *_comments column.
+ * @param buffer The buffer to fill. Null terminated.
+ * @param length The length of the text.
+ * @param escape_every How often to put in a character that must be escaped
+ * (0 for never).
+ */
+static void fill_text(char *buffer, int length, int escape_every) {
+  const char *words = "The quick brown fox jumps over the lazy dog. ";
+  for (int i = 0; i < length; i++)
+    buffer[i] = words[i % strlen(words)];
+  if (escape_every)
+    for (int i = escape_every - 1; i < length; i += escape_every)
+      buffer[i] = i / escape_every % 2 ? '\n' : '"';
+  buffer[length] = '\0';
+}
+
+void bench_json_string() {
+  const enum json_escaper escapers[] = {
+      JSON_ESCAPER_SCALAR, JSON_ESCAPER_SSE2, JSON_ESCAPER_AVX2};
+  const char *escaper_names[] = {"scalar", "SSE2", "AVX2"};
+  const char *short_text = "Hello, world 123";
+  char *long_text = malloc(LONG_TEXT_LENGTH + 1);
+  char *lines = malloc(LONG_TEXT_LENGTH + 1);
+  char *quotes = malloc(LONG_TEXT_LENGTH + 1);
+  char *output = malloc(JSON_STRING_SIZE_BOUND(LONG_TEXT_LENGTH));
+  char name[64];
+  volatile int sink = 0;
+
+  fill_text(long_text, LONG_TEXT_LENGTH, 0);
+  fill_text(lines, LONG_TEXT_LENGTH, 80);
+  fill_text(quotes, LONG_TEXT_LENGTH, 8);
+
+  for (int i = 0; i < sizeof(escapers) / sizeof(escapers[0]); i++) {
+    if (!use_json_escaper(escapers[i])) {
+      printf("%s JSON escaper: not supported by this CPU\n", escaper_names[i]);
+      continue;
+    }
+
+    snprintf(name, sizeof(name), "%s 16 B clean", escaper_names[i]);
+    bench_throughput(name, strlen(short_text),
+                     sink += write_json_string(
+                         short_text, strlen(short_text), output,
+                         JSON_STRING_SIZE_BOUND(LONG_TEXT_LENGTH)));
+
+    snprintf(name, sizeof(name), "%s 4 KiB clean", escaper_names[i]);
+    bench_throughput(name, LONG_TEXT_LENGTH,
+                     sink += write_json_string(
+                         long_text, LONG_TEXT_LENGTH, output,
+                         JSON_STRING_SIZE_BOUND(LONG_TEXT_LENGTH)));
+
+    snprintf(name, sizeof(name), "%s 4 KiB escape every 80 B",
+             escaper_names[i]);
+    bench_throughput(name, LONG_TEXT_LENGTH,
+                     sink += write_json_string(
+                         lines, LONG_TEXT_LENGTH, output,
+                         JSON_STRING_SIZE_BOUND(LONG_TEXT_LENGTH)));
+
+    snprintf(name, sizeof(name), "%s 4 KiB escape every 8 B",
+             escaper_names[i]);
+    bench_throughput(name, LONG_TEXT_LENGTH,
+                     sink += write_json_string(
+                         quotes, LONG_TEXT_LENGTH, output,
+                         JSON_STRING_SIZE_BOUND(LONG_TEXT_LENGTH)));
+  }
+
+  use_json_escaper(JSON_ESCAPER_AUTO);
+  free(long_text);
+  free(lines);
+  free(quotes);
+  free(output);
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "postgres/insert.h"
+#include "postgres/replica.h"
+#include "postgres/select.h"
+#include <jansson.h>
+#include <libpq-fe.h>
+
+/**
+ * Storage backends. The HTTP layer only talks to the backend returned by
+ * get_backend, which is chosen through SQL_RECEPTIONIST_BACKEND:
+ *  - "postgres" (default): the configured Postgres server(s) through libpq.
+ *  - "memory": an embedded in-memory store for single-box setups &
+ *    benchmarks. Data does not survive a restart.
+ * Both are driven by the schemas in config.yml. Rows are handed back as
+ * PGresults (see PQmakeEmptyPGresult) so that every backend shares the same
+ * serializers.
+ */
+
+enum upsert_status {
+  UPSERT_OK,
+  /**
+   * The entry does not conform to the schema. The error holds the reason.
+   */
+  UPSERT_INVALID_ENTRY,
+  /**
+   * The entry could not be prepared. The error holds the reason.
+   */
+  UPSERT_PREPARE_FAILED,
+  /**
+   * The storage rejected the upsert. The error holds the reason.
+   */
+  UPSERT_QUERY_FAILED,
+  /**
+   * The upsert succeeded but the primary column value was not returned.
+   */
+  UPSERT_UNEXPECTED_RETURN,
+};
+
+struct upsert_result {
+  /**
+   * @param value The primary column value of the upserted row.
+   */
+  char value[MAX_SQL_RETURN_LENGTH];
+  /**
+   * @param commit_lsn The position of the write for read-your-writes, or an
+   * empty string if the backend has no such notion.
+   */
+  char commit_lsn[MAX_LSN_LENGTH];
+  char error[ERROR_BUFFER_SIZE];
+};
+
+struct backend {
+  const char *name;
+  /**
+   * Opens a connection to the given database.
+   * @param dbname The database name.
+   * @param min_lsn The LSN reads must observe (see connect_db_for_read), or
+   * NULL. Ignored for writes.
+   * @param write Whether or not the connection will be written to.
+   * @returns The connection or NULL if the database is unavailable.
+   */
+  void *(*connect)(const char *dbname, const char *min_lsn, int write);
+  /**
+   * Closes a connection. NULL connections are ignored.
+   */
+  void (*disconnect)(void *conn);
+  /**
+   * Runs the SELECT described by the options. Sets errno if the query could
+   * not be constructed.
+   * @param conn The connection to use.
+   * @param options The query to run.
+   * @param result_format 0 for text results, 1 for binary results if the
+   * backend supports them.
+   * @param res The output pointer to store the rows in. Always set; must be
+   * freed with PQclear.
+   * @returns The status of the query.
+   */
+  ExecStatusType (*select)(void *conn, struct select_options *options,
+                           int result_format, PGresult **res);
+  /**
+   * Same as select, but hands the rows over as they are produced so that they
+   * can be sent before the query completes.
+   * @param conn The connection to use.
+   * @param options The query to run.
+   * @param result_format 0 for text results, 1 for binary results if the
+   * backend supports them.
+   * @param on_rows Called with each batch of rows in order. The last call may
+   * hold no rows. Returns 0 to cancel the query.
+   * @param arg The argument to pass to on_rows.
+   * @param res The output pointer to store the final result in, which holds
+   * the error if the query failed. Always set; must be freed with PQclear.
+   * @returns The status of the query.
+   */
+  ExecStatusType (*select_stream)(void *conn, struct select_options *options,
+                                  int result_format,
+                                  int (*on_rows)(const PGresult *rows,
+                                                 void *arg),
+                                  void *arg, PGresult **res);
+  /**
+   * Runs the SELECT described by the options & hands the rows over as CSV
+   * with a header line (the format of COPY ... WITH CSV HEADER).
+   * @param conn The connection to use.
+   * @param options The query to run.
+   * @param on_data Called with each piece of CSV in order. Returns 0 to cancel
+   * the query.
+   * @param arg The argument to pass to on_data.
+   * @param res The output pointer to store the final result in, which holds
+   * the error if the query failed. Always set; must be freed with PQclear.
+   * @returns The status of the query.
+   */
+  ExecStatusType (*export_csv)(void *conn, struct select_options *options,
+                               int (*on_data)(const char *data, size_t length,
+                                              void *arg),
+                               void *arg, PGresult **res);
+  /**
+   * Counts the rows the SELECT described by the options matches across every
+   * page (see count_select_options). Sets errno like select.
+   * @param conn The connection to use.
+   * @param options The query whose rows to count.
+   * @param mode SELECT_COUNT_EXACT or SELECT_COUNT_ESTIMATE. Backends without
+   * estimates count exactly.
+   * @param count The output to store the count in.
+   * @param res The output pointer to store the result in, which holds the
+   * error if the query failed. Always set; must be freed with PQclear.
+   * @returns The status of the query.
+   */
+  ExecStatusType (*count)(void *conn, struct select_options *options,
+                          enum select_count mode, long long *count,
+                          PGresult **res);
+  /**
+   * Validates an entry & upserts it: on a conflict on the duplicate column,
+   * every given column is overwritten.
+   * @param conn The connection to use.
+   * @param options The target table.
+   * @param entry The entry to upsert.
+   * @param result The output to store the result in.
+   * @returns The status of the upsert.
+   */
+  enum upsert_status (*upsert)(void *conn, struct insert_options *options,
+                               json_t *entry, struct upsert_result *result);
+};
+
+extern const struct backend postgres_backend;
+extern const struct backend memory_backend;
+
+/**
+ * @returns The backend chosen through SQL_RECEPTIONIST_BACKEND.
+ */
+extern const struct backend *get_backend();
\ No newline at end of file
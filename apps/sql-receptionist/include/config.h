@@ -22,6 +22,7 @@ struct data_column {
   const char *datatype;  // @todo validation
   bool comments;         // optional, ?useless here?
   const char *entrytype; // useless here
+  bool indexed;          // optional, whether SORT_BY may use the column
 };
 
 struct descriptor {
@@ -1,7 +1,10 @@
 #include <libpq-fe.h>
 
 /**
- * Executes an SQL query with the given query and connection. @TODO retry when the connection is bad.
+ * Executes an SQL query with the given query and connection. The query is sent
+ * asynchronously and the calling thread sleeps on the connection's socket until
+ * the result arrives. Connections that break are reported to the database's
+ * circuit breaker.
  * @param query The query to execute.
  * @param res The output pointer to store the result.
  * @param conn The connection to use.
@@ -9,9 +12,188 @@
  */
 ExecStatusType sql_query(const char *query, PGresult **res, PGconn *conn);
 
+/**
+ * Executes a parameterized SQL query with the given query and connection. Like
+ * sql_query, the calling thread sleeps on the connection's socket until the
+ * result arrives.
+ * @param query The query to execute. Placeholders are written as $1, $2, ...
+ * @param n_params The number of placeholder values.
+ * @param param_values The placeholder values in text format. NULL values are
+ * sent as SQL NULLs.
+ * @param res The output pointer to store the result.
+ * @param conn The connection to use.
+ * @returns The status of the executed query.
+ */
+ExecStatusType sql_query_params(const char *query, int n_params,
+                                const char *const *param_values,
+                                PGresult **res, PGconn *conn);
+
+/**
+ * Sends everything libpq has buffered for the given non-blocking connection.
+ * Incoming data is consumed while waiting so that the server never blocks on a
+ * full socket buffer.
+ * @param conn The connection to flush.
+ * @returns 1 on success, 0 on failure.
+ */
+int sql_flush(PGconn *conn);
+
+/**
+ * Sleeps until the given connection has a complete result ready, so that the
+ * next PQgetResult call will not block.
+ * @param conn The connection to wait on.
+ * @returns 1 on success, 0 if the connection failed while waiting.
+ */
+int sql_wait_result(PGconn *conn);
+
+/**
+ * Queues a parameterized query on a connection that is in pipeline mode
+ * (PQenterPipelineMode). Nothing is waited on: queued queries are sent to the
+ * server together by sql_pipeline_sync and their results are read back in order
+ * with sql_pipeline_result.
+ * @param conn The connection to queue the query on.
+ * @param query The query to queue.
+ * @param n_params The number of placeholder values.
+ * @param param_values The placeholder values in text format.
+ * @returns 1 on success, 0 on failure.
+ */
+int sql_pipeline_send(PGconn *conn, const char *query, int n_params,
+                      const char *const *param_values);
+
+/**
+ * Same as sql_pipeline_send, but also chooses the format of the result.
+ * @param conn The connection to queue the query on.
+ * @param query The query to queue.
+ * @param n_params The number of placeholder values.
+ * @param param_values The placeholder values in text format.
+ * @param result_format 0 for text results, 1 for binary results.
+ * @returns 1 on success, 0 on failure.
+ */
+int sql_pipeline_send_format(PGconn *conn, const char *query, int n_params,
+                             const char *const *param_values,
+                             int result_format);
+
+/**
+ * Ends the current pipeline segment and sends every queued query to the
+ * server. If a query inside the segment fails, the remaining queries of the
+ * segment are skipped by the server.
+ * @param conn The connection in pipeline mode.
+ * @returns 1 on success, 0 on failure.
+ */
+int sql_pipeline_sync(PGconn *conn);
+
+/**
+ * Reads the result of the next query in the pipeline. The NULL that separates
+ * the results of consecutive queries is consumed. The result of a sync point is
+ * PGRES_PIPELINE_SYNC.
+ * @param conn The connection in pipeline mode.
+ * @returns The result, which must be freed with PQclear, or NULL if the
+ * connection failed.
+ */
+PGresult *sql_pipeline_result(PGconn *conn);
+
+/**
+ * Queues SET LOCAL statement_timeout on a connection in pipeline mode, bounding
+ * the statements that follow in the same transaction by the remaining time of
+ * the calling thread's request (see sql_watch_request).
+ * @param conn The connection in pipeline mode.
+ * @returns 1 on success, 0 on failure.
+ */
+int sql_pipeline_send_timeout(PGconn *conn);
+
+/**
+ * Executes a single read query inside its own read-only transaction. The
+ * transaction, the statement timeout and the query are pipelined into a single
+ * round trip.
+ * @param query The query to execute. Must be a single statement.
+ * @param n_params The number of parameters ($1, $2, ...) of the query.
+ * @param param_values The text values of the parameters.
+ * @param result_format 0 for text results, 1 for binary results.
+ * @param res The output pointer to store the result of the query.
+ * @param conn The connection to use. Must not be in pipeline mode.
+ * @returns The status of the executed query.
+ */
+ExecStatusType sql_select(const char *query, int n_params,
+                          const char *const *param_values, int result_format,
+                          PGresult **res, PGconn *conn);
+
+/**
+ * Same as sql_select, but hands the rows over as they arrive (single-row mode)
+ * instead of collecting them into one result.
+ * @param query The query to execute. Must be a single statement.
+ * @param n_params The number of parameters ($1, $2, ...) of the query.
+ * @param param_values The text values of the parameters.
+ * @param result_format 0 for text results, 1 for binary results.
+ * @param on_rows Called with every result that holds rows, in order, followed
+ * by a final result without rows. Returns 0 to cancel the query.
+ * @param arg The argument to pass to on_rows.
+ * @param res The output pointer to store the final result of the query, which
+ * holds the error if the query failed.
+ * @param conn The connection to use. Must not be in pipeline mode.
+ * @returns The status of the executed query. PGRES_FATAL_ERROR if on_rows
+ * cancelled it.
+ */
+ExecStatusType sql_select_stream(const char *query, int n_params,
+                                 const char *const *param_values,
+                                 int result_format,
+                                 int (*on_rows)(const PGresult *rows,
+                                                void *arg),
+                                 void *arg, PGresult **res, PGconn *conn);
+
+/**
+ * Runs a COPY ... TO STDOUT query inside its own read-only transaction and
+ * hands the copied data over as it arrives, without collecting or parsing it.
+ * @param query The COPY query. Must be a single statement.
+ * @param on_data Called with every piece of data in order (one row per call
+ * for text & CSV). Returns 0 to cancel the query, with errno set to why the
+ * data could not be delivered (ETIMEDOUT if the client did not take it in
+ * time, EPIPE or ECONNRESET if it hung up).
+ * @param arg The argument to pass to on_data.
+ * @param res The output pointer to store the final result of the query, which
+ * holds the error if the query failed.
+ * @param conn The connection to use. Must not be in pipeline mode. When the
+ * deadline passes mid-COPY, the connection is left in the middle of it & must
+ * be closed.
+ * @returns The status of the executed query. PGRES_FATAL_ERROR if on_data
+ * cancelled it.
+ */
+ExecStatusType sql_copy_out(const char *query,
+                            int (*on_data)(const char *data, size_t length,
+                                           void *arg),
+                            void *arg, PGresult **res, PGconn *conn);
+
+/**
+ * Binds the database work of the calling thread to a client request. While the
+ * thread waits on the database, the client socket is watched and the running
+ * query is cancelled (PQcancel) when the client hangs up or the deadline
+ * passes.
+ * @param client_fd The client socket, or -1 to not watch a client.
+ * @param deadline_ms The request deadline on the monotonic clock (see
+ * monotonic_ms), or 0 for no deadline.
+ */
+void sql_watch_request(int client_fd, long long deadline_ms);
+
+/**
+ * @returns The milliseconds left until the calling thread's request deadline,
+ * 0 if the deadline has passed or -1 if there is no deadline.
+ */
+long long sql_remaining_ms();
+
 /**
  * Open a new Postgres connection using the given database name. Automatically populates environment variables.
+ * The connection is established without blocking on the socket and is left in
+ * non-blocking mode. Returns NULL if the connection could not be established
+ * in time or if the database's circuit breaker is open.
  * Sets errno to ENOMEM if the database name is too large. This generally should not happen so it should be considered a bug if it does.
  * @param dbname
  */
-PGconn *connect_db(const char *dbname);
\ No newline at end of file
+PGconn *connect_db(const char *dbname);
+
+/**
+ * Open a new connection to the read replica (DATABASE_REPLICA_HOST &
+ * DATABASE_REPLICA_PORT) using the given database name. The replica port
+ * defaults to DATABASE_PORT.
+ * @param dbname
+ * @returns The connection, or NULL if no replica is configured, the replica
+ * could not be reached in time or its circuit breaker is open.
+ */
+PGconn *connect_db_replica(const char *dbname);
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include <stddef.h>
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+
+/**
+ * The aggregate endpoint (/{db}/{table}/aggregate) returns aggregated rows
+ * instead of the rows themselves:
+ * - FN: the aggregates, e.g. "avg(weight),max(weight),count()". avg & sum take
+ *   int or float columns; min & max also date, time & timestamp columns.
+ * - BUCKET: the width of time buckets, e.g. "15m" (s, m, h, d or w).
+ * - BUCKET_BY: the date or timestamp column to bucket, if the table has more
+ *   than one.
+ * - GROUP_BY: the columns to group by, e.g. "primary_tag".
+ * The query runs in Postgres (date_bin & GROUP BY), so only the aggregated rows
+ * are sent.
+ */
+#define MAX_AGGREGATE_PARAM_LENGTH 512
+#define MAX_AGGREGATE_ERROR_LENGTH 160
+#define SELECT_AGGREGATE_LIMIT 10000
+
+/**
+ * Parses the parameters of an aggregate request.
+ * @param schema The columns of the table.
+ * @param schema_count The number of columns.
+ * @param tagging Whether or not the table has a primary tag to group by.
+ * @param bucket The BUCKET value, or NULL.
+ * @param bucket_by The BUCKET_BY value, or NULL.
+ * @param functions The FN value, which is split in place.
+ * @param group_by The GROUP_BY value, or NULL. Split in place.
+ * @param aggregate The aggregate to write to. Its names point into the schema.
+ * @param error The buffer a message is written to if a parameter is invalid.
+ * Must be MAX_AGGREGATE_ERROR_LENGTH long.
+ * @returns 1 if the parameters are valid, 0 if not.
+ */
+extern int parse_select_aggregate(const struct data_column *schema,
+                                  unsigned int schema_count, int tagging,
+                                  const char *bucket, const char *bucket_by,
+                                  char *functions, char *group_by,
+                                  struct select_aggregate *aggregate,
+                                  char *error);
\ No newline at end of file
@@ -0,0 +1,38 @@
+/**
+ * Per-database circuit breaker, named after the server it guards (e.g.
+ * "main@postgres:5432"). After BREAKER_FAILURE_THRESHOLD consecutive
+ * connection failures the breaker opens and requests fail fast instead of
+ * waiting on an unreachable database. Once a jittered, exponentially growing
+ * backoff has elapsed, a single request is let through as a probe (half-open).
+ * The breaker closes again when the probe succeeds.
+ */
+#define BREAKER_FAILURE_THRESHOLD 5
+#define BREAKER_BASE_BACKOFF_MS 500
+#define BREAKER_MAX_BACKOFF_MS 30000
+#define MAX_BREAKER_NAME_LENGTH 128
+
+enum breaker_state {
+  BREAKER_CLOSED,
+  BREAKER_OPEN,
+  BREAKER_HALF_OPEN,
+};
+
+/**
+ * Checks whether a request may use the given database.
+ * @param name The breaker name.
+ * @returns 1 if the request may connect, 0 if it should fail fast.
+ */
+extern int breaker_allow(const char *name);
+
+/**
+ * Records a successful connection to the given database. Closes the breaker.
+ * @param name The breaker name.
+ */
+extern void breaker_record_success(const char *name);
+
+/**
+ * Records a failed connection (or a connection that broke mid-query) to the
+ * given database.
+ * @param name The breaker name.
+ */
+extern void breaker_record_failure(const char *name);
\ No newline at end of file
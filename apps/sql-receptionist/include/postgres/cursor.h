@@ -0,0 +1,43 @@
+#include "libpq-fe.h"
+#include <stddef.h>
+
+/**
+ * Keyset pagination cursors. A cursor holds the position of the last row of a
+ * page, i.e. its order_by_column value & its ID, so that the next page is
+ * queried with a WHERE clause instead of an OFFSET Postgres has to scan
+ * through. Cursors are opaque to clients: base64url of
+ * "<column>:<ASC|DESC>:<id>:" followed by "n" for a NULL value or "v<value>".
+ */
+#define MAX_CURSOR_LENGTH 1024
+// the decoded cursor, null terminated
+#define MAX_DECODED_CURSOR_LENGTH (MAX_CURSOR_LENGTH / 4 * 3 + 1)
+
+/**
+ * Writes the cursor of a row of a SELECT query result.
+ * @param options The options the result was queried with. The result must
+ * include the ID column.
+ * @param res The result.
+ * @param row_num The row, usually the last one.
+ * @param buffer The buffer to write to. Not null terminated.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the cursor or -1 if the value of the row does not fit
+ * into a cursor (or the buffer).
+ */
+extern int write_cursor(const struct select_options *options,
+                        const PGresult *res, int row_num, char *buffer,
+                        size_t buffer_size);
+
+/**
+ * Reads a cursor into after_id & after_value of the options.
+ * @param cursor The cursor.
+ * @param cursor_length The length of the cursor.
+ * @param options The options of the query. The cursor must have been written
+ * with the same order_by_column & order_by_order.
+ * @param buffer The buffer the decoded cursor is stored in, which after_id &
+ * after_value point into. Should be MAX_DECODED_CURSOR_LENGTH long.
+ * @param buffer_size The size of the buffer.
+ * @returns 0 on success or -1 if the cursor is invalid.
+ */
+extern int read_cursor(const char *cursor, size_t cursor_length,
+                       struct select_options *options, char *buffer,
+                       size_t buffer_size);
\ No newline at end of file
@@ -0,0 +1,36 @@
+#include <stddef.h>
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+
+/**
+ * Querystring filters of SELECT requests: "<column>.<operator>=<value>", e.g.
+ * "weight.gte=2.5" or "name.in=a,b". eq & in work on every column but
+ * geodetic points, lt, lte, gt & gte on numbers, dates, times & timestamps,
+ * and is_null (true or false) on any column. Values are validated against the
+ * datatype of the column & bound as parameters (see struct select_filter).
+ */
+#define MAX_FILTER_VALUE_LENGTH 512
+#define MAX_FILTER_ERROR_LENGTH 160
+
+/**
+ * Parses a querystring filter.
+ * @param schema The columns of the table.
+ * @param schema_count The number of columns.
+ * @param id_column Whether or not the table has an ID column to filter by.
+ * @param key The querystring key, "<column>.<operator>".
+ * @param value The querystring value.
+ * @param filter The filter to write to. Its column points into the schema.
+ * @param buffer The buffer the filter's value is stored in, e.g. an array
+ * literal for in. Should be MAX_FILTER_VALUE_LENGTH long.
+ * @param buffer_size The size of the buffer.
+ * @param error The buffer a message is written to if the filter is invalid.
+ * Must be MAX_FILTER_ERROR_LENGTH long.
+ * @returns 1 if the filter is valid, 0 if not.
+ */
+extern int parse_select_filter(const struct data_column *schema,
+                               unsigned int schema_count, int id_column,
+                               const char *key, const char *value,
+                               struct select_filter *filter, char *buffer,
+                               size_t buffer_size, char *error);
\ No newline at end of file
@@ -6,6 +6,9 @@
 #endif
 #define MAX_SQL_RETURN_LENGTH 101
 #define ERROR_BUFFER_SIZE 251
+#define MAX_INSERT_QUERY_SIZE 8192
+#define MAX_PLACEHOLDER_SIZE 65536
+#define MAX_COLUMNS 64
 
 struct insert_options {
   /**
@@ -40,10 +43,58 @@ struct insert_options {
    * Should not be NULL.
    */
   const char *duplicate_column_name;
+  /**
+   * @param notify_channel The channel to NOTIFY when the upsert commits (see
+   * server/cache.h), or NULL.
+   */
+  const char *notify_channel;
+  /**
+   * @param notify_payload The payload of the NOTIFY, or NULL for none.
+   */
+  const char *notify_payload;
 };
 
 /**
- * Attempts to INSERT INTO the given table with the given data.
+ * A validated entry, ready to be upserted.
+ */
+struct prepared_insert {
+  /**
+   * @param query The parameterized upsert query.
+   */
+  char query[MAX_INSERT_QUERY_SIZE];
+  /**
+   * @param n_params The number of columns (& placeholder values) given.
+   */
+  int n_params;
+  /**
+   * @param columns The name of each given column.
+   */
+  const char *columns[MAX_COLUMNS];
+  /**
+   * @param values The value of each given column in text format, or NULL.
+   */
+  const char *values[MAX_COLUMNS];
+  char column_names[MAX_INSERT_QUERY_SIZE];
+  char placeholders[MAX_PLACEHOLDER_SIZE];
+};
+
+/**
+ * Validates an entry against the given options and prepares the upsert query
+ * without sending it. Follows the same conventions as validate_and_insert_into.
+ * @param options The data to insert.
+ * @param entry The entry to validate.
+ * @param prepared The output to store the prepared query in.
+ * @param error_buffer A buffer with at least ERROR_BUFFER_SIZE of size to write
+ * an error message to.
+ * @returns Whether or not the entry is valid.
+ */
+extern int prepare_insert(struct insert_options *options, json_t *entry,
+                          struct prepared_insert *prepared, char *error_buffer);
+
+/**
+ * Attempts to INSERT INTO the given table with the given data. The INSERT is
+ * queued on the connection, which must be in pipeline mode; its result is read
+ * back by the caller with sql_pipeline_result once the pipeline is synced.
  * Writes an error message to the error buffer on failure.
  * Assumes errno has been reset.
  * errno will be set to EILSEQ if the input entry & options contain invalid
@@ -54,15 +105,14 @@ struct insert_options {
  * the code is bugged). The code can be bugged because of an invalid regex
  * pattern. errno will not be set if validate_and_insert_into returns 1.
  * @param options The data to insert.
- * @param res Query result output pointer. Will be NULL if the query does not
- * run. This pointer must be freed afterwards.
- * @param conn Connection pointer. The connection must be closed afterwards.
+ * @param conn Connection pointer in pipeline mode. The connection must be
+ * closed afterwards.
  * @param error_buffer A buffer with at least ERROR_BUFFER_SIZE of size to write
  * an error message to. The error_buffer will contain the NULL terminator as the
- * first charcater if the query ran successfully.
- * @returns Whether or not the query ran (i.e. whether or not the input data was
- * valid).
+ * first charcater if the query was queued successfully.
+ * @returns Whether or not the query was queued (i.e. whether or not the input
+ * data was valid).
  */
 extern int validate_and_insert_into(struct insert_options *options,
-                                    json_t *entry, PGresult **res, PGconn *conn,
+                                    json_t *entry, PGconn *conn,
                                     char *error_buffer);
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+
+/**
+ * Cross-instance cache invalidation. Every instance LISTENs on the channel of
+ * each table of a database (see write_cache_channel) & instances that commit a
+ * write NOTIFY it, so that cached responses of the table are dropped
+ * everywhere (see server/cache.h). Writes to the tag tables carry
+ * TAG_DICTIONARY_NOTIFY_PAYLOAD & also reload the tag dictionary (see
+ * server/tag_dictionary.h).
+ */
+#define NOTIFY_POLL_INTERVAL_MS 1000
+#define NOTIFY_RETRY_INTERVAL_MS 1000
+#define NOTIFY_LISTEN_TIMEOUT_MS 10000
+
+/**
+ * Listens for invalidations of the tables of a database & applies them to the
+ * cache & tag dictionaries. Reconnects when the connection breaks; since
+ * notifications sent in the meantime are lost, the whole database is
+ * invalidated whenever the listener (re)connects. Never returns.
+ * @param arg The database to listen to (struct db *).
+ */
+extern void *listen_for_invalidations(void *arg);
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include "libpq-fe.h"
+
+/**
+ * Read replica routing. GET requests are served by the streaming replica
+ * configured through DATABASE_REPLICA_HOST (& DATABASE_REPLICA_PORT) while
+ * POST requests always go to the primary. Clients that just wrote something
+ * pass back the commit LSN they received so that their next read is only
+ * routed to the replica once it has replayed that LSN.
+ */
+#define MAX_LSN_LENGTH 32
+#define REPLICA_MONITOR_INTERVAL_MS 5000
+
+/**
+ * Opens a connection suitable for reading from the given database. Prefers
+ * the replica and falls back to the primary when no replica is configured,
+ * the replica is unreachable or it has not replayed min_lsn yet.
+ * @param dbname The database name.
+ * @param min_lsn The LSN the replica must have replayed (e.g. "0/16B3748"), or
+ * NULL if any replica state is acceptable.
+ * @returns The connection, or NULL if neither server could be reached.
+ */
+extern PGconn *connect_db_for_read(const char *dbname, const char *min_lsn);
+
+/**
+ * Checks whether the given string is a valid pg_lsn (e.g. "0/16B3748").
+ * @param lsn The string to check.
+ * @returns 1 if valid, 0 otherwise.
+ */
+extern int is_valid_lsn(const char *lsn);
+
+/**
+ * Periodically measures how far the replica lags behind the primary and
+ * publishes it as the sql_receptionist_replica_lag_bytes &
+ * sql_receptionist_replica_lag_ms gauges. Never returns.
+ * @param arg The name of the database to connect to (const char *).
+ */
+extern void *monitor_replica_lag(void *arg);
\ No newline at end of file
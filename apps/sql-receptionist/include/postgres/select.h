@@ -5,6 +5,121 @@
 #include "libpq-fe.h"
 #include <stdlib.h>
 #define SELECT_DEFAULT_LIMIT 500
+#define MAX_SELECT_FILTERS 8
+// the bucket interval, the filter_column, the filters & the keyset cursor (see
+// select_query_params)
+#define MAX_SELECT_PARAMS (MAX_SELECT_FILTERS + 4)
+#define MAX_PROJECTED_COLUMNS 64
+#define MAX_AGGREGATE_GROUPS 4
+#define MAX_AGGREGATE_FUNCTIONS 16
+// e.g. "999999 minutes"
+#define MAX_BUCKET_INTERVAL_LENGTH 32
+// ",<schema index>c" per column (see project_select_columns)
+#define MAX_PROJECTION_LENGTH (MAX_PROJECTED_COLUMNS * 5 + 3)
+// serialize dates & timestamps as seconds since 1970-01-01 (binary results only)
+#define SERIALIZE_EPOCH_TIMESTAMPS 1
+// serialize values as MessagePack instead of JSON
+#define SERIALIZE_MSGPACK 2
+
+// nest the tags of every row as a JSON array (the "tags" column)
+#define SELECT_EXPAND_TAGS 1
+// nest the descriptor rows of every row as a JSON object of arrays by
+// descriptor name (the "descriptors" column)
+#define SELECT_EXPAND_DESCRIPTORS 2
+
+/**
+ * The layouts a SELECT result can be serialized in.
+ */
+enum select_format {
+  // {"columns":[...],"data":[[row],...]}
+  SELECT_FORMAT_ROWS,
+  // {"columns":[...],"rows":n,"data":{"column":[value,...],...}}
+  SELECT_FORMAT_COLUMNAR,
+  // {"columns":[...]}\n[row]\n[row]\n... (newline delimited JSON)
+  SELECT_FORMAT_NDJSON,
+  // the rows layout in MessagePack (see serialize_select_msgpack_start)
+  SELECT_FORMAT_MSGPACK,
+  // an Apache Arrow IPC stream (see postgres/select_arrow.h)
+  SELECT_FORMAT_ARROW,
+};
+
+/**
+ * How the rows a SELECT matches are counted (see count_select_options).
+ */
+enum select_count {
+  SELECT_COUNT_NONE,
+  // count(*), which scans every matching row
+  SELECT_COUNT_EXACT,
+  // the planner's estimate, which reads the table statistics only
+  SELECT_COUNT_ESTIMATE,
+};
+
+/**
+ * The comparisons a filter on a column can make (see postgres/filter.h).
+ */
+enum filter_operator {
+  FILTER_EQ,
+  FILTER_LT,
+  FILTER_LTE,
+  FILTER_GT,
+  FILTER_GTE,
+  // the value is an array literal, e.g. {"1","2"}
+  FILTER_IN,
+  // the filter has no value
+  FILTER_IS_NULL,
+  FILTER_IS_NOT_NULL,
+};
+
+/**
+ * A WHERE condition on a column. The value is bound as a query parameter, so
+ * that Postgres reads it as the type of the column.
+ */
+struct select_filter {
+  const char *column;
+  enum filter_operator op;
+  const char *value;
+};
+
+enum aggregate_function {
+  AGGREGATE_COUNT,
+  AGGREGATE_AVG,
+  AGGREGATE_SUM,
+  AGGREGATE_MIN,
+  AGGREGATE_MAX,
+};
+
+struct select_aggregate_function {
+  enum aggregate_function function;
+  /**
+   * @param column The column to aggregate, or NULL to count rows.
+   */
+  const char *column;
+};
+
+/**
+ * Turns a SELECT into aggregated rows (see postgres/aggregate.h): one per time
+ * bucket & group, holding the bucket (named "bucket"), the grouped columns &
+ * the aggregates (named "<function>_<column>" or "count").
+ */
+struct select_aggregate {
+  /**
+   * @param bucket_column The date or timestamp column to bucket by, or NULL.
+   */
+  const char *bucket_column;
+  /**
+   * @param bucket_interval The width of the buckets as a Postgres interval,
+   * which is bound as a parameter.
+   */
+  char bucket_interval[MAX_BUCKET_INTERVAL_LENGTH];
+  /**
+   * @param group_by The columns to group by. primary_tag groups by tag (see
+   * transform_tag_names).
+   */
+  const char *group_by[MAX_AGGREGATE_GROUPS];
+  int group_by_count;
+  struct select_aggregate_function functions[MAX_AGGREGATE_FUNCTIONS];
+  int functions_count;
+};
 
 struct select_options {
   /**
@@ -38,7 +153,9 @@ struct select_options {
   int primary_tag;
   /**
    * Whether or not the primary tag column should be transformed to represent
-   * the tag names instead of the tag ID.
+   * the tag names instead of the tag ID by joining the tag names table. Leave
+   * it unset to substitute the names during serialization instead (see
+   * substitute_tag_names).
    * @param transform_tag_names
    */
   int transform_tag_names;
@@ -65,6 +182,47 @@ struct select_options {
    * into the SQL query) if it is 0.
    */
   int row_offset;
+  /**
+   * @param after_id The ID of the row to continue after (keyset pagination, see
+   * postgres/cursor.h), or NULL to start at the first row. Rows are ordered by
+   * order_by_column & then by ID.
+   */
+  const char *after_id;
+  /**
+   * @param after_value The order_by_column value of that row, or NULL if the
+   * value is NULL.
+   */
+  const char *after_value;
+  /**
+   * @param next_cursor Whether or not the response carries the cursor of the
+   * next page.
+   */
+  int next_cursor;
+  /**
+   * @param filters Conditions every row must meet, besides the filter_column.
+   */
+  const struct select_filter *filters;
+  /**
+   * @param filters_count The number of filters. At most MAX_SELECT_FILTERS.
+   */
+  int filters_count;
+  /**
+   * @param aggregate The aggregation of the rows, or NULL to select them.
+   * Replaces the SELECT list (the schema, id_column & primary_tag) & orders by
+   * the buckets & groups instead of order_by_column.
+   */
+  const struct select_aggregate *aggregate;
+  /**
+   * @param expand SELECT_EXPAND_* flags, or 0. Needs the id_column. The tags
+   * are named if transform_tag_names is set.
+   */
+  int expand;
+  /**
+   * @param descriptors The descriptors of the table, for
+   * SELECT_EXPAND_DESCRIPTORS.
+   */
+  const struct descriptor *descriptors;
+  unsigned int descriptors_count;
 };
 
 /**
@@ -77,8 +235,8 @@ extern size_t select_query_size(struct select_options *options);
 /**
  * Construct a select query based on the given options. Guarentees buffer
  * safety. Sets errno to ENOMEM when the buffer runs out of space. Sets errno to
- * EILSEQ if an snprintf call fails.
- * @TODO add filters
+ * EILSEQ if an snprintf call fails. Filter values & cursors are left to
+ * parameters (see select_query_params).
  * @param options The options for the select query. The value is not validated.
  * @param buffer The buffer to write to.
  * @param buffer_size The maximum amount of characters the buffer can store.
@@ -86,13 +244,281 @@ extern size_t select_query_size(struct select_options *options);
 extern void construct_select_query(struct select_options *options, char *buffer,
                                    size_t buffer_size);
 
+/**
+ * Limits a SELECT to the columns of a COLUMNS list: id, primary_tag, schema
+ * columns & their comments columns ("<column>_comments"), which bring their
+ * value column along. Geodetic points keep their accuracy & altitude columns.
+ * @param options The options of the query. Their schema, id_column &
+ * primary_tag are replaced by the projected ones.
+ * @param columns The comma separated list, which is split in place.
+ * @param projected_schema The buffer for the projected schema. Must hold
+ * MAX_PROJECTED_COLUMNS columns.
+ * @param projection The buffer for a canonical form of the projection (the
+ * schema indexes of the columns), e.g. for cache keys. Must be
+ * MAX_PROJECTION_LENGTH long.
+ * @returns NULL on success or the column that is not a part of the table.
+ * Also returns NULL if the projection fails, with errno set to E2BIG if it has
+ * more than MAX_PROJECTED_COLUMNS columns or to ENOMEM.
+ */
+extern const char *project_select_columns(struct select_options *options,
+                                          char *columns,
+                                          struct data_column *projected_schema,
+                                          char *projection);
+
+/**
+ * Collects the values of the parameters ($1, $2, ...) of the query
+ * construct_select_query writes, in order.
+ * @param options The options the query is constructed from.
+ * @param values The array to write the values to. Must hold MAX_SELECT_PARAMS
+ * values.
+ * @returns the number of parameters.
+ */
+extern int select_query_params(const struct select_options *options,
+                               const char **values);
+
+/**
+ * Write a key that identifies the query of the options, e.g. for caching its
+ * result. Options that build the same query get the same key.
+ * @param options The options for the select query.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The size of the buffer.
+ * @returns The length of the key (see snprintf). The key was cut short if it is
+ * not less than buffer_size.
+ */
+extern int write_select_options_key(const struct select_options *options,
+                                    char *buffer, size_t buffer_size);
+
+/**
+ * Turns the options of a SELECT into those of counting the rows it matches
+ * across every page: the limit, the offset, the keyset cursor & the nested
+ * rows are dropped.
+ * @param options The options to change, usually a copy.
+ * @param aggregate Where to write the count(*) aggregate, or NULL to select
+ * the rows themselves (e.g. to EXPLAIN them).
+ */
+extern void count_select_options(struct select_options *options,
+                                 struct select_aggregate *aggregate);
+
+/**
+ * Construct a COPY query that writes the result of the select query (see
+ * construct_select_query) as CSV with a header line. Sets errno like
+ * construct_select_query. COPY takes no parameters, so their values are
+ * written into the query as quoted literals.
+ * @param options The options for the select query. The value is not validated.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maximum amount of characters the buffer can store.
+ */
+extern void construct_copy_query(struct select_options *options, char *buffer,
+                                 size_t buffer_size);
+
+/**
+ * Serialize the opening of a SELECT query result, i.e. the column names up to
+ * the start of the data array. Sets errno to ENOMEM when the buffer runs out of
+ * space. Does not null terminate.
+ * @param res A PGresult of the query (any row, or none).
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the string written or -1 on error.
+ */
+extern int serialize_select_columns(const PGresult *res, char *buffer,
+                                    const size_t buffer_size);
+
+/**
+ * Writes a non-null value of a column as JSON. Does not null terminate.
+ * @param value The value as returned by PQgetvalue.
+ * @param length The length of the value as returned by PQgetlength.
+ * @param flags SERIALIZE_* flags, or 0.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the string written or -1 if the buffer is too small.
+ */
+typedef int (*column_emitter)(const char *value, int length, int flags,
+                              char *buffer, size_t buffer_size);
+
+// see server/tag_dictionary.h
+struct tag_names;
+
+/**
+ * How to serialize each column of a result, picked once from the column types
+ * & formats instead of per value.
+ */
+struct select_plan {
+  /**
+   * @param flags SERIALIZE_* flags, or 0.
+   */
+  int flags;
+  /**
+   * @param n_columns The number of columns in the result.
+   */
+  int n_columns;
+  /**
+   * @param tag_column The column whose tag IDs are written as tag names, or -1.
+   */
+  int tag_column;
+  /**
+   * @param tag_names The names written for the tag column.
+   */
+  struct tag_names *tag_names;
+  /**
+   * @param emitters The emitter of each column.
+   */
+  column_emitter emitters[];
+};
+
+/**
+ * Builds the serialization plan of a result. Results of the same query (e.g.
+ * the rows of a single-row mode query) can share a plan. Sets errno to ENOMEM
+ * on failure, or to ENOTSUP if a binary format column has a type that cannot
+ * be decoded.
+ * @param res A PGresult of the query (any row, or none).
+ * @param flags SERIALIZE_* flags, or 0.
+ * @returns The plan, which must be freed with free_select_plan, or NULL.
+ */
+extern struct select_plan *create_select_plan(const PGresult *res, int flags);
+
+/**
+ * Writes the primary_tag column of a result as tag names instead of IDs, which
+ * saves the query from joining the tag names table. Unknown IDs are written as
+ * null, like the join would.
+ * @param plan The plan built for the result.
+ * @param res A PGresult of the query (any row, or none).
+ * @param tag_names The names to write, which must outlive the plan.
+ */
+extern void substitute_tag_names(struct select_plan *plan, const PGresult *res,
+                                 struct tag_names *tag_names);
+
+/**
+ * Frees a plan built by create_select_plan.
+ * @param plan The plan to free, or NULL.
+ */
+extern void free_select_plan(struct select_plan *plan);
+
+/**
+ * Serialize the header line of a newline delimited (SELECT_FORMAT_NDJSON)
+ * result, i.e. {"columns":[...]} & a newline. Sets errno to ENOMEM when the
+ * buffer runs out of space. Does not null terminate.
+ * @param res A PGresult of the query (any row, or none).
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the string written or -1 on error.
+ */
+extern int serialize_select_ndjson_header(const PGresult *res, char *buffer,
+                                          const size_t buffer_size);
+
+/**
+ * Serialize the opening of a MessagePack result, i.e. a map holding "columns"
+ * (the column names) & "data" (an array with the row count as its length).
+ * The rows follow (see serialize_select_row with SERIALIZE_MSGPACK). Sets errno
+ * to ENOMEM when the buffer runs out of space.
+ * @param res The PGresult to serialize (the row count is needed up front).
+ * @param extra_members The number of members the caller writes into the map
+ * after the rows, e.g. the next cursor.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length written or -1 on error.
+ */
+extern int serialize_select_msgpack_start(const PGresult *res,
+                                          int extra_members, char *buffer,
+                                          const size_t buffer_size);
+
+/**
+ * Writes a value of a SELECT query result in its Postgres text format, i.e.
+ * as a literal Postgres reads back as the same value, whether the result is
+ * in text or binary format. Does not null terminate.
+ * @param res The PGresult holding the value. The value must not be null.
+ * @param row_num The row of the value.
+ * @param col_num The column of the value.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the string written or -1 if the buffer is too small.
+ */
+extern int write_select_value_text(const PGresult *res, int row_num,
+                                   int col_num, char *buffer,
+                                   size_t buffer_size);
+
+/**
+ * Serialize a single row of a SELECT query result as a JSON array (or a
+ * MessagePack array with SERIALIZE_MSGPACK). Sets errno
+ * to ENOMEM when the buffer runs out of space. Does not null terminate.
+ * @param res The PGresult holding the row.
+ * @param plan The plan built for the result.
+ * @param row_num The row to serialize.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the string written or -1 on error.
+ */
+extern int serialize_select_row(const PGresult *res,
+                                const struct select_plan *plan, int row_num,
+                                char *buffer, const size_t buffer_size);
+
+/**
+ * Serialize a single value of a SELECT query result as JSON (or MessagePack
+ * with SERIALIZE_MSGPACK). Sets errno to
+ * ENOMEM when the buffer runs out of space. Does not null terminate.
+ * @param res The PGresult holding the value.
+ * @param plan The plan built for the result.
+ * @param row_num The row of the value.
+ * @param col_num The column of the value.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the string written or -1 on error.
+ */
+extern int serialize_select_value(const PGresult *res,
+                                  const struct select_plan *plan, int row_num,
+                                  int col_num, char *buffer,
+                                  const size_t buffer_size);
+
+/**
+ * Serialize the opening of a columnar (SELECT_FORMAT_COLUMNAR) result, i.e.
+ * the column names & row count up to the start of the data object. Sets errno
+ * to ENOMEM when the buffer runs out of space. Does not null terminate.
+ * @param res The PGresult to serialize.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the string written or -1 on error.
+ */
+extern int serialize_select_columnar_start(const PGresult *res, char *buffer,
+                                           const size_t buffer_size);
+
+/**
+ * Checks whether every row of a column holds the same value (or null). Results
+ * with fewer than two rows have no constant columns.
+ * @param res The PGresult to check.
+ * @param col_num The column to check.
+ * @returns 1 if the column is constant, 0 otherwise.
+ */
+extern int select_column_is_constant(const PGresult *res, int col_num);
+
+/**
+ * Serialize the key of a column in the columnar data object, preceded by a
+ * comma for all but the first column. Constant columns are written whole as
+ * {"constant":value}; other columns are opened with a '[' and their values
+ * (see serialize_select_value) must be written & closed by the caller. Sets
+ * errno to ENOMEM when the buffer runs out of space. Does not null terminate.
+ * @param res The PGresult to serialize.
+ * @param plan The plan built for the result.
+ * @param col_num The column to serialize.
+ * @param constant Whether or not the column is constant (see
+ * select_column_is_constant).
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length of the string written or -1 on error.
+ */
+extern int serialize_select_column_start(const PGresult *res,
+                                         const struct select_plan *plan,
+                                         int col_num, int constant,
+                                         char *buffer,
+                                         const size_t buffer_size);
+
 /**
  * Serialize a SELECT query result into JSON. Guarentees buffer safety.
- * Sets errno to ENOMEM when the buffer runs out of space.
+ * Sets errno to ENOMEM when the buffer runs out of space. Results fetched in
+ * binary format (see sql_select) are decoded in process; strings are escaped.
  * @param res The PGresult to serialize.
+ * @param flags SERIALIZE_* flags, or 0.
  * @param buffer The buffer to write to.
  * @param buffer_size The maxmimum amount of characters the buffer can store.
  * @returns the length of the string written or -1 on error.
  */
-extern int serialize_select_result(const PGresult *res, char *buffer,
-                                   const size_t buffer_size);
\ No newline at end of file
+extern int serialize_select_result(const PGresult *res, int flags,
+                                   char *buffer, const size_t buffer_size);
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "libpq-fe.h"
+#include <stdlib.h>
+
+/**
+ * Apache Arrow IPC stream output for SELECT results. Each config.yml datatype
+ * gets a column builder (int: Int64, float: Float64, string/enum: Utf8, bool:
+ * Bool, date: Date32, time: Time64[us], timestamp: Timestamp[us] & geodetic
+ * point: a Struct of Float64 longitude, latitude, latlong_accuracy, altitude &
+ * altitude_accuracy). Rows are collected into record batches of up to
+ * ARROW_BATCH_ROWS rows that are written as soon as they fill up. Text & binary
+ * format results are both supported.
+ */
+#define ARROW_BATCH_ROWS 65536
+
+/**
+ * Receives the bytes of the stream.
+ * @param data The bytes to write.
+ * @param length The number of bytes.
+ * @param arg The argument given to create_arrow_writer.
+ * @returns 1 on success, 0 on failure.
+ */
+typedef int (*arrow_sink)(const char *data, size_t length, void *arg);
+
+struct arrow_writer;
+struct select_options;
+
+/**
+ * Creates a writer for the results of a SELECT query. The options are read
+ * again while writing & must outlive the writer.
+ * @param options The options the query was built from (see
+ * construct_select_query).
+ * @param sink Where to write the stream.
+ * @param sink_arg The argument to pass to the sink.
+ * @returns The writer or NULL if out of memory.
+ */
+extern struct arrow_writer *
+create_arrow_writer(const struct select_options *options, arrow_sink sink,
+                    void *sink_arg);
+
+/**
+ * Adds the rows of a result (e.g. a single row mode batch) to the stream. The
+ * schema is written on the first call, even without rows.
+ * @param writer The writer.
+ * @param res The rows to add.
+ * @returns 1 on success, 0 on failure.
+ */
+extern int arrow_write_rows(struct arrow_writer *writer, const PGresult *res);
+
+/**
+ * Writes the remaining rows & ends the stream.
+ * @param writer The writer.
+ * @returns 1 on success, 0 on failure (or if no rows were ever added).
+ */
+extern int arrow_finish(struct arrow_writer *writer);
+
+/**
+ * Frees a writer.
+ * @param writer The writer, or NULL.
+ */
+extern void free_arrow_writer(struct arrow_writer *writer);
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include <stddef.h>
+
+/**
+ * POST /batch runs several GET requests at once & answers them with a single
+ * response, so that loading a page takes one round trip & as long as its
+ * slowest read. The body is a JSON array of paths with their querystrings,
+ * e.g. ["/db/table/data?ORDER_BY=DESC", ...], or of objects like
+ * {"path": "/db/table/count", "querystring": "MODE=ESTIMATE"}.
+ *
+ * Every request is handed to the regular request handler over a socket pair
+ * in a thread of its own, with the headers of the batch (e.g. its cookies &
+ * origin). Requests are thus routed, authenticated, cached & coalesced like
+ * any other & run concurrently on connections of their own. Since every
+ * running request holds a database connection, at most
+ * MAX_RUNNING_BATCH_REQUESTS requests of all batches run at once; the others
+ * wait for their turn (until the deadline of their batch). The responses
+ * come back as multipart/mixed: an application/http part per request, in
+ * order, whose Content-ID is the index of the request. Chunked responses are
+ * reassembled & given a Content-Length.
+ */
+#define MAX_BATCH_REQUESTS 16
+#define MAX_RUNNING_BATCH_REQUESTS 8
+#define MAX_BATCH_PATH_LENGTH 2048
+// larger responses are replaced with an error
+#define MAX_BATCH_PART_SIZE (16 * 1024 * 1024)
+
+/**
+ * Runs the requests of a batch concurrently & builds the combined response.
+ * Invalid batches get a 400 response. Requests that did not respond by the
+ * deadline get a 504 part.
+ * @param body The body of the batch request, or NULL.
+ * @param headers The head of the batch request, from the request line on.
+ * @param handle_request The request handler. Called in a new thread with a
+ * pointer to the socket of the request, which it must close once it responded
+ * (see handle_client).
+ * @param client_fd The socket of the batch request, which is watched for a
+ * hangup, or -1.
+ * @param deadline_ms The deadline of the batch request (see monotonic_ms), or
+ * 0 for no deadline.
+ * @param response response text output pointer. Left untouched if the client
+ * hung up.
+ * @param response_len response text length output pointer.
+ */
+extern void respond_batch(const char *body, const char *headers,
+                          void *(*handle_request)(void *), int client_fd,
+                          long long deadline_ms, char **response,
+                          size_t *response_len);
\ No newline at end of file
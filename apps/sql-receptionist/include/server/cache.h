@@ -0,0 +1,91 @@
+#include <stdlib.h>
+
+/**
+ * A sharded LRU cache of complete HTTP responses to SELECT requests. The cache
+ * is disabled unless SQL_RECEPTIONIST_CACHE_MB sets its memory budget, which is
+ * split evenly between the shards.
+ *
+ * Entries belong to a table of the config (with every route derived from it,
+ * e.g. its tags & descriptors). Writing to any of them invalidates the whole
+ * table (cache_invalidate): locally when a POST commits & on other instances
+ * through LISTEN/NOTIFY (see postgres/notify.h). Invalidation bumps a
+ * generation counter, so stale entries are only dropped when they are next
+ * looked up or evicted. Entries also expire after SQL_RECEPTIONIST_CACHE_TTL_MS
+ * (CACHE_DEFAULT_TTL_MS by default), which bounds how stale a response served
+ * from a lagging replica or missed by the listener can get.
+ *
+ * Hits, misses, evictions & invalidations are exported as metrics.
+ */
+#define CACHE_SHARDS 16
+#define CACHE_BUCKETS_PER_SHARD 1024
+// responses larger than this fraction of a shard's budget are not cached
+#define CACHE_MAX_ENTRY_FRACTION 4
+#define CACHE_DEFAULT_TTL_MS 60000
+#define MAX_CACHE_KEY_LENGTH 1024
+// the NOTIFY channel of a table is its name with this prefix
+#define CACHE_CHANNEL_PREFIX "cache_"
+#define MAX_CACHE_CHANNEL_LENGTH 64
+
+/**
+ * @returns Whether or not the cache is enabled (SQL_RECEPTIONIST_CACHE_MB).
+ */
+extern int cache_enabled();
+
+/**
+ * @returns The size of the largest response that may be cached.
+ */
+extern size_t cache_max_entry_size();
+
+/**
+ * Reads the generation of a table, which changes every time the table is
+ * invalidated. Read it before running the query whose response is cached, so
+ * that writes that commit while the query runs invalidate the response.
+ * @param database The database name.
+ * @param table The config table name.
+ */
+extern unsigned long long cache_generation(const char *database,
+                                           const char *table);
+
+/**
+ * Looks up a response.
+ * @param key The cache key.
+ * @param response Set to a copy of the response, which must be freed.
+ * @param response_len Set to the length of the response.
+ * @returns 1 on a hit, 0 on a miss.
+ */
+extern int cache_get(const char *key, char **response, size_t *response_len);
+
+/**
+ * Stores a response, evicting the least recently used entries of its shard to
+ * stay within the budget. Responses that are too large or already stale are
+ * ignored.
+ * @param key The cache key.
+ * @param database The database name.
+ * @param table The config table the response was read from.
+ * @param generation The generation of the table before the query ran (see
+ * cache_generation).
+ * @param response The complete HTTP response.
+ * @param response_len The length of the response.
+ */
+extern void cache_put(const char *key, const char *database,
+                      const char *table, unsigned long long generation,
+                      const char *response, size_t response_len);
+
+/**
+ * Invalidates every cached response of a table.
+ * @param database The database name.
+ * @param table The config table name, or NULL to invalidate the whole
+ * database.
+ */
+extern void cache_invalidate(const char *database, const char *table);
+
+/**
+ * Writes the NOTIFY channel of a table (CACHE_CHANNEL_PREFIX & the table name).
+ * @param table The config table name.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The size of the buffer. Channel names are identifiers, so
+ * at most MAX_CACHE_CHANNEL_LENGTH - 1 characters fit.
+ * @returns 1 on success, 0 if the name is too long.
+ */
+extern int write_cache_channel(const char *table, char *buffer,
+                               size_t buffer_size);
\ No newline at end of file
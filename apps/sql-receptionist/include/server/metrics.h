@@ -0,0 +1,45 @@
+#include <stdlib.h>
+
+/**
+ * Process-wide counters & gauges, exposed in the Prometheus text format.
+ * Metric names include their labels, e.g. name{database="main"}.
+ */
+struct metric;
+
+/**
+ * Finds the metric with the given name, registering it if it does not exist
+ * yet. The returned pointer stays valid for the lifetime of the process.
+ * @param name The full metric name including labels.
+ * @returns The metric or NULL if the metric table is full.
+ */
+extern struct metric *get_metric(const char *name);
+
+/**
+ * Adds to a metric. NULL metrics are ignored.
+ * @param metric The metric to update.
+ * @param delta The amount to add.
+ */
+extern void metric_add(struct metric *metric, long long delta);
+
+/**
+ * Overwrites the value of a metric. NULL metrics are ignored.
+ * @param metric The metric to update.
+ * @param value The new value.
+ */
+extern void metric_set(struct metric *metric, long long value);
+
+/**
+ * Reads the value of a metric. NULL metrics read as 0.
+ * @param metric The metric to read.
+ */
+extern long long metric_value(struct metric *metric);
+
+/**
+ * Writes every registered metric to the given buffer in the Prometheus text
+ * format. Prevents buffer overflow with snprintf.
+ * @param buffer The buffer to write to. May be NULL if buffer_size is 0.
+ * @param buffer_size The available size of the buffer.
+ * @returns The size that would have been written if the buffer was infinitely
+ * large, excluding the null terminator.
+ */
+extern size_t write_metrics(char *buffer, size_t buffer_size);
\ No newline at end of file
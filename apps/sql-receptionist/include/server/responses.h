@@ -7,10 +7,42 @@
  * @returns The size that would have been written if the buffer was infinitely large.
  */
 extern size_t write_header(const int status_code, char *buffer, const size_t buffer_size);
+/**
+ * Same as write_header, with additional headers.
+ * @param status_code The status code of the HTTP response.
+ * @param headers additional header lines, each terminated by "\r\n". May be empty.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The available size of the buffer.
+ * @returns The size that would have been written if the buffer was infinitely large.
+ */
+extern size_t write_header_with_headers(const int status_code, const char *headers,
+                                        char *buffer, const size_t buffer_size);
+/**
+ * Same as write_header_with_headers, with a Content-Type other than text/plain.
+ * @param status_code The status code of the HTTP response.
+ * @param content_type The media type of the body.
+ * @param headers additional header lines, each terminated by "\r\n". May be empty.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The available size of the buffer.
+ * @returns The size that would have been written if the buffer was infinitely large.
+ */
+extern size_t write_header_with_content_type(const int status_code,
+                                             const char *content_type,
+                                             const char *headers, char *buffer,
+                                             const size_t buffer_size);
 extern void build_response(int status_code, char **response,
                            size_t *response_len, const char *body);
+extern void build_response_with_headers(int status_code, char **response,
+                                        size_t *response_len,
+                                        const char *headers, const char *body);
+extern void build_response_with_body(int status_code, char **response,
+                                     size_t *response_len,
+                                     const char *content_type,
+                                     const char *headers, const char *body,
+                                     size_t body_len);
 extern void build_response_printf(int status_code, char **response,
                                   size_t *response_len, size_t text_size,
                                   const char *pattern, ...);
 extern void build_response_default(int status_code, char **response,
-                                   size_t *response_len);
\ No newline at end of file
+                                   size_t *response_len);
+extern void build_unavailable_response(char **response, size_t *response_len);
\ No newline at end of file
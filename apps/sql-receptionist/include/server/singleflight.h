@@ -0,0 +1,63 @@
+#include <stdlib.h>
+
+/**
+ * Coalesces identical concurrent SELECT requests: the first request for a key
+ * (the leader) runs the query while later ones (followers) wait for it & send
+ * the very same response, which is shared by reference instead of copied.
+ * Flights only exist while their query runs, so this works without the
+ * response cache (see server/cache.h), and covers the moment after a cached
+ * response expires.
+ *
+ * sql_receptionist_singleflight_requests_total counts every request that
+ * joined a flight & sql_receptionist_singleflight_coalesced_total those that
+ * were served by another request's query. Their ratio is the coalescing ratio.
+ */
+#define SINGLEFLIGHT_BUCKETS 256
+// larger responses are not shared; followers run the query themselves
+#define SINGLEFLIGHT_MAX_RESPONSE_SIZE (8 * 1024 * 1024)
+
+struct flight;
+
+/**
+ * Joins the flight of a request, starting it if there is none.
+ * @param key The normalized request (see write_select_options_key).
+ * @param generation The generation of the table (see cache_generation).
+ * Requests only share flights of the same generation, so a request that starts
+ * after a write never receives a response read before it.
+ * @param leader Set to 1 if the caller started the flight & must run the query
+ * (then land it with flight_land), or 0 if it must wait (see flight_wait).
+ * @returns The flight, or NULL if out of memory.
+ */
+extern struct flight *flight_join(const char *key,
+                                  unsigned long long generation, int *leader);
+
+/**
+ * Hands the leader's response over to the waiting followers & leaves the
+ * flight. Later requests for the key start a new flight.
+ * @param flight The flight.
+ * @param response The complete HTTP response, which the flight takes ownership
+ * of, or NULL if the query failed & every follower must run it itself.
+ * @param response_len The length of the response.
+ */
+extern void flight_land(struct flight *flight, char *response,
+                        size_t response_len);
+
+/**
+ * Waits for the leader of a flight to land it.
+ * @param flight The flight.
+ * @param deadline_ms When to give up (see monotonic_ms), or 0 to wait as long
+ * as it takes.
+ * @param response Set to the shared response, which stays valid until the
+ * caller leaves the flight.
+ * @param response_len Set to the length of the response.
+ * @returns 1 if the leader shared its response, 0 if it failed or the deadline
+ * passed.
+ */
+extern int flight_wait(struct flight *flight, long long deadline_ms,
+                       const char **response, size_t *response_len);
+
+/**
+ * Leaves a flight the caller followed, freeing it if it was the last one.
+ * @param flight The flight, or NULL.
+ */
+extern void flight_leave(struct flight *flight);
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+
+/**
+ * Streams a response to the client with Transfer-Encoding: chunked. Data is
+ * collected into a bounded buffer and each full buffer is sent as one chunk, so
+ * the memory used per response does not depend on the size of the body. Sends
+ * block until the client has room for more data (up to the deadline), which
+ * stops the producer from reading ahead of a slow client.
+ */
+#define STREAM_CHUNK_SIZE 262144
+// how long data may sit in a partially filled buffer (see stream_flush_if_due)
+#define STREAM_FLUSH_INTERVAL_MS 100
+
+struct response_stream {
+  int client_fd;
+  long long deadline_ms;
+  /**
+   * @param started Whether or not the headers were sent.
+   */
+  int started;
+  /**
+   * @param failed 0, or why sending failed: ETIMEDOUT if the client did not
+   * take the data before the deadline, EPIPE or ECONNRESET if it hung up.
+   * Further writes are ignored.
+   */
+  int failed;
+  size_t length;
+  /**
+   * @param last_flush_ms When the last chunk was sent (see monotonic_ms).
+   */
+  long long last_flush_ms;
+  /**
+   * @param content_type The media type given to stream_start.
+   */
+  const char *content_type;
+  /**
+   * @param headers The additional header lines given to stream_start.
+   */
+  const char *headers;
+  /**
+   * @param capture A copy of the body sent so far (see stream_capture), or
+   * NULL.
+   */
+  char *capture;
+  size_t capture_length;
+  /**
+   * @param capture_limit The largest body to copy, or 0 if the body is not
+   * copied (anymore).
+   */
+  size_t capture_limit;
+  /**
+   * @param holding Whether or not the body is held back (see stream_hold).
+   */
+  int holding;
+  /**
+   * @param held_length The length of the end of the capture that was not sent
+   * yet.
+   */
+  size_t held_length;
+  char buffer[STREAM_CHUNK_SIZE];
+};
+
+/**
+ * Prepares a stream. Nothing is sent until stream_start is called.
+ * @param stream The stream to initialize.
+ * @param client_fd The client socket.
+ * @param deadline_ms The deadline for sending (see monotonic_ms), or 0 for no
+ * deadline.
+ */
+extern void stream_init(struct response_stream *stream, int client_fd,
+                        long long deadline_ms);
+
+/**
+ * Sends the status line & headers of the response.
+ * @param stream The stream.
+ * @param status_code The status code of the response.
+ * @param content_type The media type of the body.
+ * @param headers additional header lines, each terminated by "\r\n". May be
+ * empty.
+ * @returns 1 on success, 0 on failure.
+ */
+extern int stream_start(struct response_stream *stream, int status_code,
+                        const char *content_type, const char *headers);
+
+/**
+ * @returns Where the next data may be written directly into the stream's
+ * buffer. See stream_space_left & stream_advance.
+ */
+extern char *stream_space(struct response_stream *stream);
+
+/**
+ * @returns The number of bytes that may be written to stream_space.
+ */
+extern size_t stream_space_left(const struct response_stream *stream);
+
+/**
+ * Marks bytes written to stream_space as part of the body.
+ * @param stream The stream.
+ * @param length The number of bytes written.
+ */
+extern void stream_advance(struct response_stream *stream, size_t length);
+
+/**
+ * Appends data to the body, sending chunks as the buffer fills up.
+ * @param stream The stream.
+ * @param data The data to append.
+ * @param length The length of the data.
+ * @returns 1 on success, 0 on failure.
+ */
+extern int stream_write(struct response_stream *stream, const char *data,
+                        size_t length);
+
+/**
+ * Sends the buffered data as a chunk.
+ * @param stream The stream.
+ * @returns 1 on success, 0 on failure.
+ */
+extern int stream_flush(struct response_stream *stream);
+
+/**
+ * Sends the buffered data as a chunk if nothing was sent for
+ * STREAM_FLUSH_INTERVAL_MS, so that slow producers still reach the client
+ * promptly without sending a chunk per write.
+ * @param stream The stream.
+ * @returns 1 on success, 0 on failure.
+ */
+extern int stream_flush_if_due(struct response_stream *stream);
+
+/**
+ * Sends the remaining data & ends the body.
+ * @param stream The stream.
+ * @returns 1 on success, 0 on failure.
+ */
+extern int stream_finish(struct response_stream *stream);
+
+/**
+ * Keeps a copy of the body as it is sent, e.g. to cache the response. Bodies
+ * larger than the limit are not copied.
+ * @param stream The stream. Must not have sent any of the body yet.
+ * @param limit The largest body to copy.
+ */
+extern void stream_capture(struct response_stream *stream, size_t limit);
+
+/**
+ * Holds the body back instead of sending it, so that the complete body can be
+ * shared (see stream_body) before a slow client has read any of it. The held
+ * body is sent by stream_release or stream_finish, or as soon as it outgrows
+ * the capture limit.
+ * @param stream The stream. Must copy its body (see stream_capture) & not have
+ * sent any of it yet.
+ */
+extern void stream_hold(struct response_stream *stream);
+
+/**
+ * Sends the held body & stops holding it back.
+ * @param stream The stream.
+ * @returns 1 on success, 0 on failure.
+ */
+extern int stream_release(struct response_stream *stream);
+
+/**
+ * Flushes the buffered data into the copy of the body & returns the copy. Call
+ * it once the whole body was written.
+ * @param stream The stream.
+ * @param length Set to the length of the body.
+ * @returns The body, which belongs to the stream, or NULL if the body was not
+ * copied completely.
+ */
+extern const char *stream_body(struct response_stream *stream, size_t *length);
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+
+/**
+ * An in-memory dictionary of the tag names & aliases of every tagged table,
+ * so that data pages are served without joining the tag names table: the
+ * query selects the primary_tag IDs & the serializer writes the names instead
+ * (see substitute_tag_names).
+ *
+ * Dictionaries are loaded from the primary at startup or on first use &
+ * reloaded after writes to the tag tables (tag_dictionary_invalidate, which
+ * other instances hear of through LISTEN/NOTIFY, see postgres/notify.h), after
+ * TAG_DICTIONARY_TTL_MS, or once a page held an ID the dictionary does not
+ * know yet. Each load builds an immutable snapshot, so readers never lock.
+ */
+#define TAG_DICTIONARY_TTL_MS 60000
+// the NOTIFY payload of writes to the tag tables (see server/cache.h)
+#define TAG_DICTIONARY_NOTIFY_PAYLOAD "tags"
+
+/**
+ * A snapshot of the tags of a table.
+ */
+struct tag_names;
+
+/**
+ * Finds the dictionary of a table, (re)loading it if it is out of date.
+ * @param database The database name.
+ * @param table The config table name.
+ * @returns An up to date snapshot, which must be released with
+ * release_tag_names, or NULL if it could not be loaded (fall back to joining
+ * the tag names table).
+ */
+extern struct tag_names *acquire_tag_names(const char *database,
+                                           const char *table);
+
+/**
+ * Releases a snapshot acquired with acquire_tag_names.
+ * @param names The snapshot, or NULL.
+ */
+extern void release_tag_names(struct tag_names *names);
+
+/**
+ * Looks up the name of a tag. Unknown IDs mark the snapshot out of date, so
+ * the next request reloads it.
+ * @param names The snapshot.
+ * @param id The tag ID.
+ * @param length Set to the length of the name.
+ * @returns The name (not null terminated), or NULL if the ID is unknown.
+ */
+extern const char *find_tag_name(struct tag_names *names, long long id,
+                                 int *length);
+
+/**
+ * Looks up the ID of a tag by its name.
+ * @param names The snapshot.
+ * @param name The tag name.
+ * @param id Set to the ID of the tag.
+ * @returns 1 if the snapshot is up to date & knows the name, 0 otherwise.
+ */
+extern int find_tag_id(struct tag_names *names, const char *name,
+                       long long *id);
+
+/**
+ * Looks up the tag an alias points to.
+ * @param names The snapshot.
+ * @param alias The alias.
+ * @param id Set to the ID of the tag.
+ * @returns 1 if the snapshot knows the alias, 0 otherwise.
+ */
+extern int find_tag_alias(struct tag_names *names, const char *alias,
+                          long long *id);
+
+/**
+ * Marks dictionaries out of date, e.g. after a write to their tag tables.
+ * @param database The database name.
+ * @param table The config table name, or NULL for every table of the database.
+ */
+extern void tag_dictionary_invalidate(const char *database, const char *table);
\ No newline at end of file
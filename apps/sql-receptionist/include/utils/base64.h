@@ -0,0 +1,35 @@
+#include <stddef.h>
+
+/**
+ * The URL & filename safe base64 alphabet (RFC 4648 section 5) without
+ * padding, so that encoded values can be put into querystrings as they are.
+ * Neither function null terminates.
+ */
+
+/**
+ * @returns The length of the encoding of a value of the given length.
+ */
+extern size_t base64url_encoded_length(size_t length);
+
+/**
+ * Encodes a value.
+ * @param value The bytes to encode.
+ * @param length The number of bytes.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The size of the buffer.
+ * @returns The number of characters written or -1 if the buffer is too small.
+ */
+extern int base64url_encode(const char *value, size_t length, char *buffer,
+                            size_t buffer_size);
+
+/**
+ * Decodes a value.
+ * @param text The encoded value.
+ * @param length The length of the encoded value.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The size of the buffer.
+ * @returns The number of bytes written or -1 if the text is not valid base64url
+ * or the buffer is too small.
+ */
+extern int base64url_decode(const char *text, size_t length, char *buffer,
+                            size_t buffer_size);
\ No newline at end of file
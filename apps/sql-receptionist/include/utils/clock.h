@@ -0,0 +1,4 @@
+/**
+ * @returns The current value of the monotonic clock in milliseconds.
+ */
+extern long long monotonic_ms();
\ No newline at end of file
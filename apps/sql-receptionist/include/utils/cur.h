@@ -55,6 +55,19 @@
     *cur++ = character;                                                        \
   })
 
+// a quoted SQL string literal. Quotes are doubled; backslashes need no
+// escaping since standard_conforming_strings is on.
+#define cur_write_literal(cur, remaining_size, value)                          \
+  ({                                                                           \
+    cur_append(cur, remaining_size, '\'');                                     \
+    for (const char *literal_cur = value; *literal_cur; literal_cur++) {       \
+      if (*literal_cur == '\'')                                                \
+        cur_append(cur, remaining_size, '\'');                                 \
+      cur_append(cur, remaining_size, *literal_cur);                           \
+    }                                                                          \
+    cur_append(cur, remaining_size, '\'');                                     \
+  })
+
 #define cur_shave(cur, remaining_size, length)                                 \
   do {                                                                         \
     cur -= length;                                                             \
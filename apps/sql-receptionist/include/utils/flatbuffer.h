@@ -0,0 +1,115 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A minimal FlatBuffers builder, enough to write Arrow IPC metadata. Like the
+ * reference builders it fills the buffer back to front: strings, vectors &
+ * tables are finished before the tables that refer to them. Values are written
+ * little-endian. Allocation failures are remembered & reported by
+ * flatbuffer_finish.
+ */
+#define FLATBUFFER_MAX_FIELDS 16
+
+/**
+ * A finished string, vector or table, as its distance from the end of the
+ * buffer.
+ */
+typedef uint32_t flatbuffer_ref;
+
+struct flatbuffer {
+  char *data;
+  size_t capacity;
+  size_t size;
+  size_t min_align;
+  int failed;
+  /**
+   * @param object_start The size when the current table was started.
+   */
+  size_t object_start;
+  /**
+   * @param fields Where each field of the current table was written (as a
+   * distance from the end), or 0 if it is absent.
+   */
+  size_t fields[FLATBUFFER_MAX_FIELDS];
+  int n_fields;
+};
+
+/**
+ * Prepares an empty builder.
+ */
+extern void flatbuffer_init(struct flatbuffer *fb);
+
+/**
+ * Frees the builder's buffer.
+ */
+extern void flatbuffer_free(struct flatbuffer *fb);
+
+/**
+ * Writes a string.
+ * @param value The string. Need not be null terminated.
+ * @param length The length of the string.
+ */
+extern flatbuffer_ref flatbuffer_create_string(struct flatbuffer *fb,
+                                               const char *value,
+                                               size_t length);
+
+/**
+ * Starts a vector. The elements must then be prepended in reverse order
+ * (flatbuffer_prepend_*) before calling flatbuffer_end_vector.
+ * @param element_size The size of an element in bytes.
+ * @param count The number of elements.
+ * @param alignment The alignment of an element.
+ */
+extern void flatbuffer_start_vector(struct flatbuffer *fb, size_t element_size,
+                                    size_t count, size_t alignment);
+
+/**
+ * Finishes a vector.
+ * @param count The number of elements.
+ */
+extern flatbuffer_ref flatbuffer_end_vector(struct flatbuffer *fb,
+                                            size_t count);
+
+extern void flatbuffer_prepend_int64(struct flatbuffer *fb, int64_t value);
+
+/**
+ * Prepends a reference to a finished string, vector or table (e.g. as a vector
+ * element).
+ */
+extern void flatbuffer_prepend_ref(struct flatbuffer *fb, flatbuffer_ref ref);
+
+/**
+ * Starts a table. Its fields are added with flatbuffer_add_*; strings, vectors
+ * & tables it refers to must be finished before it is started.
+ */
+extern void flatbuffer_start_table(struct flatbuffer *fb);
+
+/**
+ * Adds a scalar field to the current table.
+ * @param id The field id (its position in the schema).
+ * @param value The value.
+ * @param size The size of the field in bytes (1, 2, 4 or 8).
+ */
+extern void flatbuffer_add_scalar(struct flatbuffer *fb, int id,
+                                  uint64_t value, size_t size);
+
+/**
+ * Adds a field referring to a finished string, vector or table.
+ * @param id The field id (its position in the schema).
+ */
+extern void flatbuffer_add_ref(struct flatbuffer *fb, int id,
+                               flatbuffer_ref ref);
+
+/**
+ * Finishes the current table & writes its vtable.
+ */
+extern flatbuffer_ref flatbuffer_end_table(struct flatbuffer *fb);
+
+/**
+ * Finishes the buffer.
+ * @param root The root table.
+ * @param length Set to the length of the buffer.
+ * @returns The buffer (owned by the builder) or NULL if an allocation failed.
+ */
+extern const char *flatbuffer_finish(struct flatbuffer *fb,
+                                     flatbuffer_ref root, size_t *length);
\ No newline at end of file
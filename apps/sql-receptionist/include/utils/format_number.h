@@ -0,0 +1,36 @@
+/**
+ * Number formatting for the JSON serializers. Integers are written two digits
+ * at a time and floating point numbers are written with the fewest digits that
+ * still parse back to the same value, which is also what Postgres' own text
+ * output does (extra_float_digits = 1).
+ */
+#define MAX_NUMBER_STR_LENGTH 32
+
+/**
+ * Writes an integer in decimal. Does not null terminate.
+ * @param buffer The buffer to write to. Must hold MAX_NUMBER_STR_LENGTH
+ * characters.
+ * @param value The integer to write.
+ * @returns The number of characters written.
+ */
+extern int format_int(char *buffer, long long value);
+
+/**
+ * Writes a double with the fewest significant digits that round-trip. Does not
+ * null terminate.
+ * @param buffer The buffer to write to. Must hold MAX_NUMBER_STR_LENGTH
+ * characters.
+ * @param value The double to write. Must be finite.
+ * @returns The number of characters written.
+ */
+extern int format_double(char *buffer, double value);
+
+/**
+ * Writes a float with the fewest significant digits that round-trip as a
+ * float. Does not null terminate.
+ * @param buffer The buffer to write to. Must hold MAX_NUMBER_STR_LENGTH
+ * characters.
+ * @param value The float to write. Must be finite.
+ * @returns The number of characters written.
+ */
+extern int format_float(char *buffer, float value);
\ No newline at end of file
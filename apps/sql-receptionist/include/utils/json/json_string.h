@@ -0,0 +1,43 @@
+#include <stddef.h>
+
+/**
+ * JSON string escaping for the serializers. Bytes that need no escaping are
+ * copied in runs; quotes, backslashes & control characters are escaped.
+ * Anything else (including UTF-8) is copied through unchanged. Runs are found
+ * 16 (SSE2) or 32 (AVX2) bytes at a time when the CPU supports it.
+ */
+
+enum json_escaper {
+  JSON_ESCAPER_AUTO,
+  JSON_ESCAPER_SCALAR,
+  JSON_ESCAPER_SSE2,
+  JSON_ESCAPER_AVX2,
+};
+
+/**
+ * The most characters write_json_string can write for a string of the given
+ * length (every byte escaped as \u00XX, plus the quotes).
+ * @param length The length of the unescaped string.
+ */
+#define JSON_STRING_SIZE_BOUND(length) ((length) * 6 + 2)
+
+/**
+ * Writes a string as a quoted & escaped JSON string. Sets errno to ENOMEM when
+ * the buffer runs out of space. Does not null terminate.
+ * @param value The string to write. Need not be null terminated.
+ * @param length The length of the string.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maximum amount of characters the buffer can store.
+ * @returns The number of characters written or -1 if the buffer is too small.
+ */
+extern int write_json_string(const char *value, size_t length, char *buffer,
+                             size_t buffer_size);
+
+/**
+ * Picks how write_json_string scans for characters to escape. The fastest
+ * escaper the CPU supports is picked by default. Not thread safe: meant for
+ * startup & benchmarks.
+ * @param escaper The escaper to use.
+ * @returns 1 on success or 0 if the CPU does not support the escaper.
+ */
+extern int use_json_escaper(enum json_escaper escaper);
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * MessagePack encoding for the serializers. Every function writes a single
+ * value (or the header of a container) in its most compact form, does not null
+ * terminate & returns the number of bytes written, or -1 if the buffer is too
+ * small.
+ */
+#define MSGPACK_TIMESTAMP_EXT -1
+#define MAX_MSGPACK_SCALAR_SIZE 15
+
+extern int msgpack_write_nil(char *buffer, size_t buffer_size);
+
+extern int msgpack_write_bool(int value, char *buffer, size_t buffer_size);
+
+extern int msgpack_write_int(int64_t value, char *buffer, size_t buffer_size);
+
+extern int msgpack_write_float(float value, char *buffer, size_t buffer_size);
+
+extern int msgpack_write_double(double value, char *buffer,
+                                size_t buffer_size);
+
+/**
+ * Writes a UTF-8 string.
+ * @param value The string. Need not be null terminated.
+ * @param length The length of the string in bytes.
+ */
+extern int msgpack_write_str(const char *value, size_t length, char *buffer,
+                             size_t buffer_size);
+
+/**
+ * Writes the header of a UTF-8 string. The bytes of the string follow.
+ * @param length The length of the string in bytes.
+ */
+extern int msgpack_write_str_header(size_t length, char *buffer,
+                                    size_t buffer_size);
+
+/**
+ * Writes the header of an array. The elements follow as separate values.
+ * @param length The number of elements.
+ */
+extern int msgpack_write_array_header(uint32_t length, char *buffer,
+                                      size_t buffer_size);
+
+/**
+ * Writes the header of a map. The keys & values follow as separate values.
+ * @param length The number of key-value pairs.
+ */
+extern int msgpack_write_map_header(uint32_t length, char *buffer,
+                                    size_t buffer_size);
+
+/**
+ * Writes a timestamp extension value (type -1), picking the 32, 64 or 96 bit
+ * layout.
+ * @param seconds Seconds since 1970-01-01 UTC.
+ * @param nanoseconds Nanoseconds since the second, from 0 to 999999999.
+ */
+extern int msgpack_write_timestamp(int64_t seconds, uint32_t nanoseconds,
+                                   char *buffer, size_t buffer_size);
\ No newline at end of file
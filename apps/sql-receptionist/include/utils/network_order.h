@@ -0,0 +1,9 @@
+#include <stdint.h>
+
+/**
+ * Reads a big-endian (network order) integer, e.g. of a binary format result.
+ * @param value The bytes to read.
+ * @param size The size of the integer in bytes (at most 8).
+ * @returns The integer.
+ */
+extern uint64_t read_network_uint(const char *value, int size);
\ No newline at end of file
@@ -0,0 +1,11 @@
+#include "backend.h"
+#include <stdlib.h>
+#include <string.h>
+
+const struct backend *get_backend() {
+  const char *name = getenv("SQL_RECEPTIONIST_BACKEND");
+
+  if (name && strcmp(name, memory_backend.name) == 0)
+    return &memory_backend;
+  return &postgres_backend;
+}
\ No newline at end of file
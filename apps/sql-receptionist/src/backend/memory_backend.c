@@ -0,0 +1,667 @@
+#define _GNU_SOURCE // qsort_r
+#include "backend.h"
+#include "logging.h"
+#include "postgres/filter.h"
+#include "utils/format_number.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_MEMORY_TABLES 256
+#define MAX_MEMORY_TABLE_NAME_LENGTH 192
+#define MAX_MEMORY_DB_NAME_LENGTH 64
+#define INITIAL_ROWS_CAPACITY 64
+
+// type OIDs (pg_type.dat)
+#define BOOLOID 16
+#define INT4OID 23
+#define TEXTOID 25
+#define FLOAT4OID 700
+#define FLOAT8OID 701
+#define DATEOID 1082
+#define TIMEOID 1083
+#define TIMESTAMPOID 1114
+
+/**
+ * A table of the embedded store. Cells are kept in the text format Postgres
+ * would return them in, row-major with a stride of MAX_COLUMNS.
+ */
+struct memory_table {
+  char name[MAX_MEMORY_TABLE_NAME_LENGTH]; // "[database].[table]"
+  char *columns[MAX_COLUMNS];
+  int columns_count;
+  char **cells;
+  int rows_count;
+  int rows_capacity;
+  long long next_id;
+};
+
+struct memory_conn {
+  char dbname[MAX_MEMORY_DB_NAME_LENGTH];
+};
+
+static struct memory_table tables[MAX_MEMORY_TABLES];
+static int tables_count = 0;
+static pthread_rwlock_t tables_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Finds a table of the store.
+ * @param dbname The database name.
+ * @param table_name The table name.
+ * @param create Whether or not to create the table if it does not exist. The
+ * write lock must be held when creating tables.
+ * @returns The table, or NULL if it does not exist or the store is full.
+ */
+static struct memory_table *find_table(const char *dbname,
+                                       const char *table_name, int create) {
+  char name[MAX_MEMORY_TABLE_NAME_LENGTH];
+  snprintf(name, MAX_MEMORY_TABLE_NAME_LENGTH, "%s.%s", dbname, table_name);
+
+  for (int i = 0; i < tables_count; i++)
+    if (strcmp(tables[i].name, name) == 0)
+      return &tables[i];
+
+  if (!create || tables_count >= MAX_MEMORY_TABLES)
+    return NULL;
+
+  struct memory_table *table = &tables[tables_count++];
+  memcpy(table->name, name, MAX_MEMORY_TABLE_NAME_LENGTH);
+  table->next_id = 1;
+  return table;
+}
+
+/**
+ * @returns The index of the column in the table, or -1.
+ */
+static int find_column(const struct memory_table *table, const char *column) {
+  for (int i = 0; i < table->columns_count; i++)
+    if (strcmp(table->columns[i], column) == 0)
+      return i;
+  return -1;
+}
+
+/**
+ * Finds a column of the table, adding it if it does not exist yet.
+ * @returns The index of the column in the table, or -1 if the table is full.
+ */
+static int add_column(struct memory_table *table, const char *column) {
+  int index = find_column(table, column);
+  if (index >= 0)
+    return index;
+
+  if (table->columns_count >= MAX_COLUMNS)
+    return -1;
+  if (!(table->columns[table->columns_count] = strdup(column)))
+    return -1;
+  return table->columns_count++;
+}
+
+/**
+ * @returns The cell at the given position, or NULL.
+ */
+static const char *get_cell(const struct memory_table *table, int row,
+                            int column) {
+  return column < 0 ? NULL : table->cells[(size_t)row * MAX_COLUMNS + column];
+}
+
+/**
+ * @returns The Postgres type OID of a config.yml datatype.
+ */
+static Oid datatype_oid(const char *datatype) {
+  if (strcmp(datatype, "int") == 0 || strcmp(datatype, "integer") == 0)
+    return INT4OID;
+  if (strcmp(datatype, "float") == 0 || strcmp(datatype, "number") == 0)
+    return FLOAT4OID;
+  if (strcmp(datatype, "bool") == 0 || strcmp(datatype, "boolean") == 0)
+    return BOOLOID;
+  if (strcmp(datatype, "date") == 0)
+    return DATEOID;
+  if (strcmp(datatype, "time") == 0)
+    return TIMEOID;
+  if (strcmp(datatype, "timestamp") == 0)
+    return TIMESTAMPOID;
+  // strings, enums & geodetic points (ST_AsText)
+  return TEXTOID;
+}
+
+/**
+ * Finds the type of a column the way the Postgres tables are created.
+ * @param schema The schema of the table.
+ * @param schema_count The number of columns in the schema.
+ * @param column The column name, including sub-column suffixes.
+ * @returns The type OID of the column.
+ */
+static Oid column_oid(const struct data_column *schema,
+                      unsigned int schema_count, const char *column) {
+  if (strcmp(column, "id") == 0 || strcmp(column, "primary_tag") == 0)
+    return INT4OID;
+
+  for (unsigned int i = 0; i < schema_count; i++) {
+    size_t n = strlen(schema[i].name);
+    if (strncmp(column, schema[i].name, n) != 0)
+      continue;
+    if (column[n] == '\0')
+      return datatype_oid(schema[i].datatype);
+    if (strcmp(column + n, "_comments") == 0)
+      return TEXTOID;
+    if (strcmp(column + n, "_latlong_accuracy") == 0 ||
+        strcmp(column + n, "_altitude") == 0 ||
+        strcmp(column + n, "_altitude_accuracy") == 0)
+      return FLOAT8OID;
+  }
+  return TEXTOID;
+}
+
+/**
+ * Copies a value into the text format Postgres would output it in.
+ * @param value The value to copy.
+ * @param type The type OID of the value's column.
+ * @returns The copy, which must be freed.
+ */
+static char *copy_value(const char *value, Oid type) {
+  char buffer[MAX_NUMBER_STR_LENGTH + 1];
+  int n;
+
+  switch (type) {
+  case BOOLOID:
+    return strdup(*value == 't' ? "t" : "f");
+  case FLOAT4OID:
+    n = format_float(buffer, strtof(value, NULL));
+    break;
+  case FLOAT8OID:
+    n = format_double(buffer, strtod(value, NULL));
+    break;
+  default:
+    return strdup(value);
+  }
+
+  buffer[n] = '\0';
+  return strdup(buffer);
+}
+
+static void *memory_connect(const char *dbname, const char *min_lsn,
+                            int write) {
+  struct memory_conn *conn = malloc(sizeof(struct memory_conn));
+  if (!conn)
+    return NULL;
+
+  snprintf(conn->dbname, MAX_MEMORY_DB_NAME_LENGTH, "%s", dbname);
+  return conn;
+}
+
+static void memory_disconnect(void *conn) { free(conn); }
+
+struct sort_context {
+  const struct memory_table *table;
+  int column;
+  int id_column;
+  int descending;
+};
+
+/**
+ * Orders two cells, numerically when both are numbers. NULLs sort last, like
+ * they do in Postgres.
+ */
+static int compare_cells(const char *x, const char *y) {
+  char *x_end, *y_end;
+
+  if (!x || !y)
+    return (!x) - (!y);
+
+  double x_number = strtod(x, &x_end);
+  double y_number = strtod(y, &y_end);
+  if (*x && *y && !*x_end && !*y_end)
+    return (x_number > y_number) - (x_number < y_number);
+  return strcmp(x, y);
+}
+
+/**
+ * Orders a row after the sort column & then by ID, relative to the given
+ * values (e.g. those of a keyset cursor).
+ */
+static int compare_row(const struct sort_context *context, int row,
+                       const char *value, const char *id) {
+  int result =
+      compare_cells(get_cell(context->table, row, context->column), value);
+  if (!result && context->column != context->id_column)
+    result =
+        compare_cells(get_cell(context->table, row, context->id_column), id);
+  return context->descending ? -result : result;
+}
+
+static int compare_rows(const void *a, const void *b, void *arg) {
+  const struct sort_context *context = arg;
+  int y = *(const int *)b;
+  return compare_row(context, *(const int *)a,
+                     get_cell(context->table, y, context->column),
+                     get_cell(context->table, y, context->id_column));
+}
+
+/**
+ * Checks whether a cell is an element of an array literal, as
+ * parse_select_filter writes it (every element quoted).
+ */
+static int is_array_element(const char *cell, const char *array) {
+  char element[MAX_FILTER_VALUE_LENGTH];
+  const char *cur = array;
+
+  while ((cur = strchr(cur, '"'))) {
+    size_t length = 0;
+    for (cur++; *cur && *cur != '"'; cur++) {
+      if (*cur == '\\')
+        cur++;
+      if (length + 1 < sizeof(element))
+        element[length++] = *cur;
+    }
+    element[length] = '\0';
+    if (compare_cells(cell, element) == 0)
+      return 1;
+    if (*cur)
+      cur++;
+  }
+  return 0;
+}
+
+/**
+ * Checks a cell against a filter. Comparisons with NULL fail, like in SQL.
+ */
+static int matches_filter(const char *cell,
+                          const struct select_filter *filter) {
+  int result;
+
+  switch (filter->op) {
+  case FILTER_IS_NULL:
+    return !cell;
+  case FILTER_IS_NOT_NULL:
+    return cell != NULL;
+  case FILTER_IN:
+    return cell && is_array_element(cell, filter->value);
+  default:
+    break;
+  }
+
+  if (!cell)
+    return 0;
+  result = compare_cells(cell, filter->value);
+  switch (filter->op) {
+  case FILTER_LT:
+    return result < 0;
+  case FILTER_LTE:
+    return result <= 0;
+  case FILTER_GT:
+    return result > 0;
+  case FILTER_GTE:
+    return result >= 0;
+  default:
+    return result == 0;
+  }
+}
+
+/**
+ * Looks up the name of a tag for the primary_tag column.
+ * @returns The tag name or NULL.
+ */
+static const char *find_tag_name(const char *dbname,
+                                 struct select_options *options,
+                                 const char *tag_id) {
+  char tag_names_table[MAX_MEMORY_TABLE_NAME_LENGTH];
+  snprintf(tag_names_table, MAX_MEMORY_TABLE_NAME_LENGTH, "%s_tag_names",
+           options->table_name);
+
+  const struct memory_table *table = find_table(dbname, tag_names_table, 0);
+  if (!table || !tag_id)
+    return NULL;
+
+  int id_column = find_column(table, "id");
+  for (int row = 0; row < table->rows_count; row++) {
+    const char *id = get_cell(table, row, id_column);
+    if (id && strcmp(id, tag_id) == 0)
+      return get_cell(table, row, find_column(table, "tag_name"));
+  }
+  return NULL;
+}
+
+static ExecStatusType memory_select(void *connection,
+                                    struct select_options *options,
+                                    int result_format, PGresult **res) {
+  struct memory_conn *conn = connection;
+  PGresAttDesc attributes[MAX_COLUMNS];
+  char column_names[MAX_COLUMNS][MAX_INSERT_QUERY_SIZE / MAX_COLUMNS];
+  int columns_count = 0;
+  int *rows = NULL;
+  int rows_count = 0;
+
+  // aggregates & nested rows are left to Postgres
+  if (options->aggregate || options->expand) {
+    errno = ENOTSUP;
+    *res = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+
+  // the same columns as construct_select_query
+#define add_result_column(column_name, type)                                   \
+  do {                                                                         \
+    if (columns_count >= MAX_COLUMNS)                                          \
+      goto too_many_columns;                                                   \
+    snprintf(column_names[columns_count], sizeof(column_names[0]), "%s",       \
+             column_name);                                                     \
+    attributes[columns_count] = (PGresAttDesc){                                \
+        column_names[columns_count], 0, 0, 0, type, -1, -1};                   \
+    columns_count++;                                                           \
+  } while (0)
+
+  if (options->id_column)
+    add_result_column("id", INT4OID);
+  if (options->primary_tag)
+    add_result_column("primary_tag",
+                      options->transform_tag_names ? TEXTOID : INT4OID);
+  for (unsigned int i = 0; i < options->schema_count; i++) {
+    char child_name[sizeof(column_names[0])];
+    add_result_column(options->schema[i].name,
+                      datatype_oid(options->schema[i].datatype));
+    if (strcmp(options->schema[i].datatype, "geodetic point") == 0) {
+      snprintf(child_name, sizeof(child_name), "%s_latlong_accuracy",
+               options->schema[i].name);
+      add_result_column(child_name, FLOAT8OID);
+      snprintf(child_name, sizeof(child_name), "%s_altitude",
+               options->schema[i].name);
+      add_result_column(child_name, FLOAT8OID);
+      snprintf(child_name, sizeof(child_name), "%s_altitude_accuracy",
+               options->schema[i].name);
+      add_result_column(child_name, FLOAT8OID);
+    }
+    if (options->schema[i].comments) {
+      snprintf(child_name, sizeof(child_name), "%s_comments",
+               options->schema[i].name);
+      add_result_column(child_name, TEXTOID);
+    }
+  }
+#undef add_result_column
+
+  *res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+  if (!*res || !PQsetResultAttrs(*res, columns_count, attributes))
+    goto out_of_memory;
+
+  pthread_rwlock_rdlock(&tables_lock);
+  const struct memory_table *table =
+      find_table(conn->dbname, options->table_name, 0);
+  if (!table || !table->rows_count)
+    goto end;
+
+  rows = malloc(table->rows_count * sizeof(int));
+  if (!rows) {
+    pthread_rwlock_unlock(&tables_lock);
+    goto out_of_memory;
+  }
+
+  // ORDER BY (IDs break ties)
+  struct sort_context context = {
+      table, find_column(table, options->order_by_column),
+      find_column(table, "id"), strcmp(options->order_by_order, "DESC") == 0};
+
+  // WHERE
+  int filter_column = options->filter_column_name
+                          ? find_column(table, options->filter_column_name)
+                          : -1;
+  for (int row = 0; row < table->rows_count; row++) {
+    if (options->filter_column_name) {
+      const char *cell = get_cell(table, row, filter_column);
+      if (!cell || strcmp(cell, options->filter_value) != 0)
+        continue;
+    }
+    int matches = 1;
+    for (int i = 0; matches && i < options->filters_count; i++)
+      matches = matches_filter(
+          get_cell(table, row, find_column(table, options->filters[i].column)),
+          &options->filters[i]);
+    if (!matches)
+      continue;
+    // keyset pagination
+    if (options->after_id &&
+        compare_row(&context, row,
+                    context.column == context.id_column ? options->after_id
+                                                        : options->after_value,
+                    options->after_id) <= 0)
+      continue;
+    rows[rows_count++] = row;
+  }
+
+  qsort_r(rows, rows_count, sizeof(int), compare_rows, &context);
+
+  // OFFSET & LIMIT
+  int first = options->row_offset < rows_count ? options->row_offset
+                                               : rows_count;
+  int last = options->limit >= 0 && first + options->limit < rows_count
+                 ? first + options->limit
+                 : rows_count;
+
+  int table_columns[MAX_COLUMNS];
+  for (int i = 0; i < columns_count; i++)
+    table_columns[i] = find_column(table, column_names[i]);
+
+  for (int row = first; row < last; row++) {
+    for (int i = 0; i < columns_count; i++) {
+      const char *cell = get_cell(table, rows[row], table_columns[i]);
+      if (options->primary_tag && options->transform_tag_names &&
+          strcmp(column_names[i], "primary_tag") == 0)
+        cell = find_tag_name(conn->dbname, options, cell);
+      if (!PQsetvalue(*res, row - first, i, (char *)cell,
+                      cell ? strlen(cell) : -1)) {
+        pthread_rwlock_unlock(&tables_lock);
+        goto out_of_memory;
+      }
+    }
+  }
+
+end:
+  pthread_rwlock_unlock(&tables_lock);
+  free(rows);
+  return PGRES_TUPLES_OK;
+
+too_many_columns:
+  errno = ENOMEM;
+out_of_memory:
+  free(rows);
+  PQclear(*res);
+  *res = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+  return PGRES_FATAL_ERROR;
+}
+
+static ExecStatusType
+memory_select_stream(void *conn, struct select_options *options,
+                     int result_format,
+                     int (*on_rows)(const PGresult *rows, void *arg),
+                     void *arg, PGresult **res) {
+  // the rows are already in memory, so they are handed over in one batch
+  ExecStatusType status = memory_select(conn, options, result_format, res);
+  if (status == PGRES_TUPLES_OK && !on_rows(*res, arg))
+    return PGRES_FATAL_ERROR;
+  return status;
+}
+
+// the rows are counted as they are, so estimates are exact
+static ExecStatusType memory_count(void *conn, struct select_options *options,
+                                   enum select_count mode, long long *count,
+                                   PGresult **res) {
+  struct select_options count_options = *options;
+
+  count_select_options(&count_options, NULL);
+  ExecStatusType status = memory_select(conn, &count_options, 0, res);
+  if (status == PGRES_TUPLES_OK)
+    *count = PQntuples(*res);
+  return status;
+}
+
+/**
+ * Writes a CSV field, quoted like COPY does: NULLs are left empty while empty
+ * strings & values with delimiters, quotes or line breaks are quoted.
+ * @returns 1 on success, 0 if on_data failed.
+ */
+static int write_csv_field(const char *value,
+                           int (*on_data)(const char *data, size_t length,
+                                          void *arg),
+                           void *arg) {
+  if (!value)
+    return 1;
+  if (*value && !strpbrk(value, ",\"\r\n"))
+    return on_data(value, strlen(value), arg);
+
+  if (!on_data("\"", 1, arg))
+    return 0;
+  for (const char *quote; (quote = strchr(value, '"')); value = quote + 1) {
+    // quotes are doubled
+    if (!on_data(value, quote - value + 1, arg) || !on_data("\"", 1, arg))
+      return 0;
+  }
+  return on_data(value, strlen(value), arg) && on_data("\"", 1, arg);
+}
+
+static ExecStatusType
+memory_export_csv(void *conn, struct select_options *options,
+                  int (*on_data)(const char *data, size_t length, void *arg),
+                  void *arg, PGresult **res) {
+  ExecStatusType status = memory_select(conn, options, 0, res);
+  if (status != PGRES_TUPLES_OK)
+    return status;
+
+  for (int col_num = 0; col_num < PQnfields(*res); col_num++) {
+    if ((col_num && !on_data(",", 1, arg)) ||
+        !write_csv_field(PQfname(*res, col_num), on_data, arg))
+      return PGRES_FATAL_ERROR;
+  }
+  if (!on_data("\n", 1, arg))
+    return PGRES_FATAL_ERROR;
+
+  for (int row_num = 0; row_num < PQntuples(*res); row_num++) {
+    for (int col_num = 0; col_num < PQnfields(*res); col_num++) {
+      const char *value = PQgetisnull(*res, row_num, col_num)
+                              ? NULL
+                              : PQgetvalue(*res, row_num, col_num);
+      if ((col_num && !on_data(",", 1, arg)) ||
+          !write_csv_field(value, on_data, arg))
+        return PGRES_FATAL_ERROR;
+    }
+    if (!on_data("\n", 1, arg))
+      return PGRES_FATAL_ERROR;
+  }
+
+  return status;
+}
+
+static enum upsert_status memory_upsert(void *connection,
+                                        struct insert_options *options,
+                                        json_t *entry,
+                                        struct upsert_result *result) {
+  struct memory_conn *conn = connection;
+  struct prepared_insert prepared;
+  enum upsert_status status = UPSERT_QUERY_FAILED;
+  int columns[MAX_COLUMNS];
+  int row = -1;
+
+  *result->value = '\0';
+  *result->commit_lsn = '\0';
+  *result->error = '\0';
+
+  if (!prepare_insert(options, entry, &prepared, result->error)) {
+    if (errno) {
+      perror("INSERT query");
+      errno = 0;
+    }
+    return UPSERT_INVALID_ENTRY;
+  }
+
+  pthread_rwlock_wrlock(&tables_lock);
+  struct memory_table *table =
+      find_table(conn->dbname, options->table_name, 1);
+  if (!table) {
+    snprintf(result->error, ERROR_BUFFER_SIZE, "Too many tables.");
+    goto end;
+  }
+
+  for (int i = 0; i < prepared.n_params; i++) {
+    if ((columns[i] = add_column(table, prepared.columns[i])) < 0) {
+      snprintf(result->error, ERROR_BUFFER_SIZE, "Too many columns.");
+      goto end;
+    }
+  }
+  int primary_column = add_column(table, options->primary_column_name);
+  int duplicate_column = add_column(table, options->duplicate_column_name);
+  if (primary_column < 0 || duplicate_column < 0) {
+    snprintf(result->error, ERROR_BUFFER_SIZE, "Too many columns.");
+    goto end;
+  }
+
+  // ON CONFLICT ([duplicate column])
+  for (int i = 0; i < prepared.n_params; i++) {
+    if (columns[i] != duplicate_column || !prepared.values[i])
+      continue;
+    for (int r = 0; r < table->rows_count && row < 0; r++) {
+      const char *cell = get_cell(table, r, duplicate_column);
+      if (cell && strcmp(cell, prepared.values[i]) == 0)
+        row = r;
+    }
+  }
+
+  // new row
+  if (row < 0) {
+    if (table->rows_count == table->rows_capacity) {
+      int capacity = table->rows_capacity ? table->rows_capacity * 2
+                                          : INITIAL_ROWS_CAPACITY;
+      char **cells = realloc(table->cells,
+                             (size_t)capacity * MAX_COLUMNS * sizeof(char *));
+      if (!cells) {
+        snprintf(result->error, ERROR_BUFFER_SIZE, "Out of memory.");
+        goto end;
+      }
+      memset(cells + (size_t)table->rows_capacity * MAX_COLUMNS, 0,
+             (size_t)(capacity - table->rows_capacity) * MAX_COLUMNS *
+                 sizeof(char *));
+      table->cells = cells;
+      table->rows_capacity = capacity;
+    }
+    row = table->rows_count++;
+
+    // generated (serial) primary keys
+    if (!options->primary_column_in_schema) {
+      char id[MAX_NUMBER_STR_LENGTH + 1];
+      id[format_int(id, table->next_id)] = '\0';
+      table->cells[(size_t)row * MAX_COLUMNS + primary_column] = strdup(id);
+    }
+  }
+
+  // DO UPDATE SET every given column
+  for (int i = 0; i < prepared.n_params; i++) {
+    char **cell = &table->cells[(size_t)row * MAX_COLUMNS + columns[i]];
+    free(*cell);
+    *cell = prepared.values[i]
+                ? copy_value(prepared.values[i],
+                             column_oid(options->schema, options->schema_count,
+                                        prepared.columns[i]))
+                : NULL;
+  }
+
+  // keep generated ids ahead of explicitly given ones
+  const char *value = get_cell(table, row, primary_column);
+  if (!options->primary_column_in_schema && value &&
+      atoll(value) >= table->next_id)
+    table->next_id = atoll(value) + 1;
+
+  if (!value || strlen(value) >= MAX_SQL_RETURN_LENGTH) {
+    status = UPSERT_UNEXPECTED_RETURN;
+    goto end;
+  }
+  memcpy(result->value, value, strlen(value) + 1);
+  status = UPSERT_OK;
+
+end:
+  pthread_rwlock_unlock(&tables_lock);
+  return status;
+}
+
+const struct backend memory_backend = {
+    "memory",          memory_connect,       memory_disconnect,
+    memory_select,     memory_select_stream, memory_export_csv,
+    memory_count,      memory_upsert,
+};
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "backend.h"
+#include "logging.h"
+#include "postgres.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUERY_SIZE_LIMIT 65536
+
+static void *postgres_connect(const char *dbname, const char *min_lsn,
+                              int write) {
+  return write ? connect_db(dbname) : connect_db_for_read(dbname, min_lsn);
+}
+
+static void postgres_disconnect(void *conn) {
+  if (conn)
+    PQfinish(conn);
+}
+
+static ExecStatusType postgres_select(void *conn,
+                                      struct select_options *options,
+                                      int result_format, PGresult **res) {
+  char query[QUERY_SIZE_LIMIT];
+  const char *params[MAX_SELECT_PARAMS];
+
+  errno = 0;
+  construct_select_query(options, query, QUERY_SIZE_LIMIT);
+  if (errno) {
+    *res = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+
+  return sql_select(query, select_query_params(options, params), params,
+                    result_format, res, conn);
+}
+
+static ExecStatusType
+postgres_select_stream(void *conn, struct select_options *options,
+                       int result_format,
+                       int (*on_rows)(const PGresult *rows, void *arg),
+                       void *arg, PGresult **res) {
+  char query[QUERY_SIZE_LIMIT];
+  const char *params[MAX_SELECT_PARAMS];
+
+  errno = 0;
+  construct_select_query(options, query, QUERY_SIZE_LIMIT);
+  if (errno) {
+    *res = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+
+  ExecStatusType status = sql_select_stream(
+      query, select_query_params(options, params), params, result_format,
+      on_rows, arg, res, conn);
+  if (!*res)
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+  return status;
+}
+
+static ExecStatusType
+postgres_export_csv(void *conn, struct select_options *options,
+                    int (*on_data)(const char *data, size_t length, void *arg),
+                    void *arg, PGresult **res) {
+  char query[QUERY_SIZE_LIMIT];
+
+  errno = 0;
+  construct_copy_query(options, query, QUERY_SIZE_LIMIT);
+  if (errno) {
+    *res = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+
+  return sql_copy_out(query, on_data, arg, res, conn);
+}
+
+static ExecStatusType postgres_count(void *conn,
+                                     struct select_options *options,
+                                     enum select_count mode, long long *count,
+                                     PGresult **res) {
+  char query[QUERY_SIZE_LIMIT];
+  const char *params[MAX_SELECT_PARAMS];
+  struct select_options count_options = *options;
+  struct select_aggregate aggregate;
+  int estimate = mode == SELECT_COUNT_ESTIMATE;
+  // the estimate is the row count of the plan's top node, e.g.
+  // "Seq Scan on t  (cost=0.00..35.50 rows=2550 width=36)"
+  size_t prefix_length = estimate ? strlen("EXPLAIN ") : 0;
+  const char *rows;
+
+  count_select_options(&count_options, estimate ? NULL : &aggregate);
+  memcpy(query, "EXPLAIN ", prefix_length);
+  errno = 0;
+  construct_select_query(&count_options, query + prefix_length,
+                         QUERY_SIZE_LIMIT - prefix_length);
+  if (errno) {
+    *res = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+
+  ExecStatusType status =
+      sql_select(query, select_query_params(&count_options, params), params, 0,
+                 res, conn);
+  if (status != PGRES_TUPLES_OK)
+    return status;
+  if (PQntuples(*res) < 1) {
+    PQclear(*res);
+    *res = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+
+  if (!estimate) {
+    *count = atoll(PQgetvalue(*res, 0, 0));
+  } else if ((rows = strstr(PQgetvalue(*res, 0, 0), " rows="))) {
+    *count = atoll(rows + strlen(" rows="));
+  } else {
+    PQclear(*res);
+    *res = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+  return status;
+}
+
+/**
+ * Writes the status & error message of a failed query into the result.
+ * @param result The result to write to.
+ * @param status The status of the failed query.
+ * @param res The failed query's result, or NULL.
+ * @param conn The connection the query ran on.
+ */
+static void write_query_error(struct upsert_result *result,
+                              ExecStatusType status, const PGresult *res,
+                              PGconn *conn) {
+  snprintf(result->error, ERROR_BUFFER_SIZE, "%s: %s", PQresStatus(status),
+           res ? PQresultErrorMessage(res) : PQerrorMessage(conn));
+}
+
+static enum upsert_status postgres_upsert(void *connection,
+                                          struct insert_options *options,
+                                          json_t *entry,
+                                          struct upsert_result *result) {
+  PGconn *conn = connection;
+  PGresult *res = NULL;
+  ExecStatusType sql_query_status = PGRES_FATAL_ERROR;
+  enum upsert_status status = UPSERT_QUERY_FAILED;
+  const char *temp_value = NULL;
+
+  *result->value = '\0';
+  *result->commit_lsn = '\0';
+  *result->error = '\0';
+
+  // BEGIN, the INSERT and COMMIT are pipelined so that the whole transaction
+  // costs a single round trip. The WAL position after the COMMIT is handed
+  // back to the client so that its next read can wait for a replica to catch
+  // up.
+  if (PQstatus(conn) != CONNECTION_OK || !PQenterPipelineMode(conn) ||
+      !sql_pipeline_send(conn, "BEGIN;", 0, NULL) ||
+      !sql_pipeline_send_timeout(conn)) {
+    write_query_error(result, sql_query_status, NULL, conn);
+    return UPSERT_QUERY_FAILED;
+  }
+
+  switch (validate_and_insert_into(options, entry, conn, result->error)) {
+  case 0:
+    if (errno) {
+      perror("INSERT query");
+      errno = 0;
+    }
+    return UPSERT_INVALID_ENTRY;
+  case 1:
+    break;
+  default:
+    return UPSERT_PREPARE_FAILED;
+  }
+
+  // other instances drop their cached responses once the upsert commits
+  const char *notify_params[2] = {
+      options->notify_channel,
+      options->notify_payload ? options->notify_payload : ""};
+  if (options->notify_channel &&
+      !sql_pipeline_send(conn, "SELECT pg_notify($1, $2);", 2,
+                         notify_params)) {
+    write_query_error(result, sql_query_status, NULL, conn);
+    return UPSERT_QUERY_FAILED;
+  }
+
+  if (!sql_pipeline_send(conn, "COMMIT;", 0, NULL) ||
+      !sql_pipeline_send(conn, "SELECT pg_current_wal_lsn();", 0, NULL) ||
+      !sql_pipeline_sync(conn)) {
+    write_query_error(result, sql_query_status, NULL, conn);
+    return UPSERT_QUERY_FAILED;
+  }
+
+  // BEGIN & SET LOCAL statement_timeout
+  for (int i = 0; i < 2; i++) {
+    res = sql_pipeline_result(conn);
+    if (!res || (sql_query_status = PQresultStatus(res)) != PGRES_COMMAND_OK)
+      goto query_failed;
+    PQclear(res);
+  }
+
+  // INSERT
+  res = sql_pipeline_result(conn);
+  if (!res || (sql_query_status = PQresultStatus(res)) != PGRES_TUPLES_OK)
+    goto query_failed;
+  if (PQntuples(res) != 1 || PQnfields(res) != 1 ||
+      !(temp_value = PQgetvalue(res, 0, 0)) ||
+      strlen(temp_value) >= MAX_SQL_RETURN_LENGTH) {
+    status = UPSERT_UNEXPECTED_RETURN;
+    goto end;
+  }
+  memcpy(result->value, temp_value, strlen(temp_value) + 1);
+  PQclear(res);
+
+  // NOTIFY
+  if (options->notify_channel) {
+    res = sql_pipeline_result(conn);
+    if (!res || (sql_query_status = PQresultStatus(res)) != PGRES_TUPLES_OK)
+      goto query_failed;
+    PQclear(res);
+  }
+
+  // COMMIT
+  res = sql_pipeline_result(conn);
+  if (!res || (sql_query_status = PQresultStatus(res)) != PGRES_COMMAND_OK)
+    goto query_failed;
+  PQclear(res);
+
+  // the commit LSN, which is only a hint for later reads
+  res = sql_pipeline_result(conn);
+  if (res && PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1 &&
+      is_valid_lsn(PQgetvalue(res, 0, 0)))
+    strcpy(result->commit_lsn, PQgetvalue(res, 0, 0));
+  status = UPSERT_OK;
+  goto end;
+
+query_failed:
+  write_query_error(result, sql_query_status, res, conn);
+  log_debug_printf("Database INSERT error: %s\n", result->error);
+  status = UPSERT_QUERY_FAILED;
+
+end:
+  PQclear(res);
+  return status;
+}
+
+const struct backend postgres_backend = {
+    "postgres",          postgres_connect,       postgres_disconnect,
+    postgres_select,     postgres_select_stream, postgres_export_csv,
+    postgres_count,      postgres_upsert,
+};
\ No newline at end of file
@@ -22,6 +22,9 @@ static const cyaml_schema_field_t data_column_fields_schema[] = {
 
     CYAML_FIELD_STRING_PTR("entrytype", CYAML_FLAG_POINTER, struct data_column,
                            entrytype, 0, CYAML_UNLIMITED),
+
+    CYAML_FIELD_BOOL("indexed", CYAML_FLAG_OPTIONAL, struct data_column,
+                     indexed),
     CYAML_FIELD_END};
 
 static const cyaml_schema_value_t data_column_schema = {
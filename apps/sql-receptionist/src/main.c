@@ -11,13 +11,25 @@
 #define HEADER_CONFIG
 #include "config.h"
 #endif
+#include "backend.h"
 #include "logging.h"
 #include "postgres.h"
-#include "postgres/insert.h"
-#include "postgres/select.h"
+#include "postgres/aggregate.h"
+#include "postgres/cursor.h"
+#include "postgres/filter.h"
+#include "postgres/notify.h"
+#include "postgres/select_arrow.h"
+#include "server/batch.h"
+#include "server/cache.h"
+#include "server/metrics.h"
 #include "server/responses.h"
+#include "server/singleflight.h"
+#include "server/stream.h"
+#include "server/tag_dictionary.h"
+#include "utils/clock.h"
 #include "utils/format_string.h"
 #include "utils/http.h"
+#include "utils/msgpack.h"
 #include "utils/regex_item.h"
 #include "utils/regex_iterator.h"
 #include <arpa/inet.h>
@@ -28,6 +40,7 @@
 #include <fcntl.h>
 #include <jansson.h>
 #include <libpq-fe.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <regex.h>
@@ -37,6 +50,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -49,7 +63,12 @@
 #define MAX_REGEX_MATCHES 25
 #define NUM_DATATYPES_KEYS 1
 #define MAX_PASSWORD_LENGTH 255
-#define QUERY_SIZE_LIMIT 65536
+#define DEFAULT_REQUEST_TIMEOUT_MS 30000
+#define DEFAULT_EXPORT_TIMEOUT_MS 3600000
+#define MAX_LSN_HEADERS_LENGTH 256
+#define MAX_COLUMNS_LENGTH 1024
+#define MAX_TOTAL_COUNT_HEADERS_LENGTH 128
+#define MIN_LSN_COOKIE_MAX_AGE 60 // seconds
 
 int done;
 void handle_sigterm(int signal_num) {
@@ -90,56 +109,768 @@ static struct data_column tag_groups_schema[] = {
 static int tag_groups_schema_count = 2;
 
 /**
- * Attempts to query the database and builds a response based on the query.
- * Expects the query to be a SELECT query. @TODO optimize by finding the columns
- * before-hand
+ * Where the response to a SELECT request goes in the cache & who else waits
+ * for it.
+ */
+struct select_cache_slot {
+  char key[MAX_CACHE_KEY_LENGTH];
+  const char *database;
+  /**
+   * @param table The config table the request reads from.
+   */
+  const char *table;
+  /**
+   * @param generation The generation of the table before the query ran.
+   */
+  unsigned long long generation;
+  /**
+   * @param flight The flight the request leads (see flight_join), or NULL once
+   * it landed.
+   */
+  struct flight *flight;
+};
+
+struct select_stream_context {
+  struct response_stream *stream;
+  int serialize_flags;
+  enum select_format format;
+  struct select_plan *plan;
+  int rows_written;
+  struct arrow_writer *arrow;
+  /**
+   * @param tag_names The names to write for the primary tag IDs, or NULL.
+   */
+  struct tag_names *tag_names;
+  /**
+   * @param options The options of the query. The response carries the cursor
+   * of the next page if next_cursor is set.
+   */
+  const struct select_options *options;
+  /**
+   * @param headers Additional header lines for the response (see
+   * stream_start).
+   */
+  const char *headers;
+  /**
+   * @param next The cursor of the last row sent (see write_cursor).
+   */
+  char next[MAX_CURSOR_LENGTH];
+  int next_length;
+};
+
+/**
+ * Builds the serialization plan of a result into the context.
+ * @returns 1 on success, 0 on failure.
+ */
+static int plan_select(struct select_stream_context *context,
+                       const PGresult *res) {
+  context->plan = create_select_plan(res, context->serialize_flags);
+  if (!context->plan)
+    return 0;
+  if (context->tag_names)
+    substitute_tag_names(context->plan, res, context->tag_names);
+  return 1;
+}
+
+/**
+ * Remembers the cursor of the last row of a batch, since the batch may be gone
+ * by the time the response is closed out.
+ * @returns 1 on success, 0 if the row does not fit into a cursor.
+ */
+static int remember_next_cursor(struct select_stream_context *context,
+                                const PGresult *rows) {
+  int rows_count = PQntuples(rows);
+
+  if (!context->options->next_cursor || !rows_count)
+    return 1;
+  context->next_length = write_cursor(context->options, rows, rows_count - 1,
+                                      context->next, sizeof(context->next));
+  return context->next_length > 0;
+}
+
+/**
+ * Serializes the "next" member of a response (JSON or MessagePack): the cursor
+ * of the next page, or null on the last page, i.e. when fewer rows than the
+ * limit were sent.
+ * @param context The select_stream_context.
+ * @param rows_count The number of rows sent.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maxmimum amount of characters the buffer can store.
+ * @returns the length written or -1 if the buffer is too small.
+ */
+static int serialize_next_cursor(const struct select_stream_context *context,
+                                 int rows_count, char *buffer,
+                                 size_t buffer_size) {
+  int last_page = context->options->limit < 0 ||
+                  rows_count < context->options->limit ||
+                  !context->next_length;
+
+  if (context->format == SELECT_FORMAT_MSGPACK) {
+    int key = msgpack_write_str("next", strlen("next"), buffer, buffer_size);
+    if (key < 0)
+      return -1;
+    int value = last_page ? msgpack_write_nil(buffer + key, buffer_size - key)
+                          : msgpack_write_str(context->next,
+                                              context->next_length,
+                                              buffer + key, buffer_size - key);
+    return value < 0 ? -1 : key + value;
+  }
+
+  // cursors are base64url & need no escaping
+  int n = last_page ? snprintf(buffer, buffer_size, "\"next\":null")
+                    : snprintf(buffer, buffer_size, "\"next\":\"%.*s\"",
+                               context->next_length, context->next);
+  return n < 0 || n >= buffer_size ? -1 : n;
+}
+
+/**
+ * Serializes into the stream's buffer, sending the buffered data first if the
+ * serialized text does not fit. Text larger than a chunk is serialized into a
+ * temporary buffer, which grows until the text fits, & sent over several
+ * chunks.
+ * @returns 1 on success, 0 if there is no memory for the text or if sending
+ * failed.
+ */
+#define stream_serialize(stream, serialize_call)                               \
+  ({                                                                           \
+    char *buffer = stream_space(stream);                                       \
+    size_t buffer_size = stream_space_left(stream);                            \
+    int written = serialize_call;                                              \
+    if (written < 0 && stream_flush(stream)) {                                 \
+      errno = 0;                                                               \
+      buffer = stream_space(stream);                                           \
+      buffer_size = stream_space_left(stream);                                 \
+      written = serialize_call;                                                \
+    }                                                                          \
+    int serialized = written >= 0;                                             \
+    if (serialized) {                                                          \
+      stream_advance(stream, written);                                         \
+    } else if (!stream->failed) {                                              \
+      char *large = NULL;                                                      \
+      for (buffer_size = 2 * STREAM_CHUNK_SIZE;                                \
+           written < 0 && buffer_size <= INT_MAX; buffer_size *= 2) {          \
+        free(large);                                                           \
+        if (!(large = buffer = malloc(buffer_size)))                           \
+          break;                                                               \
+        errno = 0;                                                             \
+        written = serialize_call;                                              \
+      }                                                                        \
+      serialized = written >= 0 && stream_write(stream, large, written);       \
+      free(large);                                                             \
+    }                                                                          \
+    serialized;                                                                \
+  })
+
+/**
+ * Sends a batch of rows of a SELECT query to the client. The headers & column
+ * names are sent with the first batch.
+ * @param rows The rows to send.
+ * @param arg The select_stream_context.
+ * @returns 1 to continue, 0 to cancel the query.
+ */
+static int stream_select_rows(const PGresult *rows, void *arg) {
+  struct select_stream_context *context = arg;
+  struct response_stream *stream = context->stream;
+
+  if (!context->plan && !plan_select(context, rows))
+    goto failed;
+
+  if (!stream->started && context->format == SELECT_FORMAT_NDJSON) {
+    if (!stream_start(stream, 200, "application/x-ndjson",
+                      context->headers) ||
+        !stream_serialize(stream, serialize_select_ndjson_header(
+                                      rows, buffer, buffer_size)))
+      goto failed;
+  } else if (!stream->started) {
+    if (!stream_start(stream, 200, "text/plain", context->headers) ||
+        !stream_serialize(stream, serialize_select_columns(rows, buffer,
+                                                           buffer_size)))
+      goto failed;
+  }
+
+  for (int row_num = 0; row_num < PQntuples(rows); row_num++) {
+    // rows are separated by commas, or terminated by newlines in NDJSON
+    if (context->rows_written++ && context->format != SELECT_FORMAT_NDJSON &&
+        !stream_write(stream, ",", 1))
+      goto failed;
+    if (!stream_serialize(stream,
+                          serialize_select_row(rows, context->plan, row_num,
+                                               buffer, buffer_size)))
+      goto failed;
+    if (context->format == SELECT_FORMAT_NDJSON &&
+        !stream_write(stream, "\n", 1))
+      goto failed;
+  }
+
+  if (!remember_next_cursor(context, rows))
+    goto failed;
+
+  // rows trickling in from a slow query still reach the client
+  if (!stream_flush_if_due(stream))
+    goto failed;
+
+  return 1;
+
+failed:
+  errno = 0;
+  return 0;
+}
+
+/**
+ * Sends a whole SELECT result to the client in the columnar layout, walking it
+ * column by column. Constant columns are written once.
+ * @param context The select_stream_context.
+ * @param res The result to send.
+ * @returns 1 on success, 0 on failure.
+ */
+static int stream_select_columnar(struct select_stream_context *context,
+                                  const PGresult *res) {
+  struct response_stream *stream = context->stream;
+
+  if (!plan_select(context, res))
+    goto failed;
+
+  if (!stream_start(stream, 200, "text/plain", context->headers) ||
+      !stream_serialize(stream, serialize_select_columnar_start(res, buffer,
+                                                                buffer_size)))
+    goto failed;
+
+  for (int col_num = 0; col_num < PQnfields(res); col_num++) {
+    int constant = select_column_is_constant(res, col_num);
+    if (!stream_serialize(stream, serialize_select_column_start(
+                                      res, context->plan, col_num, constant,
+                                      buffer, buffer_size)))
+      goto failed;
+    if (constant)
+      continue;
+
+    for (int row_num = 0; row_num < PQntuples(res); row_num++) {
+      if (row_num && !stream_write(stream, ",", 1))
+        goto failed;
+      if (!stream_serialize(stream,
+                            serialize_select_value(res, context->plan, row_num,
+                                                   col_num, buffer,
+                                                   buffer_size)))
+        goto failed;
+    }
+    if (!stream_write(stream, "]", 1))
+      goto failed;
+  }
+
+  if (!stream_write(stream, "}", 1))
+    goto failed;
+  if (context->options->next_cursor &&
+      (!remember_next_cursor(context, res) || !stream_write(stream, ",", 1) ||
+       !stream_serialize(stream,
+                         serialize_next_cursor(context, PQntuples(res), buffer,
+                                               buffer_size))))
+    goto failed;
+
+  return stream_write(stream, "}", 1);
+
+failed:
+  errno = 0;
+  return 0;
+}
+
+/**
+ * Sends a whole SELECT result to the client as MessagePack.
+ * @param context The select_stream_context. SERIALIZE_MSGPACK must be set.
+ * @param res The result to send.
+ * @returns 1 on success, 0 on failure.
+ */
+static int stream_select_msgpack(struct select_stream_context *context,
+                                 const PGresult *res) {
+  struct response_stream *stream = context->stream;
+
+  if (!plan_select(context, res))
+    goto failed;
+
+  if (!stream_start(stream, 200, "application/msgpack", context->headers) ||
+      !stream_serialize(stream, serialize_select_msgpack_start(
+                                    res, context->options->next_cursor, buffer,
+                                    buffer_size)))
+    goto failed;
+
+  for (int row_num = 0; row_num < PQntuples(res); row_num++) {
+    if (!stream_serialize(stream,
+                          serialize_select_row(res, context->plan, row_num,
+                                               buffer, buffer_size)))
+      goto failed;
+  }
+
+  if (context->options->next_cursor &&
+      (!remember_next_cursor(context, res) ||
+       !stream_serialize(stream,
+                         serialize_next_cursor(context, PQntuples(res), buffer,
+                                               buffer_size))))
+    goto failed;
+
+  return 1;
+
+failed:
+  errno = 0;
+  return 0;
+}
+
+/**
+ * Closes out a streamed JSON (ROWS) or NDJSON response, adding the cursor of
+ * the next page if requested.
+ * @param context The select_stream_context.
+ * @returns 1 on success, 0 on failure.
+ */
+static int stream_select_rows_finish(struct select_stream_context *context) {
+  struct response_stream *stream = context->stream;
+  int ndjson = context->format == SELECT_FORMAT_NDJSON;
+
+  if (!context->options->next_cursor)
+    return ndjson || stream_write(stream, "]}", 2); // close out the JSON
+
+  if (!stream_write(stream, ndjson ? "{" : "],", ndjson ? 1 : 2) ||
+      !stream_serialize(stream,
+                        serialize_next_cursor(context, context->rows_written,
+                                              buffer, buffer_size)))
+    goto failed;
+  return stream_write(stream, ndjson ? "}\n" : "}", ndjson ? 2 : 1);
+
+failed:
+  errno = 0;
+  return 0;
+}
+
+/**
+ * Writes Arrow IPC bytes to the response stream (an arrow_sink).
+ * @param arg The response_stream.
+ */
+static int arrow_stream_sink(const char *data, size_t length, void *arg) {
+  return stream_write(arg, data, length);
+}
+
+/**
+ * Sends a batch of rows of a SELECT query to the client as Arrow record
+ * batches. The headers & the schema are sent with the first batch.
+ * @param rows The rows to send.
+ * @param arg The select_stream_context. Its arrow writer must be set.
+ * @returns 1 to continue, 0 to cancel the query.
+ */
+static int stream_select_arrow(const PGresult *rows, void *arg) {
+  struct select_stream_context *context = arg;
+  struct response_stream *stream = context->stream;
+
+  if (!stream->started &&
+      !stream_start(stream, 200, "application/vnd.apache.arrow.stream",
+                    context->headers))
+    goto failed;
+
+  if (!arrow_write_rows(context->arrow, rows) || !stream_flush_if_due(stream))
+    goto failed;
+
+  return 1;
+
+failed:
+  errno = 0;
+  return 0;
+}
+
+/**
+ * Caches the response a stream wrote as a regular (Content-Length) response &
+ * shares it with the requests waiting on its flight.
+ * @param stream The stream, whose whole body was written & copied (see
+ * stream_capture). It may still hold the body back from its own client (see
+ * stream_hold).
+ * @param cache_slot Where to cache the response.
+ */
+static void share_stream(struct response_stream *stream,
+                         struct select_cache_slot *cache_slot) {
+  char *response = NULL;
+  size_t response_len;
+  size_t body_len;
+  const char *body = stream_body(stream, &body_len);
+
+  if (!body)
+    return;
+
+  build_response_with_body(200, &response, &response_len,
+                           stream->content_type, stream->headers, body,
+                           body_len);
+  if (response)
+    cache_put(cache_slot->key, cache_slot->database, cache_slot->table,
+              cache_slot->generation, response, response_len);
+  // the flight takes ownership of the response
+  flight_land(cache_slot->flight, response, response_len);
+  cache_slot->flight = NULL;
+}
+
+/**
+ * Counts the rows a SELECT query matches across every page. Failures are
+ * written into the response.
+ * @param options The SELECT query whose rows to count.
+ * @param mode SELECT_COUNT_EXACT or SELECT_COUNT_ESTIMATE.
+ * @param count The output to store the count in.
+ * @param res The response variable to pass into the backend's count
+ * @param conn The open backend connection to use.
+ * @param response The response variable to pass into build_response... .
+ * @param response_len The response length variable to pass into
+ * build_response... .
+ * @returns 1 on success, 0 if the response was written.
+ */
+static int count_and_report(struct select_options *options,
+                            enum select_count mode, long long *count,
+                            PGresult **res, void *conn, char **response,
+                            size_t *response_len) {
+  ExecStatusType sql_query_status =
+      get_backend()->count(conn, options, mode, count, res);
+  if (errno) {
+    perror("Data table count query construction");
+    build_response(500, response, response_len,
+                   "Server-side count query construction failure.");
+    errno = 0;
+    return 0;
+  }
+
+  if (sql_query_status != PGRES_TUPLES_OK) {
+    build_response_printf(500, response, response_len,
+                          strlen(PQresStatus(sql_query_status)) + 2 +
+                              strlen(PQresultErrorMessage(*res)) + 1,
+                          "%s: %s", PQresStatus(sql_query_status),
+                          PQresultErrorMessage(*res));
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Counts the rows a SELECT query matches & responds with
+ * {"count":n,"estimate":true|false}.
  * @param database_name The target database's name.
- * @param query The query to execute.
- * @param res The response variable to pass into sql_query
- * @param conn The connection to pass into sql_query
+ * @param min_lsn The LSN a replica must have replayed to serve the query, or
+ * NULL.
+ * @param options The SELECT query whose rows to count.
+ * @param mode SELECT_COUNT_EXACT or SELECT_COUNT_ESTIMATE.
+ * @param res The response variable to pass into the backend's count
+ * @param conn The backend connection to use (opened if NULL)
  * @param response The response variable to pass into build_response... .
  * @param response_len The response length variable to pass into
  * build_response... .
  */
-void generic_select_query_and_respond(const char *database_name, char *query,
-                                      PGresult **res, PGconn **conn,
-                                      char **response, size_t *response_len) {
+void count_and_respond(const char *database_name, const char *min_lsn,
+                       struct select_options *options, enum select_count mode,
+                       PGresult **res, void **conn, char **response,
+                       size_t *response_len) {
+  char body[MAX_TOTAL_COUNT_HEADERS_LENGTH];
+  long long count;
+
+  if (!*conn)
+    *conn = get_backend()->connect(database_name, min_lsn, 0);
+
+  // the database is unreachable (or its circuit breaker is open)
+  if (!*conn) {
+    build_unavailable_response(response, response_len);
+    return;
+  }
+
+  if (!count_and_report(options, mode, &count, res, *conn, response,
+                        response_len))
+    return;
+
+  int n = snprintf(body, MAX_TOTAL_COUNT_HEADERS_LENGTH,
+                   "{\"count\":%lld,\"estimate\":%s}", count,
+                   mode == SELECT_COUNT_ESTIMATE ? "true" : "false");
+  build_response_with_body(200, response, response_len, "application/json", "",
+                           body, n);
+}
+
+/**
+ * Attempts to query the database and streams the result to the client
+ * (Transfer-Encoding: chunked). Rows are sent as they arrive; the columnar &
+ * MessagePack layouts need the whole result first. Errors that happen before
+ * anything was sent are returned as a regular response instead.
+ * @TODO optimize by finding the columns before-hand
+ * @param database_name The target database's name.
+ * @param min_lsn The LSN a replica must have replayed to serve the query, or
+ * NULL.
+ * @param options The SELECT query to run.
+ * @param serialize_flags SERIALIZE_* flags for create_select_plan. Epoch
+ * timestamps require binary results.
+ * @param format The layout of the result.
+ * @param total_count How to count the rows the query matches across every page
+ * for the X-Total-Count header, or SELECT_COUNT_NONE to leave it out.
+ * @param tag_names The names to write for the primary tag IDs (see
+ * substitute_tag_names), or NULL.
+ * @param client_fd The client socket to stream the rows to.
+ * @param deadline_ms The request deadline (see monotonic_ms).
+ * @param res The response variable to pass into the backend's select
+ * @param conn The backend connection to use (opened if NULL)
+ * @param response The response variable to pass into build_response... . Left
+ * NULL if the response was streamed.
+ * @param response_len The response length variable to pass into
+ * build_response... .
+ * @param cache_slot Where to cache & share the response, or NULL to do
+ * neither. Its flight is left for the caller to land if the response was not
+ * shared.
+ */
+void generic_select_query_and_respond(
+    const char *database_name, const char *min_lsn,
+    struct select_options *options, int serialize_flags,
+    enum select_format format, enum select_count total_count,
+    struct tag_names *tag_names, int client_fd, long long deadline_ms,
+    PGresult **res, void **conn, char **response, size_t *response_len,
+    struct select_cache_slot *cache_slot) {
+  char headers[MAX_TOTAL_COUNT_HEADERS_LENGTH] = "";
+  // binary results skip Postgres' text formatting & are decoded in process.
+  // MessagePack & Arrow need them to encode numbers & timestamps natively
+  if (format == SELECT_FORMAT_MSGPACK)
+    serialize_flags |= SERIALIZE_MSGPACK;
+  int result_format =
+      (serialize_flags & (SERIALIZE_EPOCH_TIMESTAMPS | SERIALIZE_MSGPACK)) ||
+      format == SELECT_FORMAT_ARROW ||
+      (getenv("SQL_RECEPTIONIST_BINARY_RESULTS") &&
+       strcmp(getenv("SQL_RECEPTIONIST_BINARY_RESULTS"), "TRUE") == 0);
 
   if (!*conn)
-    *conn = connect_db(database_name);
+    *conn = get_backend()->connect(database_name, min_lsn, 0);
+
+  // the database is unreachable (or its circuit breaker is open)
+  if (!*conn) {
+    build_unavailable_response(response, response_len);
+    return;
+  }
+
+  // the count runs first, since the headers go out with the first rows
+  if (total_count != SELECT_COUNT_NONE) {
+    long long count;
+    if (!count_and_report(options, total_count, &count, res, *conn, response,
+                          response_len))
+      return;
+    PQclear(*res);
+    *res = NULL;
+    snprintf(headers, MAX_TOTAL_COUNT_HEADERS_LENGTH,
+             "X-Total-Count: %lld\r\n"
+             "Access-Control-Expose-Headers: X-Total-Count\r\n",
+             count);
+  }
+
+  struct response_stream *stream = malloc(sizeof(struct response_stream));
+  if (!stream) {
+    build_response(500, response, response_len, "No memory.");
+    return;
+  }
+  stream_init(stream, client_fd, deadline_ms);
+  if (cache_slot) {
+    size_t capture_limit = cache_max_entry_size();
+    if (cache_slot->flight && capture_limit < SINGLEFLIGHT_MAX_RESPONSE_SIZE)
+      capture_limit = SINGLEFLIGHT_MAX_RESPONSE_SIZE;
+    stream_capture(stream, capture_limit);
+    // the followers get the body without waiting for this request's client
+    if (cache_slot->flight)
+      stream_hold(stream);
+  }
+  struct select_stream_context context = {
+      stream, serialize_flags, format, NULL, 0, NULL, tag_names, options,
+      headers};
+
+  ExecStatusType sql_query_status;
+  if (format == SELECT_FORMAT_ARROW) {
+    context.arrow = create_arrow_writer(options, arrow_stream_sink, stream);
+    if (!context.arrow) {
+      build_response(500, response, response_len, "No memory.");
+      errno = 0;
+      goto end;
+    }
+    sql_query_status = get_backend()->select_stream(
+        *conn, options, result_format, stream_select_arrow, &context, res);
+  } else if (format == SELECT_FORMAT_COLUMNAR ||
+             format == SELECT_FORMAT_MSGPACK)
+    sql_query_status =
+        get_backend()->select(*conn, options, result_format, res);
+  else
+    sql_query_status = get_backend()->select_stream(
+        *conn, options, result_format, stream_select_rows, &context, res);
+  if (errno) {
+    perror("Data table SELECT query construction");
+    build_response(500, response, response_len,
+                   "Server-side SELECT query construction failure.");
+    errno = 0;
+    goto end;
+  }
 
-  ExecStatusType sql_query_status = sql_query(query, res, *conn);
   if (sql_query_status != PGRES_TUPLES_OK &&
       sql_query_status != PGRES_COMMAND_OK) { // if the query is not successful,
+    // the status line is already out, so the body is cut short instead
+    if (stream->started) {
+      log_error_printf("SELECT query failed mid-stream: %s",
+                       PQresultErrorMessage(*res));
+      goto end;
+    }
     build_response_printf(500, response, response_len,
                           strlen(PQresStatus(sql_query_status)) + 2 +
-                              strlen(PQerrorMessage(*conn)) + 1,
+                              strlen(PQresultErrorMessage(*res)) + 1,
                           "%s: %s", PQresStatus(sql_query_status),
-                          PQerrorMessage(*conn));
+                          PQresultErrorMessage(*res));
+    goto end;
+  }
+
+  int written;
+  if (format == SELECT_FORMAT_COLUMNAR) {
+    written = stream_select_columnar(&context, *res);
+  } else if (format == SELECT_FORMAT_MSGPACK) {
+    written = stream_select_msgpack(&context, *res);
+  } else if (format == SELECT_FORMAT_ARROW) {
+    written = (stream->started || stream_select_arrow(*res, &context)) &&
+              arrow_finish(context.arrow);
+  } else {
+    written = (stream->started || stream_select_rows(*res, &context)) &&
+              stream_select_rows_finish(&context);
+  }
+
+  if (!stream->started) {
+    build_response(500, response, response_len,
+                   "Server-side serialization failed.");
+  } else if (written) {
+    if (cache_slot)
+      share_stream(stream, cache_slot);
+    stream_finish(stream);
+  }
+
+end:
+  free_select_plan(context.plan);
+  free_arrow_writer(context.arrow);
+  free(stream->capture);
+  free(stream);
+}
+
+/**
+ * Writes CSV from the backend to the response stream.
+ * @param arg The response_stream, which is started on the first call.
+ * @returns 1 to continue, 0 to cancel the export with errno set to why sending
+ * failed.
+ */
+static int stream_csv(const char *data, size_t length, void *arg) {
+  struct response_stream *stream = arg;
+
+  if (!stream->started && !stream_start(stream, 200, "text/csv", ""))
+    goto failed;
+  if (!stream_write(stream, data, length) || !stream_flush_if_due(stream))
+    goto failed;
+
+  return 1;
+
+failed:
+  // the backend cancels the export for this reason
+  errno = stream->failed;
+  return 0;
+}
+
+/**
+ * Exports the whole result of a SELECT query to the client as CSV with a header
+ * line (Transfer-Encoding: chunked). With the Postgres backend the query runs
+ * as COPY ... TO STDOUT & the server's CSV is passed through untouched, which
+ * costs a single scan instead of paging through LIMIT & OFFSET. Errors that
+ * happen before anything was sent are returned as a regular response instead.
+ * @param database_name The target database's name.
+ * @param min_lsn The LSN a replica must have replayed to serve the query, or
+ * NULL.
+ * @param options The SELECT query to export. Its limit should be negative.
+ * @param client_fd The client socket to stream the CSV to.
+ * @param deadline_ms The export deadline (see monotonic_ms).
+ * @param res The response variable to pass into the backend's export_csv
+ * @param conn The backend connection to use (opened if NULL)
+ * @param response The response variable to pass into build_response... . Left
+ * NULL if the response was streamed.
+ * @param response_len The response length variable to pass into
+ * build_response... .
+ */
+void export_csv_and_respond(const char *database_name, const char *min_lsn,
+                            struct select_options *options, int client_fd,
+                            long long deadline_ms, PGresult **res, void **conn,
+                            char **response, size_t *response_len) {
+  if (!*conn)
+    *conn = get_backend()->connect(database_name, min_lsn, 0);
+
+  // the database is unreachable (or its circuit breaker is open)
+  if (!*conn) {
+    build_unavailable_response(response, response_len);
     return;
   }
 
-  *response = malloc(BUFFER_SIZE);
-  *response_len = write_header(200, *response, BUFFER_SIZE);
-  if (*response_len + 1 >= BUFFER_SIZE) {
-    free(*response);
-    build_response_printf(500, response, response_len, strlen("No memory") + 1,
-                          "No memory.");
+  struct response_stream *stream = malloc(sizeof(struct response_stream));
+  if (!stream) {
+    build_response(500, response, response_len, "No memory.");
     return;
   }
+  stream_init(stream, client_fd, deadline_ms);
 
-  // + 1 because the response_len is a length, not a size
-  *response_len += serialize_select_result(*res, *response + *response_len,
-                                           BUFFER_SIZE - *response_len);
+  ExecStatusType sql_query_status =
+      get_backend()->export_csv(*conn, options, stream_csv, stream, res);
+  // a failed stream leaves its error in errno, but the query was fine
+  if (stream->failed)
+    errno = 0;
   if (errno) {
-    perror("SELECT query result serialization");
-    free(*response);
-    build_response_printf(500, response, response_len,
-                          strlen("Server-side serialization failed.") + 1,
-                          "Server-side serialization failed.");
+    perror("Data table COPY query construction");
+    build_response(500, response, response_len,
+                   "Server-side COPY query construction failure.");
     errno = 0;
-    return;
+    goto end;
+  }
+
+  if (sql_query_status != PGRES_TUPLES_OK &&
+      sql_query_status != PGRES_COMMAND_OK) {
+    // the status line is already out, so the body is cut short instead
+    if (stream->started) {
+      log_error_printf("Export failed mid-stream: %s",
+                       PQresultErrorMessage(*res));
+      goto end;
+    }
+    build_response_printf(500, response, response_len,
+                          strlen(PQresStatus(sql_query_status)) + 2 +
+                              strlen(PQresultErrorMessage(*res)) + 1,
+                          "%s: %s", PQresStatus(sql_query_status),
+                          PQresultErrorMessage(*res));
+    goto end;
   }
+
+  // COPY always sends the header line, so the stream has started
+  if (stream->started)
+    stream_finish(stream);
+  else
+    build_response(500, response, response_len, "Export returned no data.");
+
+end:
+  free(stream);
+}
+
+/**
+ * Writes the cache key of a SELECT request & reads the generation of its
+ * table.
+ * @param cache_slot The slot to prepare. Its database & table must be set.
+ * @param options The SELECT query.
+ * @param serialize_flags The SERIALIZE_* flags of the response.
+ * @param format The layout of the response.
+ * @param total_count How the X-Total-Count header of the response is counted.
+ * @param projection The projection of the query (see
+ * project_select_columns), or ""
+ * if it selects every column.
+ * @returns 1 on success, 0 if the key is too long to cache the response.
+ */
+static int prepare_cache_slot(struct select_cache_slot *cache_slot,
+                              struct select_options *options,
+                              int serialize_flags, enum select_format format,
+                              enum select_count total_count,
+                              const char *projection) {
+  int n = snprintf(cache_slot->key, MAX_CACHE_KEY_LENGTH, "%s|%d|%d|%d|%s|",
+                   cache_slot->database, format, serialize_flags, total_count,
+                   projection);
+  if (n < 0 || n >= MAX_CACHE_KEY_LENGTH)
+    return 0;
+
+  int key_length = write_select_options_key(
+      options, cache_slot->key + n, MAX_CACHE_KEY_LENGTH - n);
+  if (key_length < 0 || key_length >= MAX_CACHE_KEY_LENGTH - n)
+    return 0;
+
+  cache_slot->generation =
+      cache_generation(cache_slot->database, cache_slot->table);
+  return 1;
 }
 
 char *replace_table_name(char *table_name, const char *suffix) {
@@ -149,6 +880,18 @@ char *replace_table_name(char *table_name, const char *suffix) {
   return table_name;
 }
 
+/**
+ * Reads a timeout from the environment.
+ * @param name The name of the environment variable, in milliseconds.
+ * @param default_ms The timeout if the variable is not a positive number.
+ * @returns The timeout in milliseconds.
+ */
+static long long read_timeout_ms(const char *name, long long default_ms) {
+  if (getenv(name) && atoll(getenv(name)) > 0)
+    return atoll(getenv(name));
+  return default_ms;
+}
+
 /**
  * Understand the client's request and decide what action to take based on the
  * request.
@@ -159,6 +902,11 @@ void *handle_client(void *arg) {
   char *buffer = malloc(BUFFER_SIZE * sizeof(char));
   char *response = NULL;
   size_t response_len = 0;
+  // a response shared by another request's query (see flight_wait)
+  struct flight *flight = NULL;
+  const char *shared_response = NULL;
+  size_t shared_response_len = 0;
+  struct tag_names *tag_names = NULL;
 
   // variables that are generally useful:
   char *method = NULL;
@@ -175,7 +923,7 @@ void *handle_client(void *arg) {
   char *table_name = NULL;
   struct table *table = NULL;
   struct regex_iterator *querystring_regex = NULL;
-  PGconn *conn = NULL;
+  void *conn = NULL;
   PGresult *res = NULL;
   char *query = NULL;
 
@@ -184,6 +932,14 @@ void *handle_client(void *arg) {
     goto end;
   }
 
+  // database work done for this request is bounded by the request's deadline
+  // and is cancelled if the client hangs up
+  long long request_start_ms = monotonic_ms();
+  long long request_deadline_ms =
+      request_start_ms + read_timeout_ms("SQL_RECEPTIONIST_REQUEST_TIMEOUT",
+                                         DEFAULT_REQUEST_TIMEOUT_MS);
+  sql_watch_request(client_fd, request_deadline_ms);
+
   // receive request data from client and store into buffer
   ssize_t bytes_received = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
 
@@ -377,6 +1133,8 @@ void *handle_client(void *arg) {
 
   bool admin_username = false;
   bool admin_password = false;
+  // the LSN of the client's last write (read-your-writes)
+  char min_lsn[MAX_LSN_LENGTH] = "";
 
   regex_t cookie_regex;
   regcomp(&cookie_regex, "[ ]*([^= ;]+)[ ]*=[ ]*([^;\r\n]+)", REG_EXTENDED);
@@ -398,6 +1156,8 @@ void *handle_client(void *arg) {
       admin_username = strcmp(value, "admin") == 0;
     else if (strcmp(key, "password") == 0)
       admin_password = strcmp(value, admin_creds) == 0;
+    else if (strcmp(key, "min_lsn") == 0 && is_valid_lsn(value))
+      strcpy(min_lsn, value);
 
     free(value);
     free(key);
@@ -412,12 +1172,40 @@ void *handle_client(void *arg) {
   regfree(&cookie_regex);
   free(raw_cookies);
 
+  // an explicit X-Min-LSN header takes precedence over the cookie
+  regex_t min_lsn_regex;
+  regmatch_t min_lsn_matches[1 + 1];
+  regcomp(&min_lsn_regex, "X-Min-LSN:[ ]*([0-9A-Fa-f]+/[0-9A-Fa-f]+)",
+          REG_EXTENDED | REG_ICASE);
+  if (regexec(&min_lsn_regex, headers, 1 + 1, min_lsn_matches, 0) == 0 &&
+      min_lsn_matches[1].rm_eo - min_lsn_matches[1].rm_so < MAX_LSN_LENGTH) {
+    char header_lsn[MAX_LSN_LENGTH];
+    int header_lsn_len = min_lsn_matches[1].rm_eo - min_lsn_matches[1].rm_so;
+    memcpy(header_lsn, headers + min_lsn_matches[1].rm_so, header_lsn_len);
+    header_lsn[header_lsn_len] = '\0';
+    if (is_valid_lsn(header_lsn))
+      strcpy(min_lsn, header_lsn);
+  }
+  regfree(&min_lsn_regex);
+
   // require authentication for all other endpoints
   if (!(admin_username && admin_password)) {
     build_response(403, &response, &response_len, "Authentication failed.");
     goto end;
   }
 
+  // several GET requests at once (see server/batch.h)
+  if (url_segments[0] && strcmp(url_segments[0], "batch") == 0) {
+    if (strcmp(method, "POST") != 0) {
+      build_response(400, &response, &response_len,
+                     "Batches must be sent with POST.");
+      goto end;
+    }
+    respond_batch(body, headers, handle_client, client_fd, request_deadline_ms,
+                  &response, &response_len);
+    goto end;
+  }
+
   // get database name
   database_name = url_segments[0];
 
@@ -428,6 +1216,25 @@ void *handle_client(void *arg) {
     goto end;
   }
 
+  // "info" is reserved for information about the receptionist itself
+  if (strcmp(database_name, "info") == 0) {
+    if (url_segments[1] && strcmp(url_segments[1], "metrics") == 0) {
+      size_t metrics_len = write_metrics(NULL, 0);
+      char *metrics_body = malloc(metrics_len + 1);
+      if (!metrics_body) {
+        build_response(500, &response, &response_len,
+                       "Memory allocation failed.");
+        goto end;
+      }
+      write_metrics(metrics_body, metrics_len + 1);
+      build_response(200, &response, &response_len, metrics_body);
+      free(metrics_body);
+    } else {
+      build_response(404, &response, &response_len, "Unknown info page.");
+    }
+    goto end;
+  }
+
   to_lower_snake_case(database_name);
 
   for (unsigned int i = 0; i < global_config->dbs_count; i++) {
@@ -484,15 +1291,38 @@ void *handle_client(void *arg) {
           table_name, "id", NULL, table->schema, table->schema_count,  1, 0,
           1,          NULL, NULL, NULL,          SELECT_DEFAULT_LIMIT, 0};
       enum table_type table_type = MAIN_TABLE;
+      int export = 0;
+      int aggregating = 0;
+      int counting = 0;
+      enum select_count total_count = SELECT_COUNT_NONE;
 
       /*
        * Special endpoints:
        * tag_names & tag_aliases are restricted to SELECT * FROM ...;
+       * export returns the whole data table as CSV;
+       * aggregate returns aggregated rows (see postgres/aggregate.h);
+       * count returns the number of rows the filters match.
        */
       if (!url_segments[2] || strcmp(url_segments[2], "data") == 0) {
         // table_type = MAIN_TABLE;
         if (table->tagging)
           options.primary_tag = 1;
+      } else if (strcmp(url_segments[2], "export") == 0) {
+        // table_type = MAIN_TABLE;
+        if (table->tagging)
+          options.primary_tag = 1;
+        export = 1;
+        options.order_by_order = "ASC";
+        options.limit = -1;
+      } else if (strcmp(url_segments[2], "aggregate") == 0) {
+        // table_type = MAIN_TABLE;
+        aggregating = 1;
+        options.order_by_order = "ASC";
+        options.limit = SELECT_AGGREGATE_LIMIT;
+      } else if (strcmp(url_segments[2], "count") == 0) {
+        // table_type = MAIN_TABLE;
+        counting = 1;
+        total_count = SELECT_COUNT_EXACT;
       } else if (strcmp(url_segments[2], "tags") == 0) {
         table_type = TAGS_TABLE;
         // check if tagging is enabled
@@ -600,8 +1430,8 @@ void *handle_client(void *arg) {
                        "Unknown or unsupported table URL.");
         goto end;
       } // @TODO tag groups
-      // REQUIRES querystring to run
-      if (querystring == NULL) {
+      // REQUIRES querystring to run (exports default to everything)
+      if (querystring == NULL && !export && !counting) {
         build_response(400, &response, &response_len,
                        "The querystring cannot be empty. It needs to specify "
                        "SELECT options.");
@@ -617,7 +1447,8 @@ void *handle_client(void *arg) {
                        "Something went wrong while parsing the querystring.");
         goto end;
       }
-      regex_iterator_load_target(querystring_regex, querystring);
+      regex_iterator_load_target(querystring_regex,
+                                 querystring ? querystring : "");
 
       // read every querystring value
       // store every single valid key-value pair.
@@ -625,6 +1456,39 @@ void *handle_client(void *arg) {
       char key[64];
       char value[64];
       char filter_value[64];
+      // cursors outgrow the other values. The extra character tells longer
+      // ones apart
+      char after[MAX_CURSOR_LENGTH + 2];
+      size_t after_length = 0;
+      char decoded_after[MAX_DECODED_CURSOR_LENGTH];
+      struct select_filter filters[MAX_SELECT_FILTERS];
+      char filter_values[MAX_SELECT_FILTERS][MAX_FILTER_VALUE_LENGTH];
+      char filter_input[MAX_FILTER_VALUE_LENGTH + 1];
+      char filter_error[MAX_FILTER_ERROR_LENGTH];
+      // COLUMNS is projected once the querystring is read, since filters &
+      // SORT_BY may name columns it leaves out
+      char columns[MAX_COLUMNS_LENGTH + 1] = "";
+      struct data_column projected_schema[MAX_PROJECTED_COLUMNS];
+      char projection[MAX_PROJECTION_LENGTH] = "";
+      // the aggregate parameters (see postgres/aggregate.h)
+      char bucket[64] = "";
+      char bucket_by[64] = "";
+      char functions[MAX_AGGREGATE_PARAM_LENGTH + 1] = "";
+      char group_by[MAX_AGGREGATE_PARAM_LENGTH + 1] = "";
+      struct select_aggregate aggregate;
+      char aggregate_error[MAX_AGGREGATE_ERROR_LENGTH];
+      int serialize_flags = 0;
+      // clients asking for MessagePack or Arrow get it unless FORMAT says
+      // otherwise
+      enum select_format format = SELECT_FORMAT_ROWS;
+      if (regex_check("^Accept:[^\r\n]*application/(x-)?msgpack", 1,
+                      REG_EXTENDED | REG_ICASE | REG_NEWLINE, 0, headers) == 1)
+        format = SELECT_FORMAT_MSGPACK;
+      else if (regex_check(
+                   "^Accept:[^\r\n]*application/vnd\\.apache\\.arrow\\.stream",
+                   1, REG_EXTENDED | REG_ICASE | REG_NEWLINE, 0,
+                   headers) == 1)
+        format = SELECT_FORMAT_ARROW;
       while (regex_iterator_match(querystring_regex, 0) == 0) {
         regex_iterator_write_match(querystring_regex, 1, key, 64);
         regex_iterator_write_match(querystring_regex, 2, value, 64);
@@ -641,6 +1505,135 @@ void *handle_client(void *arg) {
                            "Invalid ORDER_BY value. Expected ASC or DESC.");
             goto end;
           }
+        } else if (strcmp(key, "SORT_BY") == 0) {
+          // keyset pagination needs an index on the column to be fast, so
+          // only columns the config marks as indexed qualify
+          options.order_by_column = NULL;
+          if (strcmp(value, "id") == 0)
+            options.order_by_column = "id";
+          for (int i = 0; i < options.schema_count; i++) {
+            if (options.schema[i].indexed &&
+                strcmp(options.schema[i].datatype, "geodetic point") != 0 &&
+                strcmp(options.schema[i].name, value) == 0)
+              options.order_by_column = options.schema[i].name;
+          }
+          if (!options.order_by_column) {
+            build_response_printf(400, &response, &response_len,
+                                  strlen("Cannot sort by \"\". Expected id or "
+                                         "an indexed column.") +
+                                      strlen(value),
+                                  "Cannot sort by \"%s\". Expected id or an "
+                                  "indexed column.",
+                                  value);
+            goto end;
+          }
+          options.next_cursor = 1;
+        } else if (strcmp(key, "AFTER") == 0) {
+          // decoded once the ordering is known
+          after_length = regex_iterator_write_match(querystring_regex, 2, after,
+                                                    sizeof(after));
+          if (after_length >= sizeof(after)) {
+            build_response(400, &response, &response_len,
+                           "Invalid AFTER cursor.");
+            goto end;
+          }
+          after_length--;
+          options.next_cursor = 1;
+        } else if (strcmp(key, "COLUMNS") == 0) {
+          if (regex_iterator_write_match(querystring_regex, 2, columns,
+                                         sizeof(columns)) >= sizeof(columns)) {
+            build_response(400, &response, &response_len,
+                           "The COLUMNS list is too long.");
+            goto end;
+          }
+        } else if (aggregating && strcmp(key, "BUCKET") == 0) {
+          memcpy(bucket, value, 64);
+        } else if (aggregating && strcmp(key, "BUCKET_BY") == 0) {
+          memcpy(bucket_by, value, 64);
+        } else if (aggregating &&
+                   (strcmp(key, "FN") == 0 || strcmp(key, "GROUP_BY") == 0)) {
+          char *list = strcmp(key, "FN") == 0 ? functions : group_by;
+          if (regex_iterator_write_match(querystring_regex, 2, list,
+                                         MAX_AGGREGATE_PARAM_LENGTH + 1) >
+              MAX_AGGREGATE_PARAM_LENGTH) {
+            build_response_printf(400, &response, &response_len,
+                                  strlen("The  list is too long.") +
+                                      strlen(key),
+                                  "The %s list is too long.", key);
+            goto end;
+          }
+        } else if (strcmp(key, counting ? "MODE" : "TOTAL_COUNT") == 0 &&
+                   !export && !aggregating) {
+          // estimates come from the planner & skip scanning the rows
+          if (strcasecmp(value, "EXACT") == 0) {
+            total_count = SELECT_COUNT_EXACT;
+          } else if (strcasecmp(value, "ESTIMATE") == 0) {
+            total_count = SELECT_COUNT_ESTIMATE;
+          } else if (!counting && strcasecmp(value, "NONE") == 0) {
+            total_count = SELECT_COUNT_NONE;
+          } else {
+            build_response_printf(400, &response, &response_len,
+                                  strlen("Invalid  value. Expected EXACT or "
+                                         "ESTIMATE.") +
+                                      strlen(key),
+                                  "Invalid %s value. Expected EXACT or "
+                                  "ESTIMATE.",
+                                  key);
+            goto end;
+          }
+        } else if (strcmp(key, "EXPAND") == 0 && table_type == MAIN_TABLE &&
+                   !export && !aggregating && !counting) {
+          // the tags & descriptor rows of every entry are nested into it, so
+          // that rendering an entry takes a single request
+          char *item, *saveptr;
+          for (item = strtok_r(value, ",", &saveptr); item;
+               item = strtok_r(NULL, ",", &saveptr)) {
+            if (strcasecmp(item, "tags") == 0 && table->tagging) {
+              options.expand |= SELECT_EXPAND_TAGS;
+            } else if (strcasecmp(item, "descriptors") == 0 &&
+                       table->descriptors_count) {
+              options.expand |= SELECT_EXPAND_DESCRIPTORS;
+              options.descriptors = table->descriptors;
+              options.descriptors_count = table->descriptors_count;
+            } else {
+              build_response_printf(
+                  400, &response, &response_len,
+                  strlen("Cannot expand \"\". Expected tags or descriptors "
+                         "(if the table has them).") +
+                      strlen(item),
+                  "Cannot expand \"%s\". Expected tags or descriptors (if the "
+                  "table has them).",
+                  item);
+              goto end;
+            }
+          }
+        } else if (strcmp(key, "TIMESTAMPS") == 0) {
+          if (strcmp(value, "EPOCH") == 0) {
+            serialize_flags |= SERIALIZE_EPOCH_TIMESTAMPS;
+          } else if (strcmp(value, "ISO") == 0) {
+            serialize_flags &= ~SERIALIZE_EPOCH_TIMESTAMPS;
+          } else {
+            build_response(400, &response, &response_len,
+                           "Invalid TIMESTAMPS value. Expected ISO or EPOCH.");
+            goto end;
+          }
+        } else if (strcmp(key, "FORMAT") == 0) {
+          if (strcasecmp(value, "ROWS") == 0) {
+            format = SELECT_FORMAT_ROWS;
+          } else if (strcasecmp(value, "COLUMNAR") == 0) {
+            format = SELECT_FORMAT_COLUMNAR;
+          } else if (strcasecmp(value, "NDJSON") == 0) {
+            format = SELECT_FORMAT_NDJSON;
+          } else if (strcasecmp(value, "MSGPACK") == 0) {
+            format = SELECT_FORMAT_MSGPACK;
+          } else if (strcasecmp(value, "ARROW") == 0) {
+            format = SELECT_FORMAT_ARROW;
+          } else {
+            build_response(400, &response, &response_len,
+                           "Invalid FORMAT value. Expected ROWS, COLUMNAR, "
+                           "NDJSON, MSGPACK or ARROW.");
+            goto end;
+          }
         } else if (strcmp(key, "id") == 0) {
           // the query string value should be an integer.
           switch (regex_check("^[0-9]+$", 1, REG_EXTENDED, 0, value)) {
@@ -698,6 +1691,26 @@ void *handle_client(void *arg) {
                 "Something went wrong while trying to parse the querystring.");
             goto end;
           }
+        } else if (strchr(key, '.')) {
+          // <column>.<operator>=<value> (see postgres/filter.h). Lists
+          // outgrow the other values
+          if (options.filters_count == MAX_SELECT_FILTERS) {
+            build_response(400, &response, &response_len,
+                           "Too many filters.");
+            goto end;
+          }
+          regex_iterator_write_match(querystring_regex, 2, filter_input,
+                                     sizeof(filter_input));
+          if (!parse_select_filter(
+                  options.schema, options.schema_count, options.id_column, key,
+                  filter_input, &filters[options.filters_count],
+                  filter_values[options.filters_count],
+                  sizeof(filter_values[0]), filter_error)) {
+            build_response(400, &response, &response_len, filter_error);
+            goto end;
+          }
+          options.filters = filters;
+          options.filters_count++;
         } else {
           build_response_printf(400, &response, &response_len,
                                 strlen("Invalid querystring key: \"\".") +
@@ -709,19 +1722,161 @@ void *handle_client(void *arg) {
         regex_iterator_advance_cur(querystring_regex);
       }
 
+      // keyset pagination (see postgres/cursor.h) continues after the row with
+      // the ID, which tables without IDs lack
+      if (options.next_cursor && !options.id_column) {
+        build_response(400, &response, &response_len,
+                       "This table type does not support SORT_BY or AFTER.");
+        goto end;
+      }
+
+      // aggregated rows have neither IDs nor the columns of the table
+      if (aggregating) {
+        if (options.next_cursor || *columns || format == SELECT_FORMAT_ARROW) {
+          build_response(400, &response, &response_len,
+                         "Aggregate requests do not support SORT_BY, AFTER, "
+                         "COLUMNS or the ARROW format.");
+          goto end;
+        }
+        if (!parse_select_aggregate(options.schema, options.schema_count,
+                                    table->tagging, *bucket ? bucket : NULL,
+                                    *bucket_by ? bucket_by : NULL, functions,
+                                    *group_by ? group_by : NULL, &aggregate,
+                                    aggregate_error)) {
+          build_response(400, &response, &response_len, aggregate_error);
+          goto end;
+        }
+        options.aggregate = &aggregate;
+        options.id_column = 0;
+        // joins (or substitutes) the tag names when grouping by them
+        for (int i = 0; i < aggregate.group_by_count; i++) {
+          if (strcmp(aggregate.group_by[i], "primary_tag") == 0)
+            options.primary_tag = 1;
+        }
+      }
+
+      // Arrow schemas follow the table's columns
+      if (options.expand && format == SELECT_FORMAT_ARROW) {
+        build_response(400, &response, &response_len,
+                       "EXPAND does not support the ARROW format.");
+        goto end;
+      }
+
+      if (*columns) {
+        errno = 0;
+        const char *unknown_column = project_select_columns(
+            &options, columns, projected_schema, projection);
+        if (errno == E2BIG) {
+          build_response(400, &response, &response_len,
+                         "COLUMNS lists too many columns to project.");
+          errno = 0;
+          goto end;
+        }
+        if (errno) {
+          perror("COLUMNS projection");
+          build_response(500, &response, &response_len, "No memory.");
+          errno = 0;
+          goto end;
+        }
+        if (unknown_column) {
+          build_response_printf(
+              400, &response, &response_len,
+              strlen("Unknown column \"\" in COLUMNS.") +
+                  strlen(unknown_column),
+              "Unknown column \"%s\" in COLUMNS.", unknown_column);
+          goto end;
+        }
+
+        // cursors are written from the ID & the SORT_BY value of a row
+        int sort_column_included = strcmp(options.order_by_column, "id") == 0;
+        for (int i = 0; i < options.schema_count; i++) {
+          if (strcmp(options.schema[i].name, options.order_by_column) == 0)
+            sort_column_included = 1;
+        }
+        if (options.next_cursor &&
+            (!options.id_column || !sort_column_included)) {
+          build_response(400, &response, &response_len,
+                         "COLUMNS must include id & the SORT_BY column to "
+                         "page with cursors.");
+          goto end;
+        }
+      }
+      if (after_length && options.order_by_order &&
+          read_cursor(after, after_length, &options, decoded_after,
+                      sizeof(decoded_after))) {
+        build_response(400, &response, &response_len,
+                       "Invalid AFTER cursor. Cursors only continue the "
+                       "SORT_BY & ORDER_BY they were returned for.");
+        goto end;
+      }
+
       // are the mandatory request params valid? We need something to select and
       // an order to sort it by.
-      if (options.order_by_order && options.limit) {
-        char query[QUERY_SIZE_LIMIT];
-        construct_select_query(&options, query, QUERY_SIZE_LIMIT);
-        if (errno) {
-          perror("Data table SELECT query construction");
-          build_response(500, &response, &response_len,
-                         "Server-side SELECT query construction failure.");
+      if (export) {
+        // a whole table takes longer than a page, so exports have their own
+        // deadline for both the query & sending it
+        long long export_deadline_ms =
+            request_start_ms +
+            read_timeout_ms("SQL_RECEPTIONIST_EXPORT_TIMEOUT",
+                            DEFAULT_EXPORT_TIMEOUT_MS);
+        sql_watch_request(client_fd, export_deadline_ms);
+        export_csv_and_respond(database_name, *min_lsn ? min_lsn : NULL,
+                               &options, client_fd, export_deadline_ms, &res,
+                               &conn, &response, &response_len);
+      } else if (counting) {
+        count_and_respond(database_name, *min_lsn ? min_lsn : NULL, &options,
+                          total_count, &res, &conn, &response, &response_len);
+      } else if (options.order_by_order && options.limit) {
+        // reads that must observe a write skip the cache & coalescing, since
+        // other instances only hear of the write asynchronously
+        struct select_cache_slot cache_slot = {"", database_name,
+                                               table->table_name, 0, NULL};
+        int cacheable =
+            !*min_lsn &&
+            prepare_cache_slot(&cache_slot, &options, serialize_flags, format,
+                               total_count, projection);
+        if (cacheable && cache_get(cache_slot.key, &response, &response_len))
           goto end;
+
+        // substitute the tag names in process instead of joining them. Arrow
+        // writes the rows as they come & keeps the join, like reads that must
+        // observe a write. The dictionary is acquired after the cache
+        // generation was read, so that a response with outdated names is never
+        // cached. Nested tags are named by the query
+        if (options.primary_tag && options.transform_tag_names &&
+            format != SELECT_FORMAT_ARROW && !*min_lsn &&
+            !(options.expand & SELECT_EXPAND_TAGS) &&
+            (tag_names = acquire_tag_names(database_name, table->table_name)))
+          options.transform_tag_names = 0;
+
+        // identical requests that arrive while the query runs share its
+        // response
+        int leader = 1;
+        if (cacheable)
+          flight = flight_join(cache_slot.key, cache_slot.generation, &leader);
+        if (!leader) {
+          // a follower waits for half of the time it has left, which leaves
+          // it the other half to run the query itself
+          long long now_ms = monotonic_ms();
+          if (flight_wait(flight, now_ms + (request_deadline_ms - now_ms) / 2,
+                          &shared_response, &shared_response_len))
+            goto end;
+          // the leader failed (or ran out of time): query independently
+          flight_leave(flight);
+          flight = NULL;
+        } else {
+          cache_slot.flight = flight;
+          flight = NULL;
         }
-        generic_select_query_and_respond(database_name, query, &res, &conn,
-                                         &response, &response_len);
+
+        generic_select_query_and_respond(
+            database_name, *min_lsn ? min_lsn : NULL, &options,
+            serialize_flags, format, total_count, tag_names, client_fd,
+            request_deadline_ms, &res, &conn, &response, &response_len,
+            cacheable ? &cache_slot : NULL);
+        // let the followers query independently
+        if (cache_slot.flight)
+          flight_land(cache_slot.flight, NULL, 0);
       } else {
         build_response(400, &response, &response_len,
                        "SELECT queries need a valid ordering (ORDER_BY) and a "
@@ -886,91 +2041,97 @@ void *handle_client(void *arg) {
         goto schema_mismatch_end;
       }
 
-      // construct & validate query as we go
-      conn = connect_db(database_name);
-      ExecStatusType sql_query_status;
-      bool sql_query_succesful = true; // innocent until proven guilty
-      bool unexpected_return = false;  // innocent until proven guitly
-      char value[MAX_SQL_RETURN_LENGTH];
-      const char *temp_value = NULL;
-      char error_buffer[ERROR_BUFFER_SIZE];
-      *error_buffer = '\0';
-
-      sql_query("BEGIN;", &res, conn);
-      sql_query_succesful &=
-          res && (sql_query_status = PQresultStatus(res)) == PGRES_COMMAND_OK;
-      if (!sql_query_succesful)
-        goto build_sql_response;
-      PQclear(res);
-      res = NULL;
-
-      switch (
-          validate_and_insert_into(&options, entry, &res, conn, error_buffer)) {
-      case 0:
-        if (errno) {
-          perror("INSERT query");
-          errno = 0;
+      // tags are created once & then only looked up, so names that the tag
+      // dictionary knows need no round trip to the primary
+      int tag_table = strcmp(target_type, "tag_names") == 0 ||
+                      strcmp(target_type, "tag_aliases") == 0;
+      if (strcmp(target_type, "tag_names") == 0 && json_is_object(entry) &&
+          json_object_size(entry) == 1 &&
+          json_is_string(json_object_get(entry, "tag_name"))) {
+        struct tag_names *known_names =
+            acquire_tag_names(database_name, table->table_name);
+        long long tag_id;
+        int known =
+            known_names &&
+            find_tag_id(known_names,
+                        json_string_value(json_object_get(entry, "tag_name")),
+                        &tag_id);
+        release_tag_names(known_names);
+
+        if (known) {
+          char tag_id_value[MAX_SQL_RETURN_LENGTH];
+          snprintf(tag_id_value, MAX_SQL_RETURN_LENGTH, "%lld", tag_id);
+          build_response(200, &response, &response_len, tag_id_value);
+          goto schema_mismatch_end;
         }
+      }
 
+      // writes always go to the primary
+      conn = get_backend()->connect(database_name, NULL, 1);
+      if (!conn) {
+        build_unavailable_response(&response, &response_len);
+        goto schema_mismatch_end;
+      }
+
+      struct upsert_result upsert_result;
+      char commit_lsn_headers[MAX_LSN_HEADERS_LENGTH];
+      *commit_lsn_headers = '\0';
+
+      // every route of the table is cached under the config table. Tag
+      // dictionaries are always kept in sync, tag writes being rare
+      char notify_channel[MAX_CACHE_CHANNEL_LENGTH];
+      if ((cache_enabled() || tag_table) &&
+          write_cache_channel(table->table_name, notify_channel,
+                              MAX_CACHE_CHANNEL_LENGTH))
+        options.notify_channel = notify_channel;
+      if (tag_table)
+        options.notify_payload = TAG_DICTIONARY_NOTIFY_PAYLOAD;
+
+      switch (get_backend()->upsert(conn, &options, entry, &upsert_result)) {
+      case UPSERT_OK:
+        // the dictionary goes first, so that responses cached after the cache
+        // invalidation are built with the new names
+        if (tag_table)
+          tag_dictionary_invalidate(database_name, table->table_name);
+        cache_invalidate(database_name, table->table_name);
+        // the client's next read must observe this write
+        if (*upsert_result.commit_lsn)
+          snprintf(commit_lsn_headers, MAX_LSN_HEADERS_LENGTH,
+                   "X-Commit-LSN: %s\r\n"
+                   "Access-Control-Expose-Headers: X-Commit-LSN\r\n"
+                   "Set-Cookie: min_lsn=%s; Max-Age=%d\r\n",
+                   upsert_result.commit_lsn, upsert_result.commit_lsn,
+                   MIN_LSN_COOKIE_MAX_AGE);
+        build_response_with_headers(200, &response, &response_len,
+                                    commit_lsn_headers, upsert_result.value);
+        break;
+      case UPSERT_INVALID_ENTRY:
         build_response_printf(400, &response, &response_len,
                               strlen("The given entry does not "
                                      "conform to the schema: ") +
-                                  strlen(error_buffer),
+                                  strlen(upsert_result.error),
                               "The given entry does not "
                               "conform to the schema: %s",
-                              error_buffer);
-        goto schema_mismatch_end;
-      case 1:
+                              upsert_result.error);
         break;
-      default:
+      case UPSERT_PREPARE_FAILED:
         build_response_printf(
             500, &response, &response_len,
             strlen("Something went wrong while checking your entry with "
                    "the schema: ") +
-                ERROR_BUFFER_SIZE,
+                strlen(upsert_result.error),
             "Something went wrong while checking your entry with "
             "the schema: %s",
-            error_buffer);
-        goto schema_mismatch_end;
-      }
-      sql_query_succesful &=
-          res && (sql_query_status = PQresultStatus(res)) == PGRES_TUPLES_OK;
-      if (!sql_query_succesful)
-        goto build_sql_response;
-      if (PQntuples(res) != 1 || PQnfields(res) != 1 ||
-          !(temp_value = PQgetvalue(res, 0, 0))) {
-        unexpected_return = true;
-        goto build_sql_response;
-      }
-      int value_len = strlen(temp_value);
-      memcpy(value, temp_value, value_len);
-      value[value_len] = '\0';
-      PQclear(res);
-      res = NULL;
-
-      sql_query("COMMIT;", &res, conn);
-      sql_query_succesful &=
-          res && (sql_query_status = PQresultStatus(res)) == PGRES_COMMAND_OK;
-
-    build_sql_response:
-      PQclear(res);
-      res = NULL;
-      if (!sql_query_succesful) {
-        const char *status_message = PQresStatus(sql_query_status);
-        const char *error_message = PQerrorMessage(conn);
-
-        log_debug_printf("Database INSERT error: %s, %s\n", status_message,
-                         error_message);
-
-        build_response_printf(500, &response, &response_len,
-                              strlen(status_message) + 2 +
-                                  strlen(error_message) + 1,
-                              "%s: %s", status_message, error_message);
-      } else if (unexpected_return) {
+            upsert_result.error);
+        break;
+      case UPSERT_QUERY_FAILED:
+        build_response(500, &response, &response_len, upsert_result.error);
+        break;
+      case UPSERT_UNEXPECTED_RETURN:
         build_response(500, &response, &response_len,
                        "Query return value is unexpectedly NULL.");
-      } else
-        build_response(200, &response, &response_len, value);
+        break;
+      }
 
     schema_mismatch_end:
     post_bad_input_end:
@@ -996,9 +2157,14 @@ end:
     if (getenv("SQL_RECEPTIONIST_LOG_RESPONSES") &&
         strcmp(getenv("SQL_RECEPTIONIST_LOG_RESPONSES"), "TRUE") == 0)
       log_debug_printf("Response: %s\n", response);
-    send(client_fd, *&response, *&response_len, 0);
+    // the client, e.g. a batch that gave up on the request, may be gone
+    send(client_fd, *&response, *&response_len, MSG_NOSIGNAL);
+  } else if (shared_response) {
+    send(client_fd, shared_response, shared_response_len, MSG_NOSIGNAL);
   }
   close(client_fd);
+  flight_leave(flight);
+  release_tag_names(tag_names);
 
   free(buffer);
   free(response);
@@ -1011,7 +2177,7 @@ end:
   }
   free_regex_iterator(url_regex);
   free_regex_iterator(querystring_regex);
-  PQfinish(conn);
+  get_backend()->disconnect(conn);
   PQclear(res);
   free(query);
   return NULL;
@@ -1043,9 +2209,12 @@ int main(int argc, char const *argv[]) {
     return EXIT_FAILURE;
   } else {
     log_info("Successfully loaded config:\n");
+    log_info_printf(" * Backend: %s\n", get_backend()->name);
     log_info(" * Postgres Settings:\n");
     log_info_printf("   - Host: %s\n", getenv("DATABASE_HOST"));
     log_info_printf("   - Port: %s\n", getenv("DATABASE_PORT"));
+    if (getenv("DATABASE_REPLICA_HOST"))
+      log_info_printf("   - Replica: %s\n", getenv("DATABASE_REPLICA_HOST"));
     log_info_printf("   - User: %s\n", getenv("DATABASE_USERNAME"));
     log_info_printf("Recognized %u databases:\n", global_config->dbs_count);
     for (unsigned int i = 0; i < global_config->dbs_count; i++) {
@@ -1076,6 +2245,39 @@ int main(int argc, char const *argv[]) {
     }
   }
 
+  // measure the replica's lag in the background
+  if (get_backend() == &postgres_backend && getenv("DATABASE_REPLICA_HOST") &&
+      global_config->dbs_count > 0) {
+    pthread_t monitor_thread_id;
+    if (pthread_create(&monitor_thread_id, NULL, monitor_replica_lag,
+                       global_config->dbs[0].db_name) == 0)
+      pthread_detach(monitor_thread_id);
+    else
+      perror("replica monitor thread create");
+  }
+
+  // load the tag dictionaries up front, so that the first pages need not wait
+  for (unsigned int i = 0; i < global_config->dbs_count; i++) {
+    for (unsigned int j = 0; j < global_config->dbs[i].tables_count; j++) {
+      if (global_config->dbs[i].tables[j].tagging)
+        release_tag_names(
+            acquire_tag_names(global_config->dbs[i].db_name,
+                              global_config->dbs[i].tables[j].table_name));
+    }
+  }
+
+  // drop cached responses & reload tag dictionaries when other instances write
+  if (get_backend() == &postgres_backend) {
+    for (unsigned int i = 0; i < global_config->dbs_count; i++) {
+      pthread_t listener_thread_id;
+      if (pthread_create(&listener_thread_id, NULL, listen_for_invalidations,
+                         &global_config->dbs[i]) == 0)
+        pthread_detach(listener_thread_id);
+      else
+        perror("invalidation listener thread create");
+    }
+  }
+
   // Set up the server
   int server_fd;
   size_t valread;
@@ -1,34 +1,633 @@
+#define _GNU_SOURCE // POLLRDHUP
 #include "config.h"
 #include "logging.h"
+#include "postgres.h"
+#include "postgres/breaker.h"
+#include "server/metrics.h"
+#include "utils/clock.h"
 #include <errno.h>
 #include <libpq-fe.h>
+#include <poll.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define MAX_CONN_INFO_LENGTH 8192
+#define CONNECT_TIMEOUT_MS 10000
+#define MAX_CANCEL_ERROR_LENGTH 256
+#define MAX_METRIC_NAME_LENGTH 256
+#define MAX_TIMEOUT_QUERY_LENGTH 64
+
+// The client request served by the calling thread. Every client is handled by
+// its own thread, so the watch is kept per thread.
+static __thread int watched_client_fd = -1;
+static __thread long long watched_deadline_ms = 0;
+
+void sql_watch_request(int client_fd, long long deadline_ms) {
+  watched_client_fd = client_fd;
+  watched_deadline_ms = deadline_ms;
+}
+
+long long sql_remaining_ms() {
+  if (!watched_deadline_ms)
+    return -1;
+
+  long long remaining = watched_deadline_ms - monotonic_ms();
+  return remaining > 0 ? remaining : 0;
+}
+
+/**
+ * Sleeps until the connection's socket is ready for the given events.
+ * @param conn The connection to wait on.
+ * @param events The poll events to wait for.
+ * @param timeout_ms The maximum time to wait. Negative values wait forever.
+ * @returns 1 if the socket is ready, 0 on timeout and -1 on failure.
+ */
+static int wait_for_socket(PGconn *conn, short events, int timeout_ms) {
+  struct pollfd pfd = {PQsocket(conn), events, 0};
+  int n;
+
+  if (pfd.fd < 0)
+    return -1;
+
+  do {
+    n = poll(&pfd, 1, timeout_ms);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0)
+    return -1;
+  return n > 0;
+}
+
+/**
+ * Writes the name of the circuit breaker guarding the given database server.
+ * @param buffer The buffer to write to.
+ * @param dbname The database name.
+ * @param host The database host.
+ * @param port The database port.
+ */
+static void write_breaker_name(char *buffer, const char *dbname,
+                               const char *host, const char *port) {
+  snprintf(buffer, MAX_BREAKER_NAME_LENGTH, "%s@%s:%s", dbname, host, port);
+}
+
+/**
+ * Asks the server to cancel the query that is running on the connection.
+ * @param conn The connection whose query should be cancelled.
+ * @param reason The reason for the cancellation, used as a metric label.
+ */
+static void cancel_query(PGconn *conn, const char *reason) {
+  char error_buffer[MAX_CANCEL_ERROR_LENGTH];
+  char metric_name[MAX_METRIC_NAME_LENGTH];
+  PGcancel *cancel = PQgetCancel(conn);
+
+  log_debug_printf("Cancelling query on database %s: %s\n", PQdb(conn),
+                   reason);
+
+  if (!cancel)
+    return;
+  if (!PQcancel(cancel, error_buffer, MAX_CANCEL_ERROR_LENGTH))
+    log_error_printf("Failed to cancel query: %s\n", error_buffer);
+  PQfreeCancel(cancel);
+
+  snprintf(metric_name, MAX_METRIC_NAME_LENGTH,
+           "sql_receptionist_cancelled_queries_total{reason=\"%s\"}", reason);
+  metric_add(get_metric(metric_name), 1);
+}
+
+/**
+ * Names why the consumer of a query's data gave up on it.
+ * @param error The errno set by the consumer.
+ * @returns The reason, for cancel_query.
+ */
+static const char *consumer_cancel_reason(int error) {
+  if (error == ETIMEDOUT)
+    return "send_timeout";
+  if (!error || error == EPIPE || error == ECONNRESET)
+    return "client_disconnect";
+  return "send_error";
+}
+
+/**
+ * Sleeps until the connection's socket is ready for the given events, while
+ * watching the calling thread's client request. When the client hangs up, the
+ * running query is cancelled once and the wait continues so that the server's
+ * error result can be read. When the request deadline passes, the query is
+ * cancelled and the wait fails right away; the deadline stays in place so that
+ * later waits and statement timeouts on the same request fail fast as well.
+ * @param conn The connection to wait on.
+ * @param events The poll events to wait for.
+ * @returns 1 if the socket is ready and -1 on failure or timeout.
+ */
+static int wait_for_database(PGconn *conn, short events) {
+  struct pollfd pfds[2] = {{PQsocket(conn), events, 0},
+                           {watched_client_fd, POLLRDHUP, 0}};
+  nfds_t nfds = watched_client_fd >= 0 ? 2 : 1;
+  int n;
+
+  if (pfds[0].fd < 0)
+    return -1;
+
+  for (;;) {
+    n = poll(pfds, nfds, sql_remaining_ms());
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    if (n == 0) {
+      cancel_query(conn, "deadline");
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    if (nfds == 2 && pfds[1].revents & (POLLRDHUP | POLLHUP | POLLERR)) {
+      cancel_query(conn, "client_disconnect");
+      watched_client_fd = -1;
+      nfds = 1;
+    }
+
+    if (pfds[0].revents)
+      return 1;
+  }
+}
+
+/**
+ * Reports a connection that broke while it was in use to the database's
+ * circuit breaker. Errors raised by the queries themselves are not counted.
+ * @param conn The connection to check.
+ */
+static void check_connection_health(PGconn *conn) {
+  char breaker_name[MAX_BREAKER_NAME_LENGTH];
+
+  if (PQstatus(conn) == CONNECTION_BAD) {
+    write_breaker_name(breaker_name, PQdb(conn), PQhost(conn), PQport(conn));
+    breaker_record_failure(breaker_name);
+  }
+}
+
+int sql_flush(PGconn *conn) {
+  int status;
+
+  while ((status = PQflush(conn)) == 1) {
+    // the server may be blocked on sending results, so read while we wait
+    if (wait_for_database(conn, POLLIN | POLLOUT) < 0 ||
+        !PQconsumeInput(conn))
+      return 0;
+  }
+
+  return status == 0;
+}
+
+int sql_wait_result(PGconn *conn) {
+  if (!sql_flush(conn))
+    return 0;
+
+  while (PQisBusy(conn)) {
+    if (wait_for_database(conn, POLLIN) < 0 || !PQconsumeInput(conn))
+      return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Collects every result of the query that was last sent on the connection.
+ * Mirrors PQexec by keeping only the last result.
+ * @param res The output pointer to store the result.
+ * @param conn The connection to read from.
+ * @returns The status of the last result.
+ */
+static ExecStatusType collect_results(PGresult **res, PGconn *conn) {
+  PGresult *result;
+  ExecStatusType status;
+
+  while (sql_wait_result(conn) && (result = PQgetResult(conn))) {
+    PQclear(*res);
+    *res = result;
+
+    status = PQresultStatus(result);
+    if (status == PGRES_COPY_IN || status == PGRES_COPY_OUT ||
+        status == PGRES_COPY_BOTH)
+      break;
+  }
+
+  // the connection broke before a result arrived
+  if (!*res)
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+
+  status = PQresultStatus(*res);
+  if (status == PGRES_FATAL_ERROR)
+    check_connection_health(conn);
+  return status;
+}
 
 ExecStatusType sql_query(const char *query, PGresult **res, PGconn *conn) {
   if (getenv("SQL_RECEPTIONIST_LOG_QUERIES") &&
       strcmp(getenv("SQL_RECEPTIONIST_LOG_QUERIES"), "TRUE") == 0)
     log_debug_printf("Query: %s\n", query);
 
-  // Submit & Execute query
-  *res = PQexec(conn, query);
+  *res = NULL;
+  if (!conn)
+    return PGRES_FATAL_ERROR;
+
+  // Submit query & wait for the result
+  if (!PQsendQuery(conn, query)) {
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+
+  return collect_results(res, conn);
+}
+
+ExecStatusType sql_query_params(const char *query, int n_params,
+                                const char *const *param_values,
+                                PGresult **res, PGconn *conn) {
+  if (getenv("SQL_RECEPTIONIST_LOG_QUERIES") &&
+      strcmp(getenv("SQL_RECEPTIONIST_LOG_QUERIES"), "TRUE") == 0)
+    log_debug_printf("Query: %s\n", query);
+
+  *res = NULL;
+  if (!conn)
+    return PGRES_FATAL_ERROR;
+
+  // Submit query & wait for the result
+  if (!PQsendQueryParams(conn, query, n_params, NULL, param_values, NULL, NULL,
+                         0)) {
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+
+  return collect_results(res, conn);
+}
+
+int sql_pipeline_send_format(PGconn *conn, const char *query, int n_params,
+                             const char *const *param_values,
+                             int result_format) {
+  if (getenv("SQL_RECEPTIONIST_LOG_QUERIES") &&
+      strcmp(getenv("SQL_RECEPTIONIST_LOG_QUERIES"), "TRUE") == 0)
+    log_debug_printf("Pipelined query: %s\n", query);
+
+  if (!conn)
+    return 0;
+
+  return PQsendQueryParams(conn, query, n_params, NULL, param_values, NULL,
+                           NULL, result_format);
+}
+
+int sql_pipeline_send(PGconn *conn, const char *query, int n_params,
+                      const char *const *param_values) {
+  return sql_pipeline_send_format(conn, query, n_params, param_values, 0);
+}
+
+int sql_pipeline_sync(PGconn *conn) {
+  if (!conn || !PQpipelineSync(conn))
+    return 0;
+
+  return sql_flush(conn);
+}
+
+PGresult *sql_pipeline_result(PGconn *conn) {
+  PGresult *result = NULL;
+  PGresult *next;
 
+  if (!sql_wait_result(conn) || !(result = PQgetResult(conn))) {
+    check_connection_health(conn);
+    return result;
+  }
+
+  // sync points are not followed by a NULL
+  if (PQresultStatus(result) == PGRES_PIPELINE_SYNC)
+    return result;
+
+  // consume up to the NULL that ends this query, keeping the last result
+  while (sql_wait_result(conn) && (next = PQgetResult(conn))) {
+    PQclear(result);
+    result = next;
+  }
+
+  return result;
+}
+
+/**
+ * Writes the statement that bounds the current transaction by the calling
+ * thread's request deadline.
+ * @param query The buffer of MAX_TIMEOUT_QUERY_LENGTH bytes to write to.
+ */
+static void write_timeout_query(char *query) {
+  long long remaining = sql_remaining_ms();
+
+  // a statement_timeout of 0 disables the timeout, so an expired deadline is
+  // clamped to the smallest timeout instead
+  if (remaining == 0)
+    remaining = 1;
+  snprintf(query, MAX_TIMEOUT_QUERY_LENGTH, "SET LOCAL statement_timeout = %lld;",
+           remaining < 0 ? 0 : remaining);
+}
+
+int sql_pipeline_send_timeout(PGconn *conn) {
+  char query[MAX_TIMEOUT_QUERY_LENGTH];
+
+  write_timeout_query(query);
+  return sql_pipeline_send(conn, query, 0, NULL);
+}
+
+/**
+ * Discards the remaining results up to the next sync point and leaves pipeline
+ * mode.
+ * @param conn The connection in pipeline mode.
+ */
+static void finish_pipeline(PGconn *conn) {
+  PGresult *result;
+  ExecStatusType status;
+
+  while ((result = sql_pipeline_result(conn))) {
+    status = PQresultStatus(result);
+    PQclear(result);
+    if (status == PGRES_PIPELINE_SYNC)
+      break;
+  }
+
+  PQexitPipelineMode(conn);
+}
+
+/**
+ * Pipelines a read query inside its own read-only transaction and reads the
+ * results of the statements that precede it.
+ * @param query The query to execute. Must be a single statement.
+ * @param result_format 0 for text results, 1 for binary results.
+ * @param res The output pointer to store an error result in.
+ * @param conn The connection to use. Must not be in pipeline mode.
+ * @returns 1 if the results of the query are next on the connection, 0 if
+ * *res holds an error of the transaction and -1 if nothing could be sent. The
+ * pipeline must be finished unless -1 is returned.
+ */
+static int start_select(const char *query, int n_params,
+                        const char *const *param_values, int result_format,
+                        PGresult **res, PGconn *conn) {
+  PGresult *result;
+
+  *res = NULL;
+  if (!conn)
+    return -1;
+
+  // BEGIN, the timeout, the query & COMMIT cost a single round trip
+  if (!PQenterPipelineMode(conn) ||
+      !sql_pipeline_send(conn, "BEGIN READ ONLY;", 0, NULL) ||
+      !sql_pipeline_send_timeout(conn) ||
+      !sql_pipeline_send_format(conn, query, n_params, param_values,
+                                result_format) ||
+      !sql_pipeline_send(conn, "COMMIT;", 0, NULL) ||
+      !sql_pipeline_sync(conn)) {
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+    return -1;
+  }
+
+  // BEGIN & SET LOCAL
+  for (int i = 0; i < 2; i++) {
+    result = sql_pipeline_result(conn);
+    if (!result || PQresultStatus(result) != PGRES_COMMAND_OK) {
+      *res = result ? result : PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+      return 0;
+    }
+    PQclear(result);
+  }
+
+  return 1;
+}
+
+ExecStatusType sql_select(const char *query, int n_params,
+                          const char *const *param_values, int result_format,
+                          PGresult **res, PGconn *conn) {
+  switch (start_select(query, n_params, param_values, result_format, res,
+                       conn)) {
+  case -1:
+    return PGRES_FATAL_ERROR;
+  case 0:
+    goto end;
+  }
+
+  *res = sql_pipeline_result(conn);
+  if (!*res)
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+
+end:
+  finish_pipeline(conn);
   return PQresultStatus(*res);
 }
 
-PGconn *connect_db(const char *dbname) {
+ExecStatusType sql_select_stream(const char *query, int n_params,
+                                 const char *const *param_values,
+                                 int result_format,
+                                 int (*on_rows)(const PGresult *rows,
+                                                void *arg),
+                                 void *arg, PGresult **res, PGconn *conn) {
+  PGresult *result;
+  ExecStatusType status;
+  int aborted = 0;
+
+  switch (start_select(query, n_params, param_values, result_format, res,
+                       conn)) {
+  case -1:
+    return PGRES_FATAL_ERROR;
+  case 0:
+    goto end;
+  }
+
+  // hand rows over as they arrive instead of collecting them in libpq
+  PQsetSingleRowMode(conn);
+  while (sql_wait_result(conn) && (result = PQgetResult(conn))) {
+    status = PQresultStatus(result);
+    if (!aborted &&
+        (status == PGRES_SINGLE_TUPLE || status == PGRES_TUPLES_OK) &&
+        !on_rows(result, arg)) {
+      // nobody will read the remaining rows
+      aborted = 1;
+      cancel_query(conn, "client_disconnect");
+    }
+
+    if (status == PGRES_SINGLE_TUPLE) {
+      PQclear(result);
+      continue;
+    }
+    PQclear(*res);
+    *res = result;
+  }
+
+  if (!*res)
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+
+end:
+  finish_pipeline(conn);
+  return aborted ? PGRES_FATAL_ERROR : PQresultStatus(*res);
+}
+
+ExecStatusType sql_copy_out(const char *query,
+                            int (*on_data)(const char *data, size_t length,
+                                           void *arg),
+                            void *arg, PGresult **res, PGconn *conn) {
+  char timeout_query[MAX_TIMEOUT_QUERY_LENGTH];
+  char *transaction = NULL;
+  PGresult *result;
+  char *data;
+  int n;
+  int aborted = 0;
+
+  *res = NULL;
+  if (!conn)
+    return PGRES_FATAL_ERROR;
+
+  // COPY cannot be pipelined, so the transaction is sent as one simple query
+  write_timeout_query(timeout_query);
+  size_t size = strlen("BEGIN READ ONLY;") + strlen(timeout_query) +
+                strlen(query) + strlen("COMMIT;") + 1;
+  transaction = malloc(size);
+  if (!transaction) {
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+    return PGRES_FATAL_ERROR;
+  }
+  snprintf(transaction, size, "BEGIN READ ONLY;%s%sCOMMIT;", timeout_query,
+           query);
+
+  if (getenv("SQL_RECEPTIONIST_LOG_QUERIES") &&
+      strcmp(getenv("SQL_RECEPTIONIST_LOG_QUERIES"), "TRUE") == 0)
+    log_debug_printf("Query: %s\n", transaction);
+
+  if (!PQsendQuery(conn, transaction)) {
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+    goto end;
+  }
+
+  while (sql_wait_result(conn) && (result = PQgetResult(conn))) {
+    if (PQresultStatus(result) != PGRES_COPY_OUT) {
+      // BEGIN, SET LOCAL, the end of the COPY & COMMIT, or the error that
+      // skipped the rest
+      PQclear(*res);
+      *res = result;
+      continue;
+    }
+    PQclear(result);
+
+    // the rows are handed over exactly as the server sent them
+    while ((n = PQgetCopyData(conn, &data, 1)) >= 0) {
+      if (n == 0) {
+        if (wait_for_database(conn, POLLIN) < 0 || !PQconsumeInput(conn)) {
+          // the deadline passed (& the query was cancelled) or the connection
+          // broke. Reading on would only wait & cancel again, so the COPY is
+          // abandoned along with the connection
+          PQclear(*res);
+          *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+          check_connection_health(conn);
+          goto end;
+        }
+        continue;
+      }
+      if (!aborted && !on_data(data, n, arg)) {
+        // nobody will read the remaining rows
+        aborted = 1;
+        cancel_query(conn, consumer_cancel_reason(errno));
+        errno = 0;
+      }
+      PQfreemem(data);
+    }
+  }
+
+  if (!*res)
+    *res = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+  if (PQresultStatus(*res) == PGRES_FATAL_ERROR)
+    check_connection_health(conn);
+
+  // a failed statement leaves the transaction open
+  if (PQtransactionStatus(conn) == PQTRANS_INERROR) {
+    PGresult *rollback = NULL;
+    sql_query("ROLLBACK;", &rollback, conn);
+    PQclear(rollback);
+  }
+
+end:
+  free(transaction);
+  return aborted ? PGRES_FATAL_ERROR : PQresultStatus(*res);
+}
+
+/**
+ * Open a new Postgres connection to the given server without blocking on the
+ * socket.
+ * @param dbname The database name.
+ * @param host The database host.
+ * @param port The database port.
+ * @returns The connection, or NULL if it could not be established in time or
+ * if the server's circuit breaker is open.
+ */
+static PGconn *connect_db_host(const char *dbname, const char *host,
+                               const char *port) {
   char conninfo[MAX_CONN_INFO_LENGTH];
+  char breaker_name[MAX_BREAKER_NAME_LENGTH];
 
   if (MAX_CONN_INFO_LENGTH <=
       snprintf(conninfo, MAX_CONN_INFO_LENGTH,
                "dbname=%s user=%s password=%s host=%s port=%s", dbname,
-               getenv("DATABASE_USERNAME"), getenv("DATABASE_PASSWORD"),
-               getenv("DATABASE_HOST"), getenv("DATABASE_PORT"))) {
+               getenv("DATABASE_USERNAME"), getenv("DATABASE_PASSWORD"), host,
+               port)) {
     errno = ENOMEM;
     return NULL;
   }
 
-  return PQconnectdb(conninfo);
+  // fail fast while the database is known to be unreachable
+  write_breaker_name(breaker_name, dbname, host, port);
+  if (!breaker_allow(breaker_name))
+    return NULL;
+
+  PGconn *conn = PQconnectStart(conninfo);
+  if (!conn) {
+    breaker_record_failure(breaker_name);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  // drive the connection handshake without blocking on the socket
+  long long deadline = monotonic_ms() + CONNECT_TIMEOUT_MS;
+  if (watched_deadline_ms && watched_deadline_ms < deadline)
+    deadline = watched_deadline_ms;
+  PostgresPollingStatusType poll_status = PGRES_POLLING_WRITING;
+  while (PQstatus(conn) != CONNECTION_BAD && poll_status != PGRES_POLLING_OK &&
+         poll_status != PGRES_POLLING_FAILED) {
+    long long remaining = deadline - monotonic_ms();
+    if (remaining <= 0 ||
+        wait_for_socket(conn,
+                        poll_status == PGRES_POLLING_READING ? POLLIN : POLLOUT,
+                        remaining) <= 0) {
+      log_error_printf("Timed out while connecting to database %s.\n",
+                       breaker_name);
+      breaker_record_failure(breaker_name);
+      PQfinish(conn);
+      return NULL;
+    }
+    poll_status = PQconnectPoll(conn);
+  }
+
+  // leave failed connections for the caller to report (PQerrorMessage)
+  if (PQstatus(conn) == CONNECTION_OK) {
+    breaker_record_success(breaker_name);
+    PQsetnonblocking(conn, 1);
+  } else {
+    breaker_record_failure(breaker_name);
+  }
+
+  return conn;
+}
+
+PGconn *connect_db(const char *dbname) {
+  return connect_db_host(dbname, getenv("DATABASE_HOST"),
+                         getenv("DATABASE_PORT"));
+}
+
+PGconn *connect_db_replica(const char *dbname) {
+  if (!getenv("DATABASE_REPLICA_HOST"))
+    return NULL;
+
+  return connect_db_host(dbname, getenv("DATABASE_REPLICA_HOST"),
+                         getenv("DATABASE_REPLICA_PORT")
+                             ? getenv("DATABASE_REPLICA_PORT")
+                             : getenv("DATABASE_PORT"));
 }
\ No newline at end of file
@@ -0,0 +1,228 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "libpq-fe.h"
+#include "postgres/select.h"
+#include "postgres/aggregate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// date_bin takes fixed widths only, so months & years are left out
+static const struct {
+  char unit;
+  const char *name;
+} bucket_units[] = {
+    {'s', "seconds"}, {'m', "minutes"}, {'h', "hours"},
+    {'d', "days"},    {'w', "weeks"},
+};
+
+static const struct {
+  const char *name;
+  enum aggregate_function function;
+} aggregate_functions[] = {
+    {"count", AGGREGATE_COUNT}, {"avg", AGGREGATE_AVG},
+    {"sum", AGGREGATE_SUM},     {"min", AGGREGATE_MIN},
+    {"max", AGGREGATE_MAX},
+};
+
+static int is_numeric(const char *datatype) {
+  return strcmp(datatype, "int") == 0 || strcmp(datatype, "integer") == 0 ||
+         strcmp(datatype, "float") == 0 || strcmp(datatype, "number") == 0;
+}
+
+static int is_bucketable(const char *datatype) {
+  return strcmp(datatype, "date") == 0 || strcmp(datatype, "timestamp") == 0;
+}
+
+/**
+ * Finds a column of the schema.
+ * @returns The column or NULL.
+ */
+static const struct data_column *find_schema_column(
+    const struct data_column *schema, unsigned int schema_count,
+    const char *name) {
+  for (unsigned int i = 0; i < schema_count; i++) {
+    if (strcmp(schema[i].name, name) == 0)
+      return &schema[i];
+  }
+  return NULL;
+}
+
+/**
+ * Parses the BUCKET value into a Postgres interval, e.g. "15m" into
+ * "15 minutes".
+ * @returns 1 on success, 0 if the value is invalid.
+ */
+static int parse_bucket_interval(const char *bucket, char *interval) {
+  char *unit;
+  long count = strtol(bucket, &unit, 10);
+
+  if (unit == bucket || *bucket == '-' || *bucket == '+' || count < 1 ||
+      count > 999999 || strlen(unit) != 1)
+    return 0;
+  for (int i = 0; i < sizeof(bucket_units) / sizeof(bucket_units[0]); i++) {
+    if (bucket_units[i].unit == *unit) {
+      snprintf(interval, MAX_BUCKET_INTERVAL_LENGTH, "%ld %s", count,
+               bucket_units[i].name);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Parses an aggregate of the FN list, e.g. "avg(weight)" or "count()".
+ * @returns 1 on success, 0 if the aggregate is invalid.
+ */
+static int parse_aggregate_function(const struct data_column *schema,
+                                    unsigned int schema_count, char *text,
+                                    struct select_aggregate_function *function,
+                                    char *error) {
+  char *open = strchr(text, '(');
+  size_t length = strlen(text);
+  const struct data_column *column;
+  int found = 0;
+
+  if (!open || text[length - 1] != ')') {
+    snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+             "Invalid aggregate \"%s\". Expected <function>(<column>).", text);
+    return 0;
+  }
+  *open++ = '\0';
+  text[length - 1] = '\0';
+
+  for (int i = 0;
+       i < sizeof(aggregate_functions) / sizeof(aggregate_functions[0]); i++) {
+    if (strcmp(aggregate_functions[i].name, text) == 0) {
+      function->function = aggregate_functions[i].function;
+      found = 1;
+    }
+  }
+  if (!found) {
+    snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+             "Unknown aggregate function \"%s\". Expected count, avg, sum, min "
+             "or max.",
+             text);
+    return 0;
+  }
+
+  // count() counts rows
+  if (!*open && function->function == AGGREGATE_COUNT) {
+    function->column = NULL;
+    return 1;
+  }
+
+  column = find_schema_column(schema, schema_count, open);
+  if (!column) {
+    snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+             "Unknown column \"%s\" to aggregate.", open);
+    return 0;
+  }
+  function->column = column->name;
+
+  switch (function->function) {
+  case AGGREGATE_AVG:
+  case AGGREGATE_SUM:
+    found = is_numeric(column->datatype);
+    break;
+  case AGGREGATE_MIN:
+  case AGGREGATE_MAX:
+    found = is_numeric(column->datatype) || is_bucketable(column->datatype) ||
+            strcmp(column->datatype, "time") == 0;
+    break;
+  default:
+    found = 1;
+    break;
+  }
+  if (!found) {
+    snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+             "Cannot aggregate column \"%s\" (%s) with %s.", column->name,
+             column->datatype, text);
+    return 0;
+  }
+  return 1;
+}
+
+int parse_select_aggregate(const struct data_column *schema,
+                           unsigned int schema_count, int tagging,
+                           const char *bucket, const char *bucket_by,
+                           char *functions, char *group_by,
+                           struct select_aggregate *aggregate, char *error) {
+  char *item, *saveptr;
+
+  memset(aggregate, 0, sizeof(struct select_aggregate));
+
+  if (!functions || !*functions) {
+    snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+             "Aggregate requests need at least one aggregate (FN).");
+    return 0;
+  }
+  for (item = strtok_r(functions, ",", &saveptr); item;
+       item = strtok_r(NULL, ",", &saveptr)) {
+    if (aggregate->functions_count == MAX_AGGREGATE_FUNCTIONS) {
+      snprintf(error, MAX_AGGREGATE_ERROR_LENGTH, "Too many aggregates.");
+      return 0;
+    }
+    if (!parse_aggregate_function(
+            schema, schema_count, item,
+            &aggregate->functions[aggregate->functions_count++], error))
+      return 0;
+  }
+
+  if (bucket) {
+    if (!parse_bucket_interval(bucket, aggregate->bucket_interval)) {
+      snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+               "Invalid BUCKET \"%s\". Expected a count & a unit (s, m, h, d "
+               "or w), e.g. 15m.",
+               bucket);
+      return 0;
+    }
+
+    // the only date or timestamp column is bucketed by default
+    for (unsigned int i = 0; i < schema_count; i++) {
+      if (bucket_by ? strcmp(schema[i].name, bucket_by) != 0
+                    : !is_bucketable(schema[i].datatype))
+        continue;
+      if (!is_bucketable(schema[i].datatype) || aggregate->bucket_column) {
+        aggregate->bucket_column = NULL;
+        break;
+      }
+      aggregate->bucket_column = schema[i].name;
+    }
+    if (!aggregate->bucket_column) {
+      snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+               "BUCKET_BY must name a date or timestamp column%s.",
+               bucket_by ? "" : " (the table has none or several)");
+      return 0;
+    }
+  } else if (bucket_by) {
+    snprintf(error, MAX_AGGREGATE_ERROR_LENGTH, "BUCKET_BY needs a BUCKET.");
+    return 0;
+  }
+
+  if (group_by) {
+    for (item = strtok_r(group_by, ",", &saveptr); item;
+         item = strtok_r(NULL, ",", &saveptr)) {
+      const struct data_column *column =
+          find_schema_column(schema, schema_count, item);
+      if (aggregate->group_by_count == MAX_AGGREGATE_GROUPS) {
+        snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+                 "Too many GROUP_BY columns.");
+        return 0;
+      }
+      if (tagging && strcmp(item, "primary_tag") == 0) {
+        aggregate->group_by[aggregate->group_by_count++] = "primary_tag";
+      } else if (column && strcmp(column->datatype, "geodetic point") != 0) {
+        aggregate->group_by[aggregate->group_by_count++] = column->name;
+      } else {
+        snprintf(error, MAX_AGGREGATE_ERROR_LENGTH,
+                 "Cannot group by \"%s\".", item);
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
\ No newline at end of file
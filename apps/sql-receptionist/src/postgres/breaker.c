@@ -0,0 +1,159 @@
+#include "postgres/breaker.h"
+#include "logging.h"
+#include "server/metrics.h"
+#include "utils/clock.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BREAKERS 64
+#define MAX_METRIC_NAME_LENGTH 256
+
+struct breaker {
+  char name[MAX_BREAKER_NAME_LENGTH];
+  enum breaker_state state;
+  int consecutive_failures;
+  long long backoff_ms;
+  long long retry_at_ms;
+  struct metric *state_metric;
+  struct metric *trips_metric;
+  struct metric *rejected_metric;
+};
+
+static struct breaker breakers[MAX_BREAKERS];
+static int breakers_count = 0;
+static unsigned int jitter_seed = 2523;
+static pthread_mutex_t breakers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Finds the breaker with the given name, creating it if needed. Must be called
+ * with breakers_lock held.
+ * @returns The breaker or NULL if there is no room for another breaker.
+ */
+static struct breaker *find_breaker(const char *name) {
+  char metric_name[MAX_METRIC_NAME_LENGTH];
+  struct breaker *breaker;
+
+  for (int i = 0; i < breakers_count; i++) {
+    if (strcmp(breakers[i].name, name) == 0)
+      return &breakers[i];
+  }
+
+  if (breakers_count >= MAX_BREAKERS ||
+      strlen(name) >= MAX_BREAKER_NAME_LENGTH)
+    return NULL;
+
+  breaker = &breakers[breakers_count++];
+  memcpy(breaker->name, name, strlen(name) + 1);
+  breaker->state = BREAKER_CLOSED;
+  breaker->consecutive_failures = 0;
+  breaker->backoff_ms = BREAKER_BASE_BACKOFF_MS;
+  breaker->retry_at_ms = 0;
+
+  snprintf(metric_name, MAX_METRIC_NAME_LENGTH,
+           "sql_receptionist_breaker_state{target=\"%s\"}", name);
+  breaker->state_metric = get_metric(metric_name);
+  snprintf(metric_name, MAX_METRIC_NAME_LENGTH,
+           "sql_receptionist_breaker_trips_total{target=\"%s\"}", name);
+  breaker->trips_metric = get_metric(metric_name);
+  snprintf(metric_name, MAX_METRIC_NAME_LENGTH,
+           "sql_receptionist_breaker_rejected_total{target=\"%s\"}", name);
+  breaker->rejected_metric = get_metric(metric_name);
+
+  return breaker;
+}
+
+/**
+ * Opens the breaker and schedules the next probe. The wait is drawn uniformly
+ * from [backoff / 2, backoff] so that several receptionists do not probe in
+ * lockstep. Must be called with breakers_lock held.
+ */
+static void open_breaker(struct breaker *breaker) {
+  long long half = breaker->backoff_ms / 2;
+
+  breaker->state = BREAKER_OPEN;
+  breaker->retry_at_ms =
+      monotonic_ms() + half + rand_r(&jitter_seed) % (half + 1);
+  metric_set(breaker->state_metric, BREAKER_OPEN);
+
+  log_warn_printf("Circuit breaker for database %s is open. Retrying in at "
+                  "most %lld ms.\n",
+                  breaker->name, breaker->backoff_ms);
+}
+
+int breaker_allow(const char *name) {
+  int output = 1;
+
+  pthread_mutex_lock(&breakers_lock);
+  struct breaker *breaker = find_breaker(name);
+  if (!breaker)
+    goto end;
+
+  switch (breaker->state) {
+  case BREAKER_CLOSED:
+    break;
+  case BREAKER_OPEN:
+    // let a single probe through once the backoff has elapsed
+    if (monotonic_ms() >= breaker->retry_at_ms) {
+      breaker->state = BREAKER_HALF_OPEN;
+      metric_set(breaker->state_metric, BREAKER_HALF_OPEN);
+      break;
+    }
+    output = 0;
+    break;
+  case BREAKER_HALF_OPEN:
+    // a probe is already in flight
+    output = 0;
+    break;
+  }
+
+  if (!output)
+    metric_add(breaker->rejected_metric, 1);
+
+end:
+  pthread_mutex_unlock(&breakers_lock);
+  return output;
+}
+
+void breaker_record_success(const char *name) {
+  pthread_mutex_lock(&breakers_lock);
+  struct breaker *breaker = find_breaker(name);
+  if (breaker) {
+    if (breaker->state != BREAKER_CLOSED)
+      log_info_printf("Circuit breaker for database %s is closed.\n", name);
+    breaker->state = BREAKER_CLOSED;
+    breaker->consecutive_failures = 0;
+    breaker->backoff_ms = BREAKER_BASE_BACKOFF_MS;
+    metric_set(breaker->state_metric, BREAKER_CLOSED);
+  }
+  pthread_mutex_unlock(&breakers_lock);
+}
+
+void breaker_record_failure(const char *name) {
+  pthread_mutex_lock(&breakers_lock);
+  struct breaker *breaker = find_breaker(name);
+  if (!breaker)
+    goto end;
+
+  switch (breaker->state) {
+  case BREAKER_CLOSED:
+    if (++breaker->consecutive_failures >= BREAKER_FAILURE_THRESHOLD) {
+      metric_add(breaker->trips_metric, 1);
+      open_breaker(breaker);
+    }
+    break;
+  case BREAKER_HALF_OPEN:
+    // the probe failed, back off further
+    breaker->backoff_ms *= 2;
+    if (breaker->backoff_ms > BREAKER_MAX_BACKOFF_MS)
+      breaker->backoff_ms = BREAKER_MAX_BACKOFF_MS;
+    open_breaker(breaker);
+    break;
+  case BREAKER_OPEN:
+    break;
+  }
+
+end:
+  pthread_mutex_unlock(&breakers_lock);
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "libpq-fe.h"
+#include "postgres/select.h"
+#include "postgres/cursor.h"
+#include "utils/base64.h"
+#include "utils/format_string.h"
+#include <stdio.h>
+#include <string.h>
+
+int write_cursor(const struct select_options *options, const PGresult *res,
+                 int row_num, char *buffer, size_t buffer_size) {
+  char decoded[MAX_DECODED_CURSOR_LENGTH];
+  char column_name[64];
+  int id_col, col, n, length;
+
+  // the result columns are named like the SQL columns
+  snprintf(column_name, sizeof(column_name), "%s", options->order_by_column);
+  to_lower_snake_case(column_name);
+  id_col = PQfnumber(res, "id");
+  col = PQfnumber(res, column_name);
+  if (id_col < 0 || col < 0 || PQgetisnull(res, row_num, id_col))
+    return -1;
+
+  length = snprintf(decoded, sizeof(decoded), "%s:%s:",
+                    options->order_by_column, options->order_by_order);
+  if (length < 0 || length >= sizeof(decoded))
+    return -1;
+
+  n = write_select_value_text(res, row_num, id_col, decoded + length,
+                              sizeof(decoded) - length);
+  if (n < 0 || length + n + 2 > sizeof(decoded))
+    return -1;
+  length += n;
+  decoded[length++] = ':';
+
+  if (PQgetisnull(res, row_num, col)) {
+    decoded[length++] = 'n';
+  } else {
+    decoded[length++] = 'v';
+    n = write_select_value_text(res, row_num, col, decoded + length,
+                                sizeof(decoded) - length);
+    if (n < 0)
+      return -1;
+    length += n;
+  }
+
+  return base64url_encode(decoded, length, buffer, buffer_size);
+}
+
+int read_cursor(const char *cursor, size_t cursor_length,
+                struct select_options *options, char *buffer,
+                size_t buffer_size) {
+  char *column, *order, *id, *value, *cur;
+  int length;
+
+  if (!buffer_size)
+    return -1;
+  length = base64url_decode(cursor, cursor_length, buffer, buffer_size - 1);
+  if (length < 0 || memchr(buffer, '\0', length))
+    return -1;
+  buffer[length] = '\0';
+
+  // <column>:<order>:<id>:<n|v<value>>, where only the value may hold colons
+  column = buffer;
+  if (!(order = strchr(column, ':')))
+    return -1;
+  *order++ = '\0';
+  if (!(id = strchr(order, ':')))
+    return -1;
+  *id++ = '\0';
+  if (!(value = strchr(id, ':')))
+    return -1;
+  *value++ = '\0';
+
+  // a cursor only continues the ordering it was written for
+  if (strcmp(column, options->order_by_column) != 0 ||
+      strcmp(order, options->order_by_order) != 0)
+    return -1;
+
+  if (!*id)
+    return -1;
+  for (cur = id; *cur; cur++)
+    if (*cur < '0' || *cur > '9')
+      return -1;
+
+  if (strcmp(value, "n") == 0)
+    options->after_value = NULL;
+  else if (*value == 'v')
+    options->after_value = value + 1;
+  else
+    return -1;
+
+  options->after_id = id;
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,238 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "libpq-fe.h"
+#include "postgres/select.h"
+#include "postgres/filter.h"
+#include "utils/regex_item.h"
+#include <regex.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DATE_PATTERN "[0-9]{4}-[0-9]{2}-[0-9]{2}"
+#define TIME_PATTERN "[0-9]{2}:[0-9]{2}(:[0-9]{2}(\\.[0-9]{1,6})?)?"
+
+/**
+ * Which operators a datatype supports.
+ */
+enum filter_class {
+  // is_null only
+  FILTER_CLASS_NONE,
+  // eq, in & is_null
+  FILTER_CLASS_EQUALITY,
+  // every operator
+  FILTER_CLASS_ORDERED,
+};
+
+struct filter_datatype {
+  const char *datatype;
+  enum filter_class filter_class;
+  // the pattern values must match, or NULL for any value
+  char *pattern;
+};
+
+// the config.yml datatypes (see validate_column)
+static const struct filter_datatype filter_datatypes[] = {
+    {"int", FILTER_CLASS_ORDERED, "^-?[0-9]+$"},
+    {"integer", FILTER_CLASS_ORDERED, "^-?[0-9]+$"},
+    {"float", FILTER_CLASS_ORDERED,
+     "^-?([0-9]+\\.?[0-9]*|\\.[0-9]+)([eE][-+]?[0-9]+)?$"},
+    {"number", FILTER_CLASS_ORDERED,
+     "^-?([0-9]+\\.?[0-9]*|\\.[0-9]+)([eE][-+]?[0-9]+)?$"},
+    {"date", FILTER_CLASS_ORDERED, "^" DATE_PATTERN "$"},
+    {"time", FILTER_CLASS_ORDERED, "^" TIME_PATTERN "$"},
+    {"timestamp", FILTER_CLASS_ORDERED,
+     "^" DATE_PATTERN "([T ]" TIME_PATTERN ")?(Z|[-+][0-9]{2}(:?[0-9]{2})?)?$"},
+    {"bool", FILTER_CLASS_EQUALITY, "^(true|false)$"},
+    {"boolean", FILTER_CLASS_EQUALITY, "^(true|false)$"},
+    {"string", FILTER_CLASS_EQUALITY, NULL},
+    {"str", FILTER_CLASS_EQUALITY, NULL},
+    {"text", FILTER_CLASS_EQUALITY, NULL},
+    {"enum", FILTER_CLASS_EQUALITY, NULL},
+};
+
+static const struct {
+  const char *name;
+  enum filter_operator op;
+} filter_operators[] = {
+    {"eq", FILTER_EQ},  {"lt", FILTER_LT},  {"lte", FILTER_LTE},
+    {"gt", FILTER_GT},  {"gte", FILTER_GTE}, {"in", FILTER_IN},
+    {"is_null", FILTER_IS_NULL},
+};
+
+/**
+ * @returns 1 if the value is valid for the datatype, 0 if not.
+ */
+static int validate_filter_value(const struct filter_datatype *datatype,
+                                 const char *value) {
+  if (!datatype->pattern)
+    return 1;
+  return regex_check(datatype->pattern, 1, REG_EXTENDED | REG_NOSUB, 0,
+                     value) == 1;
+}
+
+/**
+ * Writes the comma separated values of an in filter as a Postgres array
+ * literal, quoting every element.
+ * @returns the length of the literal (null terminated), -1 if an element is
+ * invalid or -2 if the buffer is too small.
+ */
+static int write_filter_array(const struct filter_datatype *datatype,
+                              const char *value, char *buffer,
+                              size_t buffer_size) {
+  char element[MAX_FILTER_VALUE_LENGTH];
+  size_t length = 0;
+
+#define write_array_char(character)                                            \
+  ({                                                                           \
+    if (length + 1 >= buffer_size)                                             \
+      return -2;                                                               \
+    buffer[length++] = character;                                              \
+  })
+
+  write_array_char('{');
+  for (const char *start = value;; start++) {
+    const char *stop = strchr(start, ',');
+    size_t element_length = stop ? stop - start : strlen(start);
+    if (element_length >= sizeof(element))
+      return -2;
+    memcpy(element, start, element_length);
+    element[element_length] = '\0';
+    if (!validate_filter_value(datatype, element))
+      return -1;
+
+    if (start != value)
+      write_array_char(',');
+    write_array_char('"');
+    for (const char *cur = element; *cur; cur++) {
+      if (*cur == '"' || *cur == '\\')
+        write_array_char('\\');
+      write_array_char(*cur);
+    }
+    write_array_char('"');
+
+    if (!stop)
+      break;
+    start = stop;
+  }
+  write_array_char('}');
+#undef write_array_char
+
+  buffer[length] = '\0';
+  return length;
+}
+
+int parse_select_filter(const struct data_column *schema,
+                        unsigned int schema_count, int id_column,
+                        const char *key, const char *value,
+                        struct select_filter *filter, char *buffer,
+                        size_t buffer_size, char *error) {
+  static const struct filter_datatype id_datatype = {"int",
+                                                     FILTER_CLASS_ORDERED,
+                                                     "^-?[0-9]+$"};
+  static const struct filter_datatype no_datatype = {"", FILTER_CLASS_NONE,
+                                                     NULL};
+  const struct filter_datatype *datatype = &no_datatype;
+  const char *dot = strrchr(key, '.');
+  const char *datatype_name = NULL;
+  int column_length;
+  int found = 0;
+
+  if (!dot) {
+    snprintf(error, MAX_FILTER_ERROR_LENGTH, "Invalid filter \"%s\".", key);
+    return 0;
+  }
+  column_length = dot - key;
+
+  for (int i = 0; i < sizeof(filter_operators) / sizeof(filter_operators[0]);
+       i++) {
+    if (strcmp(filter_operators[i].name, dot + 1) == 0) {
+      filter->op = filter_operators[i].op;
+      found = 1;
+    }
+  }
+  if (!found) {
+    snprintf(error, MAX_FILTER_ERROR_LENGTH,
+             "Unknown filter operator \"%s\". Expected eq, lt, lte, gt, gte, "
+             "in or is_null.",
+             dot + 1);
+    return 0;
+  }
+
+  filter->column = NULL;
+  if (id_column && column_length == strlen("id") &&
+      strncmp(key, "id", column_length) == 0) {
+    filter->column = "id";
+    datatype = &id_datatype;
+  }
+  for (unsigned int i = 0; !filter->column && i < schema_count; i++) {
+    if (strlen(schema[i].name) == column_length &&
+        strncmp(schema[i].name, key, column_length) == 0) {
+      filter->column = schema[i].name;
+      datatype_name = schema[i].datatype;
+    }
+  }
+  if (!filter->column) {
+    snprintf(error, MAX_FILTER_ERROR_LENGTH,
+             "Unknown column \"%.*s\" to filter by.", column_length, key);
+    return 0;
+  }
+  // unknown datatypes can only be filtered by is_null
+  for (int i = 0; i < sizeof(filter_datatypes) / sizeof(filter_datatypes[0]);
+       i++) {
+    if (datatype_name &&
+        strcmp(filter_datatypes[i].datatype, datatype_name) == 0)
+      datatype = &filter_datatypes[i];
+  }
+
+  // is_null=false is IS NOT NULL
+  if (filter->op == FILTER_IS_NULL) {
+    if (strcmp(value, "true") != 0 && strcmp(value, "false") != 0) {
+      snprintf(error, MAX_FILTER_ERROR_LENGTH,
+               "Invalid is_null value. Expected true or false.");
+      return 0;
+    }
+    if (strcmp(value, "false") == 0)
+      filter->op = FILTER_IS_NOT_NULL;
+    filter->value = NULL;
+    return 1;
+  }
+
+  if (datatype->filter_class == FILTER_CLASS_NONE ||
+      (datatype->filter_class == FILTER_CLASS_EQUALITY &&
+       filter->op != FILTER_EQ && filter->op != FILTER_IN)) {
+    snprintf(error, MAX_FILTER_ERROR_LENGTH,
+             "Column \"%s\" does not support the %s filter.", filter->column,
+             dot + 1);
+    return 0;
+  }
+
+  if (filter->op == FILTER_IN) {
+    switch (write_filter_array(datatype, value, buffer, buffer_size)) {
+    case -1:
+      goto invalid_value;
+    case -2:
+      goto too_long;
+    }
+  } else {
+    if (!validate_filter_value(datatype, value))
+      goto invalid_value;
+    if (strlen(value) >= buffer_size)
+      goto too_long;
+    strcpy(buffer, value);
+  }
+  filter->value = buffer;
+  return 1;
+
+invalid_value:
+  snprintf(error, MAX_FILTER_ERROR_LENGTH,
+           "Invalid value to filter \"%s\" by (expected %s).", filter->column,
+           *datatype->datatype ? datatype->datatype : "a value");
+  return 0;
+
+too_long:
+  snprintf(error, MAX_FILTER_ERROR_LENGTH,
+           "The value to filter \"%s\" by is too long.", filter->column);
+  return 0;
+}
\ No newline at end of file
@@ -20,10 +20,7 @@
 #include <stdbool.h>
 #include <string.h>
 
-#define MAX_INSERT_QUERY_SIZE 8192
-#define MAX_PLACEHOLDER_SIZE 65536
 #define MAX_COLUMN_NAME_SIZE 100
-#define MAX_COLUMNS 64
 #define LARGEST_COLUMN_NAME_SUFFIX strlen("_altitude_accuracy")
 
 // does NOT validate datatypes
@@ -58,8 +55,14 @@
     cur += n;                                                                  \
   })
 
+// also records the name of the column that was just written into the query
 #define write_placeholder_value()                                              \
   do {                                                                         \
+    n = query_cur - query_cur_checkpoint - 1;                                  \
+    memcpy(column_names_cur, query_cur_checkpoint, n);                         \
+    column_names_cur[n] = '\0';                                                \
+    prepared->columns[columns_consumed] = column_names_cur;                    \
+    column_names_cur += n + 1;                                                 \
     if (current_item != NULL && !json_is_null(current_item)) {                 \
       placeholder_ptrs[columns_consumed++] = placeholder_cur;                  \
       cur_write_json_value(placeholder_cur, placeholder_remaining_size,        \
@@ -70,18 +73,16 @@
     }                                                                          \
   } while (0)
 
-int validate_and_insert_into(struct insert_options *options, json_t *entry,
-                             PGresult **res, PGconn *conn, char *error_buffer) {
-  // @TODO use placeholders
+int prepare_insert(struct insert_options *options, json_t *entry,
+                   struct prepared_insert *prepared, char *error_buffer) {
   int status = 0; // innocent until proven guilty
   const char *key = NULL;
   const json_t *value = NULL;
-  char query[MAX_INSERT_QUERY_SIZE];
-  char placeholders[MAX_PLACEHOLDER_SIZE];
-  const char *placeholder_ptrs[MAX_COLUMNS];
+  const char **placeholder_ptrs = prepared->values;
   char *current_column_name = NULL;
-  char *query_cur = query;
-  char *placeholder_cur = placeholders;
+  char *query_cur = prepared->query;
+  char *placeholder_cur = prepared->placeholders;
+  char *column_names_cur = prepared->column_names;
   size_t query_remaining_size = MAX_INSERT_QUERY_SIZE;
   size_t placeholder_remaining_size = MAX_PLACEHOLDER_SIZE;
   size_t n;
@@ -354,14 +355,7 @@ int validate_and_insert_into(struct insert_options *options, json_t *entry,
   cur_append(query_cur, query_remaining_size, ';');
   cur_append(query_cur, query_remaining_size, '\0');
 
-  // query database
-  if (getenv("SQL_RECEPTIONIST_LOG_QUERIES") &&
-      strcmp(getenv("SQL_RECEPTIONIST_LOG_QUERIES"), "TRUE") == 0)
-    log_debug_printf("INSERT query: %s\n", query);
-
-  // Submit & Execute query
-  *res = PQexecParams(conn, query, columns_consumed, NULL, placeholder_ptrs,
-                      NULL, NULL, 0);
+  prepared->n_params = columns_consumed;
   status = 1;
 
 end:
@@ -388,3 +382,22 @@ end:
   }
   return status;
 }
+
+int validate_and_insert_into(struct insert_options *options, json_t *entry,
+                             PGconn *conn, char *error_buffer) {
+  struct prepared_insert prepared;
+  int status = prepare_insert(options, entry, &prepared, error_buffer);
+
+  if (status != 1)
+    return status;
+
+  // Queue the query. libpq copies the query & placeholders, so the buffers
+  // may go out of scope before the pipeline is synced.
+  if (!sql_pipeline_send(conn, prepared.query, prepared.n_params,
+                         prepared.values)) {
+    snprintf(error_buffer, ERROR_BUFFER_SIZE, "%s", PQerrorMessage(conn));
+    return -1;
+  }
+
+  return 1;
+}
\ No newline at end of file
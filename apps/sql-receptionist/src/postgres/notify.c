@@ -0,0 +1,101 @@
+#include "postgres/notify.h"
+#include "logging.h"
+#include "postgres.h"
+#include "server/cache.h"
+#include "server/tag_dictionary.h"
+#include "utils/clock.h"
+#include <errno.h>
+#include <libpq-fe.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// LISTEN "<channel>";
+#define MAX_LISTEN_QUERY_LENGTH (MAX_CACHE_CHANNEL_LENGTH + 16)
+
+/**
+ * LISTENs on the channel of every table of the database.
+ * @returns 1 on success, 0 on failure.
+ */
+static int listen_to_tables(PGconn *conn, const struct db *database) {
+  char channel[MAX_CACHE_CHANNEL_LENGTH];
+  char query[MAX_LISTEN_QUERY_LENGTH];
+  PGresult *res = NULL;
+
+  // never let a stuck server stall the listener
+  sql_watch_request(-1, monotonic_ms() + NOTIFY_LISTEN_TIMEOUT_MS);
+
+  for (unsigned int i = 0; i < database->tables_count; i++) {
+    if (!write_cache_channel(database->tables[i].table_name, channel,
+                             MAX_CACHE_CHANNEL_LENGTH)) {
+      log_error_printf("Table name %s is too long to LISTEN on.\n",
+                       database->tables[i].table_name);
+      continue;
+    }
+
+    // table names are lower snake case, so the channel needs no escaping
+    snprintf(query, MAX_LISTEN_QUERY_LENGTH, "LISTEN \"%s\";", channel);
+    ExecStatusType status = sql_query(query, &res, conn);
+    PQclear(res);
+    res = NULL;
+    if (status != PGRES_COMMAND_OK) {
+      log_error_printf("Failed to LISTEN on %s: %s\n", channel,
+                       PQerrorMessage(conn));
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void *listen_for_invalidations(void *arg) {
+  const struct db *database = arg;
+  const size_t prefix_length = strlen(CACHE_CHANNEL_PREFIX);
+  PGconn *conn = NULL;
+  PGnotify *notify;
+
+  for (;;) {
+    if (!conn) {
+      conn = connect_db(database->db_name);
+      if (!conn || !listen_to_tables(conn, database)) {
+        PQfinish(conn);
+        conn = NULL;
+        usleep(NOTIFY_RETRY_INTERVAL_MS * 1000);
+        continue;
+      }
+      // writes that were not heard of may have been cached
+      tag_dictionary_invalidate(database->db_name, NULL);
+      cache_invalidate(database->db_name, NULL);
+    }
+
+    struct pollfd pfd = {PQsocket(conn), POLLIN, 0};
+    int ready = poll(&pfd, 1, NOTIFY_POLL_INTERVAL_MS);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    if (ready < 0 || !PQconsumeInput(conn) ||
+        PQstatus(conn) != CONNECTION_OK) {
+      log_error_printf("Lost the cache invalidation listener of %s: %s\n",
+                       database->db_name, PQerrorMessage(conn));
+      PQfinish(conn);
+      conn = NULL;
+      continue;
+    }
+
+    while ((notify = PQnotifies(conn))) {
+      if (strncmp(notify->relname, CACHE_CHANNEL_PREFIX, prefix_length) != 0) {
+        PQfreemem(notify);
+        continue;
+      }
+      // the dictionary goes first, so that responses cached after the cache
+      // invalidation are built with the new names
+      if (strcmp(notify->extra, TAG_DICTIONARY_NOTIFY_PAYLOAD) == 0)
+        tag_dictionary_invalidate(database->db_name,
+                                  notify->relname + prefix_length);
+      cache_invalidate(database->db_name, notify->relname + prefix_length);
+      PQfreemem(notify);
+    }
+  }
+
+  return NULL;
+}
\ No newline at end of file
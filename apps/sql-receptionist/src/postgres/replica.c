@@ -0,0 +1,148 @@
+#include "postgres/replica.h"
+#include "logging.h"
+#include "postgres.h"
+#include "server/metrics.h"
+#include "utils/clock.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int is_valid_lsn(const char *lsn) {
+  // two groups of 1-8 hex digits separated by a slash
+  for (int group = 0; group < 2; group++) {
+    int digits = 0;
+    while (isxdigit((unsigned char)*lsn) && digits <= 8) {
+      lsn++;
+      digits++;
+    }
+    if (digits < 1 || digits > 8)
+      return 0;
+    if (group == 0 && *lsn++ != '/')
+      return 0;
+  }
+
+  return *lsn == '\0';
+}
+
+/**
+ * Checks whether the replica behind the connection has replayed the given LSN.
+ * @param conn The replica connection.
+ * @param min_lsn The LSN to check for.
+ * @returns 1 if it has, 0 if it has not or the check failed.
+ */
+static int has_replayed(PGconn *conn, const char *min_lsn) {
+  PGresult *res = NULL;
+  int replayed = 0;
+
+  if (sql_query_params("SELECT pg_last_wal_replay_lsn() >= $1::pg_lsn;", 1,
+                       &min_lsn, &res, conn) == PGRES_TUPLES_OK &&
+      PQntuples(res) == 1 && !PQgetisnull(res, 0, 0))
+    replayed = strcmp(PQgetvalue(res, 0, 0), "t") == 0;
+
+  PQclear(res);
+  return replayed;
+}
+
+PGconn *connect_db_for_read(const char *dbname, const char *min_lsn) {
+  if (!getenv("DATABASE_REPLICA_HOST"))
+    return connect_db(dbname);
+
+  PGconn *conn = connect_db_replica(dbname);
+  if (!conn || PQstatus(conn) != CONNECTION_OK) {
+    metric_add(get_metric("sql_receptionist_replica_fallbacks_total{reason="
+                          "\"unavailable\"}"),
+               1);
+    goto fallback;
+  }
+
+  // read-your-writes: the replica must have caught up with the client's write
+  if (min_lsn && !has_replayed(conn, min_lsn)) {
+    metric_add(get_metric("sql_receptionist_replica_fallbacks_total{reason="
+                          "\"lag\"}"),
+               1);
+    goto fallback;
+  }
+
+  metric_add(get_metric("sql_receptionist_replica_reads_total"), 1);
+  return conn;
+
+fallback:
+  PQfinish(conn);
+  return connect_db(dbname);
+}
+
+/**
+ * Makes sure that the connection is usable, reconnecting if needed.
+ * @param conn The connection to check. Replaced on reconnect.
+ * @param replica Whether to connect to the replica instead of the primary.
+ * @param dbname The database name.
+ * @returns 1 if the connection is usable, 0 otherwise.
+ */
+static int ensure_connection(PGconn **conn, int replica, const char *dbname) {
+  if (*conn && PQstatus(*conn) == CONNECTION_OK)
+    return 1;
+
+  PQfinish(*conn);
+  *conn = replica ? connect_db_replica(dbname) : connect_db(dbname);
+  return *conn && PQstatus(*conn) == CONNECTION_OK;
+}
+
+void *monitor_replica_lag(void *arg) {
+  const char *dbname = arg;
+  PGconn *primary = NULL;
+  PGconn *replica = NULL;
+  PGresult *res = NULL;
+  char primary_lsn[MAX_LSN_LENGTH];
+  const char *param = primary_lsn;
+  struct metric *lag_bytes = get_metric("sql_receptionist_replica_lag_bytes");
+  struct metric *lag_ms = get_metric("sql_receptionist_replica_lag_ms");
+  struct metric *up = get_metric("sql_receptionist_replica_up");
+
+  for (;; usleep(REPLICA_MONITOR_INTERVAL_MS * 1000)) {
+    // never let a stuck server stall the monitor
+    sql_watch_request(-1, monotonic_ms() + REPLICA_MONITOR_INTERVAL_MS);
+
+    if (!ensure_connection(&primary, 0, dbname) ||
+        !ensure_connection(&replica, 1, dbname)) {
+      metric_set(up, 0);
+      continue;
+    }
+
+    if (sql_query("SELECT pg_current_wal_lsn();", &res, primary) !=
+            PGRES_TUPLES_OK ||
+        PQntuples(res) != 1) {
+      log_error_printf("Failed to read the primary's WAL position: %s\n",
+                       PQerrorMessage(primary));
+      goto next;
+    }
+    strncpy(primary_lsn, PQgetvalue(res, 0, 0), MAX_LSN_LENGTH - 1);
+    primary_lsn[MAX_LSN_LENGTH - 1] = '\0';
+    PQclear(res);
+
+    // replay_ms only means something while there is WAL left to replay, an
+    // idle primary would otherwise look like an ever growing lag
+    if (sql_query_params(
+            "SELECT pg_wal_lsn_diff($1::pg_lsn, pg_last_wal_replay_lsn())"
+            "::bigint, COALESCE((EXTRACT(EPOCH FROM now() - "
+            "pg_last_xact_replay_timestamp()) * 1000)::bigint, 0);",
+            1, &param, &res, replica) != PGRES_TUPLES_OK ||
+        PQntuples(res) != 1 || PQgetisnull(res, 0, 0)) {
+      log_error_printf("Failed to read the replica's replay position: %s\n",
+                       PQerrorMessage(replica));
+      metric_set(up, 0);
+      goto next;
+    }
+
+    long long bytes = atoll(PQgetvalue(res, 0, 0));
+    metric_set(up, 1);
+    metric_set(lag_bytes, bytes > 0 ? bytes : 0);
+    metric_set(lag_ms, bytes > 0 ? atoll(PQgetvalue(res, 0, 1)) : 0);
+
+  next:
+    PQclear(res);
+    res = NULL;
+  }
+
+  return NULL;
+}
\ No newline at end of file
@@ -8,14 +8,56 @@
 #endif
 #include "libpq-fe.h"
 #include "postgres/select.h"
+#include "server/tag_dictionary.h"
+#include "utils/format_number.h"
 #include "utils/format_string.h"
+#include "utils/json/json_string.h"
+#include "utils/msgpack.h"
+#include "utils/network_order.h"
 #include <asm-generic/errno.h>
 #include <errno.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 
+// type OIDs (pg_type.dat)
+#define BOOLOID 16
+#define NAMEOID 19
+#define INT8OID 20
+#define INT2OID 21
+#define INT4OID 23
+#define TEXTOID 25
+#define OIDOID 26
+#define JSONOID 114
+#define FLOAT4OID 700
+#define FLOAT8OID 701
+#define BPCHAROID 1042
+#define VARCHAROID 1043
+#define DATEOID 1082
+#define TIMEOID 1083
+#define TIMESTAMPOID 1114
+#define TIMESTAMPTZOID 1184
+#define INTERVALOID 1186
+#define TIMETZOID 1266
+#define NUMERICOID 1700
+#define UUIDOID 2950
+#define JSONBOID 3802
+
+// binary dates & timestamps count from 2000-01-01
+#define POSTGRES_EPOCH_UNIX_SECONDS 946684800LL
+#define SECONDS_PER_DAY 86400LL
+#define USECS_PER_SEC 1000000LL
+#define USECS_PER_HOUR 3600000000LL
+#define MONTHS_PER_YEAR 12
+#define MAX_BINARY_VALUE_STR_LENGTH 128
+
+// binary numeric signs (numeric.c)
+#define NUMERIC_NEG 0x4000
+#define NUMERIC_SPECIAL 0xC000
+
 size_t select_query_size(struct select_options *options) {
   // do not validate options.
   size_t query_size = strlen("SELECT  FROM \nORDER BY  \nLIMIT ;") +
@@ -46,35 +88,64 @@ size_t select_query_size(struct select_options *options) {
   return query_size;
 }
 
-void construct_select_query(struct select_options *options, char *buffer,
-                            size_t buffer_size) {
-  // do not validate options.
+/**
+ * @returns Whether a config.yml datatype holds text. The Postgres type behind
+ * such a column may be an enum, citext & the like, whose binary format cannot
+ * be decoded, so the query casts these columns to text.
+ */
+static int is_text_datatype(const char *datatype) {
+  return strcmp(datatype, "string") == 0 || strcmp(datatype, "str") == 0 ||
+         strcmp(datatype, "text") == 0 || strcmp(datatype, "enum") == 0;
+}
+
+/**
+ * @returns The config.yml datatype of a column, or "" if it is not in the
+ * schema.
+ */
+static const char *find_datatype(const struct select_options *options,
+                                 const char *column_name) {
+  for (int i = 0; i < options->schema_count; i++)
+    if (strcmp(options->schema[i].name, column_name) == 0)
+      return options->schema[i].datatype;
+  return "";
+}
+
+// SQL names of the aggregate functions, by enum aggregate_function
+static const char *const aggregate_function_names[] = {"count", "avg", "sum",
+                                                       "min", "max"};
+
+// a parameter ($1, $2, ...) or, if parameters cannot be bound, the value as a
+// literal. The order must match select_query_params
+#define cur_write_param(cur, remaining_size, value)                            \
+  ({                                                                           \
+    if (inline_params) {                                                       \
+      cur_write_literal(cur, remaining_size, value);                           \
+    } else {                                                                   \
+      n = snprintf(cur, remaining_size, "$%d", ++params_count);                \
+      if (n >= remaining_size) {                                               \
+        errno = ENOMEM;                                                        \
+        goto end;                                                              \
+      }                                                                        \
+      remaining_size -= n;                                                     \
+      cur += n;                                                                \
+    }                                                                          \
+  })
+
+/**
+ * Writes the columns of a schema the way the data endpoints select them, each
+ * followed by a comma.
+ * @param options The options holding the table name & schema.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maximum amount of characters the buffer can store.
+ * @returns The number of characters written or -1 if the buffer is too small.
+ */
+static int write_schema_columns(const struct select_options *options,
+                                char *buffer, size_t buffer_size) {
   char *cur = buffer;
   size_t n = 0;
   size_t remaining_size = buffer_size;
   const int table_name_len = strlen(options->table_name);
 
-  // construct query
-  cur_memcpy(cur, remaining_size, "SELECT ");
-
-  // columns
-  // id column
-  if (options->id_column) {
-    cur_write_table_name(cur, remaining_size);
-    cur_memcpy(cur, remaining_size, ".id,");
-  }
-
-  // primary tag column
-  if (options->primary_tag) {
-    if (options->transform_tag_names) {
-      cur_write_table_name(cur, remaining_size);
-      cur_memcpy(cur, remaining_size, "_tag_names.tag_name AS primary_tag,");
-    } else {
-      cur_write_table_name(cur, remaining_size);
-      cur_memcpy(cur, remaining_size, ".primary_tag,");
-    }
-  }
-
   for (int i = 0; i < options->schema_count; i++) {
     size_t column_name_size = strlen(options->schema[i].name);
     size_t temp;
@@ -101,6 +172,11 @@ void construct_select_query(struct select_options *options, char *buffer,
       // altitude_accuracy
       cur_write_full_column_name(cur, remaining_size);
       cur_memcpy(cur, remaining_size, "_altitude_accuracy,");
+    } else if (is_text_datatype(options->schema[i].datatype)) {
+      cur_write_full_column_name(cur, remaining_size);
+      cur_memcpy(cur, remaining_size, "::text AS ");
+      cur_write_column_name(cur, remaining_size, options->schema[i].name);
+      cur_append(cur, remaining_size, ',');
     } else {
       cur_write_full_column_name(cur, remaining_size);
       cur_append(cur, remaining_size, ',');
@@ -113,6 +189,172 @@ void construct_select_query(struct select_options *options, char *buffer,
     }
   }
 
+  return cur - buffer;
+
+end:
+  return -1;
+}
+
+/**
+ * Writes the SELECT query of construct_select_query.
+ * @param inline_params Whether to write the values of the parameters into the
+ * query instead of placeholders.
+ */
+static void write_select_query(struct select_options *options,
+                               int inline_params, char *buffer,
+                               size_t buffer_size) {
+  // do not validate options.
+  char *cur = buffer;
+  size_t n = 0;
+  size_t remaining_size = buffer_size;
+  const int table_name_len = strlen(options->table_name);
+  int params_count = 0;
+  int conditions_count = 0;
+
+  // construct query
+  cur_memcpy(cur, remaining_size, "SELECT ");
+
+  // columns
+  if (options->aggregate) {
+    const struct select_aggregate *aggregate = options->aggregate;
+    if (aggregate->bucket_column) {
+      cur_memcpy(cur, remaining_size, "date_bin(");
+      cur_write_param(cur, remaining_size, aggregate->bucket_interval);
+      cur_memcpy(cur, remaining_size, "::interval,");
+      cur_write_table_name(cur, remaining_size);
+      cur_append(cur, remaining_size, '.');
+      cur_write_column_name(cur, remaining_size, aggregate->bucket_column);
+      cur_memcpy(cur, remaining_size,
+                 "::timestamp,TIMESTAMP '2000-01-01') AS bucket,");
+    }
+    for (int i = 0; i < aggregate->group_by_count; i++) {
+      if (strcmp(aggregate->group_by[i], "primary_tag") == 0 &&
+          options->transform_tag_names) {
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tag_names.tag_name AS primary_tag,");
+        continue;
+      }
+      cur_write_table_name(cur, remaining_size);
+      cur_append(cur, remaining_size, '.');
+      cur_write_column_name(cur, remaining_size, aggregate->group_by[i]);
+      if (is_text_datatype(find_datatype(options, aggregate->group_by[i]))) {
+        cur_memcpy(cur, remaining_size, "::text AS ");
+        cur_write_column_name(cur, remaining_size, aggregate->group_by[i]);
+      }
+      cur_append(cur, remaining_size, ',');
+    }
+    for (int i = 0; i < aggregate->functions_count; i++) {
+      const struct select_aggregate_function *function =
+          &aggregate->functions[i];
+      const char *name = aggregate_function_names[function->function];
+      if (!function->column) {
+        cur_memcpy(cur, remaining_size, "count(*) AS count,");
+        continue;
+      }
+      cur_memcpy(cur, remaining_size, name);
+      cur_append(cur, remaining_size, '(');
+      cur_write_table_name(cur, remaining_size);
+      cur_append(cur, remaining_size, '.');
+      cur_write_column_name(cur, remaining_size, function->column);
+      cur_memcpy(cur, remaining_size, ") AS ");
+      cur_memcpy(cur, remaining_size, name);
+      cur_append(cur, remaining_size, '_');
+      cur_write_column_name(cur, remaining_size, function->column);
+      cur_append(cur, remaining_size, ',');
+    }
+  } else {
+    // id column
+    if (options->id_column) {
+      cur_write_table_name(cur, remaining_size);
+      cur_memcpy(cur, remaining_size, ".id,");
+    }
+
+    // primary tag column
+    if (options->primary_tag) {
+      if (options->transform_tag_names) {
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tag_names.tag_name AS primary_tag,");
+      } else {
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, ".primary_tag,");
+      }
+    }
+
+    int columns_length = write_schema_columns(options, cur, remaining_size);
+    if (columns_length < 0) {
+      errno = ENOMEM;
+      goto end;
+    }
+    cur += columns_length;
+    remaining_size -= columns_length;
+
+    // related rows are nested by correlated subqueries, which only run for the
+    // rows within the limit
+    if (options->expand & SELECT_EXPAND_TAGS) {
+      cur_memcpy(cur, remaining_size, "coalesce((SELECT json_agg(");
+      cur_write_table_name(cur, remaining_size);
+      if (options->transform_tag_names) {
+        cur_memcpy(cur, remaining_size, "_tag_names.tag_name ORDER BY ");
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tag_names.tag_name) FROM ");
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tags JOIN ");
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tag_names ON ");
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tag_names.id=");
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tags.tag_id");
+      } else {
+        cur_memcpy(cur, remaining_size, "_tags.tag_id ORDER BY ");
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tags.tag_id) FROM ");
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, "_tags");
+      }
+      cur_memcpy(cur, remaining_size, " WHERE ");
+      cur_write_table_name(cur, remaining_size);
+      cur_memcpy(cur, remaining_size, "_tags.entry_id=");
+      cur_write_table_name(cur, remaining_size);
+      cur_memcpy(cur, remaining_size, ".id),'[]') AS tags,");
+    }
+    // descriptor rows share the ID of their entry & are nested with the
+    // columns of the descriptor's data endpoint
+    if (options->expand & SELECT_EXPAND_DESCRIPTORS) {
+      cur_memcpy(cur, remaining_size, "json_build_object(");
+      for (int i = 0; i < options->descriptors_count; i++) {
+        const struct descriptor *descriptor = &options->descriptors[i];
+        struct select_options descriptor_options = {
+            "descriptor", NULL, NULL, descriptor->schema,
+            descriptor->schema_count};
+        if (i)
+          cur_append(cur, remaining_size, ',');
+        cur_append(cur, remaining_size, '\'');
+        cur_write_column_name(cur, remaining_size, descriptor->name);
+        cur_memcpy(cur, remaining_size,
+                   "',coalesce((SELECT json_agg(descriptor) FROM (SELECT "
+                   "descriptor.id,");
+        columns_length =
+            write_schema_columns(&descriptor_options, cur, remaining_size);
+        if (columns_length < 0) {
+          errno = ENOMEM;
+          goto end;
+        }
+        cur += columns_length - 1;
+        remaining_size -= columns_length - 1;
+        cur_memcpy(cur, remaining_size, " FROM ");
+        cur_write_table_name(cur, remaining_size);
+        cur_append(cur, remaining_size, '_');
+        cur_write_column_name(cur, remaining_size, descriptor->name);
+        cur_memcpy(cur, remaining_size,
+                   "_descriptors descriptor WHERE descriptor.id=");
+        cur_write_table_name(cur, remaining_size);
+        cur_memcpy(cur, remaining_size, ".id) descriptor),'[]')");
+      }
+      cur_memcpy(cur, remaining_size, ") AS descriptors,");
+    }
+  }
+
   // get rid of trailing comma
   cur--;
   remaining_size++;
@@ -135,23 +377,157 @@ void construct_select_query(struct select_options *options, char *buffer,
     cur_memcpy(cur, remaining_size, "_tag_names.id");
   }
 
+// conditions are joined into a single WHERE clause
+#define cur_write_condition_start(cur, remaining_size)                         \
+  ({                                                                           \
+    cur_memcpy(cur, remaining_size, conditions_count ? " AND " : " WHERE ");   \
+    conditions_count++;                                                        \
+  })
+
   // if there is a column name to filter by,
   if (options->filter_column_name != NULL) {
-    cur_memcpy(cur, remaining_size, " WHERE ");
+    cur_write_condition_start(cur, remaining_size);
     cur_memcpy(cur, remaining_size,
                options->filter_table_name ? options->filter_table_name
                                           : options->table_name);
     cur_append(cur, remaining_size, '.');
     cur_memcpy(cur, remaining_size, options->filter_column_name);
-    // @TODO use placeholders
-    cur_memcpy(cur, remaining_size, "='");
-    cur_memcpy(cur, remaining_size, options->filter_value);
-    cur_append(cur, remaining_size, '\'');
+    cur_append(cur, remaining_size, '=');
+    cur_write_param(cur, remaining_size, options->filter_value);
+  }
+
+  // the parameters take the type of the column they are compared to, so that
+  // indexes on the column apply
+  for (int i = 0; i < options->filters_count; i++) {
+    const struct select_filter *filter = &options->filters[i];
+    cur_write_condition_start(cur, remaining_size);
+    cur_write_table_name(cur, remaining_size);
+    cur_append(cur, remaining_size, '.');
+    cur_write_column_name(cur, remaining_size, filter->column);
+    switch (filter->op) {
+    case FILTER_EQ:
+      cur_append(cur, remaining_size, '=');
+      break;
+    case FILTER_LT:
+      cur_append(cur, remaining_size, '<');
+      break;
+    case FILTER_LTE:
+      cur_memcpy(cur, remaining_size, "<=");
+      break;
+    case FILTER_GT:
+      cur_append(cur, remaining_size, '>');
+      break;
+    case FILTER_GTE:
+      cur_memcpy(cur, remaining_size, ">=");
+      break;
+    case FILTER_IN:
+      cur_memcpy(cur, remaining_size, "=ANY(");
+      break;
+    case FILTER_IS_NULL:
+      cur_memcpy(cur, remaining_size, " IS NULL");
+      continue;
+    case FILTER_IS_NOT_NULL:
+      cur_memcpy(cur, remaining_size, " IS NOT NULL");
+      continue;
+    }
+    cur_write_param(cur, remaining_size, filter->value);
+    if (filter->op == FILTER_IN)
+      cur_append(cur, remaining_size, ')');
+  }
+
+  // keyset pagination: the rows after the cursor's row in (order_by_column,
+  // id) order, which an index on both columns finds at any depth. NULLs come
+  // last in ascending & first in descending order, like in ORDER BY
+  int order_by_id = strcmp(options->order_by_column, "id") == 0;
+  int descending = strcmp(options->order_by_order, "DESC") == 0;
+  if (options->after_id) {
+    cur_write_condition_start(cur, remaining_size);
+    if (order_by_id) {
+      cur_write_table_name(cur, remaining_size);
+      cur_memcpy(cur, remaining_size, descending ? ".id<" : ".id>");
+      cur_write_param(cur, remaining_size, options->after_id);
+    } else if (options->after_value) {
+      cur_memcpy(cur, remaining_size, "((");
+      cur_write_table_name(cur, remaining_size);
+      cur_append(cur, remaining_size, '.');
+      cur_write_column_name(cur, remaining_size, options->order_by_column);
+      cur_append(cur, remaining_size, ',');
+      cur_write_table_name(cur, remaining_size);
+      cur_memcpy(cur, remaining_size, descending ? ".id)<(" : ".id)>(");
+      cur_write_param(cur, remaining_size, options->after_value);
+      cur_append(cur, remaining_size, ',');
+      cur_write_param(cur, remaining_size, options->after_id);
+      cur_append(cur, remaining_size, ')');
+      if (!descending) {
+        cur_memcpy(cur, remaining_size, " OR ");
+        cur_write_table_name(cur, remaining_size);
+        cur_append(cur, remaining_size, '.');
+        cur_write_column_name(cur, remaining_size, options->order_by_column);
+        cur_memcpy(cur, remaining_size, " IS NULL");
+      }
+      cur_append(cur, remaining_size, ')');
+    } else {
+      cur_append(cur, remaining_size, '(');
+      cur_write_table_name(cur, remaining_size);
+      cur_append(cur, remaining_size, '.');
+      cur_write_column_name(cur, remaining_size, options->order_by_column);
+      cur_memcpy(cur, remaining_size,
+                 descending ? " IS NOT NULL OR " : " IS NULL AND ");
+      cur_write_table_name(cur, remaining_size);
+      cur_memcpy(cur, remaining_size, descending ? ".id<" : ".id>");
+      cur_write_param(cur, remaining_size, options->after_id);
+      cur_append(cur, remaining_size, ')');
+    }
+  }
+#undef cur_write_condition_start
+
+  if (options->aggregate) {
+    // the buckets & groups lead the SELECT list
+    int groups_count = (options->aggregate->bucket_column ? 1 : 0) +
+                       options->aggregate->group_by_count;
+    for (int i = 1; i <= groups_count; i++) {
+      n = snprintf(cur, remaining_size, "%s%d", i == 1 ? " GROUP BY " : ",", i);
+      if (n >= remaining_size) {
+        errno = ENOMEM;
+        goto end;
+      }
+      remaining_size -= n;
+      cur += n;
+    }
+    for (int i = 1; i <= groups_count; i++) {
+      n = snprintf(cur, remaining_size, "%s%d %s", i == 1 ? " ORDER BY " : ",",
+                   i, options->order_by_order);
+      if (n >= remaining_size) {
+        errno = ENOMEM;
+        goto end;
+      }
+      remaining_size -= n;
+      cur += n;
+    }
+  } else {
+    // qualified, since the sort column may be left out of the SELECT list &
+    // joined tables have columns of the same name
+    cur_memcpy(cur, remaining_size, " ORDER BY ");
+    cur_write_table_name(cur, remaining_size);
+    cur_append(cur, remaining_size, '.');
+    cur_write_column_name(cur, remaining_size, options->order_by_column);
+    cur_append(cur, remaining_size, ' ');
+    cur_memcpy(cur, remaining_size, options->order_by_order);
+  }
+  // IDs break ties, so that every row has a distinct position
+  if (!options->aggregate && !order_by_id &&
+      (options->after_id || options->next_cursor)) {
+    cur_append(cur, remaining_size, ',');
+    cur_write_table_name(cur, remaining_size);
+    cur_memcpy(cur, remaining_size, ".id ");
+    cur_memcpy(cur, remaining_size, options->order_by_order);
   }
 
-  n = snprintf(cur, remaining_size, " ORDER BY %s %s LIMIT %d;",
-               options->order_by_column, options->order_by_order,
-               options->limit);
+  // negative limits leave the query unbounded
+  if (options->limit < 0)
+    n = snprintf(cur, remaining_size, " LIMIT ALL;");
+  else
+    n = snprintf(cur, remaining_size, " LIMIT %d;", options->limit);
   if (n < 0 || errno == EILSEQ) {
     errno = EILSEQ;
     return;
@@ -165,7 +541,8 @@ void construct_select_query(struct select_options *options, char *buffer,
 
   // row offset
   if (options->row_offset) {
-    // -- to get rid of the semi-colon currently written into the query.
+    // get rid of the semi-colon currently written into the query.
+    cur_shave(cur, remaining_size, 1);
 
     n = snprintf(cur, remaining_size, " OFFSET %d;", options->row_offset);
     if (n < 0 || errno == EILSEQ) {
@@ -187,135 +564,1410 @@ end:
   return;
 }
 
-int serialize_select_result(const PGresult *res, char *buffer,
-                            const size_t buffer_size) {
-  char *cur = buffer;
-  size_t remaining_size = buffer_size;
-  size_t n = 0;
+#undef cur_write_param
 
-  // column names
-  n = strlen("{\"columns\":[");
-  if (remaining_size < n) {
+void construct_select_query(struct select_options *options, char *buffer,
+                            size_t buffer_size) {
+  write_select_query(options, 0, buffer, buffer_size);
+}
+
+int select_query_params(const struct select_options *options,
+                        const char **values) {
+  int count = 0;
+
+  if (options->aggregate && options->aggregate->bucket_column)
+    values[count++] = options->aggregate->bucket_interval;
+  if (options->filter_column_name)
+    values[count++] = options->filter_value;
+  for (int i = 0; i < options->filters_count; i++) {
+    if (options->filters[i].op != FILTER_IS_NULL &&
+        options->filters[i].op != FILTER_IS_NOT_NULL)
+      values[count++] = options->filters[i].value;
+  }
+  if (options->after_id) {
+    if (strcmp(options->order_by_column, "id") != 0 && options->after_value)
+      values[count++] = options->after_value;
+    values[count++] = options->after_id;
+  }
+
+  return count;
+}
+
+void count_select_options(struct select_options *options,
+                          struct select_aggregate *aggregate) {
+  options->limit = -1;
+  options->row_offset = 0;
+  options->after_id = NULL;
+  options->after_value = NULL;
+  options->next_cursor = 0;
+  // the tag names are not needed to count the rows
+  options->primary_tag = 0;
+  options->aggregate = NULL;
+  options->expand = 0;
+
+  if (aggregate) {
+    memset(aggregate, 0, sizeof(struct select_aggregate));
+    aggregate->functions[0].function = AGGREGATE_COUNT;
+    aggregate->functions_count = 1;
+    options->aggregate = aggregate;
+  }
+}
+
+const char *project_select_columns(struct select_options *options,
+                                   char *columns,
+                                   struct data_column *projected_schema,
+                                   char *projection) {
+  // 1 for the value column, 2 for the comments column
+  char *included = calloc(options->schema_count + 1, sizeof(char));
+  const char *unknown_column = NULL;
+  int id_column = 0, primary_tag = 0;
+  int projection_length;
+  char *column, *saveptr;
+
+  if (!included) {
     errno = ENOMEM;
-    return -1;
+    return NULL;
   }
-  remaining_size -= n;
-  memcpy(cur, "{\"columns\":[", n);
-  cur += n;
 
-  for (int i = 0; i < PQnfields(res); i++) {
-    if (remaining_size < 1) {
-      errno = ENOMEM;
-      return -1;
+  for (column = strtok_r(columns, ",", &saveptr); column;
+       column = strtok_r(NULL, ",", &saveptr)) {
+    int found = 0;
+    size_t column_length = strlen(column);
+    if (options->id_column && strcmp(column, "id") == 0) {
+      id_column = found = 1;
+    } else if (options->primary_tag && strcmp(column, "primary_tag") == 0) {
+      primary_tag = found = 1;
     }
-    remaining_size--;
-    *cur++ = '"';
-    n = strlen(PQfname(res, i));
-    if (n + 2 > remaining_size) { // account for both n and the extra text after
-      errno = ENOMEM;
-      return -1;
+    for (int i = 0; !found && i < options->schema_count; i++) {
+      const char *name = options->schema[i].name;
+      size_t name_length = strlen(name);
+      if (strcmp(name, column) == 0) {
+        included[i] |= 1;
+        found = 1;
+      } else if (options->schema[i].comments &&
+                 column_length == name_length + strlen("_comments") &&
+                 strncmp(column, name, name_length) == 0 &&
+                 strcmp(column + name_length, "_comments") == 0) {
+        included[i] |= 2;
+        found = 1;
+      }
     }
-    remaining_size -= n + 2;
-    memcpy(cur, PQfname(res, i), n);
-    cur += n;
-    *cur++ = '"';
-    *cur++ = ',';
+    if (!found) {
+      unknown_column = column;
+      goto end;
+    }
+  }
+
+  projection_length = snprintf(projection, MAX_PROJECTION_LENGTH, "%s%s",
+                               id_column ? "i" : "", primary_tag ? "t" : "");
+  unsigned int projected_count = 0;
+  for (int i = 0; i < options->schema_count; i++) {
+    if (!included[i])
+      continue;
+    if (projected_count == MAX_PROJECTED_COLUMNS)
+      goto too_many_columns;
+    projected_schema[projected_count] = options->schema[i];
+    projected_schema[projected_count++].comments = included[i] & 2;
+    if (projection_length < MAX_PROJECTION_LENGTH)
+      projection_length +=
+          snprintf(projection + projection_length,
+                   MAX_PROJECTION_LENGTH - projection_length, ",%d%s", i,
+                   included[i] & 2 ? "c" : "");
   }
+  // only tables of more than 999 columns have longer indexes
+  if (projection_length >= MAX_PROJECTION_LENGTH)
+    goto too_many_columns;
 
-  // remove trailing comma & continue with the data section
-  n = strlen("],\"data\":[");
-  if (remaining_size < n - 1) {
+  options->schema = projected_schema;
+  options->schema_count = projected_count;
+  options->id_column = id_column;
+  options->primary_tag = primary_tag;
+  goto end;
+
+too_many_columns:
+  errno = E2BIG;
+end:
+  free(included);
+  return unknown_column;
+}
+
+// appends to a key, keeping track of the length the key would have
+#define key_printf(...)                                                        \
+  ({                                                                           \
+    if (length >= 0) {                                                         \
+      int written = snprintf(                                                  \
+          buffer + (length < buffer_size ? length : buffer_size),              \
+          length < buffer_size ? buffer_size - length : 0, __VA_ARGS__);       \
+      length = written < 0 ? written : length + written;                       \
+    }                                                                          \
+  })
+
+int write_select_options_key(const struct select_options *options,
+                             char *buffer, size_t buffer_size) {
+  int length = 0;
+
+  // the schema follows from the table name. Values may hold any character, so
+  // they are told apart by their lengths
+  key_printf("%s|%s|%s|%d|%d|%d|%s|%s|%s|%d|%d|%d|%s|%d|%s",
+             options->table_name, options->order_by_column,
+             options->order_by_order, options->id_column, options->primary_tag,
+             options->transform_tag_names,
+             options->filter_table_name ? options->filter_table_name : "",
+             options->filter_column_name ? options->filter_column_name : "",
+             options->filter_value ? options->filter_value : "",
+             options->limit, options->row_offset, options->next_cursor,
+             options->after_id ? options->after_id : "",
+             options->after_value ? (int)strlen(options->after_value) : -1,
+             options->after_value ? options->after_value : "");
+
+  for (int i = 0; i < options->filters_count; i++) {
+    const struct select_filter *filter = &options->filters[i];
+    key_printf("|%s.%d:%d:%s", filter->column, filter->op,
+               filter->value ? (int)strlen(filter->value) : -1,
+               filter->value ? filter->value : "");
+  }
+
+  // names within the aggregation are schema names, which hold no separators
+  if (options->aggregate) {
+    const struct select_aggregate *aggregate = options->aggregate;
+    key_printf("|aggregate:%s:%s:",
+               aggregate->bucket_column ? aggregate->bucket_column : "",
+               aggregate->bucket_interval);
+    for (int i = 0; i < aggregate->group_by_count; i++)
+      key_printf("%s,", aggregate->group_by[i]);
+    for (int i = 0; i < aggregate->functions_count; i++)
+      key_printf(":%d(%s)", aggregate->functions[i].function,
+                 aggregate->functions[i].column
+                     ? aggregate->functions[i].column
+                     : "");
+  }
+  // the descriptors follow from the table name
+  if (options->expand)
+    key_printf("|expand:%d", options->expand);
+
+  return length;
+}
+
+#undef key_printf
+
+void construct_copy_query(struct select_options *options, char *buffer,
+                          size_t buffer_size) {
+  const char *prefix = "COPY (";
+  const char *suffix = ") TO STDOUT WITH CSV HEADER;";
+  size_t prefix_length = strlen(prefix);
+  size_t length;
+
+  if (buffer_size < prefix_length + strlen(suffix) + 1) {
     errno = ENOMEM;
+    return;
+  }
+  memcpy(buffer, prefix, prefix_length);
+  write_select_query(options, 1, buffer + prefix_length,
+                     buffer_size - prefix_length - strlen(suffix));
+  if (errno)
+    return;
+
+  // the SELECT is wrapped without its semi-colon
+  length = prefix_length + strlen(buffer + prefix_length) - 1;
+  memcpy(buffer + length, suffix, strlen(suffix) + 1);
+}
+
+/**
+ * Writes a zero padded number.
+ * @param cur The buffer to write to.
+ * @param value The number to write. Must not be negative.
+ * @param width The minimum number of digits.
+ * @returns The number of characters written.
+ */
+static int write_padded(char *cur, long long value, int width) {
+  char digits[MAX_NUMBER_STR_LENGTH];
+  int n = format_int(digits, value);
+  int padding = n < width ? width - n : 0;
+
+  memset(cur, '0', padding);
+  memcpy(cur + padding, digits, n);
+  return padding + n;
+}
+
+/**
+ * Writes a date the way Postgres' ISO DateStyle does, e.g. 2025-01-31.
+ * @param cur The buffer to write to.
+ * @param days The number of days since 1970-01-01.
+ * @param bc Set to whether or not the date is BC.
+ * @returns The number of characters written.
+ */
+static int write_date(char *cur, long long days, int *bc) {
+  // civil_from_days (H. Hinnant), proleptic Gregorian calendar
+  long long z = days + 719468;
+  long long era = (z >= 0 ? z : z - 146096) / 146097;
+  long long doe = z - era * 146097;
+  long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  long long mp = (5 * doy + 2) / 153;
+  long long day = doy - (153 * mp + 2) / 5 + 1;
+  long long month = mp < 10 ? mp + 3 : mp - 9;
+  long long year = yoe + era * 400 + (month <= 2);
+  int n = 0;
+
+  // there is no year 0: 1 BC directly precedes 1 AD
+  *bc = year <= 0;
+  n += write_padded(cur + n, *bc ? 1 - year : year, 4);
+  cur[n++] = '-';
+  n += write_padded(cur + n, month, 2);
+  cur[n++] = '-';
+  n += write_padded(cur + n, day, 2);
+  return n;
+}
+
+/**
+ * Writes a time of day the way Postgres does, e.g. 13:04:05.25.
+ * @param cur The buffer to write to.
+ * @param usecs The number of microseconds since midnight.
+ * @returns The number of characters written.
+ */
+static int write_time(char *cur, long long usecs) {
+  long long secs = usecs / USECS_PER_SEC;
+  long long fraction = usecs % USECS_PER_SEC;
+  int n = 0;
+
+  n += write_padded(cur + n, secs / 3600, 2);
+  cur[n++] = ':';
+  n += write_padded(cur + n, secs / 60 % 60, 2);
+  cur[n++] = ':';
+  n += write_padded(cur + n, secs % 60, 2);
+  if (fraction) {
+    cur[n++] = '.';
+    n += write_padded(cur + n, fraction, 6);
+    // trailing zeros are not printed
+    while (cur[n - 1] == '0')
+      n--;
+  }
+  return n;
+}
+
+/**
+ * Writes a number of microseconds as decimal seconds, e.g. 1.5.
+ * @param cur The buffer to write to.
+ * @param usecs The number of microseconds.
+ * @returns The number of characters written.
+ */
+static int write_seconds(char *cur, long long usecs) {
+  int n = 0;
+
+  if (usecs < 0) {
+    cur[n++] = '-';
+    usecs = -usecs;
+  }
+
+  long long fraction = usecs % USECS_PER_SEC;
+  n += format_int(cur + n, usecs / USECS_PER_SEC);
+  if (fraction) {
+    cur[n++] = '.';
+    n += write_padded(cur + n, fraction, 6);
+    while (cur[n - 1] == '0')
+      n--;
+  }
+  return n;
+}
+
+/**
+ * Writes an offset from UTC the way Postgres does, e.g. +05:30.
+ * @param cur The buffer to write to.
+ * @param seconds_east The offset in seconds east of UTC.
+ * @returns The number of characters written.
+ */
+static int write_utc_offset(char *cur, long long seconds_east) {
+  int n = 0;
+
+  cur[n++] = seconds_east < 0 ? '-' : '+';
+  if (seconds_east < 0)
+    seconds_east = -seconds_east;
+  n += write_padded(cur + n, seconds_east / 3600, 2);
+  if (seconds_east % 3600) {
+    cur[n++] = ':';
+    n += write_padded(cur + n, seconds_east / 60 % 60, 2);
+    if (seconds_east % 60) {
+      cur[n++] = ':';
+      n += write_padded(cur + n, seconds_east % 60, 2);
+    }
+  }
+  return n;
+}
+
+/**
+ * Writes a JSON null.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maximum amount of characters the buffer can store.
+ * @returns The number of characters written or -1 if the buffer is too small.
+ */
+static int emit_null(char *buffer, size_t buffer_size) {
+  if (buffer_size < strlen("null"))
+    return -1;
+  memcpy(buffer, "null", strlen("null"));
+  return strlen("null");
+}
+
+/**
+ * Writes a string of a known length unquoted.
+ * @param value The string to write.
+ * @param length The length of the string.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maximum amount of characters the buffer can store.
+ * @returns The number of characters written or -1 if the buffer is too small.
+ */
+static int emit_text(const char *value, int length, char *buffer,
+                     size_t buffer_size) {
+  if ((size_t)length > buffer_size)
     return -1;
+  memcpy(buffer, value, length);
+  return length;
+}
+
+/*
+ * Column emitters (see column_emitter). Text format values already are JSON
+ * or only need to be quoted, mapped or escaped. Binary format values are
+ * decoded; fixed size values go through a scratch buffer when the output
+ * buffer is close to full.
+ */
+
+static int emit_raw(const char *value, int length, int flags, char *buffer,
+                    size_t buffer_size) {
+  return emit_text(value, length, buffer, buffer_size);
+}
+
+static int emit_string(const char *value, int length, int flags, char *buffer,
+                       size_t buffer_size) {
+  return write_json_string(value, length, buffer, buffer_size);
+}
+
+static int emit_quoted(const char *value, int length, int flags, char *buffer,
+                       size_t buffer_size) {
+  if ((size_t)length + 2 > buffer_size)
+    return -1;
+  *buffer = '"';
+  memcpy(buffer + 1, value, length);
+  buffer[length + 1] = '"';
+  return length + 2;
+}
+
+static int emit_text_bool(const char *value, int length, int flags,
+                          char *buffer, size_t buffer_size) {
+  return *value == 't' ? emit_text("true", strlen("true"), buffer, buffer_size)
+                       : emit_text("false", strlen("false"), buffer,
+                                   buffer_size);
+}
+
+static int emit_text_number(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  // JSON has no NaN or Infinity
+  if (*value == 'N' || *value == 'I' || value[1] == 'I')
+    return emit_null(buffer, buffer_size);
+  return emit_text(value, length, buffer, buffer_size);
+}
+
+static int emit_binary_jsonb(const char *value, int length, int flags,
+                             char *buffer, size_t buffer_size) {
+  // a version byte precedes the text
+  return emit_text(value + 1, length - 1, buffer, buffer_size);
+}
+
+#define begin_fixed_size_value()                                               \
+  char scratch[MAX_BINARY_VALUE_STR_LENGTH];                                   \
+  char *out = buffer_size >= MAX_BINARY_VALUE_STR_LENGTH ? buffer : scratch;   \
+  int n = 0
+
+#define end_fixed_size_value()                                                 \
+  ({                                                                           \
+    if (out == buffer)                                                         \
+      return n;                                                                \
+    if ((size_t)n > buffer_size)                                               \
+      return -1;                                                               \
+    memcpy(buffer, scratch, n);                                                \
+    return n;                                                                  \
+  })
+
+static int emit_binary_bool(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  return *value ? emit_text("true", strlen("true"), buffer, buffer_size)
+                : emit_text("false", strlen("false"), buffer, buffer_size);
+}
+
+static int emit_binary_int2(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  begin_fixed_size_value();
+  n = format_int(out, (int16_t)read_network_uint(value, 2));
+  end_fixed_size_value();
+}
+
+static int emit_binary_int4(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  begin_fixed_size_value();
+  n = format_int(out, (int32_t)read_network_uint(value, 4));
+  end_fixed_size_value();
+}
+
+static int emit_binary_int8(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  begin_fixed_size_value();
+  n = format_int(out, (int64_t)read_network_uint(value, 8));
+  end_fixed_size_value();
+}
+
+static int emit_binary_oid(const char *value, int length, int flags,
+                           char *buffer, size_t buffer_size) {
+  begin_fixed_size_value();
+  n = format_int(out, (uint32_t)read_network_uint(value, 4));
+  end_fixed_size_value();
+}
+
+static int emit_binary_float4(const char *value, int length, int flags,
+                              char *buffer, size_t buffer_size) {
+  union {
+    uint32_t u;
+    float f;
+  } float4 = {read_network_uint(value, 4)};
+  if (!isfinite(float4.f))
+    return emit_null(buffer, buffer_size);
+
+  begin_fixed_size_value();
+  n = format_float(out, float4.f);
+  end_fixed_size_value();
+}
+
+static int emit_binary_float8(const char *value, int length, int flags,
+                              char *buffer, size_t buffer_size) {
+  union {
+    uint64_t u;
+    double f;
+  } float8 = {read_network_uint(value, 8)};
+  if (!isfinite(float8.f))
+    return emit_null(buffer, buffer_size);
+
+  begin_fixed_size_value();
+  n = format_double(out, float8.f);
+  end_fixed_size_value();
+}
+
+/**
+ * Writes +/-infinity as a JSON string, the way Postgres spells infinite dates
+ * & timestamps.
+ * @param negative Whether or not to write -infinity.
+ * @param buffer The buffer to write to.
+ * @param buffer_size The maximum amount of characters the buffer can store.
+ * @returns The number of characters written or -1 if the buffer is too small.
+ */
+static int emit_infinity(int negative, char *buffer, size_t buffer_size) {
+  return negative ? emit_text("\"-infinity\"", strlen("\"-infinity\""),
+                              buffer, buffer_size)
+                  : emit_text("\"infinity\"", strlen("\"infinity\""), buffer,
+                              buffer_size);
+}
+
+static int emit_binary_date(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  long long days = (int32_t)read_network_uint(value, 4);
+  int bc = 0;
+  if (days == INT32_MAX || days == INT32_MIN)
+    return emit_infinity(days < 0, buffer, buffer_size);
+  days += POSTGRES_EPOCH_UNIX_SECONDS / SECONDS_PER_DAY;
+
+  begin_fixed_size_value();
+  if (flags & SERIALIZE_EPOCH_TIMESTAMPS) {
+    n = format_int(out, days * SECONDS_PER_DAY);
+    end_fixed_size_value();
   }
-  memcpy(--cur, "],\"data\":[", n);
-  remaining_size -= n - 1;
-  cur += n;
-  // catch edge case where there's no data
-  if (PQntuples(res) == 0) {
-    if (remaining_size < 1) {
+  out[n++] = '"';
+  n += write_date(out + n, days, &bc);
+  if (bc) {
+    memcpy(out + n, " BC", strlen(" BC"));
+    n += strlen(" BC");
+  }
+  out[n++] = '"';
+  end_fixed_size_value();
+}
+
+static int emit_binary_time(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  begin_fixed_size_value();
+  out[n++] = '"';
+  n += write_time(out + n, (int64_t)read_network_uint(value, 8));
+  out[n++] = '"';
+  end_fixed_size_value();
+}
+
+static int emit_binary_timetz(const char *value, int length, int flags,
+                              char *buffer, size_t buffer_size) {
+  begin_fixed_size_value();
+  out[n++] = '"';
+  n += write_time(out + n, (int64_t)read_network_uint(value, 8));
+  // the zone is stored in seconds west of UTC
+  n += write_utc_offset(out + n, -(int32_t)read_network_uint(value + 8, 4));
+  out[n++] = '"';
+  end_fixed_size_value();
+}
+
+/**
+ * Writes a binary timestamp, optionally followed by a UTC offset.
+ * @param utc_offset The offset to append (e.g. "+00"), or NULL.
+ */
+static int write_binary_timestamp(const char *value, int flags,
+                                  const char *utc_offset, char *buffer,
+                                  size_t buffer_size) {
+  long long usecs_per_day = SECONDS_PER_DAY * USECS_PER_SEC;
+  long long timestamp = (int64_t)read_network_uint(value, 8);
+  int bc = 0;
+  if (timestamp == INT64_MAX || timestamp == INT64_MIN)
+    return emit_infinity(timestamp < 0, buffer, buffer_size);
+  timestamp += POSTGRES_EPOCH_UNIX_SECONDS * USECS_PER_SEC;
+
+  begin_fixed_size_value();
+  if (flags & SERIALIZE_EPOCH_TIMESTAMPS) {
+    n = write_seconds(out, timestamp);
+    end_fixed_size_value();
+  }
+
+  long long days = timestamp / usecs_per_day;
+  long long usecs = timestamp % usecs_per_day;
+  if (usecs < 0) {
+    days--;
+    usecs += usecs_per_day;
+  }
+  out[n++] = '"';
+  n += write_date(out + n, days, &bc);
+  out[n++] = ' ';
+  n += write_time(out + n, usecs);
+  if (utc_offset) {
+    memcpy(out + n, utc_offset, strlen(utc_offset));
+    n += strlen(utc_offset);
+  }
+  if (bc) {
+    memcpy(out + n, " BC", strlen(" BC"));
+    n += strlen(" BC");
+  }
+  out[n++] = '"';
+  end_fixed_size_value();
+}
+
+static int emit_binary_timestamp(const char *value, int length, int flags,
+                                 char *buffer, size_t buffer_size) {
+  return write_binary_timestamp(value, flags, NULL, buffer, buffer_size);
+}
+
+static int emit_binary_timestamptz(const char *value, int length, int flags,
+                                   char *buffer, size_t buffer_size) {
+  // binary timestamptz values are UTC, whatever the session TimeZone
+  return write_binary_timestamp(value, flags, "+00", buffer, buffer_size);
+}
+
+/**
+ * Writes one part of an interval, e.g. "2 mons", the way IntervalStyle
+ * postgres does.
+ * @param cur The buffer to write to.
+ * @param value The amount of the unit. Nothing is written if it is 0.
+ * @param unit The singular name of the unit.
+ * @param is_zero Whether or not nothing was written yet. Updated.
+ * @param is_before Whether or not the last part written was negative. Updated.
+ * @returns The number of characters written.
+ */
+static int write_interval_part(char *cur, long long value, const char *unit,
+                               int *is_zero, int *is_before) {
+  int n = 0;
+  if (!value)
+    return 0;
+
+  if (!*is_zero)
+    cur[n++] = ' ';
+  if (*is_before && value > 0)
+    cur[n++] = '+';
+  n += format_int(cur + n, value);
+  cur[n++] = ' ';
+  memcpy(cur + n, unit, strlen(unit));
+  n += strlen(unit);
+  if (value != 1)
+    cur[n++] = 's';
+
+  *is_zero = 0;
+  *is_before = value < 0;
+  return n;
+}
+
+static int emit_binary_interval(const char *value, int length, int flags,
+                                char *buffer, size_t buffer_size) {
+  long long usecs = (int64_t)read_network_uint(value, 8);
+  long long days = (int32_t)read_network_uint(value + 8, 4);
+  long long months = (int32_t)read_network_uint(value + 12, 4);
+  int is_zero = 1;
+  int is_before = 0;
+
+  begin_fixed_size_value();
+  out[n++] = '"';
+  n += write_interval_part(out + n, months / MONTHS_PER_YEAR, "year", &is_zero,
+                           &is_before);
+  n += write_interval_part(out + n, months % MONTHS_PER_YEAR, "mon", &is_zero,
+                           &is_before);
+  n += write_interval_part(out + n, days, "day", &is_zero, &is_before);
+  if (is_zero || usecs) {
+    if (!is_zero)
+      out[n++] = ' ';
+    if (usecs < 0)
+      out[n++] = '-';
+    else if (is_before)
+      out[n++] = '+';
+    // the time of day part is printed as an absolute value
+    unsigned long long magnitude = usecs < 0 ? -(unsigned long long)usecs
+                                             : (unsigned long long)usecs;
+    n += write_padded(out + n, magnitude / USECS_PER_HOUR, 2);
+    // write_time's hours are always 00 here: keep only the :MM:SS[.ffffff]
+    int time_length = write_time(out + n, magnitude % USECS_PER_HOUR);
+    memmove(out + n, out + n + 2, time_length - 2);
+    n += time_length - 2;
+  }
+  out[n++] = '"';
+  end_fixed_size_value();
+}
+
+static int emit_binary_uuid(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  static const char hex_digits[] = "0123456789abcdef";
+
+  begin_fixed_size_value();
+  out[n++] = '"';
+  for (int i = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+      out[n++] = '-';
+    out[n++] = hex_digits[(unsigned char)value[i] >> 4];
+    out[n++] = hex_digits[value[i] & 0xf];
+  }
+  out[n++] = '"';
+  end_fixed_size_value();
+}
+
+static int emit_binary_numeric(const char *value, int length, int flags,
+                               char *buffer, size_t buffer_size) {
+  // base 10000 digits, the first of which is worth 10000^weight
+  int ndigits = (int16_t)read_network_uint(value, 2);
+  int weight = (int16_t)read_network_uint(value + 2, 2);
+  int sign = read_network_uint(value + 4, 2);
+  int dscale = read_network_uint(value + 6, 2);
+  const char *digits = value + 8;
+  char *cur = buffer;
+
+  // JSON has no NaN or Infinity
+  if ((sign & NUMERIC_SPECIAL) == NUMERIC_SPECIAL)
+    return emit_null(buffer, buffer_size);
+
+  // sign, integer digits, decimal point & fraction digits (rounded up to 4)
+  size_t size_bound =
+      1 + (weight >= 0 ? (weight + 1) * 4 : 1) + 1 + dscale + 3;
+  if (size_bound > buffer_size)
+    return -1;
+
+  if (sign == NUMERIC_NEG)
+    *cur++ = '-';
+
+  if (weight < 0) {
+    *cur++ = '0';
+  } else {
+    for (int i = 0; i <= weight; i++) {
+      int digit = i < ndigits ? read_network_uint(digits + i * 2, 2) : 0;
+      // only the leading digit is not zero padded
+      cur += i ? write_padded(cur, digit, 4) : format_int(cur, digit);
+    }
+  }
+
+  if (dscale > 0) {
+    char *fraction = ++cur;
+    cur[-1] = '.';
+    for (int i = weight + 1; cur - fraction < dscale; i++) {
+      int digit = i >= 0 && i < ndigits
+                      ? read_network_uint(digits + i * 2, 2)
+                      : 0;
+      cur += write_padded(cur, digit, 4);
+    }
+    cur = fraction + dscale;
+  }
+
+  return cur - buffer;
+}
+
+#undef begin_fixed_size_value
+#undef end_fixed_size_value
+
+/*
+ * MessagePack column emitters (see SERIALIZE_MSGPACK). Numbers & booleans are
+ * encoded natively & dates & timestamps as timestamp extension values. Other
+ * values are sent as strings: their text, or their JSON text without the
+ * quotes for binary values that need formatting.
+ */
+
+/**
+ * Counts the days from 1970-01-01 to a date in the proleptic Gregorian
+ * calendar (days_from_civil, H. Hinnant).
+ */
+static long long days_from_civil(long long year, long long month,
+                                 long long day) {
+  year -= month <= 2;
+  long long era = (year >= 0 ? year : year - 399) / 400;
+  long long yoe = year - era * 400;
+  long long doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+/**
+ * Writes a number of microseconds since 1970-01-01 as a timestamp.
+ */
+static int write_msgpack_usecs(long long usecs, char *buffer,
+                               size_t buffer_size) {
+  long long seconds = usecs / USECS_PER_SEC;
+  long long fraction = usecs % USECS_PER_SEC;
+  if (fraction < 0) {
+    seconds--;
+    fraction += USECS_PER_SEC;
+  }
+  return msgpack_write_timestamp(seconds, fraction * 1000, buffer,
+                                 buffer_size);
+}
+
+static int emit_msgpack_str(const char *value, int length, int flags,
+                            char *buffer, size_t buffer_size) {
+  return msgpack_write_str(value, length, buffer, buffer_size);
+}
+
+static int emit_msgpack_text_bool(const char *value, int length, int flags,
+                                  char *buffer, size_t buffer_size) {
+  return msgpack_write_bool(*value == 't', buffer, buffer_size);
+}
+
+static int emit_msgpack_text_int(const char *value, int length, int flags,
+                                 char *buffer, size_t buffer_size) {
+  return msgpack_write_int(strtoll(value, NULL, 10), buffer, buffer_size);
+}
+
+static int emit_msgpack_text_float4(const char *value, int length, int flags,
+                                    char *buffer, size_t buffer_size) {
+  return msgpack_write_float(strtof(value, NULL), buffer, buffer_size);
+}
+
+static int emit_msgpack_text_float8(const char *value, int length, int flags,
+                                    char *buffer, size_t buffer_size) {
+  return msgpack_write_double(strtod(value, NULL), buffer, buffer_size);
+}
+
+static int emit_msgpack_text_timestamp(const char *value, int length,
+                                       int flags, char *buffer,
+                                       size_t buffer_size) {
+  int year, month, day, hour = 0, minute = 0, second = 0;
+  int consumed = 0;
+  long long usecs = 0;
+
+  // ISO dates & timestamps, e.g. 2025-01-31 13:04:05.25; anything else (BC,
+  // infinity, ...) is sent as text
+  if (sscanf(value, "%d-%d-%d%n", &year, &month, &day, &consumed) != 3)
+    return msgpack_write_str(value, length, buffer, buffer_size);
+  if (value[consumed] == ' ') {
+    int time_consumed = 0;
+    if (sscanf(value + consumed, " %d:%d:%d%n", &hour, &minute, &second,
+               &time_consumed) != 3)
+      return msgpack_write_str(value, length, buffer, buffer_size);
+    consumed += time_consumed;
+    if (value[consumed] == '.') {
+      long long scale = USECS_PER_SEC;
+      for (consumed++; value[consumed] >= '0' && value[consumed] <= '9';
+           consumed++) {
+        scale /= 10;
+        usecs += (value[consumed] - '0') * scale;
+      }
+    }
+  }
+  if (consumed != length)
+    return msgpack_write_str(value, length, buffer, buffer_size);
+
+  usecs += (days_from_civil(year, month, day) * SECONDS_PER_DAY +
+            hour * 3600LL + minute * 60LL + second) *
+           USECS_PER_SEC;
+  return write_msgpack_usecs(usecs, buffer, buffer_size);
+}
+
+static int emit_msgpack_binary_bool(const char *value, int length, int flags,
+                                    char *buffer, size_t buffer_size) {
+  return msgpack_write_bool(*value, buffer, buffer_size);
+}
+
+static int emit_msgpack_binary_int2(const char *value, int length, int flags,
+                                    char *buffer, size_t buffer_size) {
+  return msgpack_write_int((int16_t)read_network_uint(value, 2), buffer,
+                           buffer_size);
+}
+
+static int emit_msgpack_binary_int4(const char *value, int length, int flags,
+                                    char *buffer, size_t buffer_size) {
+  return msgpack_write_int((int32_t)read_network_uint(value, 4), buffer,
+                           buffer_size);
+}
+
+static int emit_msgpack_binary_int8(const char *value, int length, int flags,
+                                    char *buffer, size_t buffer_size) {
+  return msgpack_write_int((int64_t)read_network_uint(value, 8), buffer,
+                           buffer_size);
+}
+
+static int emit_msgpack_binary_oid(const char *value, int length, int flags,
+                                   char *buffer, size_t buffer_size) {
+  return msgpack_write_int((uint32_t)read_network_uint(value, 4), buffer,
+                           buffer_size);
+}
+
+static int emit_msgpack_binary_float4(const char *value, int length,
+                                      int flags, char *buffer,
+                                      size_t buffer_size) {
+  union {
+    uint32_t u;
+    float f;
+  } float4 = {read_network_uint(value, 4)};
+  return msgpack_write_float(float4.f, buffer, buffer_size);
+}
+
+static int emit_msgpack_binary_float8(const char *value, int length,
+                                      int flags, char *buffer,
+                                      size_t buffer_size) {
+  union {
+    uint64_t u;
+    double f;
+  } float8 = {read_network_uint(value, 8)};
+  return msgpack_write_double(float8.f, buffer, buffer_size);
+}
+
+static int emit_msgpack_binary_date(const char *value, int length, int flags,
+                                    char *buffer, size_t buffer_size) {
+  long long days = (int32_t)read_network_uint(value, 4);
+  if (days == INT32_MAX || days == INT32_MIN)
+    return days < 0 ? msgpack_write_str("-infinity", strlen("-infinity"),
+                                        buffer, buffer_size)
+                    : msgpack_write_str("infinity", strlen("infinity"), buffer,
+                                        buffer_size);
+  days += POSTGRES_EPOCH_UNIX_SECONDS / SECONDS_PER_DAY;
+  return msgpack_write_timestamp(days * SECONDS_PER_DAY, 0, buffer,
+                                 buffer_size);
+}
+
+static int emit_msgpack_binary_timestamp(const char *value, int length,
+                                         int flags, char *buffer,
+                                         size_t buffer_size) {
+  long long timestamp = (int64_t)read_network_uint(value, 8);
+  if (timestamp == INT64_MAX || timestamp == INT64_MIN)
+    return timestamp < 0 ? msgpack_write_str("-infinity", strlen("-infinity"),
+                                             buffer, buffer_size)
+                         : msgpack_write_str("infinity", strlen("infinity"),
+                                             buffer, buffer_size);
+  return write_msgpack_usecs(
+      timestamp + POSTGRES_EPOCH_UNIX_SECONDS * USECS_PER_SEC, buffer,
+      buffer_size);
+}
+
+static int emit_msgpack_binary_jsonb(const char *value, int length, int flags,
+                                     char *buffer, size_t buffer_size) {
+  // a version byte precedes the text
+  return msgpack_write_str(value + 1, length - 1, buffer, buffer_size);
+}
+
+/**
+ * Writes the JSON text of a value as a string (without its quotes), or nil
+ * for a JSON null.
+ * @param emitter The JSON emitter of the value's type.
+ */
+static int emit_msgpack_json_text(column_emitter emitter, const char *value,
+                                  int length, int flags, char *buffer,
+                                  size_t buffer_size) {
+  char header[MAX_MSGPACK_SCALAR_SIZE];
+  // leave room for the largest string header in front of the text
+  const int gap = 5;
+  if (buffer_size < gap)
+    return -1;
+
+  int n = emitter(value, length, flags, buffer + gap, buffer_size - gap);
+  if (n < 0)
+    return -1;
+  char *text = buffer + gap;
+  if (n == strlen("null") && memcmp(text, "null", n) == 0)
+    return msgpack_write_nil(buffer, buffer_size);
+  if (n >= 2 && *text == '"') {
+    text++;
+    n -= 2;
+  }
+
+  int header_length = msgpack_write_str_header(n, header, sizeof(header));
+  memmove(buffer + header_length, text, n);
+  memcpy(buffer, header, header_length);
+  return header_length + n;
+}
+
+#define define_msgpack_json_text_emitter(emitter)                              \
+  static int emitter##_msgpack(const char *value, int length, int flags,       \
+                               char *buffer, size_t buffer_size) {             \
+    return emit_msgpack_json_text(emitter, value, length, flags, buffer,       \
+                                  buffer_size);                                \
+  }
+
+define_msgpack_json_text_emitter(emit_binary_time);
+define_msgpack_json_text_emitter(emit_binary_timetz);
+define_msgpack_json_text_emitter(emit_binary_interval);
+define_msgpack_json_text_emitter(emit_binary_numeric);
+define_msgpack_json_text_emitter(emit_binary_uuid);
+
+#undef define_msgpack_json_text_emitter
+
+struct type_codec {
+  Oid oid;
+  column_emitter text;
+  column_emitter binary;
+  column_emitter msgpack_text;
+  column_emitter msgpack_binary;
+};
+
+// types without a codec are written as (escaped) strings in text format. Their
+// binary format is unknown, so create_select_plan refuses it
+static const struct type_codec type_codecs[] = {
+    {NAMEOID, emit_string, emit_string, emit_msgpack_str, emit_msgpack_str},
+    {TEXTOID, emit_string, emit_string, emit_msgpack_str, emit_msgpack_str},
+    {BPCHAROID, emit_string, emit_string, emit_msgpack_str, emit_msgpack_str},
+    {VARCHAROID, emit_string, emit_string, emit_msgpack_str, emit_msgpack_str},
+    {BOOLOID, emit_text_bool, emit_binary_bool, emit_msgpack_text_bool,
+     emit_msgpack_binary_bool},
+    {INT8OID, emit_raw, emit_binary_int8, emit_msgpack_text_int,
+     emit_msgpack_binary_int8},
+    {INT2OID, emit_raw, emit_binary_int2, emit_msgpack_text_int,
+     emit_msgpack_binary_int2},
+    {INT4OID, emit_raw, emit_binary_int4, emit_msgpack_text_int,
+     emit_msgpack_binary_int4},
+    {OIDOID, emit_raw, emit_binary_oid, emit_msgpack_text_int,
+     emit_msgpack_binary_oid},
+    {JSONOID, emit_raw, emit_raw, emit_msgpack_str, emit_msgpack_str},
+    {FLOAT4OID, emit_text_number, emit_binary_float4, emit_msgpack_text_float4,
+     emit_msgpack_binary_float4},
+    {FLOAT8OID, emit_text_number, emit_binary_float8, emit_msgpack_text_float8,
+     emit_msgpack_binary_float8},
+    {DATEOID, emit_quoted, emit_binary_date, emit_msgpack_text_timestamp,
+     emit_msgpack_binary_date},
+    {TIMEOID, emit_quoted, emit_binary_time, emit_msgpack_str,
+     emit_binary_time_msgpack},
+    {TIMESTAMPOID, emit_quoted, emit_binary_timestamp,
+     emit_msgpack_text_timestamp, emit_msgpack_binary_timestamp},
+    {TIMESTAMPTZOID, emit_quoted, emit_binary_timestamptz, emit_msgpack_str,
+     emit_msgpack_binary_timestamp},
+    {INTERVALOID, emit_quoted, emit_binary_interval, emit_msgpack_str,
+     emit_binary_interval_msgpack},
+    {TIMETZOID, emit_quoted, emit_binary_timetz, emit_msgpack_str,
+     emit_binary_timetz_msgpack},
+    {NUMERICOID, emit_text_number, emit_binary_numeric, emit_msgpack_str,
+     emit_binary_numeric_msgpack},
+    {UUIDOID, emit_quoted, emit_binary_uuid, emit_msgpack_str,
+     emit_binary_uuid_msgpack},
+    {JSONBOID, emit_raw, emit_binary_jsonb, emit_msgpack_str,
+     emit_msgpack_binary_jsonb},
+};
+
+struct select_plan *create_select_plan(const PGresult *res, int flags) {
+  int n_columns = PQnfields(res);
+  struct select_plan *plan =
+      malloc(sizeof(struct select_plan) + n_columns * sizeof(column_emitter));
+  if (!plan) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  plan->flags = flags;
+  plan->n_columns = n_columns;
+  plan->tag_column = -1;
+  plan->tag_names = NULL;
+  for (int col_num = 0; col_num < n_columns; col_num++) {
+    Oid type = PQftype(res, col_num);
+    int binary = PQfformat(res, col_num) == 1;
+
+    plan->emitters[col_num] = NULL;
+    if (!binary)
+      plan->emitters[col_num] =
+          flags & SERIALIZE_MSGPACK ? emit_msgpack_str : emit_string;
+    for (int i = 0; i < sizeof(type_codecs) / sizeof(type_codecs[0]); i++) {
+      if (type_codecs[i].oid != type)
+        continue;
+      if (flags & SERIALIZE_MSGPACK)
+        plan->emitters[col_num] = binary ? type_codecs[i].msgpack_binary
+                                         : type_codecs[i].msgpack_text;
+      else
+        plan->emitters[col_num] =
+            binary ? type_codecs[i].binary : type_codecs[i].text;
+      break;
+    }
+
+    // binary values of unknown types would be copied out as raw bytes
+    if (!plan->emitters[col_num]) {
+      free(plan);
+      errno = ENOTSUP;
+      return NULL;
+    }
+  }
+
+  return plan;
+}
+
+void substitute_tag_names(struct select_plan *plan, const PGresult *res,
+                          struct tag_names *tag_names) {
+  plan->tag_column = PQfnumber(res, "primary_tag");
+  plan->tag_names = tag_names;
+}
+
+void free_select_plan(struct select_plan *plan) { free(plan); }
+
+/**
+ * Writes the column names of a result as the members of a JSON array.
+ * @returns The number of characters written or -1 if the buffer is too small.
+ */
+static int write_column_names(const PGresult *res, char *buffer,
+                              size_t buffer_size) {
+  char *cur = buffer;
+  size_t remaining_size = buffer_size;
+  size_t n = 0;
+
+  for (int i = 0; i < PQnfields(res); i++) {
+    if (i)
+      cur_append(cur, remaining_size, ',');
+    int written = write_json_string(PQfname(res, i), strlen(PQfname(res, i)),
+                                    cur, remaining_size);
+    if (written < 0)
+      goto end;
+    remaining_size -= written;
+    cur += written;
+  }
+
+  return cur - buffer;
+
+end:
+  return -1;
+}
+
+int serialize_select_columns(const PGresult *res, char *buffer,
+                             const size_t buffer_size) {
+  char *cur = buffer;
+  size_t remaining_size = buffer_size;
+  size_t n = 0;
+
+  cur_memcpy(cur, remaining_size, "{\"columns\":[");
+  int written = write_column_names(res, cur, remaining_size);
+  if (written < 0)
+    goto end;
+  remaining_size -= written;
+  cur += written;
+  cur_memcpy(cur, remaining_size, "],\"data\":[");
+
+  return cur - buffer;
+
+end:
+  return -1;
+}
+
+int serialize_select_ndjson_header(const PGresult *res, char *buffer,
+                                   const size_t buffer_size) {
+  char *cur = buffer;
+  size_t remaining_size = buffer_size;
+  size_t n = 0;
+
+  cur_memcpy(cur, remaining_size, "{\"columns\":[");
+  int written = write_column_names(res, cur, remaining_size);
+  if (written < 0)
+    goto end;
+  remaining_size -= written;
+  cur += written;
+  cur_memcpy(cur, remaining_size, "]}\n");
+
+  return cur - buffer;
+
+end:
+  return -1;
+}
+
+int serialize_select_msgpack_start(const PGresult *res, int extra_members,
+                                   char *buffer, const size_t buffer_size) {
+  char *cur = buffer;
+  char *end = buffer + buffer_size;
+  int n = 0;
+
+#define cur_msgpack(write_call)                                                \
+  ({                                                                           \
+    n = write_call;                                                            \
+    if (n < 0)                                                                 \
+      goto no_memory;                                                          \
+    cur += n;                                                                  \
+  })
+
+  cur_msgpack(msgpack_write_map_header(2 + extra_members, cur, end - cur));
+  cur_msgpack(msgpack_write_str("columns", strlen("columns"), cur, end - cur));
+  cur_msgpack(msgpack_write_array_header(PQnfields(res), cur, end - cur));
+  for (int i = 0; i < PQnfields(res); i++)
+    cur_msgpack(msgpack_write_str(PQfname(res, i), strlen(PQfname(res, i)),
+                                  cur, end - cur));
+  cur_msgpack(msgpack_write_str("data", strlen("data"), cur, end - cur));
+  cur_msgpack(msgpack_write_array_header(PQntuples(res), cur, end - cur));
+
+#undef cur_msgpack
+
+  return cur - buffer;
+
+no_memory:
+  errno = ENOMEM;
+  return -1;
+}
+
+/**
+ * Writes the name of the tag whose ID is the value (see substitute_tag_names).
+ * @returns The number of characters written or -1 if the buffer is too small.
+ */
+static int emit_tag_name(const PGresult *res, const struct select_plan *plan,
+                         int row_num, int col_num, char *buffer,
+                         size_t buffer_size) {
+  const char *value = PQgetvalue(res, row_num, col_num);
+  int length = PQgetlength(res, row_num, col_num);
+  long long id;
+  int name_length;
+
+  if (PQfformat(res, col_num) == 0)
+    id = strtoll(value, NULL, 10);
+  else if (length == 2)
+    id = (int16_t)read_network_uint(value, 2);
+  else if (length == 4)
+    id = (int32_t)read_network_uint(value, 4);
+  else
+    id = (int64_t)read_network_uint(value, 8);
+
+  const char *name = find_tag_name(plan->tag_names, id, &name_length);
+  if (!name)
+    return plan->flags & SERIALIZE_MSGPACK
+               ? msgpack_write_nil(buffer, buffer_size)
+               : emit_null(buffer, buffer_size);
+  return plan->flags & SERIALIZE_MSGPACK
+             ? msgpack_write_str(name, name_length, buffer, buffer_size)
+             : write_json_string(name, name_length, buffer, buffer_size);
+}
+
+int serialize_select_value(const PGresult *res, const struct select_plan *plan,
+                           int row_num, int col_num, char *buffer,
+                           const size_t buffer_size) {
+  int written;
+
+  if (PQgetisnull(res, row_num, col_num))
+    written = plan->flags & SERIALIZE_MSGPACK
+                  ? msgpack_write_nil(buffer, buffer_size)
+                  : emit_null(buffer, buffer_size);
+  else if (col_num == plan->tag_column)
+    written =
+        emit_tag_name(res, plan, row_num, col_num, buffer, buffer_size);
+  else
+    written = plan->emitters[col_num](PQgetvalue(res, row_num, col_num),
+                                      PQgetlength(res, row_num, col_num),
+                                      plan->flags, buffer, buffer_size);
+
+  if (written < 0)
+    errno = ENOMEM;
+  return written;
+}
+
+int write_select_value_text(const PGresult *res, int row_num, int col_num,
+                            char *buffer, size_t buffer_size) {
+  const char *value = PQgetvalue(res, row_num, col_num);
+  int length = PQgetlength(res, row_num, col_num);
+  Oid type = PQftype(res, col_num);
+
+  if (PQfformat(res, col_num) == 0)
+    return emit_text(value, length, buffer, buffer_size);
+
+  // the ISO JSON of binary values is the text format, possibly quoted. Text
+  // types send their text in binary format as well, which their emitter would
+  // escape
+  for (int i = 0; i < sizeof(type_codecs) / sizeof(type_codecs[0]); i++) {
+    if (type_codecs[i].oid != type)
+      continue;
+    if (type_codecs[i].binary == emit_string)
+      return emit_text(value, length, buffer, buffer_size);
+    int n = type_codecs[i].binary(value, length, 0, buffer, buffer_size);
+    if (n >= 2 && *buffer == '"') {
+      memmove(buffer, buffer + 1, n - 2);
+      n -= 2;
+    }
+    return n;
+  }
+  return emit_text(value, length, buffer, buffer_size);
+}
+
+int serialize_select_row(const PGresult *res, const struct select_plan *plan,
+                         int row_num, char *buffer, const size_t buffer_size) {
+  char *cur = buffer;
+  size_t remaining_size = buffer_size;
+  size_t n = 0;
+
+  // MessagePack arrays are prefixed by their length instead of delimited
+  int msgpack = plan->flags & SERIALIZE_MSGPACK;
+  if (msgpack) {
+    int written =
+        msgpack_write_array_header(plan->n_columns, cur, remaining_size);
+    if (written < 0) {
       errno = ENOMEM;
-      return -1;
+      goto end;
     }
-    remaining_size--;
-    cur++;
+    remaining_size -= written;
+    cur += written;
   } else {
-    for (int row_num = 0; row_num < PQntuples(res); row_num++) {
-      if (remaining_size < 1) {
-        errno = ENOMEM;
-        return -1;
-      }
-      remaining_size--;
-      *cur++ = '[';
-      for (int col_num = 0; col_num < PQnfields(res); col_num++) {
-        if (PQgetisnull(res, row_num, col_num)) {
-          n = strlen("null,");
-          if (remaining_size < n) {
-            errno = ENOMEM;
-            return -1;
-          }
-          memcpy(cur, "null,", n);
-          remaining_size -= n;
-          cur += n;
-          continue;
-        }
+    cur_append(cur, remaining_size, '[');
+  }
+  for (int col_num = 0; col_num < plan->n_columns; col_num++) {
+    if (col_num && !msgpack)
+      cur_append(cur, remaining_size, ',');
 
-        n = strlen(PQgetvalue(res, row_num, col_num));
-        switch (PQftype(res, col_num)) {
-        case 25:
-        case 1082:
-        case 1083:
-        case 1114:
-          // if the type requires quotation,
-          if (remaining_size < n + 2) {
-            errno = ENOMEM;
-            return -1;
-          }
-          remaining_size -= n + 2;
-          *cur++ = '"';
-          memcpy(cur, PQgetvalue(res, row_num, col_num), n);
-          cur += n;
-          *cur++ = '"';
-          break;
-        default:
-          if (remaining_size < n) {
-            errno = ENOMEM;
-            return -1;
-          }
-          remaining_size -= n;
-          memcpy(cur, PQgetvalue(res, row_num, col_num), n);
-          cur += n;
-          break;
-        }
+    int written = serialize_select_value(res, plan, row_num, col_num, cur,
+                                         remaining_size);
+    if (written < 0)
+      goto end;
+    remaining_size -= written;
+    cur += written;
+  }
+  if (!msgpack)
+    cur_append(cur, remaining_size, ']');
 
-        if (remaining_size < 1) {
-          errno = ENOMEM;
-          return -1;
-        }
-        remaining_size--;
-        *cur++ = ',';
-      }
+  return cur - buffer;
+
+end:
+  return -1;
+}
+
+int serialize_select_columnar_start(const PGresult *res, char *buffer,
+                                    const size_t buffer_size) {
+  char *cur = buffer;
+  size_t remaining_size = buffer_size;
+  size_t n = 0;
+  char rows[MAX_NUMBER_STR_LENGTH + 1];
+
+  cur_memcpy(cur, remaining_size, "{\"columns\":[");
+  int written = write_column_names(res, cur, remaining_size);
+  if (written < 0)
+    goto end;
+  remaining_size -= written;
+  cur += written;
+  cur_memcpy(cur, remaining_size, "],\"rows\":");
+  rows[format_int(rows, PQntuples(res))] = '\0';
+  cur_memcpy(cur, remaining_size, rows);
+  cur_memcpy(cur, remaining_size, ",\"data\":{");
+
+  return cur - buffer;
+
+end:
+  return -1;
+}
+
+int select_column_is_constant(const PGresult *res, int col_num) {
+  int n_rows = PQntuples(res);
+  if (n_rows < 2)
+    return 0;
+
+  int first_null = PQgetisnull(res, 0, col_num);
+  const char *first = PQgetvalue(res, 0, col_num);
+  int first_length = PQgetlength(res, 0, col_num);
+  // equal bytes in the same format & type serialize the same way
+  for (int row_num = 1; row_num < n_rows; row_num++) {
+    if (PQgetisnull(res, row_num, col_num) != first_null)
+      return 0;
+    if (first_null)
+      continue;
+    if (PQgetlength(res, row_num, col_num) != first_length ||
+        memcmp(PQgetvalue(res, row_num, col_num), first, first_length) != 0)
+      return 0;
+  }
+
+  return 1;
+}
+
+int serialize_select_column_start(const PGresult *res,
+                                  const struct select_plan *plan, int col_num,
+                                  int constant, char *buffer,
+                                  const size_t buffer_size) {
+  char *cur = buffer;
+  size_t remaining_size = buffer_size;
+  size_t n = 0;
+
+  if (col_num)
+    cur_append(cur, remaining_size, ',');
+  int written = write_json_string(PQfname(res, col_num),
+                                  strlen(PQfname(res, col_num)), cur,
+                                  remaining_size);
+  if (written < 0)
+    goto end;
+  remaining_size -= written;
+  cur += written;
+  cur_append(cur, remaining_size, ':');
+
+  if (!constant) {
+    cur_append(cur, remaining_size, '[');
+    return cur - buffer;
+  }
+
+  cur_memcpy(cur, remaining_size, "{\"constant\":");
+  written =
+      serialize_select_value(res, plan, 0, col_num, cur, remaining_size);
+  if (written < 0)
+    goto end;
+  remaining_size -= written;
+  cur += written;
+  cur_append(cur, remaining_size, '}');
+
+  return cur - buffer;
+
+end:
+  return -1;
+}
 
+int serialize_select_result(const PGresult *res, int flags, char *buffer,
+                            const size_t buffer_size) {
+  char *cur = buffer;
+  size_t remaining_size = buffer_size;
+  int n = 0;
+  int length = -1;
+  struct select_plan *plan = create_select_plan(res, flags);
+  if (!plan)
+    return -1;
+
+  n = serialize_select_columns(res, cur, remaining_size);
+  if (n < 0)
+    goto end;
+  remaining_size -= n;
+  cur += n;
+
+  for (int row_num = 0; row_num < PQntuples(res); row_num++) {
+    if (row_num) {
       if (remaining_size < 1) {
         errno = ENOMEM;
-        return -1;
+        goto end;
       }
       remaining_size--;
-      cur[-1] = ']';
       *cur++ = ',';
     }
+
+    n = serialize_select_row(res, plan, row_num, cur, remaining_size);
+    if (n < 0)
+      goto end;
+    remaining_size -= n;
+    cur += n;
   }
 
-  // close out the JSON by overwriting the last trailing comma
-  if (remaining_size < 2) {
+  // close out the JSON & null terminate
+  if (remaining_size < 3) {
     errno = ENOMEM;
-    return -1;
+    goto end;
   }
-  remaining_size -= 2;
-  cur[-1] = ']';
-  *cur++ = '}';
-  *cur++ = '\0';
+  remaining_size -= 3;
+  memcpy(cur, "]}", 3);
 
   // do not count the null terminator (i.e. -1)
-  return buffer_size - remaining_size - 1;
+  length = buffer_size - remaining_size - 1;
+
+end:
+  free_select_plan(plan);
+  return length;
 }
\ No newline at end of file
@@ -0,0 +1,780 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "libpq-fe.h"
+#include "postgres/select.h"
+#include "postgres/select_arrow.h"
+#include "utils/flatbuffer.h"
+#include "utils/network_order.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Type union (Schema.fbs)
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_TYPE_DATE 8
+#define ARROW_TYPE_TIME 9
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_TYPE_STRUCT 13
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_DATE_DAY 0
+#define ARROW_TIME_MICROSECOND 2
+
+// MessageHeader union & MetadataVersion (Message.fbs, Schema.fbs)
+#define ARROW_MESSAGE_SCHEMA 1
+#define ARROW_MESSAGE_RECORD_BATCH 3
+#define ARROW_METADATA_V5 4
+
+// every IPC message starts with a continuation marker & its metadata length
+#define ARROW_CONTINUATION 0xFFFFFFFF
+#define ARROW_ALIGNMENT 8
+
+#define GEODETIC_CHILDREN 5
+
+// binary dates & timestamps count from 2000-01-01
+#define POSTGRES_EPOCH_UNIX_DAYS 10957LL
+#define POSTGRES_EPOCH_UNIX_USECS 946684800000000LL
+#define USECS_PER_SEC 1000000LL
+
+enum arrow_column_kind {
+  ARROW_INT,
+  ARROW_FLOAT,
+  ARROW_STRING,
+  ARROW_BOOL,
+  ARROW_DATE,
+  ARROW_TIME,
+  ARROW_TIMESTAMP,
+  ARROW_GEODETIC,
+  // the coordinates of a geodetic point's ST_AsText
+  ARROW_LONGITUDE,
+  ARROW_LATITUDE,
+};
+
+struct arrow_buffer {
+  char *data;
+  size_t length;
+  size_t capacity;
+};
+
+struct arrow_column {
+  enum arrow_column_kind kind;
+  /**
+   * @param name The field name, or NULL for the name of the result column.
+   */
+  const char *name;
+  /**
+   * @param result_column The column of the result the values are read from.
+   */
+  int result_column;
+  struct arrow_buffer validity;
+  /**
+   * @param values The values, or the offsets into data for strings.
+   */
+  struct arrow_buffer values;
+  struct arrow_buffer data;
+  long long null_count;
+  struct arrow_column *children;
+  int n_children;
+};
+
+struct arrow_writer {
+  arrow_sink sink;
+  void *sink_arg;
+  struct arrow_column *columns;
+  int n_columns;
+  /**
+   * @param n_result_columns The number of result columns the options select.
+   */
+  int n_result_columns;
+  int schema_written;
+  int failed;
+  /**
+   * @param rows The number of rows in the current batch.
+   */
+  long long rows;
+};
+
+/**
+ * @returns The column builder of a config.yml datatype.
+ */
+static enum arrow_column_kind datatype_kind(const char *datatype) {
+  if (strcmp(datatype, "int") == 0 || strcmp(datatype, "integer") == 0)
+    return ARROW_INT;
+  if (strcmp(datatype, "float") == 0 || strcmp(datatype, "number") == 0)
+    return ARROW_FLOAT;
+  if (strcmp(datatype, "bool") == 0 || strcmp(datatype, "boolean") == 0)
+    return ARROW_BOOL;
+  if (strcmp(datatype, "date") == 0)
+    return ARROW_DATE;
+  if (strcmp(datatype, "time") == 0)
+    return ARROW_TIME;
+  if (strcmp(datatype, "timestamp") == 0)
+    return ARROW_TIMESTAMP;
+  if (strcmp(datatype, "geodetic point") == 0)
+    return ARROW_GEODETIC;
+  // strings & enums
+  return ARROW_STRING;
+}
+
+/**
+ * Makes room at the end of a buffer.
+ * @returns 1 on success, 0 if out of memory.
+ */
+static int reserve(struct arrow_buffer *buffer, size_t length) {
+  if (buffer->length + length <= buffer->capacity)
+    return 1;
+
+  size_t capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+  while (capacity < buffer->length + length)
+    capacity *= 2;
+  char *data = realloc(buffer->data, capacity);
+  if (!data)
+    return 0;
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return 1;
+}
+
+/**
+ * Appends a little-endian integer to a buffer.
+ * @returns 1 on success, 0 if out of memory.
+ */
+static int append_le(struct arrow_buffer *buffer, uint64_t value, int size) {
+  if (!reserve(buffer, size))
+    return 0;
+  for (int i = 0; i < size; i++) {
+    buffer->data[buffer->length++] = value & 0xff;
+    value >>= 8;
+  }
+  return 1;
+}
+
+/**
+ * Sets a bit of a bitmap, growing it as needed.
+ * @param bitmap The bitmap.
+ * @param index The bit to set. Bits must be set in order.
+ * @param value Whether the bit is set.
+ * @returns 1 on success, 0 if out of memory.
+ */
+static int append_bit(struct arrow_buffer *bitmap, long long index,
+                      int value) {
+  if (index % 8 == 0 && !append_le(bitmap, 0, 1))
+    return 0;
+  if (value)
+    bitmap->data[index / 8] |= 1 << (index % 8);
+  return 1;
+}
+
+/**
+ * Reads a binary integer of any width.
+ */
+static int64_t read_network_int(const char *value, int size) {
+  switch (size) {
+  case 2:
+    return (int16_t)read_network_uint(value, 2);
+  case 4:
+    return (int32_t)read_network_uint(value, 4);
+  default:
+    return (int64_t)read_network_uint(value, 8);
+  }
+}
+
+/**
+ * Parses a text date (YYYY-MM-DD).
+ * @param days Set to the number of days since 1970-01-01.
+ * @returns The number of characters read or 0 if the text is not a date.
+ */
+static int parse_date(const char *text, long long *days) {
+  struct tm tm = {0};
+  int consumed = 0;
+
+  if (sscanf(text, "%d-%d-%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+             &consumed) != 3)
+    return 0;
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  *days = timegm(&tm) / 86400;
+  return consumed;
+}
+
+/**
+ * Parses a text time of day (HH:MM:SS[.ffffff]).
+ * @param usecs Set to the number of microseconds since midnight.
+ * @returns The number of characters read or 0 if the text is not a time.
+ */
+static int parse_time(const char *text, long long *usecs) {
+  int hour, minute, second;
+  int consumed = 0;
+
+  if (sscanf(text, "%d:%d:%d%n", &hour, &minute, &second, &consumed) != 3)
+    return 0;
+  *usecs = (hour * 3600LL + minute * 60LL + second) * USECS_PER_SEC;
+  if (text[consumed] == '.') {
+    long long scale = USECS_PER_SEC;
+    for (consumed++; text[consumed] >= '0' && text[consumed] <= '9';
+         consumed++) {
+      scale /= 10;
+      *usecs += (text[consumed] - '0') * scale;
+    }
+  }
+  return consumed;
+}
+
+/**
+ * Reads a value of a column as an integer or a double, depending on the
+ * column's kind.
+ * @returns 1 if the value is valid, 0 if it should be null (NULLs, infinite
+ * dates, BC dates, ...).
+ */
+static int read_value(const struct arrow_column *column, const PGresult *res,
+                      int row_num, int64_t *integer, double *real) {
+  if (PQgetisnull(res, row_num, column->result_column))
+    return 0;
+
+  const char *value = PQgetvalue(res, row_num, column->result_column);
+  int length = PQgetlength(res, row_num, column->result_column);
+  int binary = PQfformat(res, column->result_column) == 1;
+  long long usecs;
+  double x, y;
+  union {
+    uint32_t u;
+    float f;
+  } float4;
+  union {
+    uint64_t u;
+    double f;
+  } float8;
+
+  switch (column->kind) {
+  case ARROW_INT:
+    *integer = binary ? read_network_int(value, length)
+                      : strtoll(value, NULL, 10);
+    return 1;
+  case ARROW_FLOAT:
+    if (!binary) {
+      *real = strtod(value, NULL);
+    } else if (length == 4) {
+      float4.u = read_network_uint(value, 4);
+      *real = float4.f;
+    } else {
+      float8.u = read_network_uint(value, 8);
+      *real = float8.f;
+    }
+    return 1;
+  case ARROW_BOOL:
+    *integer = binary ? *value != 0 : *value == 't';
+    return 1;
+  case ARROW_DATE:
+    if (binary) {
+      *integer = (int32_t)read_network_uint(value, 4);
+      if (*integer == INT32_MAX || *integer == INT32_MIN)
+        return 0;
+      *integer += POSTGRES_EPOCH_UNIX_DAYS;
+      return 1;
+    }
+    return parse_date(value, (long long *)integer) == length;
+  case ARROW_TIME:
+    if (binary) {
+      *integer = (int64_t)read_network_uint(value, 8);
+      return 1;
+    }
+    return parse_time(value, (long long *)integer) == length;
+  case ARROW_TIMESTAMP:
+    if (binary) {
+      *integer = (int64_t)read_network_uint(value, 8);
+      if (*integer == INT64_MAX || *integer == INT64_MIN)
+        return 0;
+      *integer += POSTGRES_EPOCH_UNIX_USECS;
+      return 1;
+    } else {
+      long long days;
+      int consumed = parse_date(value, &days);
+      if (!consumed || value[consumed] != ' ' ||
+          consumed + 1 + parse_time(value + consumed + 1, &usecs) != length)
+        return 0;
+      *integer = days * 86400 * USECS_PER_SEC + usecs;
+      return 1;
+    }
+  case ARROW_LONGITUDE:
+  case ARROW_LATITUDE:
+    // ST_AsText is text in either format
+    if (sscanf(value, "POINT(%lf %lf)", &x, &y) != 2)
+      return 0;
+    *real = column->kind == ARROW_LONGITUDE ? x : y;
+    return 1;
+  default:
+    return 1;
+  }
+}
+
+/**
+ * Appends a value of a row to a column (& its children).
+ * @param row_index The index of the row in the batch.
+ * @returns 1 on success, 0 if out of memory.
+ */
+static int append_value(struct arrow_column *column, const PGresult *res,
+                        int row_num, long long row_index) {
+  int64_t integer = 0;
+  double real = 0;
+  int valid = read_value(column, res, row_num, &integer, &real);
+  union {
+    double f;
+    uint64_t u;
+  } bits;
+
+  if (!valid)
+    column->null_count++;
+  if (!append_bit(&column->validity, row_index, valid))
+    return 0;
+
+  switch (column->kind) {
+  case ARROW_INT:
+  case ARROW_TIME:
+  case ARROW_TIMESTAMP:
+    return append_le(&column->values, integer, 8);
+  case ARROW_DATE:
+    return append_le(&column->values, integer, 4);
+  case ARROW_BOOL:
+    return append_bit(&column->values, row_index, integer);
+  case ARROW_FLOAT:
+  case ARROW_LONGITUDE:
+  case ARROW_LATITUDE:
+    bits.f = real;
+    return append_le(&column->values, bits.u, 8);
+  case ARROW_STRING:
+    if (valid && PQgetlength(res, row_num, column->result_column)) {
+      int length = PQgetlength(res, row_num, column->result_column);
+      if (!reserve(&column->data, length))
+        return 0;
+      memcpy(column->data.data + column->data.length,
+             PQgetvalue(res, row_num, column->result_column), length);
+      column->data.length += length;
+    }
+    // offsets are the end of each value
+    return append_le(&column->values, column->data.length, 4);
+  case ARROW_GEODETIC:
+    for (int i = 0; i < column->n_children; i++)
+      if (!append_value(&column->children[i], res, row_num, row_index))
+        return 0;
+    return 1;
+  }
+  return 1;
+}
+
+/**
+ * Empties the buffers of a column (& its children) for the next batch.
+ * @returns 1 on success, 0 if out of memory.
+ */
+static int reset_column(struct arrow_column *column) {
+  column->validity.length = 0;
+  column->values.length = 0;
+  column->data.length = 0;
+  column->null_count = 0;
+  for (int i = 0; i < column->n_children; i++)
+    if (!reset_column(&column->children[i]))
+      return 0;
+  // strings start with a 0 offset
+  return column->kind != ARROW_STRING || append_le(&column->values, 0, 4);
+}
+
+/**
+ * Counts the columns of a column's tree (itself & its descendants).
+ */
+static int count_columns(const struct arrow_column *column) {
+  int count = 1;
+  for (int i = 0; i < column->n_children; i++)
+    count += count_columns(&column->children[i]);
+  return count;
+}
+
+/**
+ * Lists the body buffers of a column's tree in IPC order (depth first).
+ * @param buffers The list to append to.
+ * @returns The number of buffers listed.
+ */
+static int list_buffers(struct arrow_column *column,
+                        struct arrow_buffer **buffers) {
+  int n = 0;
+  buffers[n++] = &column->validity;
+  if (column->kind != ARROW_GEODETIC)
+    buffers[n++] = &column->values;
+  if (column->kind == ARROW_STRING)
+    buffers[n++] = &column->data;
+  for (int i = 0; i < column->n_children; i++)
+    n += list_buffers(&column->children[i], buffers + n);
+  return n;
+}
+
+/**
+ * Lists the columns of a column's tree in IPC order (depth first).
+ * @returns The number of columns listed.
+ */
+static int list_columns(struct arrow_column *column,
+                        struct arrow_column **columns) {
+  int n = 0;
+  columns[n++] = column;
+  for (int i = 0; i < column->n_children; i++)
+    n += list_columns(&column->children[i], columns + n);
+  return n;
+}
+
+/**
+ * @returns The length of a body buffer including its padding.
+ */
+static size_t padded_length(size_t length) {
+  return (length + ARROW_ALIGNMENT - 1) & ~(size_t)(ARROW_ALIGNMENT - 1);
+}
+
+/**
+ * Writes an IPC message: the continuation marker, the metadata length, the
+ * metadata & the body buffers, each padded to ARROW_ALIGNMENT.
+ * @returns 1 on success, 0 on failure.
+ */
+static int write_message(struct arrow_writer *writer, const char *metadata,
+                         size_t metadata_length, struct arrow_buffer **buffers,
+                         int n_buffers) {
+  static const char padding[ARROW_ALIGNMENT] = {0};
+  char prefix[8];
+  uint32_t padded_metadata_length = padded_length(metadata_length);
+
+  for (int i = 0; i < 4; i++) {
+    prefix[i] = (ARROW_CONTINUATION >> (8 * i)) & 0xff;
+    prefix[4 + i] = (padded_metadata_length >> (8 * i)) & 0xff;
+  }
+  if (!writer->sink(prefix, sizeof(prefix), writer->sink_arg) ||
+      !writer->sink(metadata, metadata_length, writer->sink_arg) ||
+      !writer->sink(padding, padded_metadata_length - metadata_length,
+                    writer->sink_arg))
+    return 0;
+
+  for (int i = 0; i < n_buffers; i++) {
+    size_t length = buffers[i]->length;
+    if ((length && !writer->sink(buffers[i]->data, length, writer->sink_arg)) ||
+        !writer->sink(padding, padded_length(length) - length,
+                      writer->sink_arg))
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * Writes the Field table of a column (& its children).
+ */
+static flatbuffer_ref write_field(struct flatbuffer *fb,
+                                  const struct arrow_column *column,
+                                  const PGresult *res) {
+  flatbuffer_ref children[GEODETIC_CHILDREN];
+  for (int i = 0; i < column->n_children; i++)
+    children[i] = write_field(fb, &column->children[i], res);
+  flatbuffer_start_vector(fb, 4, column->n_children, 4);
+  for (int i = column->n_children - 1; i >= 0; i--)
+    flatbuffer_prepend_ref(fb, children[i]);
+  flatbuffer_ref children_vector =
+      flatbuffer_end_vector(fb, column->n_children);
+
+  const char *name =
+      column->name ? column->name : PQfname(res, column->result_column);
+  flatbuffer_ref name_string = flatbuffer_create_string(fb, name, strlen(name));
+
+  int type_type;
+  flatbuffer_start_table(fb);
+  switch (column->kind) {
+  case ARROW_INT:
+    type_type = ARROW_TYPE_INT;
+    flatbuffer_add_scalar(fb, 0, 64, 4); // bitWidth
+    flatbuffer_add_scalar(fb, 1, 1, 1);  // is_signed
+    break;
+  case ARROW_FLOAT:
+  case ARROW_LONGITUDE:
+  case ARROW_LATITUDE:
+    type_type = ARROW_TYPE_FLOATING_POINT;
+    flatbuffer_add_scalar(fb, 0, ARROW_PRECISION_DOUBLE, 2);
+    break;
+  case ARROW_BOOL:
+    type_type = ARROW_TYPE_BOOL;
+    break;
+  case ARROW_DATE:
+    type_type = ARROW_TYPE_DATE;
+    flatbuffer_add_scalar(fb, 0, ARROW_DATE_DAY, 2);
+    break;
+  case ARROW_TIME:
+    type_type = ARROW_TYPE_TIME;
+    flatbuffer_add_scalar(fb, 1, 64, 4); // bitWidth
+    flatbuffer_add_scalar(fb, 0, ARROW_TIME_MICROSECOND, 2);
+    break;
+  case ARROW_TIMESTAMP:
+    type_type = ARROW_TYPE_TIMESTAMP;
+    flatbuffer_add_scalar(fb, 0, ARROW_TIME_MICROSECOND, 2);
+    break;
+  case ARROW_GEODETIC:
+    type_type = ARROW_TYPE_STRUCT;
+    break;
+  default:
+    type_type = ARROW_TYPE_UTF8;
+    break;
+  }
+  flatbuffer_ref type = flatbuffer_end_table(fb);
+
+  flatbuffer_start_table(fb);
+  flatbuffer_add_ref(fb, 0, name_string);
+  flatbuffer_add_ref(fb, 3, type);
+  flatbuffer_add_ref(fb, 5, children_vector);
+  flatbuffer_add_scalar(fb, 1, 1, 1); // nullable
+  flatbuffer_add_scalar(fb, 2, type_type, 1);
+  return flatbuffer_end_table(fb);
+}
+
+/**
+ * Writes a Message table around a header.
+ */
+static flatbuffer_ref write_message_table(struct flatbuffer *fb,
+                                          int header_type,
+                                          flatbuffer_ref header,
+                                          long long body_length) {
+  flatbuffer_start_table(fb);
+  flatbuffer_add_scalar(fb, 3, body_length, 8);
+  flatbuffer_add_ref(fb, 2, header);
+  flatbuffer_add_scalar(fb, 0, ARROW_METADATA_V5, 2);
+  flatbuffer_add_scalar(fb, 1, header_type, 1);
+  return flatbuffer_end_table(fb);
+}
+
+/**
+ * Writes the schema message.
+ * @returns 1 on success, 0 on failure.
+ */
+static int write_schema(struct arrow_writer *writer, const PGresult *res) {
+  struct flatbuffer fb;
+  flatbuffer_ref *fields = malloc(writer->n_columns * sizeof(flatbuffer_ref));
+  size_t length;
+  int success = 0;
+
+  if (!fields)
+    return 0;
+  flatbuffer_init(&fb);
+  for (int i = 0; i < writer->n_columns; i++)
+    fields[i] = write_field(&fb, &writer->columns[i], res);
+  flatbuffer_start_vector(&fb, 4, writer->n_columns, 4);
+  for (int i = writer->n_columns - 1; i >= 0; i--)
+    flatbuffer_prepend_ref(&fb, fields[i]);
+  flatbuffer_ref fields_vector = flatbuffer_end_vector(&fb, writer->n_columns);
+
+  flatbuffer_start_table(&fb);
+  flatbuffer_add_ref(&fb, 1, fields_vector);
+  flatbuffer_add_scalar(&fb, 0, 0, 2); // little endian
+  flatbuffer_ref schema = flatbuffer_end_table(&fb);
+
+  const char *metadata = flatbuffer_finish(
+      &fb, write_message_table(&fb, ARROW_MESSAGE_SCHEMA, schema, 0), &length);
+  if (metadata)
+    success = write_message(writer, metadata, length, NULL, 0);
+
+  flatbuffer_free(&fb);
+  free(fields);
+  return success;
+}
+
+/**
+ * Writes the rows collected so far as a record batch & starts a new batch.
+ * @returns 1 on success, 0 on failure.
+ */
+static int write_batch(struct arrow_writer *writer) {
+  int n_nodes = 0;
+  for (int i = 0; i < writer->n_columns; i++)
+    n_nodes += count_columns(&writer->columns[i]);
+
+  // at most 3 buffers per column (validity, offsets & data)
+  struct arrow_column **nodes = malloc(n_nodes * sizeof(struct arrow_column *));
+  struct arrow_buffer **buffers =
+      malloc(n_nodes * 3 * sizeof(struct arrow_buffer *));
+  struct flatbuffer fb;
+  size_t length;
+  int success = 0;
+  int n_buffers = 0;
+
+  flatbuffer_init(&fb);
+  if (!nodes || !buffers)
+    goto end;
+
+  for (int i = 0, n = 0; i < writer->n_columns; i++) {
+    n += list_columns(&writer->columns[i], nodes + n);
+    n_buffers += list_buffers(&writer->columns[i], buffers + n_buffers);
+  }
+
+  // Buffer structs (offset, length), prepended back to front
+  long long body_length = 0;
+  for (int i = 0; i < n_buffers; i++)
+    body_length += padded_length(buffers[i]->length);
+  flatbuffer_start_vector(&fb, 16, n_buffers, 8);
+  long long offset = body_length;
+  for (int i = n_buffers - 1; i >= 0; i--) {
+    offset -= padded_length(buffers[i]->length);
+    flatbuffer_prepend_int64(&fb, buffers[i]->length);
+    flatbuffer_prepend_int64(&fb, offset);
+  }
+  flatbuffer_ref buffers_vector = flatbuffer_end_vector(&fb, n_buffers);
+
+  // FieldNode structs (length, null_count)
+  flatbuffer_start_vector(&fb, 16, n_nodes, 8);
+  for (int i = n_nodes - 1; i >= 0; i--) {
+    flatbuffer_prepend_int64(&fb, nodes[i]->null_count);
+    flatbuffer_prepend_int64(&fb, writer->rows);
+  }
+  flatbuffer_ref nodes_vector = flatbuffer_end_vector(&fb, n_nodes);
+
+  flatbuffer_start_table(&fb);
+  flatbuffer_add_scalar(&fb, 0, writer->rows, 8);
+  flatbuffer_add_ref(&fb, 1, nodes_vector);
+  flatbuffer_add_ref(&fb, 2, buffers_vector);
+  flatbuffer_ref batch = flatbuffer_end_table(&fb);
+
+  const char *metadata = flatbuffer_finish(
+      &fb,
+      write_message_table(&fb, ARROW_MESSAGE_RECORD_BATCH, batch, body_length),
+      &length);
+  if (!metadata ||
+      !write_message(writer, metadata, length, buffers, n_buffers))
+    goto end;
+
+  writer->rows = 0;
+  success = 1;
+  for (int i = 0; i < writer->n_columns; i++)
+    success = success && reset_column(&writer->columns[i]);
+
+end:
+  flatbuffer_free(&fb);
+  free(nodes);
+  free(buffers);
+  return success;
+}
+
+struct arrow_writer *create_arrow_writer(const struct select_options *options,
+                                         arrow_sink sink, void *sink_arg) {
+  struct arrow_writer *writer = calloc(1, sizeof(struct arrow_writer));
+  if (!writer)
+    goto no_memory;
+  writer->sink = sink;
+  writer->sink_arg = sink_arg;
+
+  // the columns of construct_select_query, in order
+  writer->columns = calloc(2 + options->schema_count * 2,
+                           sizeof(struct arrow_column));
+  if (!writer->columns)
+    goto no_memory;
+  int r = 0;
+  struct arrow_column *column = writer->columns;
+  if (options->id_column)
+    *column++ = (struct arrow_column){ARROW_INT, NULL, r++};
+  if (options->primary_tag)
+    *column++ = (struct arrow_column){
+        options->transform_tag_names ? ARROW_STRING : ARROW_INT, NULL, r++};
+  for (int i = 0; i < options->schema_count; i++) {
+    enum arrow_column_kind kind = datatype_kind(options->schema[i].datatype);
+    if (kind == ARROW_GEODETIC) {
+      *column = (struct arrow_column){ARROW_GEODETIC, NULL, r};
+      column->children =
+          calloc(GEODETIC_CHILDREN, sizeof(struct arrow_column));
+      if (!column->children) {
+        // the children of the points before are freed with their columns
+        writer->n_columns = column - writer->columns;
+        goto no_memory;
+      }
+      column->n_children = GEODETIC_CHILDREN;
+      column->children[0] = (struct arrow_column){ARROW_LONGITUDE,
+                                                  "longitude", r};
+      column->children[1] = (struct arrow_column){ARROW_LATITUDE,
+                                                  "latitude", r};
+      column->children[2] = (struct arrow_column){ARROW_FLOAT,
+                                                  "latlong_accuracy", r + 1};
+      column->children[3] = (struct arrow_column){ARROW_FLOAT, "altitude",
+                                                  r + 2};
+      column->children[4] = (struct arrow_column){
+          ARROW_FLOAT, "altitude_accuracy", r + 3};
+      column++;
+      r += 4;
+    } else {
+      *column++ = (struct arrow_column){kind, NULL, r++};
+    }
+    if (options->schema[i].comments)
+      *column++ = (struct arrow_column){ARROW_STRING, NULL, r++};
+  }
+  writer->n_columns = column - writer->columns;
+  writer->n_result_columns = r;
+
+  for (int i = 0; i < writer->n_columns; i++)
+    if (!reset_column(&writer->columns[i]))
+      goto no_memory;
+
+  return writer;
+
+no_memory:
+  free_arrow_writer(writer);
+  errno = ENOMEM;
+  return NULL;
+}
+
+int arrow_write_rows(struct arrow_writer *writer, const PGresult *res) {
+  if (writer->failed)
+    return 0;
+
+  if (!writer->schema_written) {
+    // the result must have the shape the options describe
+    if (PQnfields(res) != writer->n_result_columns ||
+        !write_schema(writer, res))
+      goto failed;
+    writer->schema_written = 1;
+  }
+
+  for (int row_num = 0; row_num < PQntuples(res); row_num++) {
+    for (int i = 0; i < writer->n_columns; i++)
+      if (!append_value(&writer->columns[i], res, row_num, writer->rows))
+        goto failed;
+    if (++writer->rows == ARROW_BATCH_ROWS && !write_batch(writer))
+      goto failed;
+  }
+
+  return 1;
+
+failed:
+  writer->failed = 1;
+  return 0;
+}
+
+int arrow_finish(struct arrow_writer *writer) {
+  static const char end_of_stream[8] = {0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0};
+
+  if (writer->failed || !writer->schema_written)
+    return 0;
+  if (writer->rows && !write_batch(writer))
+    return 0;
+  return writer->sink(end_of_stream, sizeof(end_of_stream), writer->sink_arg);
+}
+
+/**
+ * Frees the buffers of a column (& its children).
+ */
+static void free_column(struct arrow_column *column) {
+  free(column->validity.data);
+  free(column->values.data);
+  free(column->data.data);
+  for (int i = 0; i < column->n_children; i++)
+    free_column(&column->children[i]);
+  free(column->children);
+}
+
+void free_arrow_writer(struct arrow_writer *writer) {
+  if (!writer)
+    return;
+  if (writer->columns)
+    for (int i = 0; i < writer->n_columns; i++)
+      free_column(&writer->columns[i]);
+  free(writer->columns);
+  free(writer);
+}
\ No newline at end of file
@@ -0,0 +1,590 @@
+#define _GNU_SOURCE // memmem
+/**
+ * @brief POST /batch: several GET requests in a single round trip.
+ * The requests run through the regular request handler, each in a thread of
+ * its own, & their responses are read back concurrently through socket pairs.
+ */
+
+#include "server/batch.h"
+#include "logging.h"
+#include "server/responses.h"
+#include "utils/clock.h"
+#include <errno.h>
+#include <jansson.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BATCH_READ_SIZE 65536
+#define MAX_BATCH_BOUNDARY_LENGTH 64
+// the delimiter & headers of a part, including the Content-Length of its
+// response
+#define MAX_BATCH_PART_HEADERS_LENGTH 256
+
+// header lines of the batch that describe its own body
+static const char *const dropped_headers[] = {
+    "Content-Length:", "Content-Type:", "Transfer-Encoding:"};
+
+static unsigned long long boundary_counter = 0;
+
+struct batch_part {
+  /**
+   * @param fd The end of the socket pair the response is read from, or -1 once
+   * it was read.
+   */
+  int fd;
+  /**
+   * @param response The response read so far, null terminated.
+   */
+  char *response;
+  size_t response_len;
+  size_t capacity;
+  /**
+   * @param error The response to send instead, e.g. if the request could not
+   * be started, or NULL.
+   */
+  const char *error;
+  /**
+   * @param timed_out Whether or not the request ran out of time, which makes
+   * the error a 504 instead of a 502.
+   */
+  int timed_out;
+};
+
+/**
+ * The request handler of a batch request & the socket it responds on. The
+ * thread owns it, so that the socket outlives a batch that gave up early.
+ */
+struct batch_handler {
+  void *(*handle_request)(void *);
+  int fd;
+  long long deadline_ms;
+};
+
+// the requests of all batches that are running (see
+// MAX_RUNNING_BATCH_REQUESTS)
+static int running_requests = 0;
+static pthread_mutex_t running_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t running_cond;
+static pthread_once_t batch_initialization = PTHREAD_ONCE_INIT;
+
+static void initialize_batch() {
+  // deadlines are monotonic (see monotonic_ms)
+  pthread_condattr_t attributes;
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+  pthread_cond_init(&running_cond, &attributes);
+  pthread_condattr_destroy(&attributes);
+}
+
+/**
+ * Copies the header lines of the batch that apply to its requests, i.e. every
+ * line but the request line & those describing the body.
+ * @returns The header lines, each terminated by "\r\n", or NULL if out of
+ * memory.
+ */
+static char *forward_headers(const char *headers) {
+  char *forwarded = malloc(strlen(headers) + 3);
+  char *cur = forwarded;
+  const char *line = strchr(headers, '\n');
+
+  if (!forwarded)
+    return NULL;
+
+  while (line) {
+    const char *start = line + 1;
+    size_t length;
+    int dropped = 0;
+
+    line = strchr(start, '\n');
+    length = line ? line - start : strlen(start);
+    if (length && start[length - 1] == '\r')
+      length--;
+    for (int i = 0; i < sizeof(dropped_headers) / sizeof(dropped_headers[0]);
+         i++) {
+      if (strncasecmp(start, dropped_headers[i], strlen(dropped_headers[i])) ==
+          0)
+        dropped = 1;
+    }
+    if (dropped || !length)
+      continue;
+
+    memcpy(cur, start, length);
+    cur += length;
+    *cur++ = '\r';
+    *cur++ = '\n';
+  }
+  *cur = '\0';
+  return forwarded;
+}
+
+/**
+ * Reads the path of a request of the batch, i.e. a string or an object with a
+ * path & an optional querystring.
+ * @param item The element of the batch.
+ * @param path The buffer to write the path to. Must be MAX_BATCH_PATH_LENGTH +
+ * 1 long.
+ * @returns NULL on success or the reason the request is invalid.
+ */
+static const char *read_batch_path(json_t *item, char *path) {
+  const char *route = json_string_value(item);
+  const char *querystring = NULL;
+
+  if (json_is_object(item)) {
+    route = json_string_value(json_object_get(item, "path"));
+    querystring = json_string_value(json_object_get(item, "querystring"));
+    if (!route || (json_object_get(item, "querystring") && !querystring))
+      return "Batch requests need a path & an optional querystring "
+             "(strings).";
+  }
+  if (!route)
+    return "Batch requests must be paths or objects.";
+
+  int n = snprintf(path, MAX_BATCH_PATH_LENGTH + 1, "%s%s%s", route,
+                   querystring && *querystring ? "?" : "",
+                   querystring ? querystring : "");
+  if (n > MAX_BATCH_PATH_LENGTH)
+    return "A batch request path is too long.";
+  if (*path != '/')
+    return "Batch request paths must start with a slash.";
+  // the path goes into a request line
+  for (const char *c = path; *c; c++) {
+    if ((unsigned char)*c <= ' ' || *c == 0x7f)
+      return "Batch request paths must be URL encoded.";
+  }
+  if (strncmp(path, "/batch", strlen("/batch")) == 0 &&
+      strchr("/?", path[strlen("/batch")]))
+    return "Batches cannot be nested.";
+  return NULL;
+}
+
+/**
+ * Waits until fewer than MAX_RUNNING_BATCH_REQUESTS requests run & counts the
+ * calling one as running.
+ * @param deadline_ms The deadline of the batch (see monotonic_ms), or 0 for no
+ * deadline.
+ * @returns 1 on success, 0 if the deadline passed first.
+ */
+static int start_running(long long deadline_ms) {
+  struct timespec deadline = {deadline_ms / 1000,
+                              (deadline_ms % 1000) * 1000000};
+  int started = 0;
+
+  pthread_once(&batch_initialization, initialize_batch);
+  pthread_mutex_lock(&running_lock);
+  while (running_requests >= MAX_RUNNING_BATCH_REQUESTS) {
+    if (!deadline_ms)
+      pthread_cond_wait(&running_cond, &running_lock);
+    else if (pthread_cond_timedwait(&running_cond, &running_lock, &deadline))
+      break;
+  }
+  if (running_requests < MAX_RUNNING_BATCH_REQUESTS) {
+    running_requests++;
+    started = 1;
+  }
+  pthread_mutex_unlock(&running_lock);
+  return started;
+}
+
+/**
+ * Lets the next waiting request run.
+ */
+static void stop_running() {
+  pthread_mutex_lock(&running_lock);
+  running_requests--;
+  pthread_cond_signal(&running_cond);
+  pthread_mutex_unlock(&running_lock);
+}
+
+/**
+ * Runs a request handler with its socket once it is the request's turn.
+ * @param arg The batch_handler, which is freed.
+ */
+static void *run_batch_handler(void *arg) {
+  struct batch_handler handler = *(struct batch_handler *)arg;
+  struct pollfd pfd = {handler.fd, POLLRDHUP, 0};
+  void *result = NULL;
+
+  free(arg);
+  if (!start_running(handler.deadline_ms)) {
+    close(handler.fd);
+    return NULL;
+  }
+
+  // the batch may have given up on the request while it waited
+  if (poll(&pfd, 1, 0) > 0 && pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))
+    close(handler.fd);
+  else
+    result = handler.handle_request(&handler.fd);
+  stop_running();
+  return result;
+}
+
+/**
+ * Sends a request to the handler & starts the handler in a thread of its own.
+ * @returns 1 on success, 0 on failure.
+ */
+static int start_batch_request(struct batch_part *part, const char *path,
+                               const char *forwarded_headers,
+                               void *(*handle_request)(void *),
+                               long long deadline_ms) {
+  int fds[2];
+  pthread_t thread_id;
+  struct batch_handler *handler = NULL;
+  size_t request_length = strlen("GET  HTTP/1.1\r\n\r\n") + strlen(path) +
+                          strlen(forwarded_headers);
+  char *request = malloc(request_length + 1);
+  size_t sent = 0;
+
+  if (!request)
+    return 0;
+  snprintf(request, request_length + 1, "GET %s HTTP/1.1\r\n%s\r\n", path,
+           forwarded_headers);
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    perror("Batch socketpair");
+    free(request);
+    return 0;
+  }
+  part->fd = fds[0];
+
+  // the request is far smaller than the socket buffer, so it is sent whole
+  // before the handler reads it
+  while (sent < request_length) {
+    ssize_t n = send(part->fd, request + sent, request_length - sent,
+                     MSG_NOSIGNAL);
+    if (n <= 0)
+      goto failed;
+    sent += n;
+  }
+  free(request);
+  request = NULL;
+
+  handler = malloc(sizeof(struct batch_handler));
+  if (!handler)
+    goto failed;
+  *handler = (struct batch_handler){handle_request, fds[1], deadline_ms};
+  if (pthread_create(&thread_id, NULL, run_batch_handler, handler) != 0)
+    goto failed;
+  pthread_detach(thread_id);
+  return 1;
+
+failed:
+  free(request);
+  free(handler);
+  close(part->fd);
+  close(fds[1]);
+  part->fd = -1;
+  return 0;
+}
+
+/**
+ * Reads what the handler sent of a response. Closes the socket once the
+ * handler closed its end.
+ */
+static void read_batch_part(struct batch_part *part) {
+  char discarded[BATCH_READ_SIZE];
+  char *target = discarded;
+
+  // responses that are too large are read to the end, but not kept
+  if (!part->error) {
+    if (part->capacity - part->response_len < BATCH_READ_SIZE + 1) {
+      size_t capacity = part->capacity * 2 + BATCH_READ_SIZE + 1;
+      char *response = realloc(part->response, capacity);
+      if (!response) {
+        part->error = "No memory.";
+      } else {
+        part->response = response;
+        part->capacity = capacity;
+      }
+    }
+    if (!part->error)
+      target = part->response + part->response_len;
+  }
+
+  ssize_t n = recv(part->fd, target, BATCH_READ_SIZE, 0);
+  if (n < 0 && (errno == EINTR || errno == EAGAIN))
+    return;
+  if (n <= 0) {
+    close(part->fd);
+    part->fd = -1;
+    return;
+  }
+
+  if (target != discarded) {
+    part->response_len += n;
+    part->response[part->response_len] = '\0';
+    if (part->response_len > MAX_BATCH_PART_SIZE)
+      part->error = "The response is too large to batch.";
+  }
+}
+
+/**
+ * Decodes a chunked body.
+ * @param cur The start of the body. The response must be null terminated.
+ * @param end The end of the response.
+ * @param out The buffer to write the body to, or NULL to measure it.
+ * @returns The length of the body or -1 if it is malformed.
+ */
+static long decode_chunks(const char *cur, const char *end, char *out) {
+  long length = 0;
+
+  for (;;) {
+    char *size_end;
+    unsigned long size = strtoul(cur, &size_end, 16);
+    const char *data = strstr(size_end, "\r\n");
+
+    if (size_end == cur || !data || data >= end)
+      return -1;
+    data += 2;
+    if (!size)
+      return length;
+    if (size > end - data || end - data - size < 2 ||
+        memcmp(data + size, "\r\n", 2) != 0)
+      return -1;
+    if (out)
+      memcpy(out + length, data, size);
+    length += size;
+    cur = data + size + 2;
+  }
+}
+
+/**
+ * Finds the end of the headers of a response & whether its body is chunked.
+ * @param response The response, null terminated.
+ * @param chunked Set to 1 if the body is chunked, 0 if not.
+ * @returns The blank line that ends the headers, or NULL if there is none.
+ */
+static const char *find_header_end(const char *response, int *chunked) {
+  const char *header_end = strstr(response, "\r\n\r\n");
+
+  *chunked = 0;
+  for (const char *line = response; header_end && line <= header_end;
+       line = strstr(line, "\r\n") + 2) {
+    if (strncasecmp(line, "Transfer-Encoding:", strlen("Transfer-Encoding:")) ==
+        0)
+      *chunked = 1;
+  }
+  return header_end;
+}
+
+/**
+ * Replaces the response of a request with an error response if it cannot be
+ * sent (see batch_part.error) or is not a valid HTTP response.
+ */
+static void check_batch_part(struct batch_part *part) {
+  const char *header_end = NULL;
+  int chunked = 0;
+
+  if (!part->error && part->response)
+    header_end = find_header_end(part->response, &chunked);
+  if (!part->error &&
+      (!header_end ||
+       (chunked && decode_chunks(header_end + 4,
+                                 part->response + part->response_len,
+                                 NULL) < 0)))
+    part->error = "The request returned no valid response.";
+  if (!part->error)
+    return;
+
+  free(part->response);
+  part->response = NULL;
+  build_response(part->timed_out ? 504 : 502, &part->response,
+                 &part->response_len, part->error);
+  if (!part->response)
+    part->response_len = 0;
+}
+
+/**
+ * Writes the response of a request as a part of the batch. Chunked bodies are
+ * decoded & given a Content-Length.
+ * @param part The request. Its response must have passed check_batch_part.
+ * @param index The index of the request.
+ * @param boundary The delimiter of the parts.
+ * @param out The buffer to write to. Must hold the response &
+ * MAX_BATCH_PART_HEADERS_LENGTH more bytes.
+ * @returns The number of bytes written.
+ */
+static size_t write_batch_part(const struct batch_part *part, int index,
+                               const char *boundary, char *out) {
+  char *cur = out;
+  const char *response = part->response;
+  const char *response_end = response + part->response_len;
+  int chunked = 0;
+  const char *header_end =
+      response ? find_header_end(response, &chunked) : NULL;
+
+  cur += sprintf(cur,
+                 "--%s\r\nContent-Type: application/http\r\nContent-ID: "
+                 "%d\r\n\r\n",
+                 boundary, index);
+
+  if (!header_end) {
+    // out of memory for the error response
+  } else if (chunked) {
+    // the status line & the headers, without Transfer-Encoding
+    for (const char *line = response; line <= header_end;) {
+      const char *line_end = strstr(line, "\r\n") + 2;
+      if (strncasecmp(line, "Transfer-Encoding:",
+                      strlen("Transfer-Encoding:")) != 0) {
+        memcpy(cur, line, line_end - line);
+        cur += line_end - line;
+      }
+      line = line_end;
+    }
+    cur += sprintf(cur, "Content-Length: %ld\r\n\r\n",
+                   decode_chunks(header_end + 4, response_end, NULL));
+    cur += decode_chunks(header_end + 4, response_end, cur);
+  } else {
+    memcpy(cur, response, part->response_len);
+    cur += part->response_len;
+  }
+
+  memcpy(cur, "\r\n", 2);
+  return cur + 2 - out;
+}
+
+void respond_batch(const char *body, const char *headers,
+                   void *(*handle_request)(void *), int client_fd,
+                   long long deadline_ms, char **response,
+                   size_t *response_len) {
+  struct batch_part parts[MAX_BATCH_REQUESTS];
+  // the parts & the client
+  struct pollfd pfds[MAX_BATCH_REQUESTS + 1];
+  char path[MAX_BATCH_PATH_LENGTH + 1];
+  char boundary[MAX_BATCH_BOUNDARY_LENGTH];
+  char content_type[MAX_BATCH_BOUNDARY_LENGTH + 32];
+  char *forwarded_headers = NULL;
+  char *multipart = NULL;
+  size_t multipart_size = MAX_BATCH_PART_HEADERS_LENGTH;
+  size_t multipart_len = 0;
+  json_t *requests = body ? json_loads(body, 0, NULL) : NULL;
+  int count = json_array_size(requests);
+  const char *invalid = NULL;
+
+  for (int i = 0; i < MAX_BATCH_REQUESTS; i++)
+    parts[i] = (struct batch_part){-1, NULL, 0, 0, NULL, 0};
+
+  if (!json_is_array(requests) || !count || count > MAX_BATCH_REQUESTS) {
+    build_response_printf(400, response, response_len,
+                          strlen("The body must be a JSON array of 1 to  "
+                                 "requests.") +
+                              2,
+                          "The body must be a JSON array of 1 to %d requests.",
+                          MAX_BATCH_REQUESTS);
+    goto end;
+  }
+  // every request is checked before any of them runs
+  for (int i = 0; !invalid && i < count; i++)
+    invalid = read_batch_path(json_array_get(requests, i), path);
+  if (invalid) {
+    build_response(400, response, response_len, invalid);
+    goto end;
+  }
+
+  forwarded_headers = forward_headers(headers);
+  if (!forwarded_headers) {
+    build_response(500, response, response_len, "No memory.");
+    goto end;
+  }
+
+  for (int i = 0; i < count; i++) {
+    read_batch_path(json_array_get(requests, i), path);
+    if (!start_batch_request(&parts[i], path, forwarded_headers,
+                             handle_request, deadline_ms))
+      parts[i].error = "The request could not be started.";
+  }
+
+  // the responses are read as they are written, so that no handler waits on
+  // another one's response to be read. Requests still running at the deadline
+  // are given up on, & so is the whole batch if its client hangs up
+  for (;;) {
+    int open = 0;
+    for (int i = 0; i < count; i++) {
+      pfds[i] = (struct pollfd){parts[i].fd, POLLIN, 0};
+      open += parts[i].fd >= 0;
+    }
+    if (!open)
+      break;
+    pfds[count] = (struct pollfd){client_fd, POLLRDHUP, 0};
+
+    long long timeout = -1;
+    if (deadline_ms && (timeout = deadline_ms - monotonic_ms()) < 0)
+      timeout = 0;
+    int ready = poll(pfds, count + 1, timeout);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    if (ready < 0) {
+      perror("Batch poll");
+      break;
+    }
+
+    if (pfds[count].revents & (POLLRDHUP | POLLHUP | POLLERR)) {
+      log_debug_printf("Batch client hung up.\n");
+      goto end;
+    }
+    for (int i = 0; !ready && i < count; i++) {
+      if (parts[i].fd < 0)
+        continue;
+      // the handler's writes fail once its socket is closed
+      close(parts[i].fd);
+      parts[i].fd = -1;
+      parts[i].error = "The request timed out.";
+      parts[i].timed_out = 1;
+    }
+    for (int i = 0; i < count; i++) {
+      if (pfds[i].revents)
+        read_batch_part(&parts[i]);
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    check_batch_part(&parts[i]);
+    multipart_size += parts[i].response_len + MAX_BATCH_PART_HEADERS_LENGTH;
+  }
+  multipart = malloc(multipart_size);
+  if (!multipart) {
+    build_response(500, response, response_len, "No memory.");
+    goto end;
+  }
+
+  // the boundary may not occur within a part, which is unlikely but checked
+  for (int collision = 1; collision;) {
+    snprintf(boundary, MAX_BATCH_BOUNDARY_LENGTH, "batch-%llx-%llx",
+             (unsigned long long)monotonic_ms(),
+             __atomic_add_fetch(&boundary_counter, 1, __ATOMIC_RELAXED));
+    collision = 0;
+    multipart_len = 0;
+    for (int i = 0; i < count; i++) {
+      size_t part_start = multipart_len;
+      multipart_len += write_batch_part(&parts[i], i, boundary,
+                                        multipart + multipart_len);
+      // past the part's delimiter
+      part_start += strlen(boundary) + 2;
+      if (memmem(multipart + part_start, multipart_len - part_start, boundary,
+                 strlen(boundary)))
+        collision = 1;
+    }
+  }
+  multipart_len += sprintf(multipart + multipart_len, "--%s--\r\n", boundary);
+
+  snprintf(content_type, sizeof(content_type), "multipart/mixed; boundary=%s",
+           boundary);
+  build_response_with_body(200, response, response_len, content_type, "",
+                           multipart, multipart_len);
+
+end:
+  for (int i = 0; i < MAX_BATCH_REQUESTS; i++) {
+    if (parts[i].fd >= 0)
+      close(parts[i].fd);
+    free(parts[i].response);
+  }
+  free(multipart);
+  free(forwarded_headers);
+  json_decref(requests);
+}
\ No newline at end of file
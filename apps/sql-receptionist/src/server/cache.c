@@ -0,0 +1,284 @@
+/**
+ * @brief sharded LRU cache of SELECT responses.
+ * Every shard has its own lock, hash table & LRU list, so concurrent requests
+ * rarely contend. Invalidation only bumps a generation counter (a lock-free
+ * array indexed by a hash of the table) & never walks the shards.
+ */
+
+#include "server/cache.h"
+#include "server/metrics.h"
+#include "utils/clock.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// tables sharing a slot invalidate each other, which is harmless
+#define CACHE_GENERATION_SLOTS 4096
+
+struct cache_entry {
+  struct cache_entry *next_in_bucket;
+  // the LRU list, from the most recently used entry
+  struct cache_entry *newer;
+  struct cache_entry *older;
+  uint64_t hash;
+  /**
+   * @param table_slot The generation slot of the entry's table.
+   * @param database_slot The generation slot of the entry's database.
+   */
+  unsigned int table_slot;
+  unsigned int database_slot;
+  unsigned long long generation;
+  long long expires_ms;
+  /**
+   * @param size The memory used by the entry.
+   */
+  size_t size;
+  size_t response_len;
+  char *response;
+  char key[];
+};
+
+struct cache_shard {
+  pthread_mutex_t lock;
+  struct cache_entry *buckets[CACHE_BUCKETS_PER_SHARD];
+  struct cache_entry *newest;
+  struct cache_entry *oldest;
+  size_t size;
+};
+
+static struct cache_shard shards[CACHE_SHARDS];
+static atomic_ullong generations[CACHE_GENERATION_SLOTS];
+static size_t shard_budget = 0;
+static long long ttl_ms = CACHE_DEFAULT_TTL_MS;
+static pthread_once_t cache_initialization = PTHREAD_ONCE_INIT;
+
+static struct metric *hits_metric;
+static struct metric *misses_metric;
+static struct metric *evictions_metric;
+static struct metric *invalidations_metric;
+static struct metric *size_metric;
+
+static void initialize_cache() {
+  const char *budget_mb = getenv("SQL_RECEPTIONIST_CACHE_MB");
+  const char *ttl = getenv("SQL_RECEPTIONIST_CACHE_TTL_MS");
+
+  if (budget_mb && atoll(budget_mb) > 0)
+    shard_budget = atoll(budget_mb) * 1024 * 1024 / CACHE_SHARDS;
+  if (ttl && atoll(ttl) > 0)
+    ttl_ms = atoll(ttl);
+
+  for (int i = 0; i < CACHE_SHARDS; i++)
+    pthread_mutex_init(&shards[i].lock, NULL);
+
+  hits_metric = get_metric("sql_receptionist_cache_hits_total");
+  misses_metric = get_metric("sql_receptionist_cache_misses_total");
+  evictions_metric = get_metric("sql_receptionist_cache_evictions_total");
+  invalidations_metric =
+      get_metric("sql_receptionist_cache_invalidations_total");
+  size_metric = get_metric("sql_receptionist_cache_bytes");
+}
+
+/**
+ * FNV-1a over the given strings, each followed by a separator.
+ */
+static uint64_t hash_strings(const char *first, const char *second) {
+  uint64_t hash = 14695981039346656037ULL;
+  const char *strings[2] = {first, second};
+
+  for (int i = 0; i < 2 && strings[i]; i++) {
+    for (const char *cur = strings[i]; *cur; cur++)
+      hash = (hash ^ (unsigned char)*cur) * 1099511628211ULL;
+    hash = (hash ^ '/') * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static unsigned int generation_slot(const char *database, const char *table) {
+  return hash_strings(database, table) % CACHE_GENERATION_SLOTS;
+}
+
+/**
+ * @returns The current generation of an entry's table & database.
+ */
+static unsigned long long current_generation(unsigned int table_slot,
+                                             unsigned int database_slot) {
+  // both only grow, so their sum changes whenever either is bumped
+  return atomic_load(&generations[table_slot]) +
+         atomic_load(&generations[database_slot]);
+}
+
+static struct cache_shard *get_shard(uint64_t hash) {
+  return &shards[hash % CACHE_SHARDS];
+}
+
+static struct cache_entry **get_bucket(struct cache_shard *shard,
+                                       uint64_t hash) {
+  return &shard->buckets[(hash / CACHE_SHARDS) % CACHE_BUCKETS_PER_SHARD];
+}
+
+/**
+ * Removes an entry from its shard & frees it. The shard must be locked.
+ */
+static void remove_entry(struct cache_shard *shard, struct cache_entry *entry) {
+  struct cache_entry **cur = get_bucket(shard, entry->hash);
+  while (*cur != entry)
+    cur = &(*cur)->next_in_bucket;
+  *cur = entry->next_in_bucket;
+
+  if (entry->newer)
+    entry->newer->older = entry->older;
+  else
+    shard->newest = entry->older;
+  if (entry->older)
+    entry->older->newer = entry->newer;
+  else
+    shard->oldest = entry->newer;
+
+  shard->size -= entry->size;
+  metric_add(size_metric, -(long long)entry->size);
+  free(entry);
+}
+
+/**
+ * Makes an entry the most recently used one of its shard. The shard must be
+ * locked.
+ */
+static void push_newest(struct cache_shard *shard, struct cache_entry *entry) {
+  entry->newer = NULL;
+  entry->older = shard->newest;
+  if (shard->newest)
+    shard->newest->newer = entry;
+  else
+    shard->oldest = entry;
+  shard->newest = entry;
+}
+
+/**
+ * @returns The entry with the given key or NULL. The shard must be locked.
+ */
+static struct cache_entry *find_entry(struct cache_shard *shard, uint64_t hash,
+                                      const char *key) {
+  for (struct cache_entry *entry = *get_bucket(shard, hash); entry;
+       entry = entry->next_in_bucket) {
+    if (entry->hash == hash && strcmp(entry->key, key) == 0)
+      return entry;
+  }
+  return NULL;
+}
+
+int cache_enabled() {
+  pthread_once(&cache_initialization, initialize_cache);
+  return shard_budget > 0;
+}
+
+size_t cache_max_entry_size() {
+  pthread_once(&cache_initialization, initialize_cache);
+  return shard_budget / CACHE_MAX_ENTRY_FRACTION;
+}
+
+unsigned long long cache_generation(const char *database, const char *table) {
+  return current_generation(generation_slot(database, table),
+                            generation_slot(database, NULL));
+}
+
+int cache_get(const char *key, char **response, size_t *response_len) {
+  uint64_t hash = hash_strings(key, NULL);
+  struct cache_shard *shard = get_shard(hash);
+  int hit = 0;
+
+  if (!cache_enabled())
+    return 0;
+
+  pthread_mutex_lock(&shard->lock);
+  struct cache_entry *entry = find_entry(shard, hash, key);
+  if (entry && (entry->generation != current_generation(entry->table_slot,
+                                                        entry->database_slot) ||
+                monotonic_ms() >= entry->expires_ms)) {
+    remove_entry(shard, entry);
+    entry = NULL;
+  }
+
+  if (entry && (*response = malloc(entry->response_len + 1))) {
+    memcpy(*response, entry->response, entry->response_len);
+    (*response)[entry->response_len] = '\0';
+    *response_len = entry->response_len;
+
+    // move it to the front of the LRU list
+    if (entry->newer) {
+      entry->newer->older = entry->older;
+      if (entry->older)
+        entry->older->newer = entry->newer;
+      else
+        shard->oldest = entry->newer;
+      push_newest(shard, entry);
+    }
+    hit = 1;
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  metric_add(hit ? hits_metric : misses_metric, 1);
+  return hit;
+}
+
+void cache_put(const char *key, const char *database, const char *table,
+               unsigned long long generation, const char *response,
+               size_t response_len) {
+  uint64_t hash = hash_strings(key, NULL);
+  struct cache_shard *shard = get_shard(hash);
+  size_t key_size = strlen(key) + 1;
+  unsigned int table_slot = generation_slot(database, table);
+  unsigned int database_slot = generation_slot(database, NULL);
+
+  if (!cache_enabled() || response_len > cache_max_entry_size() ||
+      generation != current_generation(table_slot, database_slot))
+    return;
+
+  size_t size = sizeof(struct cache_entry) + key_size + response_len;
+  struct cache_entry *entry = malloc(size);
+  if (!entry)
+    return;
+  entry->hash = hash;
+  entry->table_slot = table_slot;
+  entry->database_slot = database_slot;
+  entry->generation = generation;
+  entry->expires_ms = monotonic_ms() + ttl_ms;
+  entry->size = size;
+  entry->response_len = response_len;
+  memcpy(entry->key, key, key_size);
+  entry->response = entry->key + key_size;
+  memcpy(entry->response, response, response_len);
+
+  pthread_mutex_lock(&shard->lock);
+  struct cache_entry *old_entry = find_entry(shard, hash, key);
+  if (old_entry)
+    remove_entry(shard, old_entry);
+
+  struct cache_entry **bucket = get_bucket(shard, hash);
+  entry->next_in_bucket = *bucket;
+  *bucket = entry;
+  push_newest(shard, entry);
+  shard->size += size;
+  metric_add(size_metric, size);
+
+  while (shard->size > shard_budget) {
+    remove_entry(shard, shard->oldest);
+    metric_add(evictions_metric, 1);
+  }
+  pthread_mutex_unlock(&shard->lock);
+}
+
+void cache_invalidate(const char *database, const char *table) {
+  pthread_once(&cache_initialization, initialize_cache);
+  atomic_fetch_add(&generations[generation_slot(database, table)], 1);
+  metric_add(invalidations_metric, 1);
+}
+
+int write_cache_channel(const char *table, char *buffer, size_t buffer_size) {
+  if (buffer_size > MAX_CACHE_CHANNEL_LENGTH)
+    buffer_size = MAX_CACHE_CHANNEL_LENGTH;
+
+  size_t n = snprintf(buffer, buffer_size, "%s%s", CACHE_CHANNEL_PREFIX, table);
+  return n < buffer_size;
+}
\ No newline at end of file
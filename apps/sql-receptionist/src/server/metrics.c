@@ -0,0 +1,80 @@
+/**
+ * @brief process-wide metrics registry.
+ * Metrics are registered lazily by name and are never removed, so pointers
+ * returned by get_metric may be cached by the caller.
+ */
+
+#include "server/metrics.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_METRICS 256
+#define MAX_METRIC_NAME_LENGTH 256
+
+struct metric {
+  char name[MAX_METRIC_NAME_LENGTH];
+  atomic_llong value;
+};
+
+static struct metric metrics[MAX_METRICS];
+static atomic_int metrics_count = 0;
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct metric *get_metric(const char *name) {
+  struct metric *output = NULL;
+
+  pthread_mutex_lock(&metrics_lock);
+  for (int i = 0; i < metrics_count; i++) {
+    if (strcmp(metrics[i].name, name) == 0) {
+      output = &metrics[i];
+      goto end;
+    }
+  }
+
+  if (metrics_count >= MAX_METRICS ||
+      strlen(name) >= MAX_METRIC_NAME_LENGTH)
+    goto end;
+
+  output = &metrics[metrics_count];
+  memcpy(output->name, name, strlen(name) + 1);
+  atomic_init(&output->value, 0);
+  // publish the metric only after it is fully written
+  metrics_count++;
+
+end:
+  pthread_mutex_unlock(&metrics_lock);
+  return output;
+}
+
+void metric_add(struct metric *metric, long long delta) {
+  if (metric)
+    atomic_fetch_add(&metric->value, delta);
+}
+
+void metric_set(struct metric *metric, long long value) {
+  if (metric)
+    atomic_store(&metric->value, value);
+}
+
+long long metric_value(struct metric *metric) {
+  return metric ? atomic_load(&metric->value) : 0;
+}
+
+size_t write_metrics(char *buffer, size_t buffer_size) {
+  size_t total = 0;
+  int count = metrics_count;
+
+  if (buffer_size > 0)
+    *buffer = '\0';
+
+  for (int i = 0; i < count; i++) {
+    size_t remaining_size = total < buffer_size ? buffer_size - total : 0;
+    total += snprintf(remaining_size ? buffer + total : NULL, remaining_size,
+                      "%s %lld\n", metrics[i].name,
+                      atomic_load(&metrics[i].value));
+  }
+
+  return total;
+}
\ No newline at end of file
@@ -1,15 +1,19 @@
 /**
  * @brief helper library for building HTTP 1.1 responses.
  * This helper library can build responses for the following status codes: 200,
- * 204, 400, 403, 404, 500.
+ * 204, 400, 403, 404, 500, 503.
  */
 
 #include "config.h"
 #include "logging.h"
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+
+#define MAX_CONTENT_LENGTH_HEADER_LENGTH 64
+
 /**
  * Returns the name associated with the given status code.
  * @return the name associated with the given status code.
@@ -30,13 +34,21 @@ const char *get_status_code_name(int status_code) {
     return "Not Found";
   case 500:
     return "Internal Server Error";
+  case 502:
+    return "Bad Gateway";
+  case 503:
+    return "Service Unavailable";
+  case 504:
+    return "Gateway Timeout";
   default:
     return "";
   }
 }
 
-size_t write_header(const int status_code, char *buffer,
-                    const size_t buffer_size) {
+size_t write_header_with_content_type(const int status_code,
+                                      const char *content_type,
+                                      const char *headers, char *buffer,
+                                      const size_t buffer_size) {
   const char *status_code_name = get_status_code_name(status_code);
 
   if (getenv("SQL_RECEPTIONIST_LOG_RESPONSES") &&
@@ -56,26 +68,41 @@ size_t write_header(const int status_code, char *buffer,
 
   return snprintf(buffer, buffer_size,
                   "HTTP/1.1 %d %s\r\n"
-                  "Content-Type: text/plain\r\n"
+                  "Content-Type: %s\r\n"
                   "Access-Control-Allow-Origin: %s\r\n"
-                  "Access-Control-Allow-Headers: Content-Type\r\n"
+                  "Access-Control-Allow-Headers: Content-Type, X-Min-LSN\r\n"
                   "Access-Control-Allow-Credentials: true\r\n"
+                  "%s"
                   "Connection: %s\r\n"
                   "\r\n",
-                  status_code, status_code_name, getenv("MAIN_URL"),
-                  connection);
+                  status_code, status_code_name, content_type,
+                  getenv("MAIN_URL"), headers, connection);
+}
+
+size_t write_header_with_headers(const int status_code, const char *headers,
+                                 char *buffer, const size_t buffer_size) {
+  return write_header_with_content_type(status_code, "text/plain", headers,
+                                        buffer, buffer_size);
+}
+
+size_t write_header(const int status_code, char *buffer,
+                    const size_t buffer_size) {
+  return write_header_with_headers(status_code, "", buffer, buffer_size);
 }
 
 /**
- * Build a response, and set its body to the given string. Fails if the config
- * is missing or NULL.
+ * Build a response with additional headers, and set its body to the given
+ * string. Fails if the config is missing or NULL.
  * @param status_code The status code of the response.
  * @param response response text output pointer.
  * @param response_len response text length output pointer.
+ * @param headers additional header lines, each terminated by "\r\n". May be
+ * empty.
  * @param body response body string.
  */
-void build_response(int status_code, char **response, size_t *response_len,
-                    const char *body) {
+void build_response_with_headers(int status_code, char **response,
+                                 size_t *response_len, const char *headers,
+                                 const char *body) {
   const char *status_code_name = get_status_code_name(status_code);
 
   if (getenv("SQL_RECEPTIONIST_LOG_RESPONSES") &&
@@ -91,12 +118,13 @@ void build_response(int status_code, char **response, size_t *response_len,
   *response_len = strlen("HTTP/1.1 xxx \r\n"
                          "Content-Type: text/plain\r\n"
                          "Access-Control-Allow-Origin: \r\n"
-                         "Access-Control-Allow-Headers: Content-Type\r\n"
+                         "Access-Control-Allow-Headers: Content-Type, "
+                         "X-Min-LSN\r\n"
                          "Access-Control-Allow-Credentials: true\r\n"
                          "Connection: \r\n"
                          "\r\n") +
                   strlen(status_code_name) + strlen(getenv("MAIN_URL")) +
-                  strlen(connection) + strlen(body);
+                  strlen(headers) + strlen(connection) + strlen(body);
   *response = malloc(*response_len + 1);
   if (!*response) {
     perror("Malloc failure on *response.");
@@ -106,11 +134,68 @@ void build_response(int status_code, char **response, size_t *response_len,
            "HTTP/1.1 %d %s\r\n"
            "Content-Type: text/plain\r\n"
            "Access-Control-Allow-Origin: %s\r\n"
-           "Access-Control-Allow-Headers: Content-Type\r\n"
+           "Access-Control-Allow-Headers: Content-Type, X-Min-LSN\r\n"
            "Access-Control-Allow-Credentials: true\r\n"
+           "%s"
            "Connection: %s\r\n"
            "\r\n%s",
-           status_code, status_code_name, getenv("MAIN_URL"), connection, body);
+           status_code, status_code_name, getenv("MAIN_URL"), headers,
+           connection, body);
+}
+
+/**
+ * Build a response, and set its body to the given string. Fails if the config
+ * is missing or NULL.
+ * @param status_code The status code of the response.
+ * @param response response text output pointer.
+ * @param response_len response text length output pointer.
+ * @param body response body string.
+ */
+void build_response(int status_code, char **response, size_t *response_len,
+                    const char *body) {
+  build_response_with_headers(status_code, response, response_len, "", body);
+}
+
+/**
+ * Build a response with the given Content-Type & a body of known length, which
+ * may hold binary data. Sets Content-Length. Fails if the config is missing or
+ * NULL.
+ * @param status_code The status code of the response.
+ * @param response response text output pointer.
+ * @param response_len response text length output pointer.
+ * @param content_type The media type of the body.
+ * @param headers additional header lines, each terminated by "\r\n". May be
+ * empty.
+ * @param body The response body.
+ * @param body_len The length of the body.
+ */
+void build_response_with_body(int status_code, char **response,
+                              size_t *response_len, const char *content_type,
+                              const char *headers, const char *body,
+                              size_t body_len) {
+  size_t headers_size = strlen(headers) + MAX_CONTENT_LENGTH_HEADER_LENGTH;
+  char *all_headers = malloc(headers_size);
+  if (!all_headers) {
+    perror("Malloc failure on the response headers.");
+    return;
+  }
+  snprintf(all_headers, headers_size, "%sContent-Length: %zu\r\n", headers,
+           body_len);
+
+  size_t header_len = write_header_with_content_type(
+      status_code, content_type, all_headers, NULL, 0);
+  *response = malloc(header_len + body_len + 1);
+  if (!*response) {
+    perror("Malloc failure on *response.");
+    free(all_headers);
+    return;
+  }
+  write_header_with_content_type(status_code, content_type, all_headers,
+                                 *response, header_len + 1);
+  free(all_headers);
+  memcpy(*response + header_len, body, body_len);
+  (*response)[header_len + body_len] = '\0';
+  *response_len = header_len + body_len;
 }
 
 /**
@@ -166,5 +251,35 @@ void build_response_default(int status_code, char **response,
   case 500:
     build_response(500, response, response_len, "Internal Server Error");
     break;
+  case 503:
+    build_response(503, response, response_len, "Service Unavailable");
+    break;
+  }
+}
+
+static char *unavailable_response = NULL;
+static size_t unavailable_response_len = 0;
+static pthread_once_t unavailable_response_once = PTHREAD_ONCE_INIT;
+
+static void initialize_unavailable_response() {
+  build_response(503, &unavailable_response, &unavailable_response_len,
+                 "The database is currently unavailable. Try again later.");
+}
+
+/**
+ * Copy the pre-built 503 response that is sent while a database is
+ * unreachable. The response is only formatted once.
+ * @param response response text output pointer.
+ * @param response_len response text length output pointer.
+ */
+void build_unavailable_response(char **response, size_t *response_len) {
+  pthread_once(&unavailable_response_once, initialize_unavailable_response);
+
+  *response = malloc(unavailable_response_len + 1);
+  if (!*response) {
+    perror("Malloc failure on *response.");
+    return;
   }
+  memcpy(*response, unavailable_response, unavailable_response_len + 1);
+  *response_len = unavailable_response_len;
 }
\ No newline at end of file
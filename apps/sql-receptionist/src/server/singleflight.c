@@ -0,0 +1,169 @@
+/**
+ * @brief coalescing of identical concurrent SELECT requests.
+ * In-flight requests are few & short-lived, so a single lock guards the table;
+ * it is never held while waiting or querying.
+ */
+
+#include "server/singleflight.h"
+#include "server/metrics.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+struct flight {
+  struct flight *next_in_bucket;
+  pthread_cond_t landed_cond;
+  uint64_t hash;
+  unsigned long long generation;
+  /**
+   * @param references The leader & the followers that did not leave yet.
+   */
+  int references;
+  /**
+   * @param landed Whether or not the leader landed the flight. Landed flights
+   * are no longer in the table.
+   */
+  int landed;
+  char *response;
+  size_t response_len;
+  char key[];
+};
+
+static pthread_mutex_t flights_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct flight *buckets[SINGLEFLIGHT_BUCKETS];
+static pthread_once_t singleflight_initialization = PTHREAD_ONCE_INIT;
+static pthread_condattr_t landed_cond_attributes;
+
+static struct metric *requests_metric;
+static struct metric *coalesced_metric;
+
+static void initialize_singleflight() {
+  // deadlines are monotonic (see monotonic_ms)
+  pthread_condattr_init(&landed_cond_attributes);
+  pthread_condattr_setclock(&landed_cond_attributes, CLOCK_MONOTONIC);
+
+  requests_metric = get_metric("sql_receptionist_singleflight_requests_total");
+  coalesced_metric =
+      get_metric("sql_receptionist_singleflight_coalesced_total");
+}
+
+/**
+ * FNV-1a over the key.
+ */
+static uint64_t hash_key(const char *key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *cur = key; *cur; cur++)
+    hash = (hash ^ (unsigned char)*cur) * 1099511628211ULL;
+  return hash;
+}
+
+static struct flight **get_bucket(uint64_t hash) {
+  return &buckets[hash % SINGLEFLIGHT_BUCKETS];
+}
+
+/**
+ * Drops a reference to a flight. flights_lock must be held.
+ */
+static void release_flight(struct flight *flight) {
+  if (--flight->references)
+    return;
+  pthread_cond_destroy(&flight->landed_cond);
+  free(flight->response);
+  free(flight);
+}
+
+struct flight *flight_join(const char *key, unsigned long long generation,
+                           int *leader) {
+  uint64_t hash = hash_key(key);
+  struct flight **bucket = get_bucket(hash);
+  size_t key_size = strlen(key) + 1;
+
+  pthread_once(&singleflight_initialization, initialize_singleflight);
+  metric_add(requests_metric, 1);
+
+  pthread_mutex_lock(&flights_lock);
+  for (struct flight *flight = *bucket; flight;
+       flight = flight->next_in_bucket) {
+    if (flight->hash == hash && flight->generation == generation &&
+        strcmp(flight->key, key) == 0) {
+      flight->references++;
+      pthread_mutex_unlock(&flights_lock);
+      *leader = 0;
+      return flight;
+    }
+  }
+
+  struct flight *flight = malloc(sizeof(struct flight) + key_size);
+  if (flight) {
+    pthread_cond_init(&flight->landed_cond, &landed_cond_attributes);
+    flight->hash = hash;
+    flight->generation = generation;
+    flight->references = 1;
+    flight->landed = 0;
+    flight->response = NULL;
+    flight->response_len = 0;
+    memcpy(flight->key, key, key_size);
+    flight->next_in_bucket = *bucket;
+    *bucket = flight;
+  }
+  pthread_mutex_unlock(&flights_lock);
+
+  *leader = 1;
+  return flight;
+}
+
+void flight_land(struct flight *flight, char *response, size_t response_len) {
+  if (!flight) {
+    free(response);
+    return;
+  }
+
+  pthread_mutex_lock(&flights_lock);
+  struct flight **cur = get_bucket(flight->hash);
+  while (*cur != flight)
+    cur = &(*cur)->next_in_bucket;
+  *cur = flight->next_in_bucket;
+
+  flight->landed = 1;
+  flight->response = response;
+  flight->response_len = response_len;
+  pthread_cond_broadcast(&flight->landed_cond);
+  release_flight(flight);
+  pthread_mutex_unlock(&flights_lock);
+}
+
+int flight_wait(struct flight *flight, long long deadline_ms,
+                const char **response, size_t *response_len) {
+  struct timespec deadline = {deadline_ms / 1000,
+                              (deadline_ms % 1000) * 1000000};
+  int shared = 0;
+
+  pthread_mutex_lock(&flights_lock);
+  while (!flight->landed) {
+    if (!deadline_ms)
+      pthread_cond_wait(&flight->landed_cond, &flights_lock);
+    else if (pthread_cond_timedwait(&flight->landed_cond, &flights_lock,
+                                    &deadline))
+      break;
+  }
+  if (flight->landed && flight->response) {
+    *response = flight->response;
+    *response_len = flight->response_len;
+    shared = 1;
+  }
+  pthread_mutex_unlock(&flights_lock);
+
+  if (shared)
+    metric_add(coalesced_metric, 1);
+  return shared;
+}
+
+void flight_leave(struct flight *flight) {
+  if (!flight)
+    return;
+
+  pthread_mutex_lock(&flights_lock);
+  release_flight(flight);
+  pthread_mutex_unlock(&flights_lock);
+}
\ No newline at end of file
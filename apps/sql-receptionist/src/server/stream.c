@@ -0,0 +1,248 @@
+/**
+ * @brief chunked (Transfer-Encoding: chunked) HTTP 1.1 responses.
+ */
+
+#include "server/stream.h"
+#include "server/responses.h"
+#include "utils/clock.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define MAX_STREAM_HEADER_SIZE 4096
+#define MAX_CHUNK_SIZE_LENGTH 32
+
+void stream_init(struct response_stream *stream, int client_fd,
+                 long long deadline_ms) {
+  stream->client_fd = client_fd;
+  stream->deadline_ms = deadline_ms;
+  stream->started = 0;
+  stream->failed = 0;
+  stream->length = 0;
+  stream->last_flush_ms = monotonic_ms();
+  stream->content_type = NULL;
+  stream->headers = "";
+  stream->capture = NULL;
+  stream->capture_length = 0;
+  stream->capture_limit = 0;
+  stream->holding = 0;
+  stream->held_length = 0;
+}
+
+/**
+ * Sends every given buffer, waiting for the client to make room as needed.
+ * @param stream The stream to send on.
+ * @param iov The buffers to send. Modified in place.
+ * @param iov_count The number of buffers.
+ * @returns 1 on success, 0 on failure.
+ */
+static int send_all(struct response_stream *stream, struct iovec *iov,
+                    int iov_count) {
+  struct msghdr message = {0};
+  message.msg_iov = iov;
+  message.msg_iovlen = iov_count;
+
+  while (message.msg_iovlen) {
+    // backpressure: wait for the client to read what was already sent
+    struct pollfd pfd = {stream->client_fd, POLLOUT, 0};
+    long long timeout = -1;
+    if (stream->deadline_ms) {
+      timeout = stream->deadline_ms - monotonic_ms();
+      if (timeout <= 0) {
+        stream->failed = ETIMEDOUT;
+        goto failed;
+      }
+    }
+    int ready = poll(&pfd, 1, timeout);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    if (ready <= 0) {
+      stream->failed = ready ? errno : ETIMEDOUT;
+      goto failed;
+    }
+    if (pfd.revents & (POLLERR | POLLHUP)) {
+      stream->failed = EPIPE;
+      goto failed;
+    }
+
+    ssize_t sent = sendmsg(stream->client_fd, &message, MSG_NOSIGNAL);
+    if (sent < 0 && (errno == EINTR || errno == EAGAIN))
+      continue;
+    if (sent < 0) {
+      stream->failed = errno;
+      goto failed;
+    }
+
+    // skip whatever was fully sent
+    while (message.msg_iovlen && (size_t)sent >= message.msg_iov->iov_len) {
+      sent -= message.msg_iov->iov_len;
+      message.msg_iov++;
+      message.msg_iovlen--;
+    }
+    if (message.msg_iovlen) {
+      message.msg_iov->iov_base = (char *)message.msg_iov->iov_base + sent;
+      message.msg_iov->iov_len -= sent;
+    }
+  }
+
+  return 1;
+
+failed:
+  errno = 0;
+  return 0;
+}
+
+int stream_start(struct response_stream *stream, int status_code,
+                 const char *content_type, const char *headers) {
+  char header[MAX_STREAM_HEADER_SIZE];
+  char extra_headers[MAX_STREAM_HEADER_SIZE];
+
+  snprintf(extra_headers, MAX_STREAM_HEADER_SIZE,
+           "%sTransfer-Encoding: chunked\r\n", headers);
+  size_t header_len =
+      write_header_with_content_type(status_code, content_type, extra_headers,
+                                     header, MAX_STREAM_HEADER_SIZE);
+  if (header_len >= MAX_STREAM_HEADER_SIZE) {
+    stream->failed = EMSGSIZE;
+    return 0;
+  }
+
+  struct iovec iov = {header, header_len};
+  stream->started = 1;
+  stream->content_type = content_type;
+  stream->headers = headers;
+  return send_all(stream, &iov, 1);
+}
+
+char *stream_space(struct response_stream *stream) {
+  return stream->buffer + stream->length;
+}
+
+size_t stream_space_left(const struct response_stream *stream) {
+  return STREAM_CHUNK_SIZE - stream->length;
+}
+
+void stream_advance(struct response_stream *stream, size_t length) {
+  stream->length += length;
+}
+
+int stream_flush(struct response_stream *stream) {
+  char chunk_size[MAX_CHUNK_SIZE_LENGTH];
+
+  if (stream->failed)
+    return 0;
+  // an empty chunk would end the body
+  if (!stream->length)
+    return 1;
+
+  if (stream->capture_limit) {
+    char *capture = NULL;
+    if (stream->capture_length + stream->length <= stream->capture_limit)
+      capture = realloc(stream->capture,
+                        stream->capture_length + stream->length);
+    if (capture) {
+      memcpy(capture + stream->capture_length, stream->buffer, stream->length);
+      stream->capture = capture;
+      stream->capture_length += stream->length;
+    } else {
+      // too large (or out of memory): the copy would be incomplete, so a held
+      // body is sent after all
+      if (!stream_release(stream))
+        return 0;
+      free(stream->capture);
+      stream->capture = NULL;
+      stream->capture_limit = 0;
+    }
+  }
+
+  stream->last_flush_ms = monotonic_ms();
+  if (stream->holding) {
+    stream->held_length += stream->length;
+    stream->length = 0;
+    return 1;
+  }
+
+  int n = snprintf(chunk_size, MAX_CHUNK_SIZE_LENGTH, "%zx\r\n",
+                   stream->length);
+  struct iovec iov[3] = {{chunk_size, n},
+                         {stream->buffer, stream->length},
+                         {"\r\n", 2}};
+  stream->length = 0;
+  return send_all(stream, iov, 3);
+}
+
+int stream_flush_if_due(struct response_stream *stream) {
+  if (monotonic_ms() - stream->last_flush_ms < STREAM_FLUSH_INTERVAL_MS)
+    return !stream->failed;
+  return stream_flush(stream);
+}
+
+int stream_write(struct response_stream *stream, const char *data,
+                 size_t length) {
+  while (length) {
+    if (stream->failed)
+      return 0;
+
+    size_t n = stream_space_left(stream);
+    if (n > length)
+      n = length;
+    memcpy(stream_space(stream), data, n);
+    stream_advance(stream, n);
+    data += n;
+    length -= n;
+
+    if (!stream_space_left(stream) && !stream_flush(stream))
+      return 0;
+  }
+
+  return !stream->failed;
+}
+
+int stream_finish(struct response_stream *stream) {
+  if (!stream_flush(stream) || !stream_release(stream))
+    return 0;
+
+  struct iovec iov = {"0\r\n\r\n", 5};
+  return send_all(stream, &iov, 1);
+}
+
+void stream_capture(struct response_stream *stream, size_t limit) {
+  stream->capture_limit = limit;
+}
+
+void stream_hold(struct response_stream *stream) {
+  // held chunks only exist in the copy of the body
+  stream->holding = stream->capture_limit > 0;
+}
+
+int stream_release(struct response_stream *stream) {
+  char chunk_size[MAX_CHUNK_SIZE_LENGTH];
+  size_t held_length = stream->held_length;
+
+  stream->holding = 0;
+  stream->held_length = 0;
+  if (stream->failed)
+    return 0;
+  if (!held_length)
+    return 1;
+
+  // the held chunks are sent as one
+  int n = snprintf(chunk_size, MAX_CHUNK_SIZE_LENGTH, "%zx\r\n", held_length);
+  struct iovec iov[3] = {
+      {chunk_size, n},
+      {stream->capture + stream->capture_length - held_length, held_length},
+      {"\r\n", 2}};
+  return send_all(stream, iov, 3);
+}
+
+const char *stream_body(struct response_stream *stream, size_t *length) {
+  if (!stream_flush(stream) || !stream->capture_limit)
+    return NULL;
+
+  *length = stream->capture_length;
+  // an empty body was never flushed
+  return stream->capture ? stream->capture : "";
+}
\ No newline at end of file
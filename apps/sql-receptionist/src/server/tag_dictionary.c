@@ -0,0 +1,354 @@
+/**
+ * @brief in-memory tag names & aliases of the tagged tables.
+ * The rows of a load are kept as PGresults, which own the strings; the
+ * snapshot only adds sorted indexes over them. Readers hold a reference to the
+ * snapshot they serialize with, so reloads never wait for them.
+ */
+
+#include "server/tag_dictionary.h"
+#include "backend.h"
+#include "logging.h"
+#include "server/metrics.h"
+#include "utils/clock.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+// Identifier max length is 63 or 64
+#define MAX_TAG_TABLE_NAME_LENGTH 64
+
+struct tag {
+  long long id;
+  const char *name;
+  int name_length;
+};
+
+struct tag_alias {
+  const char *alias;
+  long long tag_id;
+};
+
+struct tag_names {
+  atomic_int references;
+  /**
+   * @param outdated Whether or not the tags changed since the snapshot was
+   * loaded (or might have).
+   */
+  atomic_int outdated;
+  long long expires_ms;
+  int tags_count;
+  // sorted by ID
+  struct tag *tags;
+  // sorted by name
+  struct tag **tags_by_name;
+  int aliases_count;
+  // sorted by alias
+  struct tag_alias *aliases;
+  PGresult *tag_rows;
+  PGresult *alias_rows;
+};
+
+struct tag_dictionary {
+  struct tag_dictionary *next;
+  /**
+   * @param load_lock Held while (re)loading, so that concurrent requests wait
+   * for a single load instead of each running their own.
+   */
+  pthread_mutex_t load_lock;
+  /**
+   * @param names The latest snapshot, or NULL. Guarded by dictionaries_lock.
+   */
+  struct tag_names *names;
+  /**
+   * @param generation Bumped by every invalidation, so that loads racing with
+   * a write are not mistaken for up to date. Guarded by dictionaries_lock.
+   */
+  unsigned long long generation;
+  char *database;
+  char *table;
+};
+
+static struct data_column tag_names_schema[] = {
+    {"tag_name", "string", false, ""},
+};
+static struct data_column tag_aliases_schema[] = {
+    {"alias", "string", false, ""},
+    {"tag_id", "int", false, ""},
+};
+
+static pthread_mutex_t dictionaries_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tag_dictionary *dictionaries = NULL;
+static pthread_once_t tag_dictionary_initialization = PTHREAD_ONCE_INIT;
+
+static struct metric *loads_metric;
+static struct metric *unknown_ids_metric;
+
+static void initialize_tag_dictionary() {
+  loads_metric = get_metric("sql_receptionist_tag_dictionary_loads_total");
+  unknown_ids_metric =
+      get_metric("sql_receptionist_tag_dictionary_unknown_ids_total");
+}
+
+static int compare_tag_ids(const void *a, const void *b) {
+  const struct tag *x = a, *y = b;
+  return (x->id > y->id) - (x->id < y->id);
+}
+
+static int compare_tag_names(const void *a, const void *b) {
+  const struct tag *const *x = a, *const *y = b;
+  return strcmp((*x)->name, (*y)->name);
+}
+
+static int compare_tag_aliases(const void *a, const void *b) {
+  const struct tag_alias *x = a, *y = b;
+  return strcmp(x->alias, y->alias);
+}
+
+static void free_tag_names(struct tag_names *names) {
+  free(names->tags);
+  free(names->tags_by_name);
+  free(names->aliases);
+  PQclear(names->tag_rows);
+  PQclear(names->alias_rows);
+  free(names);
+}
+
+/**
+ * SELECTs a whole tag table.
+ * @returns 1 on success, 0 on failure.
+ */
+static int select_tag_table(void *conn, const char *table, const char *suffix,
+                            struct select_options *options, PGresult **res) {
+  char table_name[MAX_TAG_TABLE_NAME_LENGTH];
+  if (snprintf(table_name, MAX_TAG_TABLE_NAME_LENGTH, "%s%s", table, suffix) >=
+      MAX_TAG_TABLE_NAME_LENGTH)
+    return 0;
+
+  options->table_name = table_name;
+  ExecStatusType status = get_backend()->select(conn, options, 0, res);
+  if (errno || status != PGRES_TUPLES_OK) {
+    log_error_printf("Failed to load the tag dictionary of %s: %s\n",
+                     table_name, PQresultErrorMessage(*res));
+    errno = 0;
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Loads a snapshot of the tags of a table from the primary, so that tags that
+ * were just written are included.
+ * @returns The snapshot (with a reference for the dictionary & one for the
+ * caller) or NULL.
+ */
+static struct tag_names *load_tag_names(const char *database,
+                                        const char *table) {
+  struct select_options tag_options = {
+      NULL, "id", "ASC", tag_names_schema, 1, 1, 0, 0, NULL, NULL, NULL,
+      -1,   0};
+  struct select_options alias_options = {
+      NULL, "alias", "ASC", tag_aliases_schema, 2, 0, 0, 0, NULL, NULL, NULL,
+      -1,   0};
+  struct tag_names *names = calloc(1, sizeof(struct tag_names));
+  void *conn = get_backend()->connect(database, NULL, 1);
+
+  if (!names || !conn ||
+      !select_tag_table(conn, table, "_tag_names", &tag_options,
+                        &names->tag_rows) ||
+      !select_tag_table(conn, table, "_tag_aliases", &alias_options,
+                        &names->alias_rows))
+    goto failed;
+
+  // id, tag_name
+  names->tags_count = PQntuples(names->tag_rows);
+  names->tags = malloc((names->tags_count + 1) * sizeof(struct tag));
+  names->tags_by_name = malloc((names->tags_count + 1) * sizeof(struct tag *));
+  // alias, tag_id
+  names->aliases_count = PQntuples(names->alias_rows);
+  names->aliases =
+      malloc((names->aliases_count + 1) * sizeof(struct tag_alias));
+  if (!names->tags || !names->tags_by_name || !names->aliases)
+    goto failed;
+
+  for (int i = 0; i < names->tags_count; i++) {
+    names->tags[i].id = strtoll(PQgetvalue(names->tag_rows, i, 0), NULL, 10);
+    names->tags[i].name = PQgetvalue(names->tag_rows, i, 1);
+    names->tags[i].name_length = PQgetlength(names->tag_rows, i, 1);
+  }
+  qsort(names->tags, names->tags_count, sizeof(struct tag), compare_tag_ids);
+  for (int i = 0; i < names->tags_count; i++)
+    names->tags_by_name[i] = &names->tags[i];
+  qsort(names->tags_by_name, names->tags_count, sizeof(struct tag *),
+        compare_tag_names);
+
+  for (int i = 0; i < names->aliases_count; i++) {
+    names->aliases[i].alias = PQgetvalue(names->alias_rows, i, 0);
+    names->aliases[i].tag_id =
+        strtoll(PQgetvalue(names->alias_rows, i, 1), NULL, 10);
+  }
+  qsort(names->aliases, names->aliases_count, sizeof(struct tag_alias),
+        compare_tag_aliases);
+
+  atomic_init(&names->references, 2);
+  atomic_init(&names->outdated, 0);
+  names->expires_ms = monotonic_ms() + TAG_DICTIONARY_TTL_MS;
+  get_backend()->disconnect(conn);
+  metric_add(loads_metric, 1);
+  return names;
+
+failed:
+  if (names)
+    free_tag_names(names);
+  get_backend()->disconnect(conn);
+  return NULL;
+}
+
+static int is_current(struct tag_names *names) {
+  return names && !atomic_load(&names->outdated) &&
+         monotonic_ms() < names->expires_ms;
+}
+
+/**
+ * Takes a reference to the snapshot of a dictionary if it is up to date.
+ * dictionaries_lock must be held.
+ */
+static struct tag_names *acquire_current(struct tag_dictionary *dictionary) {
+  if (!is_current(dictionary->names))
+    return NULL;
+  atomic_fetch_add(&dictionary->names->references, 1);
+  return dictionary->names;
+}
+
+/**
+ * Finds the dictionary of a table, creating an empty one if there is none.
+ * dictionaries_lock must be held.
+ */
+static struct tag_dictionary *find_dictionary(const char *database,
+                                              const char *table) {
+  struct tag_dictionary *dictionary;
+
+  for (dictionary = dictionaries; dictionary; dictionary = dictionary->next) {
+    if (strcmp(dictionary->database, database) == 0 &&
+        strcmp(dictionary->table, table) == 0)
+      return dictionary;
+  }
+
+  dictionary = calloc(1, sizeof(struct tag_dictionary));
+  if (!dictionary)
+    return NULL;
+  dictionary->database = strdup(database);
+  dictionary->table = strdup(table);
+  if (!dictionary->database || !dictionary->table) {
+    free(dictionary->database);
+    free(dictionary->table);
+    free(dictionary);
+    return NULL;
+  }
+  pthread_mutex_init(&dictionary->load_lock, NULL);
+  dictionary->next = dictionaries;
+  dictionaries = dictionary;
+  return dictionary;
+}
+
+struct tag_names *acquire_tag_names(const char *database, const char *table) {
+  struct tag_names *names = NULL;
+
+  pthread_once(&tag_dictionary_initialization, initialize_tag_dictionary);
+
+  pthread_mutex_lock(&dictionaries_lock);
+  struct tag_dictionary *dictionary = find_dictionary(database, table);
+  if (dictionary)
+    names = acquire_current(dictionary);
+  pthread_mutex_unlock(&dictionaries_lock);
+  if (!dictionary || names)
+    return names;
+
+  pthread_mutex_lock(&dictionary->load_lock);
+  // another request may have loaded it while this one waited
+  pthread_mutex_lock(&dictionaries_lock);
+  names = acquire_current(dictionary);
+  unsigned long long generation = dictionary->generation;
+  pthread_mutex_unlock(&dictionaries_lock);
+
+  if (!names && (names = load_tag_names(database, table))) {
+    pthread_mutex_lock(&dictionaries_lock);
+    struct tag_names *old_names = dictionary->names;
+    dictionary->names = names;
+    // the tags were written to while loading
+    if (dictionary->generation != generation)
+      atomic_store(&names->outdated, 1);
+    pthread_mutex_unlock(&dictionaries_lock);
+    release_tag_names(old_names);
+
+    if (!is_current(names)) {
+      release_tag_names(names);
+      names = NULL;
+    }
+  }
+  pthread_mutex_unlock(&dictionary->load_lock);
+
+  return names;
+}
+
+void release_tag_names(struct tag_names *names) {
+  if (names && atomic_fetch_sub(&names->references, 1) == 1)
+    free_tag_names(names);
+}
+
+const char *find_tag_name(struct tag_names *names, long long id,
+                          int *length) {
+  struct tag key = {id, NULL, 0};
+  struct tag *tag = bsearch(&key, names->tags, names->tags_count,
+                            sizeof(struct tag), compare_tag_ids);
+
+  if (!tag) {
+    // e.g. written through another instance that did not NOTIFY yet
+    atomic_store(&names->outdated, 1);
+    metric_add(unknown_ids_metric, 1);
+    return NULL;
+  }
+  *length = tag->name_length;
+  return tag->name;
+}
+
+int find_tag_id(struct tag_names *names, const char *name, long long *id) {
+  struct tag key = {0, name, 0};
+  struct tag *key_pointer = &key;
+  struct tag **tag =
+      bsearch(&key_pointer, names->tags_by_name, names->tags_count,
+              sizeof(struct tag *), compare_tag_names);
+
+  if (!tag || !is_current(names))
+    return 0;
+  *id = (*tag)->id;
+  return 1;
+}
+
+int find_tag_alias(struct tag_names *names, const char *alias,
+                   long long *id) {
+  struct tag_alias key = {alias, 0};
+  struct tag_alias *tag_alias =
+      bsearch(&key, names->aliases, names->aliases_count,
+              sizeof(struct tag_alias), compare_tag_aliases);
+
+  if (!tag_alias)
+    return 0;
+  *id = tag_alias->tag_id;
+  return 1;
+}
+
+void tag_dictionary_invalidate(const char *database, const char *table) {
+  pthread_mutex_lock(&dictionaries_lock);
+  for (struct tag_dictionary *dictionary = dictionaries; dictionary;
+       dictionary = dictionary->next) {
+    if (strcmp(dictionary->database, database) != 0 ||
+        (table && strcmp(dictionary->table, table) != 0))
+      continue;
+    dictionary->generation++;
+    if (dictionary->names)
+      atomic_store(&dictionary->names->outdated, 1);
+  }
+  pthread_mutex_unlock(&dictionaries_lock);
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "utils/base64.h"
+
+static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/**
+ * @returns The 6 bits a character encodes or -1 if it is not in the alphabet.
+ */
+static int decode_char(char c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '-')
+    return 62;
+  if (c == '_')
+    return 63;
+  return -1;
+}
+
+size_t base64url_encoded_length(size_t length) {
+  return length / 3 * 4 + (length % 3 ? length % 3 + 1 : 0);
+}
+
+int base64url_encode(const char *value, size_t length, char *buffer,
+                     size_t buffer_size) {
+  const unsigned char *bytes = (const unsigned char *)value;
+  size_t n = 0;
+
+  if (base64url_encoded_length(length) > buffer_size)
+    return -1;
+
+  for (size_t i = 0; i < length; i += 3) {
+    unsigned long group = (unsigned long)bytes[i] << 16;
+    if (i + 1 < length)
+      group |= (unsigned long)bytes[i + 1] << 8;
+    if (i + 2 < length)
+      group |= bytes[i + 2];
+
+    buffer[n++] = alphabet[group >> 18 & 63];
+    buffer[n++] = alphabet[group >> 12 & 63];
+    if (i + 1 < length)
+      buffer[n++] = alphabet[group >> 6 & 63];
+    if (i + 2 < length)
+      buffer[n++] = alphabet[group & 63];
+  }
+
+  return n;
+}
+
+int base64url_decode(const char *text, size_t length, char *buffer,
+                     size_t buffer_size) {
+  unsigned long group = 0;
+  int bits = 0;
+  size_t n = 0;
+
+  // a single character holds fewer than 8 bits
+  if (length % 4 == 1)
+    return -1;
+
+  for (size_t i = 0; i < length; i++) {
+    int sextet = decode_char(text[i]);
+    if (sextet < 0)
+      return -1;
+
+    group = (group << 6 | sextet) & 0xffffff;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      if (n >= buffer_size)
+        return -1;
+      buffer[n++] = group >> bits & 0xff;
+    }
+  }
+
+  return n;
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#include "utils/clock.h"
+#include <time.h>
+
+long long monotonic_ms() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "utils/flatbuffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FLATBUFFER_INITIAL_CAPACITY 1024
+
+void flatbuffer_init(struct flatbuffer *fb) {
+  memset(fb, 0, sizeof(struct flatbuffer));
+  fb->min_align = 1;
+}
+
+void flatbuffer_free(struct flatbuffer *fb) {
+  free(fb->data);
+  fb->data = NULL;
+}
+
+/**
+ * Makes room for more bytes at the front of the buffer.
+ * @returns 1 on success, 0 if the allocation failed.
+ */
+static int reserve(struct flatbuffer *fb, size_t length) {
+  if (fb->failed)
+    return 0;
+  if (fb->size + length <= fb->capacity)
+    return 1;
+
+  size_t capacity =
+      fb->capacity ? fb->capacity * 2 : FLATBUFFER_INITIAL_CAPACITY;
+  while (capacity < fb->size + length)
+    capacity *= 2;
+  char *data = malloc(capacity);
+  if (!data) {
+    fb->failed = 1;
+    return 0;
+  }
+
+  // the data lives at the end of the buffer
+  if (fb->data)
+    memcpy(data + capacity - fb->size, fb->data + fb->capacity - fb->size,
+           fb->size);
+  free(fb->data);
+  fb->data = data;
+  fb->capacity = capacity;
+  return 1;
+}
+
+/**
+ * Prepends a little-endian integer without aligning it.
+ */
+static void push(struct flatbuffer *fb, uint64_t value, size_t size) {
+  if (!reserve(fb, size))
+    return;
+  fb->size += size;
+  char *cur = fb->data + fb->capacity - fb->size;
+  for (size_t i = 0; i < size; i++) {
+    cur[i] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+/**
+ * Pads the front of the buffer so that it is aligned after prepending more
+ * bytes.
+ * @param alignment The alignment needed.
+ * @param additional The number of bytes that will be prepended.
+ */
+static void prep(struct flatbuffer *fb, size_t alignment, size_t additional) {
+  if (alignment > fb->min_align)
+    fb->min_align = alignment;
+  size_t padding = (~(fb->size + additional) + 1) & (alignment - 1);
+  while (padding--)
+    push(fb, 0, 1);
+}
+
+flatbuffer_ref flatbuffer_create_string(struct flatbuffer *fb,
+                                        const char *value, size_t length) {
+  prep(fb, 4, length + 1);
+  push(fb, 0, 1);
+  if (reserve(fb, length)) {
+    fb->size += length;
+    memcpy(fb->data + fb->capacity - fb->size, value, length);
+  }
+  push(fb, length, 4);
+  return fb->size;
+}
+
+void flatbuffer_start_vector(struct flatbuffer *fb, size_t element_size,
+                             size_t count, size_t alignment) {
+  prep(fb, 4, element_size * count);
+  prep(fb, alignment, element_size * count);
+}
+
+flatbuffer_ref flatbuffer_end_vector(struct flatbuffer *fb, size_t count) {
+  push(fb, count, 4);
+  return fb->size;
+}
+
+void flatbuffer_prepend_int64(struct flatbuffer *fb, int64_t value) {
+  prep(fb, 8, 0);
+  push(fb, value, 8);
+}
+
+void flatbuffer_prepend_ref(struct flatbuffer *fb, flatbuffer_ref ref) {
+  prep(fb, 4, 0);
+  // relative to where the reference itself ends up
+  push(fb, fb->size + 4 - ref, 4);
+}
+
+void flatbuffer_start_table(struct flatbuffer *fb) {
+  memset(fb->fields, 0, sizeof(fb->fields));
+  fb->n_fields = 0;
+  fb->object_start = fb->size;
+}
+
+/**
+ * Records where a field of the current table was written.
+ */
+static void track_field(struct flatbuffer *fb, int id) {
+  if (id >= FLATBUFFER_MAX_FIELDS) {
+    fb->failed = 1;
+    return;
+  }
+  fb->fields[id] = fb->size;
+  if (id + 1 > fb->n_fields)
+    fb->n_fields = id + 1;
+}
+
+void flatbuffer_add_scalar(struct flatbuffer *fb, int id, uint64_t value,
+                           size_t size) {
+  prep(fb, size, 0);
+  push(fb, value, size);
+  track_field(fb, id);
+}
+
+void flatbuffer_add_ref(struct flatbuffer *fb, int id, flatbuffer_ref ref) {
+  flatbuffer_prepend_ref(fb, ref);
+  track_field(fb, id);
+}
+
+flatbuffer_ref flatbuffer_end_table(struct flatbuffer *fb) {
+  // the offset to the vtable is filled in once the vtable is written
+  prep(fb, 4, 0);
+  push(fb, 0, 4);
+  size_t table = fb->size;
+
+  for (int id = fb->n_fields - 1; id >= 0; id--)
+    push(fb, fb->fields[id] ? table - fb->fields[id] : 0, 2);
+  push(fb, table - fb->object_start, 2);
+  push(fb, (fb->n_fields + 2) * 2, 2);
+
+  if (!fb->failed) {
+    // the vtable precedes the table
+    int32_t vtable_offset = fb->size - table;
+    char *cur = fb->data + fb->capacity - table;
+    for (int i = 0; i < 4; i++)
+      cur[i] = (uint32_t)vtable_offset >> (8 * i) & 0xff;
+  }
+  return table;
+}
+
+const char *flatbuffer_finish(struct flatbuffer *fb, flatbuffer_ref root,
+                              size_t *length) {
+  prep(fb, fb->min_align, 4);
+  flatbuffer_prepend_ref(fb, root);
+  if (fb->failed)
+    return NULL;
+
+  *length = fb->size;
+  return fb->data + fb->capacity - fb->size;
+}
\ No newline at end of file
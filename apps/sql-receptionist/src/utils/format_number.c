@@ -0,0 +1,80 @@
+#include "utils/format_number.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char digit_pairs[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+int format_int(char *buffer, long long value) {
+  char digits[MAX_NUMBER_STR_LENGTH];
+  char *cur = digits + MAX_NUMBER_STR_LENGTH;
+  // negate as unsigned so that LLONG_MIN does not overflow
+  unsigned long long magnitude =
+      value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+  int n = 0;
+
+  // fill the scratch buffer from the back, two digits at a time
+  while (magnitude >= 100) {
+    unsigned int pair = (magnitude % 100) * 2;
+    magnitude /= 100;
+    *--cur = digit_pairs[pair + 1];
+    *--cur = digit_pairs[pair];
+  }
+  if (magnitude >= 10) {
+    *--cur = digit_pairs[magnitude * 2 + 1];
+    *--cur = digit_pairs[magnitude * 2];
+  } else {
+    *--cur = '0' + magnitude;
+  }
+
+  if (value < 0)
+    buffer[n++] = '-';
+  memcpy(buffer + n, cur, digits + MAX_NUMBER_STR_LENGTH - cur);
+  return n + (digits + MAX_NUMBER_STR_LENGTH - cur);
+}
+
+int format_double(char *buffer, double value) {
+  char scratch[MAX_NUMBER_STR_LENGTH];
+  int n = 0;
+
+  // whole numbers that fit in a long long are the common case
+  if (value > -1e15 && value < 1e15 && value == (double)(long long)value)
+    return format_int(buffer, (long long)value);
+
+  // 17 significant digits always round-trip, fewer usually do
+  for (int precision = 15; precision <= 17; precision++) {
+    n = snprintf(scratch, MAX_NUMBER_STR_LENGTH, "%.*g", precision, value);
+    if (strtod(scratch, NULL) == value)
+      break;
+  }
+
+  memcpy(buffer, scratch, n);
+  return n;
+}
+
+int format_float(char *buffer, float value) {
+  char scratch[MAX_NUMBER_STR_LENGTH];
+  int n = 0;
+
+  if (value > -1e7f && value < 1e7f && value == (float)(long long)value)
+    return format_int(buffer, (long long)value);
+
+  // 9 significant digits always round-trip, fewer usually do
+  for (int precision = 6; precision <= 9; precision++) {
+    n = snprintf(scratch, MAX_NUMBER_STR_LENGTH, "%.*g", precision, value);
+    if (strtof(scratch, NULL) == value)
+      break;
+  }
+
+  memcpy(buffer, scratch, n);
+  return n;
+}
\ No newline at end of file
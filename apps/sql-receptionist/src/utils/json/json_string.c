@@ -0,0 +1,187 @@
+#include "utils/json/json_string.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// the character following the backslash, 'u' for \u00XX & 0 for no escaping
+static const char escapes[256] = {
+    ['\0'] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u',
+    [0x05] = 'u', [0x06] = 'u', [0x07] = 'u', ['\b'] = 'b', ['\t'] = 't',
+    ['\n'] = 'n', [0x0b] = 'u', ['\f'] = 'f', ['\r'] = 'r', [0x0e] = 'u',
+    [0x0f] = 'u', [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u',
+    [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u', [0x18] = 'u',
+    [0x19] = 'u', [0x1a] = 'u', [0x1b] = 'u', [0x1c] = 'u', [0x1d] = 'u',
+    [0x1e] = 'u', [0x1f] = 'u', ['"'] = '"',  ['\\'] = '\\',
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/**
+ * Finds the run of characters at the start of a string that need no escaping.
+ * @param in The string to scan.
+ * @param length The length of the string.
+ * @returns The length of the run.
+ */
+typedef size_t (*clean_run_finder)(const unsigned char *in, size_t length);
+
+static size_t find_clean_run_scalar(const unsigned char *in, size_t length) {
+  size_t i = 0;
+  while (i < length && !escapes[in[i]])
+    i++;
+  return i;
+}
+
+#if defined(__x86_64__)
+static size_t find_clean_run_sse2(const unsigned char *in, size_t length) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i max_control = _mm_set1_epi8(0x1f);
+  size_t i = 0;
+
+  for (; i + 16 <= length; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(in + i));
+    // unsigned chunk <= 0x1f is max(chunk, 0x1f) == 0x1f
+    __m128i dirty = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                     _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(chunk, max_control), max_control));
+    uint32_t mask = _mm_movemask_epi8(dirty);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  return i + find_clean_run_scalar(in + i, length - i);
+}
+
+__attribute__((target("avx2"))) static size_t
+find_clean_run_avx2(const unsigned char *in, size_t length) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i max_control = _mm256_set1_epi8(0x1f);
+  size_t i = 0;
+
+  for (; i + 32 <= length; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(in + i));
+    __m256i dirty = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote),
+                        _mm256_cmpeq_epi8(chunk, backslash)),
+        _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, max_control), max_control));
+    uint32_t mask = _mm256_movemask_epi8(dirty);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  // calling the legacy encoded SSE2 code from here would stall on the dirty
+  // upper halves of the registers, so the 16 byte step is inlined
+  if (i + 16 <= length) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i dirty = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(quote)),
+                     _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(backslash))),
+        _mm_cmpeq_epi8(
+            _mm_max_epu8(chunk, _mm256_castsi256_si128(max_control)),
+            _mm256_castsi256_si128(max_control)));
+    uint32_t mask = _mm_movemask_epi8(dirty);
+    if (mask)
+      return i + __builtin_ctz(mask);
+    i += 16;
+  }
+
+  return i + find_clean_run_scalar(in + i, length - i);
+}
+#endif
+
+static clean_run_finder find_clean_run = find_clean_run_scalar;
+static pthread_once_t escaper_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Switches to an escaper. See use_json_escaper.
+ */
+static int set_escaper(enum json_escaper escaper) {
+  switch (escaper) {
+  case JSON_ESCAPER_AUTO:
+    if (!set_escaper(JSON_ESCAPER_AVX2) && !set_escaper(JSON_ESCAPER_SSE2))
+      set_escaper(JSON_ESCAPER_SCALAR);
+    return 1;
+  case JSON_ESCAPER_SCALAR:
+    find_clean_run = find_clean_run_scalar;
+    return 1;
+#if defined(__x86_64__)
+  case JSON_ESCAPER_SSE2:
+    // SSE2 is part of x86-64
+    find_clean_run = find_clean_run_sse2;
+    return 1;
+  case JSON_ESCAPER_AVX2:
+    if (!__builtin_cpu_supports("avx2"))
+      return 0;
+    find_clean_run = find_clean_run_avx2;
+    return 1;
+#endif
+  default:
+    return 0;
+  }
+}
+
+static void pick_default_escaper() { set_escaper(JSON_ESCAPER_AUTO); }
+
+int use_json_escaper(enum json_escaper escaper) {
+  // an explicit choice must not be overridden by the default later on
+  pthread_once(&escaper_once, pick_default_escaper);
+  return set_escaper(escaper);
+}
+
+int write_json_string(const char *value, size_t length, char *buffer,
+                      size_t buffer_size) {
+  const unsigned char *in = (const unsigned char *)value;
+  const unsigned char *in_end = in + length;
+  char *cur = buffer;
+  char *end = buffer + buffer_size;
+  // if even the worst case fits, the size checks can be skipped
+  int checked = JSON_STRING_SIZE_BOUND(length) > buffer_size;
+
+  pthread_once(&escaper_once, pick_default_escaper);
+
+  if (cur == end)
+    goto no_memory;
+  *cur++ = '"';
+
+  while (in < in_end) {
+    // copy the run of characters that need no escaping
+    const unsigned char *run = in;
+    in += find_clean_run(in, in_end - in);
+    if (in > run) {
+      if (checked && (size_t)(end - cur) < (size_t)(in - run))
+        goto no_memory;
+      memcpy(cur, run, in - run);
+      cur += in - run;
+    }
+    if (in == in_end)
+      break;
+
+    char escape = escapes[*in];
+    if (checked && end - cur < (escape == 'u' ? 6 : 2))
+      goto no_memory;
+    *cur++ = '\\';
+    *cur++ = escape;
+    if (escape == 'u') {
+      *cur++ = '0';
+      *cur++ = '0';
+      *cur++ = hex_digits[*in >> 4];
+      *cur++ = hex_digits[*in & 0xf];
+    }
+    in++;
+  }
+
+  if (cur == end)
+    goto no_memory;
+  *cur++ = '"';
+  return cur - buffer;
+
+no_memory:
+  errno = ENOMEM;
+  return -1;
+}
\ No newline at end of file
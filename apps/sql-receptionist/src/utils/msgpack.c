@@ -0,0 +1,169 @@
+#include "utils/msgpack.h"
+#include <string.h>
+
+/**
+ * Writes a big-endian (network order) unsigned integer.
+ * @param cur The buffer to write to.
+ * @param value The integer to write.
+ * @param size The size of the integer in bytes.
+ */
+static void write_network_uint(char *cur, uint64_t value, int size) {
+  for (int i = size - 1; i >= 0; i--) {
+    cur[i] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+/**
+ * Writes a type byte followed by a big-endian integer.
+ * @returns The number of bytes written or -1 if the buffer is too small.
+ */
+static int write_tagged(unsigned char tag, uint64_t value, int size,
+                        char *buffer, size_t buffer_size) {
+  if ((size_t)size + 1 > buffer_size)
+    return -1;
+  buffer[0] = tag;
+  write_network_uint(buffer + 1, value, size);
+  return size + 1;
+}
+
+int msgpack_write_nil(char *buffer, size_t buffer_size) {
+  if (buffer_size < 1)
+    return -1;
+  *buffer = 0xc0;
+  return 1;
+}
+
+int msgpack_write_bool(int value, char *buffer, size_t buffer_size) {
+  if (buffer_size < 1)
+    return -1;
+  *buffer = value ? 0xc3 : 0xc2;
+  return 1;
+}
+
+int msgpack_write_int(int64_t value, char *buffer, size_t buffer_size) {
+  // positive & negative fixint
+  if (value >= -32 && value <= 127) {
+    if (buffer_size < 1)
+      return -1;
+    *buffer = value;
+    return 1;
+  }
+
+  if (value > 0) {
+    if (value <= UINT8_MAX)
+      return write_tagged(0xcc, value, 1, buffer, buffer_size);
+    if (value <= UINT16_MAX)
+      return write_tagged(0xcd, value, 2, buffer, buffer_size);
+    if (value <= UINT32_MAX)
+      return write_tagged(0xce, value, 4, buffer, buffer_size);
+    return write_tagged(0xcf, value, 8, buffer, buffer_size);
+  }
+
+  if (value >= INT8_MIN)
+    return write_tagged(0xd0, (uint8_t)value, 1, buffer, buffer_size);
+  if (value >= INT16_MIN)
+    return write_tagged(0xd1, (uint16_t)value, 2, buffer, buffer_size);
+  if (value >= INT32_MIN)
+    return write_tagged(0xd2, (uint32_t)value, 4, buffer, buffer_size);
+  return write_tagged(0xd3, (uint64_t)value, 8, buffer, buffer_size);
+}
+
+int msgpack_write_float(float value, char *buffer, size_t buffer_size) {
+  union {
+    float f;
+    uint32_t u;
+  } bits = {value};
+  return write_tagged(0xca, bits.u, 4, buffer, buffer_size);
+}
+
+int msgpack_write_double(double value, char *buffer, size_t buffer_size) {
+  union {
+    double f;
+    uint64_t u;
+  } bits = {value};
+  return write_tagged(0xcb, bits.u, 8, buffer, buffer_size);
+}
+
+int msgpack_write_str_header(size_t length, char *buffer,
+                             size_t buffer_size) {
+  if (length < 32) {
+    if (buffer_size < 1)
+      return -1;
+    *buffer = 0xa0 | length;
+    return 1;
+  }
+  if (length <= UINT8_MAX)
+    return write_tagged(0xd9, length, 1, buffer, buffer_size);
+  if (length <= UINT16_MAX)
+    return write_tagged(0xda, length, 2, buffer, buffer_size);
+  return write_tagged(0xdb, length, 4, buffer, buffer_size);
+}
+
+int msgpack_write_str(const char *value, size_t length, char *buffer,
+                      size_t buffer_size) {
+  int n = msgpack_write_str_header(length, buffer, buffer_size);
+  if (n < 0 || length > buffer_size - n)
+    return -1;
+  memcpy(buffer + n, value, length);
+  return n + length;
+}
+
+int msgpack_write_array_header(uint32_t length, char *buffer,
+                               size_t buffer_size) {
+  if (length < 16) {
+    if (buffer_size < 1)
+      return -1;
+    *buffer = 0x90 | length;
+    return 1;
+  }
+  if (length <= UINT16_MAX)
+    return write_tagged(0xdc, length, 2, buffer, buffer_size);
+  return write_tagged(0xdd, length, 4, buffer, buffer_size);
+}
+
+int msgpack_write_map_header(uint32_t length, char *buffer,
+                             size_t buffer_size) {
+  if (length < 16) {
+    if (buffer_size < 1)
+      return -1;
+    *buffer = 0x80 | length;
+    return 1;
+  }
+  if (length <= UINT16_MAX)
+    return write_tagged(0xde, length, 2, buffer, buffer_size);
+  return write_tagged(0xdf, length, 4, buffer, buffer_size);
+}
+
+int msgpack_write_timestamp(int64_t seconds, uint32_t nanoseconds,
+                            char *buffer, size_t buffer_size) {
+  // timestamp 32: fixext 4 holding the seconds
+  if (!nanoseconds && seconds >= 0 && seconds <= UINT32_MAX) {
+    if (buffer_size < 6)
+      return -1;
+    buffer[0] = 0xd6;
+    buffer[1] = MSGPACK_TIMESTAMP_EXT;
+    write_network_uint(buffer + 2, seconds, 4);
+    return 6;
+  }
+
+  // timestamp 64: fixext 8 holding 30 bits of nanoseconds & 34 of seconds
+  if (seconds >= 0 && seconds < (1LL << 34)) {
+    if (buffer_size < 10)
+      return -1;
+    buffer[0] = 0xd7;
+    buffer[1] = MSGPACK_TIMESTAMP_EXT;
+    write_network_uint(buffer + 2, (uint64_t)nanoseconds << 34 | seconds, 8);
+    return 10;
+  }
+
+  // timestamp 96: ext 8 holding 32 bits of nanoseconds & 64 of seconds
+  if (buffer_size < 15)
+    return -1;
+  buffer[0] = 0xc7;
+  buffer[1] = 12;
+  buffer[2] = MSGPACK_TIMESTAMP_EXT;
+  write_network_uint(buffer + 3, nanoseconds, 4);
+  write_network_uint(buffer + 7, seconds, 8);
+  return 15;
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#include "utils/network_order.h"
+
+uint64_t read_network_uint(const char *value, int size) {
+  uint64_t result = 0;
+  for (int i = 0; i < size; i++)
+    result = (result << 8) | (unsigned char)value[i];
+  return result;
+}
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_memory_backend();
\ No newline at end of file
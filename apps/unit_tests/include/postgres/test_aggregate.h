@@ -0,0 +1 @@
+extern void test_aggregate();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_breaker();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_filter();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_select();
\ No newline at end of file
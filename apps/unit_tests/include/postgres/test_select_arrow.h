@@ -0,0 +1 @@
+extern void test_select_arrow();
\ No newline at end of file
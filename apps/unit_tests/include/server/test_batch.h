@@ -0,0 +1 @@
+extern void test_batch();
\ No newline at end of file
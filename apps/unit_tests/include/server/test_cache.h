@@ -0,0 +1 @@
+extern void test_cache();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_singleflight();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_stream();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_tag_dictionary();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_format_number();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_json_string();
\ No newline at end of file
@@ -0,0 +1 @@
+extern void test_msgpack();
\ No newline at end of file
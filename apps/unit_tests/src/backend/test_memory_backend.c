@@ -0,0 +1,169 @@
+#include "assert_test.h"
+#include "backend.h"
+#include "postgres/cursor.h"
+#include <jansson.h>
+#include <stdio.h>
+#include <string.h>
+
+static struct data_column test_schema[] = {
+    {"name", "string", false, ""},
+    {"weight", "float", true, ""},
+};
+
+/**
+ * Upserts a JSON entry into the test table.
+ * @returns The status of the upsert.
+ */
+static enum upsert_status upsert_json(void *conn, const char *json,
+                                      struct upsert_result *result) {
+  struct insert_options options = {"test_table", test_schema, 2, 0,
+                                   "id",         0,           "id"};
+  json_t *entry = json_loads(json, 0, NULL);
+  enum upsert_status status =
+      memory_backend.upsert(conn, &options, entry, result);
+  json_decref(entry);
+  return status;
+}
+
+/**
+ * Collects exported CSV into a null terminated buffer (an export_csv
+ * callback).
+ */
+static int collect_csv(const char *data, size_t length, void *arg) {
+  char *csv = arg;
+  size_t csv_length = strlen(csv);
+  if (csv_length + length >= 256)
+    return 0;
+  memcpy(csv + csv_length, data, length);
+  csv[csv_length + length] = '\0';
+  return 1;
+}
+
+void test_memory_backend() {
+  void *conn = memory_backend.connect("test_db", NULL, 1);
+  struct upsert_result result;
+  struct select_options options = {
+      "test_table", "id", "ASC", test_schema,          2, 1, 0,
+      0,            NULL, NULL,  NULL,                 SELECT_DEFAULT_LIMIT, 0};
+  PGresult *res = NULL;
+  char csv[256] = "";
+  char cursor[MAX_CURSOR_LENGTH];
+  char decoded_cursor[MAX_DECODED_CURSOR_LENGTH];
+  int cursor_length;
+  int passed;
+
+  passed = upsert_json(conn, "{\"name\": \"a\", \"weight\": 0.1}",
+                       &result) == UPSERT_OK &&
+           strcmp(result.value, "1") == 0;
+  assert_true(passed, "The memory backend did not generate the first id.");
+  passed = upsert_json(conn, "{\"name\": \"b\", \"weight\": 2.5}",
+                       &result) == UPSERT_OK &&
+           strcmp(result.value, "2") == 0;
+  assert_true(passed, "The memory backend did not generate the second id.");
+  passed = upsert_json(conn,
+                       "{\"id\": 1, \"name\": \"c\", \"weight\": 1.0}",
+                       &result) == UPSERT_OK &&
+           strcmp(result.value, "1") == 0;
+  assert_true(passed, "The memory backend did not upsert on a conflicting id.");
+  passed = upsert_json(conn, "{\"name\": 5, \"weight\": 1}", &result) ==
+           UPSERT_INVALID_ENTRY;
+  assert_true(passed, "The memory backend accepted an invalid entry.");
+
+  passed = memory_backend.select(conn, &options, 0, &res) == PGRES_TUPLES_OK;
+  assert_true(passed, "The memory backend failed to SELECT.");
+  passed = PQntuples(res) == 2 && PQnfields(res) == 4;
+  assert_true(passed, "The memory backend returned the wrong shape.");
+  passed = strcmp(PQgetvalue(res, 0, 1), "c") == 0 &&
+           strcmp(PQgetvalue(res, 1, 2), "2.5") == 0 && PQgetisnull(res, 0, 3);
+  assert_true(passed, "The memory backend returned the wrong values.");
+  PQclear(res);
+
+  options.order_by_order = "DESC";
+  options.limit = 1;
+  memory_backend.select(conn, &options, 0, &res);
+  passed = PQntuples(res) == 1 && strcmp(PQgetvalue(res, 0, 0), "2") == 0;
+  assert_true(passed, "The memory backend did not apply ORDER BY & LIMIT.");
+  PQclear(res);
+
+  upsert_json(conn, "{\"name\": \"say \\\"hi\\\", bye\", \"weight\": 3.5}",
+              &result);
+  options.order_by_order = "ASC";
+  options.limit = -1;
+  passed = memory_backend.export_csv(conn, &options, collect_csv, csv, &res) ==
+           PGRES_TUPLES_OK;
+  assert_true(passed, "The memory backend failed to export.");
+  passed = strcmp(csv, "id,name,weight,weight_comments\n"
+                       "1,c,1,\n"
+                       "2,b,2.5,\n"
+                       "3,\"say \"\"hi\"\", bye\",3.5,\n") == 0;
+  assert_true(passed, "The memory backend exported the wrong CSV.");
+  PQclear(res);
+
+  // keyset pagination: the second page continues after the first one's cursor
+  options.order_by_column = "weight";
+  options.order_by_order = "DESC";
+  options.limit = 1;
+  options.next_cursor = 1;
+  memory_backend.select(conn, &options, 0, &res);
+  cursor_length = write_cursor(&options, res, 0, cursor, sizeof(cursor));
+  passed = PQntuples(res) == 1 && cursor_length > 0;
+  assert_true(passed, "The cursor of the first page was not written.");
+  PQclear(res);
+  passed = read_cursor(cursor, cursor_length, &options, decoded_cursor,
+                       sizeof(decoded_cursor)) == 0 &&
+           strcmp(options.after_id, "3") == 0 &&
+           strcmp(options.after_value, "3.5") == 0;
+  assert_true(passed, "The cursor of the first page was not read back.");
+  memory_backend.select(conn, &options, 0, &res);
+  passed = PQntuples(res) == 1 && strcmp(PQgetvalue(res, 0, 0), "2") == 0;
+  assert_true(passed, "The memory backend did not continue after the cursor.");
+  PQclear(res);
+
+  options.order_by_order = "ASC";
+  passed = read_cursor(cursor, cursor_length, &options, decoded_cursor,
+                       sizeof(decoded_cursor)) == -1 &&
+           read_cursor("a*b", 3, &options, decoded_cursor,
+                       sizeof(decoded_cursor)) == -1;
+  assert_true(passed, "A cursor of another ordering (or garbage) was read.");
+
+  struct select_filter filters[] = {{"weight", FILTER_GT, "2"},
+                                    {"name", FILTER_IN, "{\"b\",\"c\"}"}};
+  options.after_id = NULL;
+  options.limit = -1;
+  options.filters = filters;
+  options.filters_count = 2;
+  memory_backend.select(conn, &options, 0, &res);
+  passed = PQntuples(res) == 1 && strcmp(PQgetvalue(res, 0, 0), "2") == 0;
+  assert_true(passed, "The memory backend did not apply the filters.");
+  PQclear(res);
+  // counts span every page
+  long long count = 0;
+  options.limit = 0;
+  passed = memory_backend.count(conn, &options, SELECT_COUNT_ESTIMATE, &count,
+                                &res) == PGRES_TUPLES_OK &&
+           count == 1;
+  assert_true(passed, "The memory backend did not count the filtered rows.");
+  PQclear(res);
+  options.limit = -1;
+
+  // COLUMNS: a comments column brings its value column along
+  struct data_column projected_schema[MAX_PROJECTED_COLUMNS];
+  char projection[MAX_PROJECTION_LENGTH];
+  char columns[] = "weight_comments,id";
+  char unknown_columns[] = "name,name_comments";
+  passed = project_select_columns(&options, columns, projected_schema,
+                                  projection) == NULL &&
+           strcmp(projection, "i,1c") == 0;
+  assert_true(passed, "The COLUMNS list was not projected.");
+  memory_backend.select(conn, &options, 0, &res);
+  passed = PQnfields(res) == 3 && strcmp(PQfname(res, 1), "weight") == 0;
+  assert_true(passed, "The memory backend did not project the columns.");
+  PQclear(res);
+  options.schema = test_schema;
+  options.schema_count = 2;
+  passed = project_select_columns(&options, unknown_columns, projected_schema,
+                                  projection) != NULL;
+  assert_true(passed, "A comments column without comments was projected.");
+
+  memory_backend.disconnect(conn);
+}
\ No newline at end of file
@@ -1,7 +1,35 @@
+#include "backend/test_memory_backend.h"
+#include "postgres/test_aggregate.h"
+#include "postgres/test_breaker.h"
 #include "postgres/test_datatype_validation.h"
+#include "postgres/test_filter.h"
+#include "postgres/test_select.h"
+#include "postgres/test_select_arrow.h"
+#include "server/test_batch.h"
+#include "server/test_cache.h"
+#include "server/test_singleflight.h"
+#include "server/test_stream.h"
+#include "server/test_tag_dictionary.h"
+#include "utils/test_format_number.h"
+#include "utils/test_json_string.h"
+#include "utils/test_msgpack.h"
 
 int main() {
   test_check_st_point();
+  test_breaker();
+  test_filter();
+  test_select();
+  test_select_arrow();
+  test_aggregate();
+  test_format_number();
+  test_json_string();
+  test_msgpack();
+  test_memory_backend();
+  test_cache();
+  test_singleflight();
+  test_batch();
+  test_stream();
+  test_tag_dictionary();
 
   return 0;
 }
\ No newline at end of file
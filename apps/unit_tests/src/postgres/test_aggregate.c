@@ -0,0 +1,93 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "assert_test.h"
+#include "libpq-fe.h"
+#include "postgres/select.h"
+#include "postgres/aggregate.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_QUERY_SIZE 1024
+
+static struct data_column test_schema[] = {
+    {"name", "string", false, ""},
+    {"weight", "float", false, ""},
+    {"measured_at", "timestamp", false, ""},
+};
+
+/**
+ * Parses aggregate parameters on the test schema.
+ * @returns 1 if the parameters are valid, 0 if not.
+ */
+static int parse(const char *bucket, const char *bucket_by,
+                 const char *functions, const char *group_by,
+                 struct select_aggregate *aggregate) {
+  char functions_copy[MAX_AGGREGATE_PARAM_LENGTH];
+  char group_by_copy[MAX_AGGREGATE_PARAM_LENGTH];
+  char error[MAX_AGGREGATE_ERROR_LENGTH];
+  snprintf(functions_copy, sizeof(functions_copy), "%s", functions);
+  snprintf(group_by_copy, sizeof(group_by_copy), "%s",
+           group_by ? group_by : "");
+  return parse_select_aggregate(test_schema, 3, 1, bucket, bucket_by,
+                                functions_copy,
+                                group_by ? group_by_copy : NULL, aggregate,
+                                error);
+}
+
+void test_aggregate() {
+  struct select_aggregate aggregate;
+  char query[TEST_QUERY_SIZE];
+  const char *params[MAX_SELECT_PARAMS];
+  struct select_options options = {
+      "test_table", "id", "ASC", test_schema, 3,  0, 1,
+      0,            NULL, NULL,  NULL,        10, 0};
+  int passed;
+
+  passed = parse("15m", NULL, "avg(weight),count()", "primary_tag",
+                 &aggregate) &&
+           strcmp(aggregate.bucket_interval, "15 minutes") == 0 &&
+           strcmp(aggregate.bucket_column, "measured_at") == 0 &&
+           aggregate.functions_count == 2 && !aggregate.functions[1].column &&
+           aggregate.group_by_count == 1;
+  assert_true(passed, "Aggregate parameters were not parsed.");
+
+  assert_false(parse(NULL, NULL, "avg(name)", NULL, &aggregate),
+               "A string column was averaged.");
+  assert_false(parse("1h", "weight", "count()", NULL, &aggregate),
+               "A float column was bucketed.");
+  assert_false(parse("1y", NULL, "count()", NULL, &aggregate),
+               "A bucket of months or years was accepted.");
+  assert_false(parse(NULL, NULL, "", NULL, &aggregate),
+               "An aggregate request without aggregates was accepted.");
+  assert_false(parse(NULL, NULL, "max(location)", "location", &aggregate),
+               "An unknown column was aggregated.");
+
+  // the buckets & groups are numbered by their position in the SELECT list
+  parse("1h", NULL, "max(weight)", "primary_tag", &aggregate);
+  options.aggregate = &aggregate;
+  options.filter_column_name = "id";
+  options.filter_value = "7";
+  construct_select_query(&options, query, TEST_QUERY_SIZE);
+  passed =
+      strstr(query, "SELECT date_bin($1::interval,test_table.measured_at::"
+                    "timestamp,TIMESTAMP '2000-01-01') AS bucket,"
+                    "test_table.primary_tag,max(test_table.weight) AS "
+                    "max_weight FROM test_table WHERE test_table.id=$2 "
+                    "GROUP BY 1,2 ORDER BY 1 ASC,2 ASC LIMIT 10;") != NULL;
+  assert_true(passed, "The aggregate query was not written.");
+  passed = select_query_params(&options, params) == 2 &&
+           strcmp(params[0], "1 hours") == 0 && strcmp(params[1], "7") == 0;
+  assert_true(passed, "The bucket interval does not match its placeholder.");
+
+  // counts drop the paging & the tag names
+  options.aggregate = NULL;
+  options.primary_tag = 1;
+  options.row_offset = 20;
+  count_select_options(&options, &aggregate);
+  construct_select_query(&options, query, TEST_QUERY_SIZE);
+  passed = strcmp(query, "SELECT count(*) AS count FROM test_table WHERE "
+                         "test_table.id=$1 LIMIT ALL;") == 0;
+  assert_true(passed, "The count query was not written.");
+}
\ No newline at end of file
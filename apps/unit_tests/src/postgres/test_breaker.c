@@ -0,0 +1,21 @@
+#include "assert_test.h"
+#include "postgres/breaker.h"
+#include <stdio.h>
+
+void test_breaker() {
+  for (int i = 0; i < BREAKER_FAILURE_THRESHOLD - 1; i++)
+    breaker_record_failure("test_breaker");
+  assert_true(breaker_allow("test_breaker"),
+              "The circuit breaker opened before reaching the failure "
+              "threshold.");
+
+  breaker_record_failure("test_breaker");
+  assert_false(breaker_allow("test_breaker"),
+               "The circuit breaker did not open after reaching the failure "
+               "threshold.");
+
+  breaker_record_success("test_breaker");
+  assert_true(breaker_allow("test_breaker"),
+              "The circuit breaker did not close after a successful "
+              "connection.");
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "assert_test.h"
+#include "libpq-fe.h"
+#include "postgres/select.h"
+#include "postgres/filter.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_QUERY_SIZE 1024
+
+static struct data_column test_schema[] = {
+    {"name", "string", false, ""},
+    {"weight", "float", false, ""},
+    {"location", "geodetic point", false, ""},
+};
+
+/**
+ * Parses a filter on the test schema.
+ * @returns 1 if the filter is valid, 0 if not.
+ */
+static int parse(const char *key, const char *value,
+                 struct select_filter *filter, char *buffer) {
+  char error[MAX_FILTER_ERROR_LENGTH];
+  return parse_select_filter(test_schema, 3, 1, key, value, filter, buffer,
+                             MAX_FILTER_VALUE_LENGTH, error);
+}
+
+void test_filter() {
+  struct select_filter filters[3];
+  char values[3][MAX_FILTER_VALUE_LENGTH];
+  char query[TEST_QUERY_SIZE];
+  const char *params[MAX_SELECT_PARAMS];
+  struct select_options options = {
+      "test_table", "id", "ASC", test_schema, 3,  1, 0,
+      0,            NULL, NULL,  NULL,        10, 0};
+  int passed;
+
+  passed = parse("weight.gte", "2.5", &filters[0], values[0]) &&
+           filters[0].op == FILTER_GTE && strcmp(filters[0].value, "2.5") == 0;
+  assert_true(passed, "A gte filter was not parsed.");
+  passed = parse("name.in", "a,say \"hi\"", &filters[1], values[1]) &&
+           strcmp(filters[1].value, "{\"a\",\"say \\\"hi\\\"\"}") == 0;
+  assert_true(passed, "An in filter was not written as an array literal.");
+  passed = parse("location.is_null", "false", &filters[2], values[2]) &&
+           filters[2].op == FILTER_IS_NOT_NULL && !filters[2].value;
+  assert_true(passed, "An is_null filter was not parsed.");
+
+  assert_false(parse("weight.gte", "2.5'", &filters[0], values[0]),
+               "A filter with a value of the wrong type was accepted.");
+  assert_false(parse("id.in", "1,x", &filters[0], values[0]),
+               "An in filter with an invalid element was accepted.");
+  assert_false(parse("name.lt", "a", &filters[0], values[0]),
+               "A string column was filtered by lt.");
+  assert_false(parse("location.eq", "a", &filters[0], values[0]),
+               "A geodetic point was filtered by eq.");
+  assert_false(parse("unknown.eq", "a", &filters[0], values[0]),
+               "An unknown column was filtered by.");
+
+  // the values are bound in the order of the placeholders
+  parse("weight.gte", "2.5", &filters[0], values[0]);
+  options.filters = filters;
+  options.filters_count = 3;
+  options.filter_column_name = "id";
+  options.filter_value = "7";
+  construct_select_query(&options, query, TEST_QUERY_SIZE);
+  passed = strstr(query, " WHERE test_table.id=$1 AND test_table.weight>=$2 "
+                         "AND test_table.name=ANY($3) AND "
+                         "test_table.location IS NOT NULL ORDER BY") != NULL;
+  assert_true(passed, "The filters were not written as placeholders.");
+  passed = select_query_params(&options, params) == 3 &&
+           strcmp(params[0], "7") == 0 && strcmp(params[1], "2.5") == 0 &&
+           params[2] == filters[1].value;
+  assert_true(passed, "The filter values do not match the placeholders.");
+
+  // COPY takes no parameters
+  construct_copy_query(&options, query, TEST_QUERY_SIZE);
+  passed = strstr(query, "test_table.name=ANY('{\"a\",\"say \\\"hi\\\"\"}')") !=
+           NULL;
+  assert_true(passed, "The filters were not written into the COPY query.");
+}
\ No newline at end of file
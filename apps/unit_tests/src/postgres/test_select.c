@@ -0,0 +1,279 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "assert_test.h"
+#include "backend.h"
+#include "libpq-fe.h"
+#include "postgres/cursor.h"
+#include <errno.h>
+#include <jansson.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_QUERY_SIZE 1024
+#define TEST_RESPONSE_SIZE 1024
+#define INT4OID 23
+#define TEXTOID 25
+#define CIDROID 650
+
+static struct data_column test_schema[] = {
+    {"name", "string", false, ""},
+    {"weight", "float", false, ""},
+};
+
+/**
+ * Builds a result with a single column.
+ * @param type The type OID of the column.
+ * @param format 0 for text format, 1 for binary format.
+ * @returns The result, which must be freed with PQclear.
+ */
+static PGresult *make_result(Oid type, int format) {
+  PGresAttDesc attribute = {"value", 0, 0, format, type, -1, -1};
+  PGresult *res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+  PQsetResultAttrs(res, 1, &attribute);
+  return res;
+}
+
+/**
+ * Fills a memory backend table & selects it: the name column is constant, the
+ * weight column was added after the first row (which holds NULL) & the note
+ * column was never written.
+ * @returns The result, which must be freed with PQclear.
+ */
+static PGresult *select_memory_rows() {
+  static struct data_column memory_schema[] = {
+      {"name", "string", false, ""},
+      {"weight", "float", false, ""},
+      {"note", "string", false, ""},
+  };
+  struct insert_options insert_options = {"test_table", memory_schema, 1, 0,
+                                          "id",         0,             "id"};
+  struct select_options options = {
+      "test_table", "id", "ASC", memory_schema,        3, 1, 0,
+      0,            NULL, NULL,  NULL,                 SELECT_DEFAULT_LIMIT, 0};
+  const char *entries[] = {"{\"name\": \"a\\\"b\"}",
+                           "{\"name\": \"a\\\"b\", \"weight\": 1.5}",
+                           "{\"name\": \"a\\\"b\", \"weight\": 2.25}"};
+  struct upsert_result result;
+  PGresult *res = NULL;
+
+  void *conn = memory_backend.connect("test_select_db", NULL, 1);
+  for (int i = 0; i < 3; i++) {
+    json_t *entry = json_loads(entries[i], 0, NULL);
+    insert_options.schema_count = i ? 2 : 1;
+    memory_backend.upsert(conn, &insert_options, entry, &result);
+    json_decref(entry);
+  }
+  memory_backend.select(conn, &options, 0, &res);
+  memory_backend.disconnect(conn);
+  return res;
+}
+
+/**
+ * Serializes a result in the columnar layout, column by column like the server
+ * streams it.
+ * @returns The length written, or -1 if the buffer is too small.
+ */
+static int serialize_columnar(const PGresult *res,
+                              const struct select_plan *plan, char *buffer,
+                              size_t buffer_size) {
+  char *cur = buffer;
+  char *end = buffer + buffer_size;
+  int n;
+
+#define cur_serialize(serialize_call)                                          \
+  do {                                                                         \
+    if ((n = serialize_call) < 0 || n >= end - cur)                            \
+      return -1;                                                               \
+    cur += n;                                                                  \
+  } while (0)
+
+  cur_serialize(serialize_select_columnar_start(res, cur, end - cur));
+  for (int col_num = 0; col_num < PQnfields(res); col_num++) {
+    int constant = select_column_is_constant(res, col_num);
+    cur_serialize(serialize_select_column_start(res, plan, col_num, constant,
+                                                cur, end - cur));
+    if (constant)
+      continue;
+    for (int row_num = 0; row_num < PQntuples(res); row_num++) {
+      cur_serialize(snprintf(cur, end - cur, row_num ? "," : ""));
+      cur_serialize(
+          serialize_select_value(res, plan, row_num, col_num, cur, end - cur));
+    }
+    cur_serialize(snprintf(cur, end - cur, "]"));
+  }
+  cur_serialize(snprintf(cur, end - cur, "}}"));
+  return cur - buffer;
+}
+
+/**
+ * Serializes a result as NDJSON, a header line followed by a line per row
+ * like the server streams it.
+ * @returns The length written, or -1 if the buffer is too small.
+ */
+static int serialize_ndjson(const PGresult *res,
+                            const struct select_plan *plan, char *buffer,
+                            size_t buffer_size) {
+  char *cur = buffer;
+  char *end = buffer + buffer_size;
+  int n;
+
+  cur_serialize(serialize_select_ndjson_header(res, cur, end - cur));
+  for (int row_num = 0; row_num < PQntuples(res); row_num++) {
+    cur_serialize(serialize_select_row(res, plan, row_num, cur, end - cur));
+    cur_serialize(snprintf(cur, end - cur, "\n"));
+  }
+  return cur - buffer;
+}
+#undef cur_serialize
+
+void test_select() {
+  char query[TEST_QUERY_SIZE];
+  struct select_options options = {
+      "test_table", "id", "ASC", test_schema, 2,  1, 0,
+      0,            NULL, NULL,  NULL,        10, 0};
+  struct select_plan *plan;
+  PGresult *res;
+  int passed;
+
+  // text columns may be enums or the like, whose binary format is unknown
+  construct_select_query(&options, query, TEST_QUERY_SIZE);
+  passed = strstr(query, "SELECT test_table.id,test_table.name::text AS name,"
+                         "test_table.weight FROM") != NULL;
+  assert_true(passed, "A string column was not selected as text.");
+
+  // EXPAND nests the tags & descriptor rows of every row, with the columns of
+  // the descriptors' own endpoints
+  struct data_column notes_schema[] = {{"note", "string", false, ""},
+                                       {"place", "geodetic point", false, ""}};
+  struct descriptor descriptors[] = {{"Notes", notes_schema, 2}};
+  options.schema_count = 1;
+  options.transform_tag_names = 1;
+  options.expand = SELECT_EXPAND_TAGS | SELECT_EXPAND_DESCRIPTORS;
+  options.descriptors = descriptors;
+  options.descriptors_count = 1;
+  construct_select_query(&options, query, TEST_QUERY_SIZE);
+  passed =
+      strstr(query,
+             "coalesce((SELECT json_agg(test_table_tag_names.tag_name ORDER BY "
+             "test_table_tag_names.tag_name) FROM test_table_tags JOIN "
+             "test_table_tag_names ON test_table_tag_names.id=test_table_tags."
+             "tag_id WHERE test_table_tags.entry_id=test_table.id),'[]') AS "
+             "tags,json_build_object('notes',coalesce((SELECT json_agg("
+             "descriptor) FROM (SELECT descriptor.id,descriptor.note::text AS "
+             "note,ST_AsText(descriptor.place) AS place,descriptor.place_"
+             "latlong_accuracy,descriptor.place_altitude,descriptor.place_"
+             "altitude_accuracy FROM test_table_notes_descriptors descriptor "
+             "WHERE descriptor.id=test_table.id) descriptor),'[]')) AS "
+             "descriptors FROM test_table ORDER BY") != NULL;
+  assert_true(passed, "The tags & descriptors were not nested.");
+  options.expand = 0;
+
+  res = make_result(TEXTOID, 1);
+  plan = create_select_plan(res, 0);
+  passed = plan != NULL;
+  assert_true(passed, "A binary text column was not planned.");
+  free_select_plan(plan);
+  PQclear(res);
+
+  res = make_result(CIDROID, 0);
+  plan = create_select_plan(res, 0);
+  passed = plan != NULL;
+  assert_true(passed, "A text column of an unknown type was not planned.");
+  free_select_plan(plan);
+  PQclear(res);
+
+  res = make_result(CIDROID, 1);
+  errno = 0;
+  plan = create_select_plan(res, 0);
+  passed = !plan && errno == ENOTSUP;
+  assert_true(passed, "A binary column of an unknown type was planned.");
+  errno = 0;
+  PQclear(res);
+
+  // cursors hold the raw text of binary text columns, not its JSON escaping
+  PGresAttDesc attributes[] = {{"id", 0, 0, 1, INT4OID, 4, -1},
+                               {"name", 0, 0, 1, TEXTOID, -1, -1}};
+  char id[] = {0, 0, 0, 7};
+  char cursor[MAX_CURSOR_LENGTH];
+  char decoded_cursor[MAX_DECODED_CURSOR_LENGTH];
+  int cursor_length;
+  res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+  PQsetResultAttrs(res, 2, attributes);
+  PQsetvalue(res, 0, 0, id, sizeof(id));
+  PQsetvalue(res, 0, 1, "a\"b\\c", 5);
+  options.order_by_column = "name";
+  cursor_length = write_cursor(&options, res, 0, cursor, sizeof(cursor));
+  passed = cursor_length > 0 &&
+           read_cursor(cursor, cursor_length, &options, decoded_cursor,
+                       sizeof(decoded_cursor)) == 0 &&
+           strcmp(options.after_id, "7") == 0 &&
+           strcmp(options.after_value, "a\"b\\c") == 0;
+  assert_true(passed, "The cursor of a binary text column was escaped.");
+  PQclear(res);
+
+  // the columnar layout writes constant columns (NULL or not) once
+  char response[TEST_RESPONSE_SIZE];
+  int response_length;
+  res = select_memory_rows();
+  plan = create_select_plan(res, 0);
+  response_length = plan ? serialize_columnar(res, plan, response,
+                                              sizeof(response))
+                         : -1;
+  if (response_length >= 0)
+    response[response_length] = '\0';
+  passed = response_length >= 0 &&
+           strcmp(response,
+                   "{\"columns\":[\"id\",\"name\",\"weight\",\"note\"],"
+                   "\"rows\":3,\"data\":{\"id\":[1,2,3],\"name\":{"
+                   "\"constant\":\"a\\\"b\"},\"weight\":[null,1.5,2.25],"
+                   "\"note\":{\"constant\":null}}}") == 0;
+  assert_true(passed, "The columnar result is wrong.");
+
+  // NDJSON: the column names, then one array per line
+  response_length =
+      plan ? serialize_ndjson(res, plan, response, sizeof(response)) : -1;
+  if (response_length >= 0)
+    response[response_length] = '\0';
+  passed = response_length >= 0 &&
+           strcmp(response,
+                  "{\"columns\":[\"id\",\"name\",\"weight\",\"note\"]}\n"
+                  "[1,\"a\\\"b\",null,null]\n"
+                  "[2,\"a\\\"b\",1.5,null]\n"
+                  "[3,\"a\\\"b\",2.25,null]\n") == 0;
+  assert_true(passed, "The NDJSON result is wrong.");
+  free_select_plan(plan);
+  PQclear(res);
+
+  // tables wider than a projection can project some of their columns, but not
+  // all of them
+  struct data_column wide_schema[MAX_PROJECTED_COLUMNS + 1];
+  char wide_names[MAX_PROJECTED_COLUMNS + 1][8];
+  char all_columns[(MAX_PROJECTED_COLUMNS + 1) * 8] = "";
+  char last_column[8];
+  struct data_column projected_schema[MAX_PROJECTED_COLUMNS];
+  char projection[MAX_PROJECTION_LENGTH];
+  for (int i = 0; i <= MAX_PROJECTED_COLUMNS; i++) {
+    snprintf(wide_names[i], sizeof(wide_names[i]), "c%d", i);
+    wide_schema[i] = (struct data_column){wide_names[i], "int", false, ""};
+    strcat(all_columns, i ? "," : "");
+    strcat(all_columns, wide_names[i]);
+  }
+  strcpy(last_column, wide_names[MAX_PROJECTED_COLUMNS]);
+  options.schema = wide_schema;
+  options.schema_count = MAX_PROJECTED_COLUMNS + 1;
+  errno = 0;
+  passed = project_select_columns(&options, last_column, projected_schema,
+                                  projection) == NULL &&
+           !errno && options.schema_count == 1 &&
+           strcmp(options.schema[0].name, last_column) == 0;
+  assert_true(passed, "A column of a wide table was not projected.");
+  options.schema = wide_schema;
+  options.schema_count = MAX_PROJECTED_COLUMNS + 1;
+  passed = project_select_columns(&options, all_columns, projected_schema,
+                                  projection) == NULL &&
+           errno == E2BIG;
+  assert_true(passed, "Too many columns were projected.");
+  errno = 0;
+}
\ No newline at end of file
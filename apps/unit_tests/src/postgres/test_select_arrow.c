@@ -0,0 +1,203 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "config.h"
+#endif
+#include "assert_test.h"
+#include "libpq-fe.h"
+#include "postgres/select.h"
+#include "postgres/select_arrow.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_STREAM_SIZE 4096
+#define INT8OID 20
+#define TEXTOID 25
+#define FLOAT8OID 701
+
+struct test_sink {
+  char data[TEST_STREAM_SIZE];
+  size_t length;
+};
+
+/**
+ * Collects the stream into a test_sink (an arrow_sink).
+ */
+static int collect_stream(const char *data, size_t length, void *arg) {
+  struct test_sink *sink = arg;
+  if (sink->length + length > TEST_STREAM_SIZE)
+    return 0;
+  memcpy(sink->data + sink->length, data, length);
+  sink->length += length;
+  return 1;
+}
+
+/**
+ * @returns The little-endian integer at the given bytes.
+ */
+static uint64_t read_le(const char *bytes, int size) {
+  uint64_t value = 0;
+  for (int i = size - 1; i >= 0; i--)
+    value = value << 8 | (unsigned char)bytes[i];
+  return value;
+}
+
+/**
+ * Finds a field of a FlatBuffers table through its vtable.
+ * @returns The field, or NULL if it is absent.
+ */
+static const char *table_field(const char *table, int id) {
+  const char *vtable = table - (int32_t)read_le(table, 4);
+  if (4 + 2 * id >= read_le(vtable, 2))
+    return NULL;
+  uint16_t offset = read_le(vtable + 4 + 2 * id, 2);
+  return offset ? table + offset : NULL;
+}
+
+/**
+ * Follows a field referring to a string, vector or table.
+ * @returns The string or vector (starting with its length) or the table, or
+ * NULL if the field is absent.
+ */
+static const char *table_ref(const char *table, int id) {
+  const char *field = table_field(table, id);
+  return field ? field + read_le(field, 4) : NULL;
+}
+
+/**
+ * @returns An element of a vector of tables.
+ */
+static const char *vector_table(const char *vector, int index) {
+  const char *element = vector + 4 + 4 * index;
+  return element + read_le(element, 4);
+}
+
+/**
+ * @returns 1 if the name of a Field table is the given one.
+ */
+static int has_name(const char *field, const char *name) {
+  const char *string = table_ref(field, 0);
+  return string && read_le(string, 4) == strlen(name) &&
+         memcmp(string + 4, name, strlen(name)) == 0;
+}
+
+/**
+ * Reads the IPC message at the given position of the stream.
+ * @param message Set to the root Message table.
+ * @param body Set to the body of the message.
+ * @returns The position of the next message.
+ */
+static size_t read_message(const char *stream, size_t position,
+                           const char **message, const char **body) {
+  const char *metadata = stream + position + 8;
+  size_t metadata_length = read_le(stream + position + 4, 4);
+  *message = metadata + read_le(metadata, 4);
+  *body = metadata + metadata_length;
+  const char *body_length = table_field(*message, 3);
+  return position + 8 + metadata_length +
+         (body_length ? read_le(body_length, 8) : 0);
+}
+
+/**
+ * @returns The body buffer at the given index of a RecordBatch.
+ */
+static const char *batch_buffer(const char *batch, const char *body,
+                                int index) {
+  return body + read_le(table_ref(batch, 2) + 4 + 16 * index, 8);
+}
+
+void test_select_arrow() {
+  struct data_column schema[] = {{"weight", "float", false, ""},
+                                 {"place", "geodetic point", false, ""}};
+  struct select_options options = {"test_table", "id", "ASC", schema, 2, 1, 0,
+                                   0,            NULL, NULL,  NULL,   10, 0};
+  // the columns of construct_select_query: a point is selected as ST_AsText
+  // followed by its accuracy & altitude columns
+  PGresAttDesc attributes[] = {
+      {"id", 0, 0, 0, INT8OID, 8, -1},
+      {"weight", 0, 0, 0, FLOAT8OID, 8, -1},
+      {"place", 0, 0, 0, TEXTOID, -1, -1},
+      {"place_latlong_accuracy", 0, 0, 0, FLOAT8OID, 8, -1},
+      {"place_altitude", 0, 0, 0, FLOAT8OID, 8, -1},
+      {"place_altitude_accuracy", 0, 0, 0, FLOAT8OID, 8, -1}};
+  const char *rows[2][6] = {{"1", "2.5", "POINT(10 20)", "1", NULL, NULL},
+                            {"2", NULL, NULL, NULL, NULL, NULL}};
+  struct test_sink sink = {.length = 0};
+  struct arrow_writer *writer;
+  const char *message;
+  const char *body;
+  const char *fields;
+  const char *batch;
+  size_t position;
+  union {
+    uint64_t u;
+    double f;
+  } value;
+  int passed;
+
+  PGresult *res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+  PQsetResultAttrs(res, 6, attributes);
+  for (int row_num = 0; row_num < 2; row_num++)
+    for (int col_num = 0; col_num < 6; col_num++)
+      PQsetvalue(res, row_num, col_num, (char *)rows[row_num][col_num],
+                 rows[row_num][col_num] ? strlen(rows[row_num][col_num])
+                                        : -1);
+
+  writer = create_arrow_writer(&options, collect_stream, &sink);
+  passed = writer && arrow_write_rows(writer, res) && arrow_finish(writer);
+  assert_true(passed, "The Arrow stream was not written.");
+  free_arrow_writer(writer);
+  PQclear(res);
+  if (!passed)
+    return;
+
+  // the schema: Int64 id, Float64 weight & a Struct of the point's coordinates
+  position = read_message(sink.data, 0, &message, &body);
+  fields = table_ref(table_ref(message, 2), 1);
+  passed = read_le(sink.data, 4) == 0xFFFFFFFF &&
+           read_le(table_field(message, 1), 1) == 1 &&
+           read_le(fields, 4) == 3 && has_name(vector_table(fields, 0), "id") &&
+           read_le(table_field(vector_table(fields, 0), 2), 1) == 2 &&
+           has_name(vector_table(fields, 1), "weight") &&
+           read_le(table_field(vector_table(fields, 1), 2), 1) == 3 &&
+           has_name(vector_table(fields, 2), "place") &&
+           read_le(table_field(vector_table(fields, 2), 2), 1) == 13;
+  assert_true(passed, "The Arrow schema has the wrong fields.");
+  fields = table_ref(vector_table(fields, 2), 5);
+  passed = read_le(fields, 4) == 5 &&
+           has_name(vector_table(fields, 0), "longitude") &&
+           has_name(vector_table(fields, 1), "latitude") &&
+           has_name(vector_table(fields, 2), "latlong_accuracy") &&
+           has_name(vector_table(fields, 3), "altitude") &&
+           has_name(vector_table(fields, 4), "altitude_accuracy");
+  assert_true(passed, "The geodetic point is not a struct of its coordinates.");
+
+  // the record batch: nodes & buffers are listed depth first, so the point is
+  // followed by its children
+  position = read_message(sink.data, position, &message, &body);
+  batch = table_ref(message, 2);
+  const char *nodes = table_ref(batch, 1);
+  long long null_counts[] = {0, 1, 1, 1, 1, 1, 2, 2};
+  passed = read_le(table_field(message, 1), 1) == 3 &&
+           read_le(table_field(batch, 0), 8) == 2 && read_le(nodes, 4) == 8;
+  for (int i = 0; passed && i < 8; i++)
+    passed = read_le(nodes + 4 + 16 * i, 8) == 2 &&
+             read_le(nodes + 4 + 16 * i + 8, 8) == null_counts[i];
+  assert_true(passed, "The Arrow record batch has the wrong nodes.");
+  // buffers: id validity & values, weight validity & values, place validity,
+  // longitude validity & values, ...
+  value.u = read_le(batch_buffer(batch, body, 3), 8);
+  passed = *batch_buffer(batch, body, 0) == 0x03 &&
+           read_le(batch_buffer(batch, body, 1) + 8, 8) == 2 &&
+           *batch_buffer(batch, body, 2) == 0x01 && value.f == 2.5 &&
+           *batch_buffer(batch, body, 4) == 0x01 &&
+           *batch_buffer(batch, body, 5) == 0x01 &&
+           *batch_buffer(batch, body, 11) == 0x00;
+  value.u = read_le(batch_buffer(batch, body, 6), 8);
+  passed = passed && value.f == 10;
+  assert_true(passed, "The Arrow record batch has the wrong values.");
+
+  passed = position + 8 == sink.length &&
+           memcmp(sink.data + position, "\xff\xff\xff\xff\0\0\0\0", 8) == 0;
+  assert_true(passed, "The Arrow stream does not end after the batch.");
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "assert_test.h"
+#include "server/batch.h"
+#include "utils/clock.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SLOW_REQUEST_US 500000
+#define COUNTED_REQUEST_US 20000
+
+/**
+ * Answers with the request it received as a chunked body, split in two.
+ */
+static void *echo_request(void *arg) {
+  int client_fd = *(int *)arg;
+  char request[1024];
+  char response[2048];
+  ssize_t length = recv(client_fd, request, sizeof(request), 0);
+  int half = length / 2;
+
+  int n = snprintf(response, sizeof(response),
+                   "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "%x\r\n%.*s\r\n%x\r\n%.*s\r\n0\r\n\r\n",
+                   half, half, request, (int)length - half,
+                   (int)length - half, request + half);
+  send(client_fd, response, n, MSG_NOSIGNAL);
+  close(client_fd);
+  return NULL;
+}
+
+static atomic_int running_requests = 0;
+static atomic_int max_running_requests = 0;
+
+/**
+ * Answers like echo_request after a while, keeping track of how many requests
+ * run at once.
+ */
+static void *counted_request(void *arg) {
+  int running = atomic_fetch_add(&running_requests, 1) + 1;
+  int max_running = atomic_load(&max_running_requests);
+  while (running > max_running &&
+         !atomic_compare_exchange_weak(&max_running_requests, &max_running,
+                                       running))
+    ;
+  usleep(COUNTED_REQUEST_US);
+  atomic_fetch_sub(&running_requests, 1);
+  return echo_request(arg);
+}
+
+/**
+ * Answers like echo_request, but only after the batch tests gave up on it.
+ */
+static void *slow_request(void *arg) {
+  usleep(SLOW_REQUEST_US);
+  return echo_request(arg);
+}
+
+void test_batch() {
+  char *response = NULL;
+  size_t response_len = 0;
+  const char *headers = "POST /batch HTTP/1.1\r\nCookie: a=1\r\n"
+                        "Content-Length: 64";
+  int passed;
+
+  setenv("MAIN_URL", "http://localhost", 0);
+  respond_batch("[\"/db/t/data?ORDER_BY=DESC\",{\"path\":\"/db/t/count\","
+                "\"querystring\":\"MODE=ESTIMATE\"}]",
+                headers, echo_request, -1, 0, &response, &response_len);
+  // the requests are answered in order & their bodies are reassembled
+  passed = response &&
+           strstr(response, "Content-Type: multipart/mixed; boundary=") &&
+           strstr(response, "Content-ID: 0\r\n\r\nHTTP/1.1 200 OK\r\n"
+                            "Content-Length: 54\r\n\r\nGET "
+                            "/db/t/data?ORDER_BY=DESC HTTP/1.1\r\nCookie: "
+                            "a=1\r\n\r\n\r\n--") &&
+           strstr(response, "Content-ID: 1\r\n\r\nHTTP/1.1 200 OK\r\n"
+                            "Content-Length: 55\r\n\r\nGET "
+                            "/db/t/count?MODE=ESTIMATE HTTP/1.1\r\n");
+  assert_true(passed, "The batch was not answered as multipart.");
+  free(response);
+  response = NULL;
+
+  respond_batch("[\"/batch\"]", headers, echo_request, -1, 0, &response,
+                &response_len);
+  passed = response && strncmp(response, "HTTP/1.1 400", 12) == 0;
+  assert_true(passed, "A nested batch was accepted.");
+  free(response);
+  response = NULL;
+
+  respond_batch("[\"/db/t/data?a=b c\"]", headers, echo_request, -1, 0,
+                &response, &response_len);
+  passed = response && strncmp(response, "HTTP/1.1 400", 12) == 0;
+  assert_true(passed, "A path that breaks the request line was accepted.");
+  free(response);
+  response = NULL;
+
+  // the requests beyond MAX_RUNNING_BATCH_REQUESTS wait for their turn
+  respond_batch("[\"/1\",\"/2\",\"/3\",\"/4\",\"/5\",\"/6\",\"/7\",\"/8\","
+                "\"/9\",\"/10\",\"/11\",\"/12\",\"/13\",\"/14\",\"/15\","
+                "\"/16\"]",
+                headers, counted_request, -1, 0, &response, &response_len);
+  passed = response && strstr(response, "Content-ID: 15\r\n\r\nHTTP/1.1 200") &&
+           !strstr(response, "HTTP/1.1 50") &&
+           max_running_requests == MAX_RUNNING_BATCH_REQUESTS;
+  assert_true(passed, "The batch ran too many requests at once.");
+  free(response);
+  response = NULL;
+
+  // a request still running at the deadline gets a 504 part
+  long long started_ms = monotonic_ms();
+  respond_batch("[\"/db/t/data\"]", headers, slow_request, -1,
+                started_ms + 50, &response, &response_len);
+  passed = response &&
+           strstr(response, "Content-ID: 0\r\n\r\nHTTP/1.1 504") &&
+           monotonic_ms() - started_ms < SLOW_REQUEST_US / 1000;
+  assert_true(passed, "The batch did not give up on a late request.");
+  free(response);
+  response = NULL;
+
+  // the batch is given up on once its client hangs up
+  int client_fds[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, client_fds);
+  close(client_fds[1]);
+  started_ms = monotonic_ms();
+  respond_batch("[\"/db/t/data\"]", headers, slow_request, client_fds[0], 0,
+                &response, &response_len);
+  passed = !response && monotonic_ms() - started_ms < SLOW_REQUEST_US / 1000;
+  assert_true(passed, "The batch kept running after its client hung up.");
+  close(client_fds[0]);
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "assert_test.h"
+#include "server/cache.h"
+#include "server/metrics.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @returns 1 if the key is cached with the expected response.
+ */
+static int is_cached(const char *key, const char *expected) {
+  char *response = NULL;
+  size_t response_len = 0;
+  int passed = cache_get(key, &response, &response_len) &&
+               response_len == strlen(expected) &&
+               memcmp(response, expected, response_len) == 0;
+  free(response);
+  return passed;
+}
+
+void test_cache() {
+  char key[32];
+  // one byte more than the largest response (a quarter of a shard)
+  char large_response[16 * 1024 + 1];
+  char *response = NULL;
+  size_t response_len;
+  int passed;
+
+  // 64 KiB per shard
+  setenv("SQL_RECEPTIONIST_CACHE_MB", "1", 1);
+  assert_true(cache_enabled(), "The cache is not enabled.");
+
+  cache_put("a", "db", "animals", cache_generation("db", "animals"), "first",
+            5);
+  assert_true(is_cached("a", "first"), "The cache missed a cached response.");
+  assert_false(is_cached("b", "first"), "The cache hit an unknown key.");
+  cache_put("a", "db", "animals", cache_generation("db", "animals"), "second",
+            6);
+  assert_true(is_cached("a", "second"), "The cache did not replace a key.");
+
+  cache_invalidate("db", "plants");
+  assert_true(is_cached("a", "second"),
+              "Invalidating a table dropped another table's response.");
+  cache_invalidate("db", "animals");
+  assert_false(is_cached("a", "second"),
+               "Invalidating a table did not drop its response.");
+
+  // a write that commits while the query runs makes its response stale
+  unsigned long long generation = cache_generation("db", "animals");
+  cache_invalidate("db", "animals");
+  cache_put("a", "db", "animals", generation, "stale", 5);
+  assert_false(is_cached("a", "stale"), "The cache stored a stale response.");
+
+  cache_put("a", "db", "animals", cache_generation("db", "animals"), "third",
+            5);
+  cache_invalidate("db", NULL);
+  assert_false(is_cached("a", "third"),
+               "Invalidating a database did not drop its responses.");
+
+  // 512 responses of 8 KiB are four times the 1 MiB budget
+  memset(large_response, 'x', sizeof(large_response));
+  long long evictions = metric_value(
+      get_metric("sql_receptionist_cache_evictions_total"));
+  for (int i = 0; i < 512; i++) {
+    snprintf(key, sizeof(key), "large %d", i);
+    cache_put(key, "db", "animals", cache_generation("db", "animals"),
+              large_response, 8192);
+  }
+  passed = metric_value(get_metric(
+               "sql_receptionist_cache_evictions_total")) > evictions &&
+           metric_value(get_metric("sql_receptionist_cache_bytes")) <=
+               1024 * 1024;
+  assert_true(passed, "The cache did not evict to stay within its budget.");
+  passed = cache_get(key, &response, &response_len);
+  assert_true(passed, "The cache evicted the most recently used response.");
+  free(response);
+
+  cache_put("huge", "db", "animals", cache_generation("db", "animals"),
+            large_response, sizeof(large_response));
+  assert_false(is_cached("huge", ""), "The cache stored a response too large.");
+}
\ No newline at end of file
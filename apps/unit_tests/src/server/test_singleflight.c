@@ -0,0 +1,77 @@
+#include "assert_test.h"
+#include "server/singleflight.h"
+#include "utils/clock.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+struct follower {
+  struct flight *flight;
+  const char *response;
+  size_t response_len;
+  int shared;
+};
+
+static void *follow(void *arg) {
+  struct follower *follower = arg;
+  follower->shared =
+      flight_wait(follower->flight, monotonic_ms() + 5000,
+                  &follower->response, &follower->response_len);
+  return NULL;
+}
+
+void test_singleflight() {
+  struct follower followers[2] = {0};
+  pthread_t threads[2];
+  int leader;
+  int passed;
+
+  struct flight *flight = flight_join("a", 0, &leader);
+  passed = flight && leader;
+  assert_true(passed, "The first request did not lead its flight.");
+  for (int i = 0; i < 2; i++) {
+    followers[i].flight = flight_join("a", 0, &leader);
+    passed = followers[i].flight == flight && !leader;
+    assert_true(passed, "An identical request did not join the flight.");
+    pthread_create(&threads[i], NULL, follow, &followers[i]);
+  }
+
+  struct flight *other = flight_join("b", 0, &leader);
+  passed = other != flight && leader;
+  assert_true(passed, "A different request joined the flight.");
+  flight_land(other, NULL, 0);
+  other = flight_join("a", 1, &leader);
+  passed = other != flight && leader;
+  assert_true(passed, "A request of a newer generation joined a stale flight.");
+  flight_land(other, NULL, 0);
+
+  char *response = strdup("response");
+  flight_land(flight, response, strlen(response));
+  for (int i = 0; i < 2; i++) {
+    pthread_join(threads[i], NULL);
+    passed = followers[i].shared && followers[i].response == response &&
+             followers[i].response_len == strlen("response");
+    assert_true(passed, "A follower did not share the leader's response.");
+  }
+
+  // landed flights take no more followers
+  flight = flight_join("a", 0, &leader);
+  assert_true(leader, "A request joined a landed flight.");
+  for (int i = 0; i < 2; i++)
+    flight_leave(followers[i].flight);
+
+  followers[0].flight = flight_join("a", 0, &leader);
+  flight_land(flight, NULL, 0);
+  passed = !flight_wait(followers[0].flight, monotonic_ms() + 5000,
+                        &followers[0].response, &followers[0].response_len);
+  assert_true(passed, "A follower shared the response of a failed query.");
+  flight_leave(followers[0].flight);
+
+  flight = flight_join("c", 0, &leader);
+  followers[0].flight = flight_join("c", 0, &leader);
+  passed = !flight_wait(followers[0].flight, monotonic_ms() + 10,
+                        &followers[0].response, &followers[0].response_len);
+  assert_true(passed, "A follower waited past its deadline.");
+  flight_leave(followers[0].flight);
+  flight_land(flight, NULL, 0);
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "assert_test.h"
+#include "server/stream.h"
+#include "utils/clock.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define LARGE_ROW_SIZE (STREAM_CHUNK_SIZE + 1000)
+
+struct test_client {
+  int fd;
+  char *data;
+  size_t length;
+};
+
+/**
+ * Reads everything the stream sent, until it is closed.
+ * @param arg The test_client.
+ */
+static void *read_response(void *arg) {
+  struct test_client *client = arg;
+  size_t capacity = 0;
+  ssize_t n;
+
+  do {
+    if (client->length == capacity) {
+      capacity = capacity ? capacity * 2 : 65536;
+      char *data = realloc(client->data, capacity);
+      if (!data)
+        break;
+      client->data = data;
+    }
+    n = recv(client->fd, client->data + client->length,
+             capacity - client->length, 0);
+    if (n > 0)
+      client->length += n;
+  } while (n > 0);
+  return NULL;
+}
+
+/**
+ * Decodes the chunked body of a response.
+ * @param body Set to the body, which must be freed.
+ * @param max_chunk_size Set to the size of the largest chunk.
+ * @returns The length of the body, or -1 if the response is malformed or does
+ * not end right after its last chunk.
+ */
+static long long decode_chunked(const char *response, size_t length,
+                                char **body, size_t *max_chunk_size) {
+  const char *end = response + length;
+  const char *position = strstr(response, "\r\n\r\n");
+  long long body_length = 0;
+  char *chunk_end;
+
+  *body = malloc(length);
+  *max_chunk_size = 0;
+  if (!*body || !position)
+    return -1;
+
+  for (position += 4; position < end;) {
+    size_t size = strtoul(position, &chunk_end, 16);
+    if (chunk_end == position || chunk_end + 2 + size + 2 > end ||
+        memcmp(chunk_end, "\r\n", 2) != 0 ||
+        memcmp(chunk_end + 2 + size, "\r\n", 2) != 0)
+      return -1;
+    // the last chunk is empty
+    if (!size)
+      return chunk_end + 4 == end ? body_length : -1;
+    memcpy(*body + body_length, chunk_end + 2, size);
+    body_length += size;
+    if (size > *max_chunk_size)
+      *max_chunk_size = size;
+    position = chunk_end + 2 + size + 2;
+  }
+  return -1;
+}
+
+void test_stream() {
+  struct response_stream *stream = malloc(sizeof(struct response_stream));
+  struct test_client client = {-1, NULL, 0};
+  pthread_t reader;
+  int fds[2];
+  char *row = malloc(LARGE_ROW_SIZE);
+  char *body = NULL;
+  size_t max_chunk_size;
+  const char *copy;
+  size_t copy_length;
+  long long body_length;
+  int passed;
+
+  if (!stream || !row || socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+    puts("The stream test could not be set up.");
+    goto end;
+  }
+
+  // a row larger than a chunk is sent over several chunks, & flushing an empty
+  // buffer does not send the empty chunk that would end the body
+  memset(row, 'x', LARGE_ROW_SIZE);
+  client.fd = fds[1];
+  pthread_create(&reader, NULL, read_response, &client);
+  stream_init(stream, fds[0], 0);
+  passed = stream_start(stream, 200, "text/plain", "") &&
+           stream_write(stream, "[", 1) && stream_flush(stream) &&
+           stream_flush(stream) &&
+           stream_write(stream, row, LARGE_ROW_SIZE) &&
+           stream_write(stream, "]", 1) && stream_finish(stream);
+  close(fds[0]);
+  pthread_join(reader, NULL);
+  close(fds[1]);
+  assert_true(passed, "The stream failed to send a large row.");
+  body_length =
+      decode_chunked(client.data, client.length, &body, &max_chunk_size);
+  passed = strncmp(client.data, "HTTP/1.1 200 OK\r\n", 17) == 0 &&
+           strstr(client.data, "Transfer-Encoding: chunked\r\n") &&
+           body_length == LARGE_ROW_SIZE + 2 && body[0] == '[' &&
+           memcmp(body + 1, row, LARGE_ROW_SIZE) == 0 &&
+           body[LARGE_ROW_SIZE + 1] == ']' &&
+           max_chunk_size <= STREAM_CHUNK_SIZE;
+  assert_true(passed, "The chunks of a large row did not add up to the row.");
+  free(body);
+  free(client.data);
+  client = (struct test_client){-1, NULL, 0};
+
+  // a held body is copied but only sent on release
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+    goto end;
+  stream_init(stream, fds[0], 0);
+  stream_capture(stream, 1024);
+  stream_start(stream, 200, "text/plain", "");
+  stream_hold(stream);
+  stream_write(stream, "held", 4);
+  stream_flush(stream);
+  copy = stream_body(stream, &copy_length);
+  char headers[1024];
+  ssize_t headers_length = recv(fds[1], headers, sizeof(headers) - 1, 0);
+  headers[headers_length > 0 ? headers_length : 0] = '\0';
+  passed = copy && copy_length == 4 && memcmp(copy, "held", 4) == 0 &&
+           strstr(headers, "\r\n\r\n") &&
+           strstr(headers, "\r\n\r\n")[4] == '\0';
+  assert_true(passed, "A held body was sent before its release.");
+  client.fd = fds[1];
+  pthread_create(&reader, NULL, read_response, &client);
+  passed = stream_release(stream) && stream_finish(stream);
+  close(fds[0]);
+  pthread_join(reader, NULL);
+  passed = passed && client.length == 14 &&
+           memcmp(client.data, "4\r\nheld\r\n0\r\n\r\n", 14) == 0;
+  assert_true(passed, "A released body was not sent as one chunk.");
+  free(client.data);
+  free(stream->capture);
+
+  // failures are remembered with their reason
+  stream_init(stream, fds[1], monotonic_ms() - 1);
+  passed = !stream_start(stream, 200, "text/plain", "") &&
+           stream->failed == ETIMEDOUT &&
+           !stream_write(stream, "late", 4);
+  assert_true(passed, "A stream past its deadline did not time out.");
+  close(fds[1]);
+
+end:
+  free(stream);
+  free(row);
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "assert_test.h"
+#include "backend.h"
+#include "server/tag_dictionary.h"
+#include <jansson.h>
+#include <stdio.h>
+#include <string.h>
+
+// type OIDs (pg_type.dat)
+#define INT4OID 23
+
+static struct data_column tag_names_schema[] = {
+    {"tag_name", "string", false, ""},
+};
+static struct data_column tag_aliases_schema[] = {
+    {"alias", "string", false, ""},
+    {"tag_id", "int", false, ""},
+};
+
+/**
+ * Upserts a JSON entry into a tag table of the fruit table.
+ */
+static void upsert_tag(struct insert_options *options, const char *json) {
+  void *conn = memory_backend.connect("tags_db", NULL, 1);
+  struct upsert_result result;
+  json_t *entry = json_loads(json, 0, NULL);
+  memory_backend.upsert(conn, options, entry, &result);
+  json_decref(entry);
+  memory_backend.disconnect(conn);
+}
+
+/**
+ * @returns 1 if the tag ID is known under the expected name.
+ */
+static int has_name(struct tag_names *names, long long id,
+                    const char *expected) {
+  int length;
+  const char *name = find_tag_name(names, id, &length);
+  return name && length == strlen(expected) &&
+         memcmp(name, expected, length) == 0;
+}
+
+/**
+ * @returns The serialization of a row holding a single primary tag ID.
+ */
+static void serialize_tag_id(struct tag_names *names, char *id, char *buffer) {
+  PGresAttDesc attribute = {"primary_tag", 0, 0, 0, INT4OID, -1, -1};
+  PGresult *res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+  PQsetResultAttrs(res, 1, &attribute);
+  PQsetvalue(res, 0, 0, id, strlen(id));
+
+  struct select_plan *plan = create_select_plan(res, 0);
+  substitute_tag_names(plan, res, names);
+  int n = serialize_select_row(res, plan, 0, buffer, 63);
+  buffer[n < 0 ? 0 : n] = '\0';
+  free_select_plan(plan);
+  PQclear(res);
+}
+
+void test_tag_dictionary() {
+  struct insert_options tag_names_options = {
+      "fruit_tag_names", tag_names_schema, 1, 0, "id", 0, "tag_name"};
+  struct insert_options tag_aliases_options = {
+      "fruit_tag_aliases", tag_aliases_schema, 2, 0, "alias", 1, "alias"};
+  char buffer[64];
+  long long id;
+  int passed;
+
+  setenv("SQL_RECEPTIONIST_BACKEND", "memory", 1);
+  upsert_tag(&tag_names_options, "{\"tag_name\": \"red\"}");
+  upsert_tag(&tag_names_options, "{\"tag_name\": \"blue\"}");
+  upsert_tag(&tag_aliases_options, "{\"alias\": \"crimson\", \"tag_id\": 1}");
+
+  struct tag_names *names = acquire_tag_names("tags_db", "fruit");
+  assert_true(names != NULL, "The tag dictionary failed to load.");
+  passed = has_name(names, 1, "red") && has_name(names, 2, "blue");
+  assert_true(passed, "The tag dictionary did not map IDs to names.");
+  passed = find_tag_id(names, "blue", &id) && id == 2;
+  assert_true(passed, "The tag dictionary did not map names to IDs.");
+  passed = find_tag_alias(names, "crimson", &id) && id == 1;
+  assert_true(passed, "The tag dictionary did not map aliases to IDs.");
+  assert_false(find_tag_id(names, "green", &id),
+               "The tag dictionary knows an unknown name.");
+
+  serialize_tag_id(names, "2", buffer);
+  assert_true(strcmp(buffer, "[\"blue\"]") == 0,
+              "The tag name was not substituted for its ID.");
+  release_tag_names(names);
+
+  // snapshots are reused until the tags are written to
+  upsert_tag(&tag_names_options, "{\"tag_name\": \"green\"}");
+  names = acquire_tag_names("tags_db", "fruit");
+  assert_false(find_tag_id(names, "green", &id),
+               "The tag dictionary reloaded without an invalidation.");
+  release_tag_names(names);
+  tag_dictionary_invalidate("tags_db", "fruit");
+  names = acquire_tag_names("tags_db", "fruit");
+  passed = find_tag_id(names, "green", &id) && id == 3;
+  assert_true(passed, "The tag dictionary did not reload when invalidated.");
+
+  // unknown IDs are written as null & outdate the snapshot
+  serialize_tag_id(names, "9", buffer);
+  assert_true(strcmp(buffer, "[null]") == 0,
+              "An unknown tag ID was not written as null.");
+  assert_false(find_tag_id(names, "green", &id),
+               "A snapshot that missed an ID is still up to date.");
+  release_tag_names(names);
+  unsetenv("SQL_RECEPTIONIST_BACKEND");
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "assert_test.h"
+#include "utils/format_number.h"
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @returns 1 if formatting the integer yields the expected string.
+ */
+static int int_matches(long long value, const char *expected) {
+  char buffer[MAX_NUMBER_STR_LENGTH];
+  int n = format_int(buffer, value);
+  return n == strlen(expected) && memcmp(buffer, expected, n) == 0;
+}
+
+/**
+ * @returns 1 if formatting the double yields the expected string.
+ */
+static int double_matches(double value, const char *expected) {
+  char buffer[MAX_NUMBER_STR_LENGTH];
+  int n = format_double(buffer, value);
+  return n == strlen(expected) && memcmp(buffer, expected, n) == 0;
+}
+
+/**
+ * @returns 1 if formatting the float yields the expected string.
+ */
+static int float_matches(float value, const char *expected) {
+  char buffer[MAX_NUMBER_STR_LENGTH];
+  int n = format_float(buffer, value);
+  return n == strlen(expected) && memcmp(buffer, expected, n) == 0;
+}
+
+void test_format_number() {
+  assert_true(int_matches(0, "0"), "format_int failed on 0.");
+  assert_true(int_matches(7, "7"), "format_int failed on 7.");
+  assert_true(int_matches(-42, "-42"), "format_int failed on -42.");
+  assert_true(int_matches(1234567, "1234567"), "format_int failed on 1234567.");
+  assert_true(int_matches(LLONG_MIN, "-9223372036854775808"),
+              "format_int failed on LLONG_MIN.");
+
+  assert_true(double_matches(0.1, "0.1"), "format_double failed on 0.1.");
+  assert_true(double_matches(0.1 + 0.2, "0.30000000000000004"),
+              "format_double did not round-trip 0.1 + 0.2.");
+  assert_true(double_matches(-3.0, "-3"), "format_double failed on -3.");
+  assert_true(double_matches(1e20, "1e+20"), "format_double failed on 1e20.");
+
+  assert_true(float_matches(0.1f, "0.1"), "format_float failed on 0.1.");
+  assert_true(float_matches(3.14159274f, "3.1415927"),
+              "format_float did not round-trip pi.");
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "assert_test.h"
+#include "utils/json/json_string.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @returns 1 if escaping the string yields the expected JSON string.
+ */
+static int escapes_to(const char *value, const char *expected) {
+  char buffer[256];
+  int n = write_json_string(value, strlen(value), buffer, sizeof(buffer));
+  return n == strlen(expected) && memcmp(buffer, expected, n) == 0;
+}
+
+/**
+ * @returns 1 if a long string with an escape at every position up to its
+ * length is escaped correctly, which crosses the vectorized chunk boundaries.
+ */
+static int escapes_long_strings() {
+  char value[80];
+  char expected[96];
+
+  for (int position = 0; position < sizeof(value) - 1; position++) {
+    memset(value, 'a', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    value[position] = '\n';
+
+    memset(expected, 'a', sizeof(value) + 2);
+    expected[0] = '"';
+    memcpy(expected + 1 + position, "\\n", 2);
+    expected[sizeof(value) + 1] = '"';
+    expected[sizeof(value) + 2] = '\0';
+
+    if (!escapes_to(value, expected))
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * Asserts a check of one of the escapers, naming the escaper on failure.
+ * @param passed Whether the check passed.
+ * @param escaper_name The name of the escaper under test.
+ * @param failure The message to print if the check failed.
+ */
+static void assert_escaper(int passed, const char *escaper_name,
+                           const char *failure) {
+  char message[128];
+  snprintf(message, sizeof(message), "%s (%s JSON escaper)", failure,
+           escaper_name);
+  assert_true(passed, message);
+}
+
+void test_json_string() {
+  const enum json_escaper escapers[] = {
+      JSON_ESCAPER_SCALAR, JSON_ESCAPER_SSE2, JSON_ESCAPER_AVX2};
+  const char *escaper_names[] = {"scalar", "SSE2", "AVX2"};
+  char buffer[8];
+
+  for (int i = 0; i < sizeof(escapers) / sizeof(escapers[0]); i++) {
+    const char *name = escaper_names[i];
+    // skip escapers the CPU does not support
+    if (!use_json_escaper(escapers[i]))
+      continue;
+
+    assert_escaper(escapes_to("", "\"\""), name,
+                   "write_json_string failed on \"\".");
+    assert_escaper(escapes_to("plain text", "\"plain text\""), name,
+                   "write_json_string changed plain text.");
+    assert_escaper(escapes_to("say \"hi\"\\", "\"say \\\"hi\\\"\\\\\""), name,
+                   "write_json_string did not escape quotes & backslashes.");
+    assert_escaper(escapes_to("a\tb\nc\x01", "\"a\\tb\\nc\\u0001\""), name,
+                   "write_json_string did not escape control characters.");
+    assert_escaper(escapes_to("caf\xc3\xa9", "\"caf\xc3\xa9\""), name,
+                   "write_json_string changed UTF-8.");
+    assert_escaper(escapes_long_strings(), name,
+                   "write_json_string failed on a long string.");
+
+    assert_escaper(
+        write_json_string("1234567", 7, buffer, sizeof(buffer)) == -1, name,
+        "write_json_string overflowed the buffer.");
+    assert_escaper(
+        write_json_string("123456", 6, buffer, sizeof(buffer)) == 8, name,
+        "write_json_string did not fill the buffer.");
+  }
+
+  use_json_escaper(JSON_ESCAPER_AUTO);
+}
\ No newline at end of file
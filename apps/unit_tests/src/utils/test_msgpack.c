@@ -0,0 +1,52 @@
+#include "assert_test.h"
+#include "utils/msgpack.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @returns 1 if the written bytes match the expected encoding.
+ */
+static int encodes_to(const char *buffer, int n, const char *expected,
+                      int expected_length) {
+  return n == expected_length && memcmp(buffer, expected, n) == 0;
+}
+
+void test_msgpack() {
+  char buffer[32];
+  int n;
+
+  n = msgpack_write_int(7, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n, "\x07", 1),
+              "msgpack_write_int failed on a positive fixint.");
+  n = msgpack_write_int(-3, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n, "\xfd", 1),
+              "msgpack_write_int failed on a negative fixint.");
+  n = msgpack_write_int(300, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n, "\xcd\x01\x2c", 3),
+              "msgpack_write_int failed on a uint 16.");
+  n = msgpack_write_int(-200, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n, "\xd1\xff\x38", 3),
+              "msgpack_write_int failed on an int 16.");
+
+  n = msgpack_write_str("hi", 2, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n, "\xa2hi", 3),
+              "msgpack_write_str failed on a fixstr.");
+  n = msgpack_write_double(1.5, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n, "\xcb\x3f\xf8\0\0\0\0\0\0", 9),
+              "msgpack_write_double failed on 1.5.");
+
+  n = msgpack_write_timestamp(1, 0, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n, "\xd6\xff\0\0\0\x01", 6),
+              "msgpack_write_timestamp failed on a timestamp 32.");
+  n = msgpack_write_timestamp(1, 1, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n, "\xd7\xff\0\0\0\x04\0\0\0\x01", 10),
+              "msgpack_write_timestamp failed on a timestamp 64.");
+  n = msgpack_write_timestamp(-1, 0, buffer, sizeof(buffer));
+  assert_true(encodes_to(buffer, n,
+                         "\xc7\x0c\xff\0\0\0\0\xff\xff\xff\xff\xff\xff\xff\xff",
+                         15),
+              "msgpack_write_timestamp failed on a timestamp 96.");
+
+  assert_true(msgpack_write_str("hello", 5, buffer, 5) == -1,
+              "msgpack_write_str overflowed the buffer.");
+}
\ No newline at end of file